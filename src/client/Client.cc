@@ -47,6 +47,7 @@ using namespace std;
 #include "messages/MClientRequestForward.h"
 #include "messages/MClientReply.h"
 #include "messages/MClientCaps.h"
+#include "messages/MClientCapsBatch.h"
 #include "messages/MClientLease.h"
 #include "messages/MClientSnap.h"
 #include "messages/MCommandReply.h"
@@ -148,7 +149,7 @@ bool Client::CommandHook::call(std::string command, cmdmap_t& cmdmap,
 dir_result_t::dir_result_t(Inode *in)
   : inode(in), offset(0), this_offset(2), next_offset(2),
     release_count(0), ordered_count(0), start_shared_gen(0),
-    buffer(0) {
+    buffer(0), cache_prefetch(false) {
   inode->get();
 }
 
@@ -419,6 +420,10 @@ int Client::init()
   plb.add_time_avg(l_c_reply, "reply", "Latency of receiving a reply on metadata request");
   plb.add_time_avg(l_c_lat, "lat", "Latency of processing a metadata request");
   plb.add_time_avg(l_c_wrlat, "wrlat", "Latency of a file data write operation");
+  plb.add_u64_counter(l_c_async_dirop, "async_dirop", "Creates and unlinks sent without waiting for the reply");
+  plb.add_u64_counter(l_c_readahead, "readahead", "Readahead requests sent");
+  plb.add_u64_counter(l_c_read_stall, "read_stall", "Sequential reads that waited on the osds");
+  plb.add_u64_counter(l_c_write_behind, "write_behind", "Flushes of full stripe units behind sequential writers");
   logger = plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 
@@ -833,7 +838,8 @@ Inode * Client::add_update_inode(InodeStat *st, utime_t from,
   }
 
   if (in->snapid == CEPH_NOSNAP) {
-    add_update_cap(in, session, st->cap.cap_id, st->cap.caps, st->cap.seq, st->cap.mseq, inodeno_t(st->cap.realm), st->cap.flags);
+    add_update_cap(in, session, st->cap.cap_id, st->cap.caps, st->cap.seq, st->cap.mseq, inodeno_t(st->cap.realm), st->cap.flags, from,
+		   st->mtime, st->ctime);
     if (in->auth_cap && in->auth_cap->session == session)
       in->max_size = st->max_size;
   } else
@@ -1029,6 +1035,11 @@ void Client::insert_readdir_results(MetaRequest *request, MetaSession *session,
     request->readdir_end = end;
     request->readdir_num = numdn;
 
+    // a complete cache we hold Fs on is already in listing order; a chunk
+    // read for its attrs must leave the dentries where they are
+    bool ordered = diri->is_complete_and_ordered() &&
+		   diri->caps_issued_mask(CEPH_CAP_FILE_SHARED);
+
     string dname;
     LeaseStat dlease;
     for (unsigned i=0; i<numdn; i++) {
@@ -1040,8 +1051,18 @@ void Client::insert_readdir_results(MetaRequest *request, MetaSession *session,
 
       Inode *in = add_update_inode(&ist, request->sent_stamp, session);
       Dentry *dn;
-      if (diri->dir->dentries.count(dname)) {
-	Dentry *olddn = diri->dir->dentries[dname];
+      Dentry *olddn = NULL;
+      if (diri->dir->dentries.count(dname))
+	olddn = diri->dir->dentries[dname];
+      if (ordered && (!olddn || olddn->inode != in)) {
+	// then the cache wasn't complete after all
+	ldout(cct, 10) << " clearing (I_COMPLETE|I_DIR_ORDERED) on " << *diri << dendl;
+	diri->flags &= ~(I_COMPLETE | I_DIR_ORDERED);
+	dir->release_count++;
+	dir->ordered_count++;
+	ordered = false;
+      }
+      if (olddn) {
 	if (olddn->inode != in) {
 	  // replace incorrect dentry
 	  unlink(olddn, true, true);  // keep dir, dentry
@@ -1051,7 +1072,8 @@ void Client::insert_readdir_results(MetaRequest *request, MetaSession *session,
 	  // keep existing dn
 	  dn = olddn;
 	  touch_dn(dn);
-	  dn->item_dentry_list.move_to_back();
+	  if (!ordered)
+	    dn->item_dentry_list.move_to_back();
 	}
       } else {
 	// new dn
@@ -1461,6 +1483,13 @@ int Client::make_request(MetaRequest *request,
 {
   int r = 0;
 
+  // nothing about a file we created asynchronously may reach the mds
+  // before the create itself
+  if (request->inode())
+    wait_async_create(request->inode());
+  if (request->other_inode())
+    wait_async_create(request->other_inode());
+
   // assign a unique tid
   ceph_tid_t tid = ++last_tid;
   request->set_tid(tid);
@@ -1594,6 +1623,138 @@ int Client::make_request(MetaRequest *request,
   return r;
 }
 
+/*
+ * Send a request without waiting for its reply.  This is for creates and
+ * unlinks in a dir we hold Fx on: the mds applies the session's requests
+ * in order, before it can take Fx back, so the caller can go on as if the
+ * request had succeeded.  finish_async_request deals with the reply.
+ */
+void Client::make_async_request(MetaRequest *request, MetaSession *session,
+				int uid, int gid)
+{
+  ceph_tid_t tid = ++last_tid;
+  request->set_tid(tid);
+  request->async_op = true;
+
+  mds_requests[tid] = request->get();
+  if (oldest_tid == 0)
+    oldest_tid = tid;
+
+  if (uid < 0) {
+    uid = geteuid();
+    gid = getegid();
+  }
+  request->set_caller_uid(uid);
+  request->set_caller_gid(gid);
+  request->set_oldest_client_tid(oldest_tid);
+
+  send_request(request, session);
+
+  // fsync on the dir waits for these as for any unsafe dir op
+  request->inode()->unsafe_dir_ops.push_back(&request->unsafe_dir_item);
+  logger->inc(l_c_async_dirop);
+}
+
+void Client::resend_async_request(MetaRequest *request)
+{
+  mds_rank_t mds = request->resend_mds;
+  request->resend_mds = -1;
+  if (mds >= 0 && have_open_session(mds)) {
+    send_request(request, mds_sessions[mds]);
+    return;
+  }
+
+  ldout(cct, 1) << "resend_async_request tid " << request->get_tid()
+		<< " has no session to mds." << mds << ", failing it" << dendl;
+  finish_async_request(request, -ESTALE);
+  request->item.remove_myself();
+  request->unsafe_dir_item.remove_myself();
+  signal_cond_list(request->waitfor_safe);
+  unregister_request(request);
+}
+
+void Client::finish_async_request(MetaRequest *request, int r)
+{
+  Inode *dir = request->inode();
+  Dentry *dn = request->dentry();
+  ldout(cct, 10) << "finish_async_request tid " << request->get_tid() << " "
+		 << ceph_mds_op_name(request->get_op()) << " = " << r << dendl;
+
+  if (request->get_op() == CEPH_MDS_OP_CREATE) {
+    Inode *in = request->other_inode();
+    if (r == -EAGAIN && request->mds >= 0 && have_open_session(request->mds)) {
+      // the ino wasn't ours to use: whatever else it delegated is stale too
+      mds_sessions[request->mds]->delegated_inos.clear();
+    }
+    in->flags &= ~I_ASYNC_CREATE;
+    signal_cond_list(in->waitfor_caps);
+    if (r < 0) {
+      fail_async_create(in);
+    } else if (!(in->flags & I_BAD)) {
+      in->oset.poolid = in->layout.fl_pg_pool;
+      check_caps(in, false);  // whatever we held back meanwhile
+    }
+  }
+
+  if (r < 0) {
+    lderr(cct) << "async " << ceph_mds_op_name(request->get_op()) << " of "
+	       << (dn ? dn->name : string()) << " in " << *dir << " failed: "
+	       << cpp_strerror(r) << dendl;
+    // fsync on the dir reports it
+    dir->async_err = r;
+    // and what we told the caller about the dir was wrong
+    dir->flags &= ~(I_COMPLETE | I_DIR_ORDERED);
+    if (dn && dn->dir)
+      unlink(dn, true, false);
+  }
+}
+
+/*
+ * The file of an async create doesn't exist with the ino the caller has
+ * been using.  We can't give the inode another ino under its open files,
+ * so it goes bad: the caps we made up for it go, it leaves the inode map
+ * so the ino can come back as another file, and its I/O gets -EIO.
+ */
+void Client::fail_async_create(Inode *in)
+{
+  ldout(cct, 1) << "async create of " << *in << " failed, marking it bad" << dendl;
+  in->flags |= I_BAD;
+  in->async_err = -EIO;
+  while (!in->caps.empty())
+    remove_cap(in->caps.begin()->second, false);
+  ceph::unordered_map<vinodeno_t, Inode*>::iterator p = inode_map.find(in->vino());
+  if (p != inode_map.end() && p->second == in)
+    inode_map.erase(p);
+}
+
+/*
+ * The reply to an async create has to be for the ino we picked.
+ */
+void Client::check_created_ino(MetaRequest *request, MClientReply *reply)
+{
+  bufferlist& bl = reply->get_extra_bl();
+  if (bl.length() < sizeof(inodeno_t))
+    return;
+
+  bufferlist::iterator p = bl.begin();
+  inodeno_t ino;
+  ::decode(ino, p);
+
+  Inode *in = request->other_inode();
+  if (in->ino != ino && !(in->flags & I_BAD)) {
+    lderr(cct) << "async create of " << *in << " created " << ino << " instead" << dendl;
+    fail_async_create(in);
+  }
+}
+
+void Client::wait_async_create(Inode *in)
+{
+  while (in->flags & I_ASYNC_CREATE) {
+    ldout(cct, 10) << "waiting for async create of " << *in << dendl;
+    wait_on_list(in->waitfor_caps);
+  }
+}
+
 void Client::unregister_request(MetaRequest *req)
 {
   mds_requests.erase(req->tid);
@@ -1811,6 +1972,10 @@ MetaSession *Client::_open_mds_session(mds_rank_t mds)
   mds_sessions[mds] = session;
   MClientSession *m = new MClientSession(CEPH_SESSION_REQUEST_OPEN);
   m->client_meta = metadata;
+  if (cct->_conf->client_cap_lease_ttl > 0) {
+    session->cap_lease_ttl = cct->_conf->client_cap_lease_ttl;
+    m->client_meta["cap_lease_ttl"] = stringify(session->cap_lease_ttl);
+  }
   session->con->send_message(m);
   return session;
 }
@@ -2013,11 +2178,33 @@ void Client::handle_client_request_forward(MClientRequestForward *fwd)
   request->mds = -1;
   request->num_fwd = fwd->get_num_fwd();
   request->resend_mds = fwd->get_dest_mds();
-  request->caller_cond->Signal();
+  if (request->async_op)
+    resend_async_request(request);
+  else
+    request->caller_cond->Signal();
 
   fwd->put();
 }
 
+/*
+ * Replies to creates may carry preallocated inos the mds hands to us for
+ * async creates, after the created ino.
+ */
+void Client::got_delegated_inos(MetaSession *session, MClientReply *reply)
+{
+  bufferlist& bl = reply->get_extra_bl();
+  if (bl.length() <= sizeof(inodeno_t))
+    return;
+
+  bufferlist::iterator p = bl.begin();
+  inodeno_t created_ino;
+  interval_set<inodeno_t> inos;
+  ::decode(created_ino, p);
+  ::decode(inos, p);
+  ldout(cct, 10) << "got delegated inos " << inos << " from mds." << session->mds_num << dendl;
+  session->delegated_inos.union_of(inos);
+}
+
 bool Client::is_dir_operation(MetaRequest *req)
 {
   int op = req->get_op();
@@ -2079,7 +2266,10 @@ void Client::handle_client_reply(MClientReply *reply)
 	 request->sent_on_mseq == in->caps[request->resend_mds]->mseq)) {
       // have to return ESTALE
     } else {
-      request->caller_cond->Signal();
+      if (request->async_op)
+	resend_async_request(request);
+      else
+	request->caller_cond->Signal();
       reply->put();
       return;
     }
@@ -2088,6 +2278,11 @@ void Client::handle_client_reply(MClientReply *reply)
   
   assert(request->reply == NULL);
   request->reply = reply;
+  if (request->get_op() == CEPH_MDS_OP_CREATE && reply->get_result() >= 0) {
+    got_delegated_inos(session, reply);
+    if (request->async_op)
+      check_created_ino(request, reply);
+  }
   insert_trace(request, session);
 
   // Handle unsafe reply
@@ -2103,7 +2298,11 @@ void Client::handle_client_reply(MClientReply *reply)
 
   // Only signal the caller once (on the first reply):
   // Either its an unsafe reply, or its a safe reply and no unsafe reply was sent.
-  if (!is_safe || !request->got_unsafe) {
+  if ((!is_safe || !request->got_unsafe) && request->async_op) {
+    request->reply = NULL;
+    finish_async_request(request, reply->get_result());
+    reply->put();
+  } else if (!is_safe || !request->got_unsafe) {
     Cond cond;
     request->dispatch_cond = &cond;
 
@@ -2121,7 +2320,7 @@ void Client::handle_client_reply(MClientReply *reply)
   if (is_safe) {
     // the filesystem change is committed to disk
     // we're done, clean up
-    if (request->got_unsafe) {
+    if (request->got_unsafe || request->async_op) {
       request->unsafe_item.remove_myself();
       request->unsafe_dir_item.remove_myself();
       signal_cond_list(request->waitfor_safe);
@@ -2251,6 +2450,9 @@ bool Client::ms_dispatch(Message *m)
   case CEPH_MSG_CLIENT_CAPS:
     handle_caps(static_cast<MClientCaps*>(m));
     break;
+  case CEPH_MSG_CLIENT_CAPS_BATCH:
+    handle_caps_batch(static_cast<MClientCapsBatch*>(m));
+    break;
   case CEPH_MSG_CLIENT_LEASE:
     handle_lease(static_cast<MClientLease*>(m));
     break;
@@ -2394,6 +2596,8 @@ void Client::send_reconnect(MetaSession *session)
 
   // reset my cap seq number
   session->seq = 0;
+  // the mds forgot what it delegated to us
+  session->delegated_inos.clear();
   //connect to the mds' offload targets
   connect_mds_targets(mds);
   //make sure unsafe requests get saved
@@ -2500,6 +2704,11 @@ void Client::kick_requests_closed(MetaSession *session)
 	req->unsafe_dir_item.remove_myself();
 	signal_cond_list(req->waitfor_safe);
 	unregister_request(req);
+      } else if (req->async_op) {
+	finish_async_request(req, -EIO);
+	req->unsafe_dir_item.remove_myself();
+	signal_cond_list(req->waitfor_safe);
+	unregister_request(req);
       }
     }
   }
@@ -2580,7 +2789,10 @@ void Client::put_inode(Inode *in, int n)
     put_qtree(in);
     if (in->snapdir_parent)
       put_inode(in->snapdir_parent);
-    inode_map.erase(in->vino());
+    // a bad inode may have left the map to another one with its ino
+    ceph::unordered_map<vinodeno_t, Inode*>::iterator p = inode_map.find(in->vino());
+    if (p != inode_map.end() && p->second == in)
+      inode_map.erase(p);
     in->cap_item.remove_myself();
     in->snaprealm_item.remove_myself();
     if (in == root) {
@@ -2803,6 +3015,11 @@ void Client::put_cap_ref(Inode *in, int cap)
 
 int Client::get_caps(Inode *in, int need, int want, int *phave, loff_t endoff)
 {
+  // the layout of an async create is only known from the reply
+  wait_async_create(in);
+  if (in->flags & I_BAD)
+    return -EIO;
+
   int r = check_pool_perm(in, need);
   if (r < 0)
     return r;
@@ -3035,6 +3252,11 @@ void Client::check_caps(Inode *in, bool is_delayed)
   if (in->caps.empty())
     return;   // guard if at end of func
 
+  if (in->flags & I_ASYNC_CREATE) {
+    ldout(cct, 10) << "check_caps waiting for async create of " << *in << dendl;
+    return;
+  }
+
   if (!in->cap_snaps.empty())
     flush_snaps(in);
 
@@ -3421,6 +3643,38 @@ void Client::_flush_range(Inode *in, int64_t offset, uint64_t size)
   }
 }
 
+/*
+ * Start writing back the full stripe units a sequential writer has left
+ * behind, once there is a whole stripe of them, so each flush goes to
+ * every object in the layout at once instead of leaving the flusher to
+ * trickle out whatever has aged.
+ */
+void Client::_write_behind(Fh *f, int64_t offset, uint64_t size)
+{
+  assert(client_lock.is_locked());
+  Inode *in = f->inode;
+  uint64_t su = in->layout.fl_stripe_unit;
+  uint64_t stripe = su * in->layout.fl_stripe_count;
+
+  if ((uint64_t)offset != f->last_write_end)
+    f->write_behind_pos = offset;
+  f->last_write_end = offset + size;
+
+  uint64_t end = f->last_write_end / su * su;
+  if (end <= f->write_behind_pos || end - f->write_behind_pos < stripe)
+    return;
+  if (objecter->osdmap_pool_full(in->layout.fl_pg_pool))
+    return;
+
+  ldout(cct, 10) << "_write_behind " << *in << " " << f->write_behind_pos
+		 << "~" << (end - f->write_behind_pos) << dendl;
+  objectcacher->file_flush(&in->oset, &in->layout, in->snaprealm->get_snap_context(),
+			   f->write_behind_pos, end - f->write_behind_pos,
+			   new C_NoopContext);
+  f->write_behind_pos = end;
+  logger->inc(l_c_write_behind);
+}
+
 void Client::flush_set_callback(ObjectCacher::ObjectSet *oset)
 {
   //  Mutex::Locker l(client_lock);
@@ -3440,9 +3694,12 @@ void Client::_flushed(Inode *in)
 
 
 // checks common to add_update_cap, handle_cap_grant
-void Client::check_cap_issue(Inode *in, Cap *cap, unsigned issued)
+void Client::check_cap_issue(Inode *in, Cap *cap, unsigned issued,
+			     utime_t mtime, utime_t ctime)
 {
-  unsigned had = in->caps_issued();
+  // shared caps whose lease ran out count as lost: the dir may have
+  // changed since without us hearing about it
+  unsigned had = in->caps_usable();
 
   if ((issued & CEPH_CAP_FILE_CACHE) &&
       !(had & CEPH_CAP_FILE_CACHE))
@@ -3453,15 +3710,69 @@ void Client::check_cap_issue(Inode *in, Cap *cap, unsigned issued)
     in->shared_gen++;
 
     if (in->is_dir() && (in->flags & I_COMPLETE)) {
-      ldout(cct, 10) << " clearing (I_COMPLETE|I_DIR_ORDERED) on " << *in << dendl;
-      in->flags &= ~(I_COMPLETE | I_DIR_ORDERED);
+      Dir *dir = in->dir;
+      // the mds sets the dir's mtime and ctime on every link and unlink
+      // in it; check the times that came with the grant, ours may not
+      // have been updated yet
+      if (dir && dir->saved_complete &&
+	  dir->saved_mtime == mtime &&
+	  dir->saved_ctime == ctime) {
+	// nothing changed while we didn't hold Fs; carry the dentries we
+	// had under the old shared_gen over to the new one
+	ldout(cct, 10) << " keeping (I_COMPLETE|I_DIR_ORDERED) on unchanged " << *in << dendl;
+	in->flags &= ~(I_COMPLETE | I_DIR_ORDERED);
+	in->flags |= dir->saved_flags;
+	for (xlist<Dentry*>::iterator p = dir->dentry_list.begin(); !p.end(); ++p) {
+	  Dentry *dn = *p;
+	  if (dn->cap_shared_gen == in->shared_gen - 1)
+	    dn->cap_shared_gen = in->shared_gen;
+	}
+      } else {
+	ldout(cct, 10) << " clearing (I_COMPLETE|I_DIR_ORDERED) on " << *in << dendl;
+	in->flags &= ~(I_COMPLETE | I_DIR_ORDERED);
+      }
     }
+    if (in->dir)
+      in->dir->saved_complete = false;
+  }
+}
+
+/*
+ * We are losing Fs on a dir.  If its dentry cache is complete, remember
+ * the dir's mtime and ctime so that check_cap_issue can tell whether the
+ * cache is still good when Fs is issued again.
+ */
+void Client::save_dir_complete(Inode *in)
+{
+  if (!in->is_dir() || !in->dir || !(in->flags & I_COMPLETE))
+    return;
+  if (in->caps_usable() & CEPH_CAP_FILE_SHARED)
+    return;
+  Dir *dir = in->dir;
+  ldout(cct, 10) << "save_dir_complete " << *in << dendl;
+  dir->saved_complete = true;
+  dir->saved_flags = in->flags & (I_COMPLETE | I_DIR_ORDERED);
+  dir->saved_mtime = in->mtime;
+  dir->saved_ctime = in->ctime;
+}
+
+/*
+ * We just heard from the MDS about this cap: with cap leases, trust its
+ * shared caps for cap_lease_ttl from @from.  That's when we sent the
+ * request it answers, or when the MDS sent the cap batch, never when the
+ * message got here: the MDS counts from when it sent it.
+ */
+void Client::refresh_cap_lease(Cap *cap, utime_t from)
+{
+  if (cap->session->cap_lease_ttl > 0) {
+    cap->lease_until = from;
+    cap->lease_until += cap->session->cap_lease_ttl;
   }
 }
 
 void Client::add_update_cap(Inode *in, MetaSession *mds_session, uint64_t cap_id,
 			    unsigned issued, unsigned seq, unsigned mseq, inodeno_t realm,
-			    int flags)
+			    int flags, utime_t from, utime_t mtime, utime_t ctime)
 {
   Cap *cap = 0;
   mds_rank_t mds = mds_session->mds_num;
@@ -3501,7 +3812,7 @@ void Client::add_update_cap(Inode *in, MetaSession *mds_session, uint64_t cap_id
     cap_list.push_back(&in->cap_item);
   }
 
-  check_cap_issue(in, cap, issued);
+  check_cap_issue(in, cap, issued, mtime, ctime);
 
   if (flags & CEPH_CAP_FLAG_AUTH) {
     if (in->auth_cap != cap &&
@@ -3522,6 +3833,7 @@ void Client::add_update_cap(Inode *in, MetaSession *mds_session, uint64_t cap_id
   cap->seq = seq;
   cap->issue_seq = seq;
   cap->mseq = mseq;
+  refresh_cap_lease(cap, from);
   ldout(cct, 10) << "add_update_cap issued " << ccap_string(old_caps) << " -> " << ccap_string(cap->issued)
 	   << " from mds." << mds
 	   << " on " << *in
@@ -3577,6 +3889,8 @@ void Client::remove_cap(Cap *cap, bool queue_release)
     delete cap;
   }
 
+  save_dir_complete(in);
+
   if (!in->is_any_caps()) {
     ldout(cct, 15) << "remove_cap last one, closing snaprealm " << in->snaprealm << dendl;
     in->snaprealm_item.remove_myself();
@@ -4165,6 +4479,19 @@ void Client::handle_quota(MClientQuota *m)
   m->put();
 }
 
+void Client::handle_caps_batch(MClientCapsBatch *m)
+{
+  list<MClientCaps*> ls;
+  m->claim_caps(ls);
+  m->put();
+
+  ldout(cct, 10) << "handle_caps_batch " << ls.size() << " caps" << dendl;
+  while (!ls.empty()) {
+    handle_caps(ls.front());
+    ls.pop_front();
+  }
+}
+
 void Client::handle_caps(MClientCaps *m)
 {
   mds_rank_t mds = mds_rank_t(m->get_source().num());
@@ -4250,7 +4577,8 @@ void Client::handle_cap_import(MetaSession *session, Inode *in, MClientCaps *m)
   update_snap_trace(m->snapbl);
   add_update_cap(in, session, m->get_cap_id(),
 		 m->get_caps(), m->get_seq(), m->get_mseq(), m->get_realm(),
-		 CEPH_CAP_FLAG_AUTH);
+		 CEPH_CAP_FLAG_AUTH, m->get_recv_stamp(),
+		 m->get_mtime(), m->get_ctime());
 
   const mds_rank_t peer_mds = mds_rank_t(m->peer.mds);
 
@@ -4295,6 +4623,8 @@ void Client::handle_cap_export(MetaSession *session, Inode *in, MClientCaps *m)
 	  tcap->mseq = m->peer.mseq;
 	  tcap->issued |= cap->issued;
 	  tcap->implemented |= cap->issued;
+	  if (cap->lease_until < tcap->lease_until)
+	    tcap->lease_until = cap->lease_until;
 	  if (cap == in->auth_cap)
 	    in->auth_cap = tcap;
 	  if (in->auth_cap == tcap && in->flushing_cap_item.is_on_list())
@@ -4303,7 +4633,10 @@ void Client::handle_cap_export(MetaSession *session, Inode *in, MClientCaps *m)
       } else {
 	add_update_cap(in, tsession, m->peer.cap_id, cap->issued,
 		       m->peer.seq - 1, m->peer.mseq, (uint64_t)-1,
-		       cap == in->auth_cap ? CEPH_CAP_FLAG_AUTH : 0);
+		       cap == in->auth_cap ? CEPH_CAP_FLAG_AUTH : 0,
+		       utime_t(), in->mtime, in->ctime);
+	// the importer takes over the exporter's stamp along with the cap
+	in->caps[peer_mds]->lease_until = cap->lease_until;
       }
     }
 
@@ -4522,7 +4855,8 @@ void Client::handle_cap_grant(MetaSession *session, Inode *in, Cap *cap, MClient
   if (m->get_op() == CEPH_CAP_OP_IMPORT && m->get_wanted() != wanted)
     check = true;
 
-  check_cap_issue(in, cap, issued);
+  check_cap_issue(in, cap, new_caps, m->get_mtime(), m->get_ctime());
+  refresh_cap_lease(cap, m->get_recv_stamp());
 
   // update caps
   if (old_caps & ~new_caps) { 
@@ -4530,6 +4864,9 @@ void Client::handle_cap_grant(MetaSession *session, Inode *in, Cap *cap, MClient
     cap->issued = new_caps;
     cap->implemented |= new_caps;
 
+    if ((old_caps & ~new_caps) & CEPH_CAP_FILE_SHARED)
+      save_dir_complete(in);
+
     if (((used & ~new_caps) & CEPH_CAP_FILE_BUFFER)
         && !_flush(in, new C_Client_FlushComplete(this, in))) {
       // waitin' for flush
@@ -6178,6 +6515,8 @@ int Client::_readdir_get_frag(dir_result_t *dirp)
   }
   req->readdir_offset = dirp->next_offset;
   req->readdir_frag = fg;
+  if (dirp->cache_prefetch)
+    req->head.args.readdir.max_entries = cct->_conf->client_readdir_attr_prefetch;
   
   
   bufferlist dirbl;
@@ -6255,6 +6594,8 @@ int Client::_readdir_cache_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p)
   }
 
   string dn_name;
+  int prefetch = cct->_conf->client_readdir_attr_prefetch;
+  int until_check = 0;
   while (true) {
     if (!dirp->inode->is_complete_and_ordered())
       return -EAGAIN;
@@ -6271,6 +6612,14 @@ int Client::_readdir_cache_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p)
       ++pd;
       continue;
     }
+    if (prefetch > 0 && until_check-- == 0) {
+      if (_readdir_cache_wants_attrs(dirp)) {
+	// readdir_r_cb reads the next chunk from the mds and comes back
+	dirp->cache_prefetch = true;
+	return -EAGAIN;
+      }
+      until_check = prefetch - 1;
+    }
 
     struct stat st;
     struct dirent de;
@@ -6306,6 +6655,43 @@ int Client::_readdir_cache_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p)
   return 0;
 }
 
+/*
+ * Look at the cached dentries the cursor is about to return.  If many of
+ * their inodes no longer have the caps needed to stat them, a caller
+ * doing ls -l would follow up with a getattr for each of them; reading
+ * that chunk from the mds instead gets the attrs and caps for all of them
+ * in one go.  The listing goes back to the cache after the chunk.
+ */
+bool Client::_readdir_cache_wants_attrs(dir_result_t *dirp)
+{
+  int max = cct->_conf->client_readdir_attr_prefetch;
+  Dir *dir = dirp->inode->dir;
+  if (max <= 0 || !dir)
+    return false;
+
+  xlist<Dentry*>::iterator pd = dir->dentry_list.begin();
+  if (dirp->at_cache_name.length()) {
+    ceph::unordered_map<string,Dentry*>::iterator it = dir->dentries.find(dirp->at_cache_name);
+    if (it == dir->dentries.end())
+      return false;
+    pd = xlist<Dentry*>::iterator(&it->second->item_dentry_list);
+    ++pd;
+  }
+
+  int seen = 0, missing = 0;
+  for (; !pd.end() && seen < max; ++pd) {
+    Dentry *dn = *pd;
+    if (!dn->inode)
+      continue;
+    ++seen;
+    if (!dn->inode->caps_issued_mask(CEPH_STAT_CAP_INODE_ALL))
+      ++missing;
+  }
+  ldout(cct, 15) << "_readdir_cache_wants_attrs " << missing << "/" << seen
+		 << " entries lack attr caps" << dendl;
+  return seen && missing * 2 >= seen;
+}
+
 int Client::readdir_r_cb(dir_result_t *d, add_dirent_cb_t cb, void *p)
 {
   Mutex::Locker lock(client_lock);
@@ -6434,6 +6820,26 @@ int Client::readdir_r_cb(dir_result_t *d, add_dirent_cb_t cb, void *p)
 	return r;
     }
 
+    if (dirp->cache_prefetch) {
+      // we have the attrs of the chunk the cache wanted, pick the
+      // listing up in the cache after its last entry
+      dirp->cache_prefetch = false;
+      if (!dirp->buffer->empty() && diri->dir &&
+	  diri->is_complete_and_ordered() &&
+	  diri->caps_issued_mask(CEPH_CAP_FILE_SHARED) &&
+	  diri->dir->dentries.count(dirp->buffer->back().first)) {
+	ldout(cct, 10) << " back to the cache after " << dirp->buffer->back().first << dendl;
+	dirp->at_cache_name = dirp->buffer->back().first;
+	_readdir_drop_dirp_buffer(dirp);
+	int err = _readdir_cache_cb(dirp, cb, p);
+	if (err != -EAGAIN)
+	  return err;
+	dirp->last_name = dirp->at_cache_name;
+	dirp->at_cache_name.clear();
+	continue;
+      }
+    }
+
     if (dirp->last_name.length()) {
       ldout(cct, 10) << " fetching next chunk of this frag" << dendl;
       _readdir_drop_dirp_buffer(dirp);
@@ -6862,8 +7268,10 @@ Fh *Client::_create_fh(Inode *in, int flags, int cmode)
 
   const md_config_t *conf = cct->_conf;
   loff_t p = in->layout.fl_stripe_count * in->layout.fl_object_size;
+  // one stripe unit on each object: the least that reads all of them at once
+  uint64_t stripe = (uint64_t)in->layout.fl_stripe_count * in->layout.fl_stripe_unit;
   f->readahead.set_trigger_requests(1);
-  f->readahead.set_min_readahead_size(conf->client_readahead_min);
+  uint64_t min_readahead = conf->client_readahead_min;
   uint64_t max_readahead = Readahead::NO_LIMIT;
   if (conf->client_readahead_max_bytes) {
     max_readahead = MIN(max_readahead, (uint64_t)conf->client_readahead_max_bytes);
@@ -6871,9 +7279,22 @@ Fh *Client::_create_fh(Inode *in, int flags, int cmode)
   if (conf->client_readahead_max_periods) {
     max_readahead = MIN(max_readahead, ((uint64_t)conf->client_readahead_max_periods) * p);
   }
-  f->readahead.set_max_readahead_size(max_readahead);
+  if (conf->client_oc) {
+    // don't read so far ahead that we push out what hasn't been read yet
+    max_readahead = MIN(max_readahead, (uint64_t)conf->client_oc_size / 4);
+  }
+  if (stripe > min_readahead && stripe <= max_readahead)
+    min_readahead = stripe;
+  f->readahead_ceiling = max_readahead;
+  f->readahead_max = max_readahead;
+  if (conf->client_readahead_adaptive)
+    f->readahead_max = MIN(max_readahead, MAX(min_readahead, stripe));
+  f->readahead.set_min_readahead_size(min_readahead);
+  f->readahead.set_max_readahead_size(f->readahead_max);
   vector<uint64_t> alignments;
   alignments.push_back(p);
+  if (stripe != (uint64_t)p && stripe != in->layout.fl_stripe_unit)
+    alignments.push_back(stripe);
   alignments.push_back(in->layout.fl_stripe_unit);
   f->readahead.set_alignments(alignments);
 
@@ -7303,7 +7724,11 @@ int Client::_read_async(Fh *f, uint64_t off, uint64_t len, bufferlist *bl)
   }
 
   ldout(cct, 10) << " max_bytes=" << conf->client_readahead_max_bytes
-		 << " max_periods=" << conf->client_readahead_max_periods << dendl;
+		 << " max_periods=" << conf->client_readahead_max_periods
+		 << " window " << f->readahead_max << "/" << f->readahead_ceiling << dendl;
+
+  bool sequential = off > 0 && off == f->last_read_end;
+  f->last_read_end = off + len;
 
   // read (and possibly block)
   int r, rvalue = 0;
@@ -7323,12 +7748,25 @@ int Client::_read_async(Fh *f, uint64_t off, uint64_t len, bufferlist *bl)
     client_lock.Lock();
     put_cap_ref(in, CEPH_CAP_FILE_CACHE);
     r = rvalue;
+
+    if (sequential) {
+      // the readahead didn't stay far enough ahead of this reader; open
+      // the window up so more of the file's objects are read at once
+      logger->inc(l_c_read_stall);
+      if (conf->client_readahead_adaptive &&
+	  f->readahead_max < f->readahead_ceiling) {
+	f->readahead_max = MIN(f->readahead_max * 2, f->readahead_ceiling);
+	f->readahead.set_max_readahead_size(f->readahead_max);
+	ldout(cct, 20) << "readahead window now " << f->readahead_max << dendl;
+      }
+    }
   } else {
     // it was cached.
     delete onfinish;
   }
 
-  if(conf->client_readahead_max_bytes > 0) {
+  if (conf->client_readahead_max_bytes > 0 ||
+      conf->client_readahead_max_periods > 0) {
     pair<uint64_t, uint64_t> readahead_extent = f->readahead.update(off, len, in->size);
     if (readahead_extent.second > 0) {
       ldout(cct, 20) << "readahead " << readahead_extent.first << "~" << readahead_extent.second
@@ -7341,6 +7779,7 @@ int Client::_read_async(Fh *f, uint64_t off, uint64_t len, bufferlist *bl)
       if (r2 == 0) {
 	ldout(cct, 20) << "readahead initiated, c " << onfinish2 << dendl;
 	get_cap_ref(in, CEPH_CAP_FILE_RD | CEPH_CAP_FILE_CACHE);
+	logger->inc(l_c_readahead);
       } else {
 	f->readahead.dec_pending();
 	ldout(cct, 20) << "readahead was no-op, already cached" << dendl;
@@ -7663,6 +8102,8 @@ int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf,
     // O_SYNC = __O_SYNC | O_DSYNC on linux >= 2.6.33
     if ((f->flags & O_SYNC) || (f->flags & O_DSYNC)) {
       _flush_range(in, offset, size);
+    } else if (cct->_conf->client_write_behind) {
+      _write_behind(f, offset, size);
     }
   } else {
     // simple, non-atomic sync write
@@ -7817,6 +8258,9 @@ int Client::_fsync(Inode *in, bool syncdataonly)
   C_SafeCond *object_cacher_completion = NULL;
 
   ldout(cct, 3) << "_fsync on " << *in << " " << (syncdataonly ? "(dataonly)":"(data+metadata)") << dendl;
+
+  // there is no cap to flush until the mds has the inode
+  wait_async_create(in);
   
   if (cct->_conf->client_oc) {
     object_cacher_completion = new C_SafeCond(&lock, &cond, &done, &r);
@@ -9396,6 +9840,16 @@ int Client::_create(Inode *dir, const char *name, int flags, mode_t mode,
       return -ERANGE;  // bummer!
   }
 
+  bool default_layout = !stripe_unit && !stripe_count && !object_size && pool_id < 0;
+  if (default_layout) {
+    int r = _async_create(dir, name, flags, cmode, mode, uid, gid, inp, fhp);
+    if (r != -EAGAIN) {
+      if (r >= 0 && created)
+	*created = true;
+      return r;
+    }
+  }
+
   MetaRequest *req = new MetaRequest(CEPH_MDS_OP_CREATE);
 
   filepath path;
@@ -9405,6 +9859,8 @@ int Client::_create(Inode *dir, const char *name, int flags, mode_t mode,
   req->set_inode(dir);
   req->head.args.open.flags = flags | O_CREAT;
   req->head.args.open.mode = mode;
+  if (cct->_conf->client_async_dirops)
+    req->head.flags = req->head.flags | CEPH_MDS_FLAG_WANT_INOS;
 
   req->head.args.open.stripe_unit = stripe_unit;
   req->head.args.open.stripe_count = stripe_count;
@@ -9427,6 +9883,9 @@ int Client::_create(Inode *dir, const char *name, int flags, mode_t mode,
     goto reply_error;
   }
 
+  if (default_layout && inp && *inp && dir->dir)
+    dir->dir->create_layout = (*inp)->layout;
+
   /* If the caller passed a value in fhp, do the open */
   if(fhp) {
     (*inp)->get_open_ref(cmode);
@@ -9449,6 +9908,128 @@ int Client::_create(Inode *dir, const char *name, int flags, mode_t mode,
 }
 
 
+/*
+ * Create a file without waiting for the mds: the name must be known not to
+ * exist and we need an ino the mds delegated to us.  We set up the inode
+ * and the caps the mds will issue for it ourselves; the reply fills in the
+ * rest.  The mds picks the layout, so I/O waits for the reply.
+ */
+int Client::_async_create(Inode *dir, const char *name, int flags, int cmode,
+			  mode_t mode, int uid, int gid, Inode **inp, Fh **fhp)
+{
+  if (!_can_async_dirop(dir, uid, gid))
+    return -EAGAIN;
+
+  MetaSession *session = dir->auth_cap->session;
+  ceph_file_layout *layout = &dir->dir->create_layout;
+  if (session->delegated_inos.empty() || !ceph_file_layout_is_valid(layout))
+    return -EAGAIN;
+
+  // our rstats don't count the creates the mds hasn't replied to yet,
+  // leave files under a quota to the mds
+  if (cct->_conf->client_quota) {
+    for (Inode *q = dir; q != root_ancestor; q = get_quota_root(q)) {
+      if (q->quota.max_files)
+	return -EAGAIN;
+    }
+  }
+
+  Dentry *dn = NULL;
+  ceph::unordered_map<string,Dentry*>::iterator p = dir->dir->dentries.find(name);
+  if (p != dir->dir->dentries.end())
+    dn = p->second;
+  if (dn ? (dn->inode || dn->cap_shared_gen != dir->shared_gen) :
+      !(dir->flags & I_COMPLETE))
+    return -EAGAIN;
+
+  if (uid < 0) {
+    uid = geteuid();
+    gid = getegid();
+  }
+
+  inodeno_t ino = session->delegated_inos.range_start();
+  session->delegated_inos.erase(ino);
+  if (inode_map.count(vinodeno_t(ino, CEPH_NOSNAP))) {
+    // not a new ino after all, don't trust the rest either
+    ldout(cct, 1) << "delegated ino " << ino << " is in use, dropping delegation" << dendl;
+    session->delegated_inos.clear();
+    return -EAGAIN;
+  }
+  utime_t now = ceph_clock_now(cct);
+
+  MetaRequest *req = new MetaRequest(CEPH_MDS_OP_CREATE);
+
+  filepath path;
+  dir->make_nosnap_relative_path(path);
+  path.push_dentry(name);
+  req->set_filepath(path);
+  req->set_inode(dir);
+  req->head.ino = ino;
+  req->head.flags = req->head.flags | CEPH_MDS_FLAG_WANT_INOS | CEPH_MDS_FLAG_ASYNC;
+  req->head.args.open.flags = flags | O_CREAT;
+  req->head.args.open.mode = mode;
+  req->head.args.open.stripe_unit = 0;
+  req->head.args.open.stripe_count = 0;
+  req->head.args.open.object_size = 0;
+  req->head.args.open.pool = -1;
+  req->dentry_drop = CEPH_CAP_FILE_SHARED;
+  req->dentry_unless = CEPH_CAP_FILE_EXCL;
+  req->op_stamp = now;
+
+  // the inode as Server::prepare_new_inode will make it
+  InodeStat st;
+  st.vino = vinodeno_t(ino, CEPH_NOSNAP);
+  st.version = 0;
+  memset(&st.cap, 0, sizeof(st.cap));
+  st.cap.caps = CEPH_CAP_PIN | CEPH_CAP_ANY_SHARED | CEPH_CAP_AUTH_EXCL |
+    CEPH_CAP_XATTR_EXCL | ceph_caps_for_mode(cmode);
+  st.cap.realm = dir->snaprealm->ino;
+  st.cap.flags = CEPH_CAP_FLAG_AUTH;
+  st.layout = *layout;
+  st.mode = (mode & ~S_IFMT) | S_IFREG;
+  st.uid = uid;
+  st.gid = (dir->mode & S_ISGID) ? dir->gid : gid;
+  st.nlink = 1;
+  st.rdev = 0;
+  st.size = 0;
+  st.max_size = (cmode & CEPH_FILE_MODE_WR) ?
+    (uint64_t)layout->fl_object_size * layout->fl_stripe_count : 0;
+  st.truncate_seq = 1;
+  st.truncate_size = -1ull;
+  st.ctime = st.mtime = st.atime = now;
+  st.time_warp_seq = 0;
+  st.inline_version = mdsmap->get_inline_data_enabled() ? 1 : CEPH_INLINE_NONE;
+  st.xattr_version = 0;
+  memset(&st.dir_layout, 0, sizeof(st.dir_layout));
+  memset(&st.quota, 0, sizeof(st.quota));
+
+  Inode *in = add_update_inode(&st, now, session);
+  in->flags |= I_ASYNC_CREATE;
+
+  LeaseStat dlease;
+  dlease.mask = 0;
+  dlease.duration_ms = 0;
+  dlease.seq = 0;
+  dn = insert_dentry_inode(dir->dir, name, &dlease, in, now, session, NULL);
+  req->set_dentry(dn);
+  req->set_other_inode(in);
+
+  make_async_request(req, session, uid, gid);
+  put_request(req);
+
+  if (fhp) {
+    in->get_open_ref(cmode);
+    *fhp = _create_fh(in, flags, cmode);
+  }
+  if (inp)
+    *inp = in;
+
+  trim_cache();
+  ldout(cct, 3) << "create(" << path << ", 0" << oct << mode << dec
+		<< ") = 0 (async, ino " << ino << ")" << dendl;
+  return 0;
+}
+
 int Client::_mkdir(Inode *dir, const char *name, mode_t mode, int uid, int gid,
 		   Inode **inp)
 {
@@ -9603,6 +10184,10 @@ int Client::_unlink(Inode *dir, const char *name, int uid, int gid)
     return -EROFS;
   }
 
+  int res = _async_unlink(dir, name, uid, gid);
+  if (res != -EAGAIN)
+    return res;
+
   MetaRequest *req = new MetaRequest(CEPH_MDS_OP_UNLINK);
 
   filepath path;
@@ -9611,7 +10196,7 @@ int Client::_unlink(Inode *dir, const char *name, int uid, int gid)
   req->set_filepath(path);
 
   Dentry *de;
-  int res = get_or_create(dir, name, &de);
+  res = get_or_create(dir, name, &de);
   if (res < 0)
     goto fail;
   req->set_dentry(de);
@@ -9638,6 +10223,96 @@ int Client::_unlink(Inode *dir, const char *name, int uid, int gid)
   return res;
 }
 
+/*
+ * Can we change dir without waiting for the mds?  Only with Fs and Fx from
+ * its auth mds: nobody else can see or change the dir until the mds takes
+ * them back, and it will apply the requests we've sent by then first.
+ */
+bool Client::_can_async_dirop(Inode *dir, int uid, int gid)
+{
+  if (!cct->_conf->client_async_dirops)
+    return false;
+  if (dir->snapid != CEPH_NOSNAP || !dir->dir || !dir->auth_cap)
+    return false;
+  unsigned want = CEPH_CAP_FILE_SHARED | CEPH_CAP_FILE_EXCL;
+  if ((dir->auth_cap->issued & want) != want)
+    return false;
+
+  // an error would come back too late to return it, so leave anything
+  // the mds might refuse to it: we need write and search on the dir
+  if (uid < 0) {
+    uid = geteuid();
+    gid = getegid();
+  }
+  if (uid == 0)
+    return true;
+  unsigned need = S_IWOTH | S_IXOTH;
+  if ((uid_t)uid == dir->uid) {
+    need <<= 6;
+  } else {
+    bool in_group = ((gid_t)gid == dir->gid);
+    if (!in_group && getgroups_cb) {
+      gid_t *sgids = NULL;
+      int sgid_count = getgroups_cb(callback_handle, uid, &sgids);
+      for (int i = 0; i < sgid_count && !in_group; ++i)
+	in_group = (sgids[i] == dir->gid);
+      free(sgids);
+    }
+    if (in_group)
+      need <<= 3;
+  }
+  return (dir->mode & need) == need;
+}
+
+int Client::_async_unlink(Inode *dir, const char *name, int uid, int gid)
+{
+  if (!_can_async_dirop(dir, uid, gid))
+    return -EAGAIN;
+
+  // we must know what we are unlinking
+  ceph::unordered_map<string,Dentry*>::iterator p = dir->dir->dentries.find(name);
+  if (p == dir->dir->dentries.end())
+    return -EAGAIN;
+  Dentry *dn = p->second;
+  Inode *otherin = dn->inode;
+  if (!otherin || otherin->is_dir() ||
+      (otherin->flags & I_ASYNC_CREATE) ||
+      dn->cap_shared_gen != dir->shared_gen)
+    return -EAGAIN;
+  // in a sticky dir only the owners may unlink
+  int euid = (uid < 0 ? (int)geteuid() : uid);
+  if ((dir->mode & S_ISVTX) && euid != 0 &&
+      (uid_t)euid != dir->uid && (uid_t)euid != otherin->uid)
+    return -EAGAIN;
+
+  MetaRequest *req = new MetaRequest(CEPH_MDS_OP_UNLINK);
+
+  filepath path;
+  dir->make_nosnap_relative_path(path);
+  path.push_dentry(name);
+  req->set_filepath(path);
+  req->set_dentry(dn);
+  req->dentry_drop = CEPH_CAP_FILE_SHARED;
+  req->dentry_unless = CEPH_CAP_FILE_EXCL;
+  req->set_other_inode(otherin);
+  req->other_inode_drop = CEPH_CAP_LINK_SHARED | CEPH_CAP_LINK_EXCL;
+  req->set_inode(dir);
+  req->op_stamp = ceph_clock_now(cct);
+  req->head.flags = req->head.flags | CEPH_MDS_FLAG_ASYNC;
+
+  make_async_request(req, dir->auth_cap->session, uid, gid);
+  put_request(req);
+
+  // the reply will bring the real nlink; until then this is our best guess
+  if (otherin->nlink > 0)
+    otherin->nlink--;
+  unlink(dn, true, true);  // keep dir, keep dentry
+  dn->cap_shared_gen = dir->shared_gen;
+
+  ldout(cct, 3) << "unlink(" << path << ") = 0 (async)" << dendl;
+  return 0;
+}
+
 int Client::ll_unlink(Inode *in, const char *name, int uid, int gid)
 {
   Mutex::Locker lock(client_lock);
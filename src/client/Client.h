@@ -81,6 +81,10 @@ enum {
   l_c_reply,
   l_c_lat,
   l_c_wrlat,
+  l_c_async_dirop,
+  l_c_readahead,
+  l_c_read_stall,
+  l_c_write_behind,
   l_c_last,
 };
 
@@ -183,6 +187,7 @@ struct dir_result_t {
   vector<pair<string,Inode*> > *buffer;
 
   string at_cache_name;  // last entry we successfully returned
+  bool cache_prefetch;   // reading a chunk from the mds for its attrs, then back to the cache
 
   dir_result_t(Inode *in);
 
@@ -206,6 +211,7 @@ struct dir_result_t {
   void reset() {
     last_name.clear();
     at_cache_name.clear();
+    cache_prefetch = false;
     next_offset = 2;
     this_offset = 0;
     offset = 0;
@@ -302,6 +308,13 @@ public:
 		   //MClientRequest *req, int uid, int gid,
 		   Inode **ptarget = 0, bool *pcreated = 0,
 		   int use_mds=-1, bufferlist *pdirbl=0);
+  void make_async_request(MetaRequest *req, MetaSession *session,
+			  int uid, int gid);
+  void resend_async_request(MetaRequest *request);
+  void finish_async_request(MetaRequest *request, int r);
+  void fail_async_create(Inode *in);
+  void check_created_ino(MetaRequest *request, MClientReply *reply);
+  void wait_async_create(Inode *in);
   void put_request(MetaRequest *request);
   void unregister_request(MetaRequest *request);
 
@@ -323,6 +336,7 @@ public:
   void handle_client_request_forward(MClientRequestForward *reply);
   void handle_client_reply(MClientReply *reply);
   bool is_dir_operation(MetaRequest *request);
+  void got_delegated_inos(MetaSession *session, MClientReply *reply);
 
   bool   initialized;
   bool   authenticated;
@@ -522,10 +536,13 @@ protected:
   int uninline_data(Inode *in, Context *onfinish);
 
   // file caps
-  void check_cap_issue(Inode *in, Cap *cap, unsigned issued);
+  void check_cap_issue(Inode *in, Cap *cap, unsigned issued,
+		       utime_t mtime, utime_t ctime);
+  void save_dir_complete(Inode *in);
+  void refresh_cap_lease(Cap *cap, utime_t from);
   void add_update_cap(Inode *in, MetaSession *session, uint64_t cap_id,
 		      unsigned issued, unsigned seq, unsigned mseq, inodeno_t realm,
-		      int flags);
+		      int flags, utime_t from, utime_t mtime, utime_t ctime);
   void remove_cap(Cap *cap, bool queue_release);
   void remove_all_caps(Inode *in);
   void remove_session_caps(MetaSession *session);
@@ -544,6 +561,7 @@ protected:
   void handle_quota(struct MClientQuota *m);
   void handle_snap(struct MClientSnap *m);
   void handle_caps(class MClientCaps *m);
+  void handle_caps_batch(class MClientCapsBatch *m);
   void handle_cap_import(MetaSession *session, Inode *in, class MClientCaps *m);
   void handle_cap_export(MetaSession *session, Inode *in, class MClientCaps *m);
   void handle_cap_trunc(MetaSession *session, Inode *in, class MClientCaps *m);
@@ -586,6 +604,7 @@ protected:
    */
   bool _flush(Inode *in, Context *c);
   void _flush_range(Inode *in, int64_t off, uint64_t size);
+  void _write_behind(Fh *f, int64_t off, uint64_t size);
   void _flushed(Inode *in);
   void flush_set_callback(ObjectCacher::ObjectSet *oset);
 
@@ -628,6 +647,7 @@ private:
   void _readdir_rechoose_frag(dir_result_t *dirp);
   int _readdir_get_frag(dir_result_t *dirp);
   int _readdir_cache_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p);
+  bool _readdir_cache_wants_attrs(dir_result_t *dirp);
   void _closedir(dir_result_t *dirp);
 
   // other helpers
@@ -659,6 +679,10 @@ private:
 
   int _link(Inode *in, Inode *dir, const char *name, int uid=-1, int gid=-1, Inode **inp = 0);
   int _unlink(Inode *dir, const char *name, int uid=-1, int gid=-1);
+  bool _can_async_dirop(Inode *dir, int uid, int gid);
+  int _async_unlink(Inode *dir, const char *name, int uid, int gid);
+  int _async_create(Inode *dir, const char *name, int flags, int cmode,
+		    mode_t mode, int uid, int gid, Inode **inp, Fh **fhp);
   int _rename(Inode *olddir, const char *oname, Inode *ndir, const char *nname, int uid=-1, int gid=-1);
   int _mkdir(Inode *dir, const char *name, mode_t mode, int uid=-1, int gid=-1, Inode **inp = 0);
   int _rmdir(Inode *dir, const char *name, int uid=-1, int gid=-1);
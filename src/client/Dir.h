@@ -11,7 +11,21 @@ class Dir {
   uint64_t release_count;
   uint64_t ordered_count;
 
-  Dir(Inode* in) : release_count(0), ordered_count(0) { parent_inode = in; }
+  // what the dir looked like when we lost Fs with a complete cache, so
+  // that the cache can be kept if it is unchanged when Fs comes back
+  bool saved_complete;
+  unsigned saved_flags;
+  utime_t saved_mtime, saved_ctime;
+
+  // layout of the last file the mds created here for us; the inode of an
+  // async create has it until the reply brings the real one
+  ceph_file_layout create_layout;
+
+  Dir(Inode* in) : release_count(0), ordered_count(0),
+		   saved_complete(false), saved_flags(0) {
+    parent_inode = in;
+    memset(&create_layout, 0, sizeof(create_layout));
+  }
 
   bool is_empty() {  return dentries.empty(); }
 };
@@ -22,13 +22,22 @@ struct Fh {
   list<Cond*> pos_waiters;   // waiters for pos
 
   Readahead readahead;
+  uint64_t readahead_max;      // current cap on the readahead window
+  uint64_t readahead_ceiling;  // ... and how far it may grow
+  uint64_t last_read_end;
+
+  // start of the sequential write run not yet flushed behind the writer
+  uint64_t write_behind_pos;
+  uint64_t last_write_end;
 
   // file lock
   ceph_lock_state_t *fcntl_locks;
   ceph_lock_state_t *flock_locks;
 
   Fh() : _ref(1), inode(0), pos(0), mds(0), mode(0), flags(0), pos_locked(false),
-      readahead(), fcntl_locks(NULL), flock_locks(NULL) {}
+      readahead(), readahead_max(0), readahead_ceiling(0), last_read_end(0),
+      write_behind_pos(0), last_write_end(0),
+      fcntl_locks(NULL), flock_locks(NULL) {}
   void get() { ++_ref; }
   int put() { return --_ref; }
 };
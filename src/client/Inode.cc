@@ -185,6 +185,30 @@ void Inode::try_touch_cap(mds_rank_t mds)
     touch_cap(caps[mds]);
 }
 
+/*
+ * The caps we may act on.  With cap leases we stop trusting a cap's
+ * shared caps once we haven't heard about it for client_cap_lease_ttl:
+ * the MDS may have taken them back since without telling us.
+ */
+int Inode::cap_usable(Cap *cap)
+{
+  if (cap->lease_until != utime_t() &&
+      ceph_clock_now(cct) >= cap->lease_until)
+    return cap->issued & ~CEPH_CAP_ANY_SHARED;
+  return cap->issued;
+}
+
+int Inode::caps_usable()
+{
+  int c = snap_caps;
+  for (map<mds_rank_t,Cap*>::iterator it = caps.begin();
+       it != caps.end();
+       ++it)
+    if (cap_is_valid(it->second))
+      c |= cap_usable(it->second);
+  return c;
+}
+
 bool Inode::caps_issued_mask(unsigned mask)
 {
   int c = snap_caps;
@@ -193,7 +217,7 @@ bool Inode::caps_issued_mask(unsigned mask)
   // prefer auth cap
   if (auth_cap &&
       cap_is_valid(auth_cap) &&
-      (auth_cap->issued & mask) == mask) {
+      (cap_usable(auth_cap) & mask) == mask) {
     touch_cap(auth_cap);
     return true;
   }
@@ -202,11 +226,12 @@ bool Inode::caps_issued_mask(unsigned mask)
        it != caps.end();
        ++it) {
     if (cap_is_valid(it->second)) {
-      if ((it->second->issued & mask) == mask) {
+      int usable = cap_usable(it->second);
+      if ((usable & mask) == mask) {
 	touch_cap(it->second);
 	return true;
       }
-      c |= it->second->issued;
+      c |= usable;
     }
   }
   if ((c & mask) == mask) {
@@ -258,7 +283,7 @@ int Inode::caps_dirty()
 bool Inode::have_valid_size()
 {
   // RD+RDCACHE or WR+WRBUFFER => valid size
-  if (caps_issued() & (CEPH_CAP_FILE_SHARED | CEPH_CAP_FILE_EXCL))
+  if (caps_usable() & (CEPH_CAP_FILE_SHARED | CEPH_CAP_FILE_EXCL))
     return true;
   return false;
 }
@@ -33,6 +33,7 @@ struct Cap {
   uint64_t seq, issue_seq;
   __u32 mseq;  // migration seq
   __u32 gen;
+  utime_t lease_until;  // with cap leases, when we stop trusting its shared caps
 
   Cap() : session(NULL), inode(NULL), cap_item(this), cap_id(0), issued(0),
 	       implemented(0), wanted(0), seq(0), issue_seq(0), mseq(0), gen(0) {}
@@ -149,6 +150,8 @@ public:
 // inode flags
 #define I_COMPLETE 1
 #define I_DIR_ORDERED 2
+#define I_ASYNC_CREATE 4
+#define I_BAD 8  /* an async create of it failed, I/O gets -EIO */
 
 struct Inode {
   CephContext *cct;
@@ -351,6 +354,8 @@ struct Inode {
   bool is_any_caps();
   bool cap_is_valid(Cap* cap);
   int caps_issued(int *implemented = 0);
+  int cap_usable(Cap *cap);
+  int caps_usable();
   void touch_cap(Cap *cap);
   void try_touch_cap(mds_rank_t mds);
   bool caps_issued_mask(unsigned mask);
@@ -69,6 +69,7 @@ public:
 
   //possible responses
   bool got_unsafe;
+  bool async_op;               // nobody is waiting for the reply
 
   xlist<MetaRequest*>::item item;
   xlist<MetaRequest*>::item unsafe_item;
@@ -96,7 +97,7 @@ public:
     ref(1), reply(0), 
     kick(false), aborted(false), success(false),
     readdir_offset(0), readdir_end(false), readdir_num(0),
-    got_unsafe(false), item(this), unsafe_item(this), unsafe_dir_item(this),
+    got_unsafe(false), async_op(false), item(this), unsafe_item(this), unsafe_dir_item(this),
     lock("MetaRequest lock"),
     caller_cond(0), dispatch_cond(0),
     target(0) {
@@ -8,6 +8,7 @@
 #include "include/utime.h"
 #include "msg/msg_types.h"
 #include "include/xlist.h"
+#include "include/interval_set.h"
 
 #include "messages/MClientCapRelease.h"
 #include "mds/MDSMap.h"
@@ -26,6 +27,7 @@ struct MetaSession {
   utime_t cap_ttl, last_cap_renew_request;
   uint64_t cap_renew_seq;
   int num_caps;
+  double cap_lease_ttl;  // as we asked for it when we opened the session
   entity_inst_t inst;
 
   enum {
@@ -47,13 +49,15 @@ struct MetaSession {
   xlist<MetaRequest*> requests;
   xlist<MetaRequest*> unsafe_requests;
 
+  interval_set<inodeno_t> delegated_inos;  // ours to create files with
+
   Cap *s_cap_iterator;
 
   MClientCapRelease *release;
   
   MetaSession()
     : mds_num(-1), con(NULL),
-      seq(0), cap_gen(0), cap_renew_seq(0), num_caps(0),
+      seq(0), cap_gen(0), cap_renew_seq(0), num_caps(0), cap_lease_ttl(0),
       state(STATE_NEW), readonly(false), s_cap_iterator(NULL),
       release(NULL)
   {}
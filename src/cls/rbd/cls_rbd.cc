@@ -83,6 +83,7 @@ cls_method_handle_t h_get_children;
 cls_method_handle_t h_get_snapcontext;
 cls_method_handle_t h_get_object_prefix;
 cls_method_handle_t h_get_snapshot_name;
+cls_method_handle_t h_get_image_info;
 cls_method_handle_t h_snapshot_add;
 cls_method_handle_t h_snapshot_remove;
 cls_method_handle_t h_get_all_features;
@@ -1413,6 +1414,118 @@ int get_object_prefix(cls_method_context_t hctx, bufferlist *in, bufferlist *out
   return 0;
 }
 
+/**
+ * Retrieve all the header state needed to refresh an open image in a
+ * single call: size, features, flags, parent, snap context and the
+ * per-snapshot metadata.
+ *
+ * Input:
+ * @param read_only true if the image will be opened read-only (bool)
+ *
+ * Output:
+ * @param info image header state (cls_rbd_image_info)
+ * @returns 0 on success, negative error code on failure
+ */
+int get_image_info(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  bool read_only = false;
+
+  bufferlist::iterator iter = in->begin();
+  try {
+    if (!iter.end()) {
+      ::decode(read_only, iter);
+    }
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+
+  CLS_LOG(20, "get_image_info read_only=%d", read_only);
+
+  cls_rbd_image_info info;
+  int r = read_key(hctx, "order", &info.order);
+  if (r < 0) {
+    CLS_ERR("failed to read the order off of disk: %s", cpp_strerror(r).c_str());
+    return r;
+  }
+
+  r = read_key(hctx, "size", &info.size);
+  if (r < 0) {
+    CLS_ERR("failed to read the image's size off of disk: %s", cpp_strerror(r).c_str());
+    return r;
+  }
+
+  r = read_key(hctx, "features", &info.features);
+  if (r < 0) {
+    CLS_ERR("failed to read features off disk: %s", cpp_strerror(r).c_str());
+    return r;
+  }
+  info.incompatible_features =
+    (read_only ? info.features & RBD_FEATURES_INCOMPATIBLE :
+		 info.features & RBD_FEATURES_RW_INCOMPATIBLE);
+
+  r = read_key(hctx, "flags", &info.flags);
+  if (r < 0 && r != -ENOENT) {
+    CLS_ERR("failed to read flags off disk: %s", cpp_strerror(r).c_str());
+    return r;
+  }
+
+  r = read_key(hctx, "snap_seq", &info.snap_seq);
+  if (r < 0) {
+    CLS_ERR("could not read the image's snap_seq off disk: %s", cpp_strerror(r).c_str());
+    return r;
+  }
+
+  bool layering = ((info.features & RBD_FEATURE_LAYERING) != 0);
+  if (layering) {
+    r = read_key(hctx, "parent", &info.parent);
+    if (r < 0 && r != -ENOENT) {
+      return r;
+    }
+  }
+
+  int max_read = RBD_MAX_KEYS_READ;
+  string last_read = RBD_SNAP_KEY_PREFIX;
+  do {
+    map<string, bufferlist> vals;
+    r = cls_cxx_map_get_vals(hctx, last_read, RBD_SNAP_KEY_PREFIX,
+			     max_read, &vals);
+    if (r < 0) {
+      return r;
+    }
+
+    for (map<string, bufferlist>::iterator it = vals.begin();
+	 it != vals.end(); ++it) {
+      cls_rbd_snap snap;
+      bufferlist::iterator snap_iter = it->second.begin();
+      try {
+	::decode(snap, snap_iter);
+      } catch (const buffer::error &err) {
+	CLS_ERR("could not decode snapshot %s", it->first.c_str());
+	return -EIO;
+      }
+
+      if (snap.protection_status >= RBD_PROTECTION_STATUS_LAST) {
+	CLS_ERR("invalid protection status for snap id %llu: %u",
+		(unsigned long long)snap.id.val, snap.protection_status);
+	return -EIO;
+      }
+      if (!layering) {
+	snap.parent = cls_rbd_parent();
+      }
+      info.snaps.push_back(snap);
+    }
+    if (!vals.empty()) {
+      last_read = vals.rbegin()->first;
+    }
+  } while (r == max_read);
+
+  // snaps must be descending to match the snap context
+  std::reverse(info.snaps.begin(), info.snaps.end());
+
+  ::encode(info, *out);
+  return 0;
+}
+
 int get_snapshot_name(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 {
   uint64_t snap_id;
@@ -2748,6 +2861,9 @@ void __cls_init()
   cls_register_cxx_method(h_class, "get_object_prefix",
 			  CLS_METHOD_RD,
 			  get_object_prefix, &h_get_object_prefix);
+  cls_register_cxx_method(h_class, "get_image_info",
+			  CLS_METHOD_RD,
+			  get_image_info, &h_get_image_info);
   cls_register_cxx_method(h_class, "get_snapshot_name",
 			  CLS_METHOD_RD,
 			  get_snapshot_name, &h_get_snapshot_name);
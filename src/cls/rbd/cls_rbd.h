@@ -151,4 +151,83 @@ struct cls_rbd_snap {
 };
 WRITE_CLASS_ENCODER(cls_rbd_snap)
 
+/// image header state needed to refresh an open image
+struct cls_rbd_image_info {
+  uint8_t order;
+  uint64_t size;
+  uint64_t features;
+  uint64_t incompatible_features;
+  uint64_t flags;
+  uint64_t snap_seq;
+  cls_rbd_parent parent;
+  vector<cls_rbd_snap> snaps;  ///< in descending snap id order
+
+  cls_rbd_image_info() : order(0), size(0), features(0),
+			 incompatible_features(0), flags(0), snap_seq(0) {}
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(order, bl);
+    ::encode(size, bl);
+    ::encode(features, bl);
+    ::encode(incompatible_features, bl);
+    ::encode(flags, bl);
+    ::encode(snap_seq, bl);
+    ::encode(parent, bl);
+    ::encode(snaps, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::iterator& p) {
+    DECODE_START(1, p);
+    ::decode(order, p);
+    ::decode(size, p);
+    ::decode(features, p);
+    ::decode(incompatible_features, p);
+    ::decode(flags, p);
+    ::decode(snap_seq, p);
+    ::decode(parent, p);
+    ::decode(snaps, p);
+    DECODE_FINISH(p);
+  }
+  void dump(Formatter *f) const {
+    f->dump_unsigned("order", order);
+    f->dump_unsigned("size", size);
+    f->dump_unsigned("features", features);
+    f->dump_unsigned("incompatible_features", incompatible_features);
+    f->dump_unsigned("flags", flags);
+    f->dump_unsigned("snap_seq", snap_seq);
+    f->open_object_section("parent");
+    parent.dump(f);
+    f->close_section();
+    f->open_array_section("snaps");
+    for (vector<cls_rbd_snap>::const_iterator it = snaps.begin();
+	 it != snaps.end(); ++it) {
+      f->open_object_section("snap");
+      it->dump(f);
+      f->close_section();
+    }
+    f->close_section();
+  }
+  static void generate_test_instances(list<cls_rbd_image_info*>& o) {
+    o.push_back(new cls_rbd_image_info);
+    cls_rbd_image_info *t = new cls_rbd_image_info;
+    t->order = 22;
+    t->size = 1 << 30;
+    t->features = 3;
+    t->flags = 1;
+    t->snap_seq = 2;
+    t->parent.pool = 1;
+    t->parent.id = "parent";
+    t->parent.snapid = 456;
+    t->parent.overlap = 12345;
+    cls_rbd_snap snap;
+    snap.id = 2;
+    snap.name = "snap";
+    snap.image_size = 123456;
+    t->snaps.push_back(snap);
+    o.push_back(t);
+  }
+};
+WRITE_CLASS_ENCODER(cls_rbd_image_info)
+
 #endif
@@ -46,6 +46,47 @@ namespace librbd {
       return 0;
     }
 
+    void get_initial_metadata_start(librados::ObjectReadOperation *op)
+    {
+      bufferlist sizebl, featuresbl, empty;
+      snapid_t snap = CEPH_NOSNAP;
+      ::encode(snap, sizebl);
+      op->exec("rbd", "get_size", sizebl);
+      op->exec("rbd", "get_object_prefix", empty);
+
+      // incompatible features are re-checked against the open mode
+      // when the image is refreshed
+      bool read_only = true;
+      ::encode(snap, featuresbl);
+      ::encode(read_only, featuresbl);
+      op->exec("rbd", "get_features", featuresbl);
+    }
+
+    int get_initial_metadata_finish(bufferlist::iterator *it,
+				    std::string *object_prefix,
+				    uint8_t *order, uint64_t *features)
+    {
+      assert(object_prefix);
+      assert(order);
+      assert(features);
+
+      try {
+	uint64_t size;
+	uint64_t incompatible_features;
+	// get_size
+	::decode(*order, *it);
+	::decode(size, *it);
+	// get_object_prefix
+	::decode(*object_prefix, *it);
+	// get_features
+	::decode(*features, *it);
+	::decode(incompatible_features, *it);
+      } catch (const buffer::error &err) {
+	return -EBADMSG;
+      }
+      return 0;
+    }
+
     int get_mutable_metadata(librados::IoCtx *ioctx, const std::string &oid,
 			     bool read_only, uint64_t *size, uint64_t *features,
 			     uint64_t *incompatible_features,
@@ -121,6 +162,60 @@ namespace librbd {
       return 0;
     }
 
+    void get_image_info_start(librados::ObjectReadOperation *op,
+			      bool read_only)
+    {
+      bufferlist bl;
+      ::encode(read_only, bl);
+      op->exec("rbd", "get_image_info", bl);
+    }
+
+    int get_image_info_finish(bufferlist::iterator *it,
+			      cls_rbd_image_info *info)
+    {
+      assert(info);
+
+      try {
+	::decode(*info, *it);
+      } catch (const buffer::error &err) {
+	return -EBADMSG;
+      }
+      return 0;
+    }
+
+    int get_image_info(librados::IoCtx *ioctx, const std::string &oid,
+		       bool read_only, cls_rbd_image_info *info,
+		       map<rados::cls::lock::locker_id_t,
+			   rados::cls::lock::locker_info_t> *lockers,
+		       bool *exclusive_lock, std::string *lock_tag)
+    {
+      assert(lockers);
+      assert(exclusive_lock);
+
+      librados::ObjectReadOperation op;
+      get_image_info_start(&op, read_only);
+      rados::cls::lock::get_lock_info_start(&op, RBD_LOCK_NAME);
+
+      bufferlist outbl;
+      int r = ioctx->operate(oid, &op, &outbl);
+      if (r < 0)
+	return r;
+
+      bufferlist::iterator iter = outbl.begin();
+      r = get_image_info_finish(&iter, info);
+      if (r < 0)
+	return r;
+
+      ClsLockType lock_type = LOCK_NONE;
+      r = rados::cls::lock::get_lock_info_finish(&iter, lockers, &lock_type,
+						 lock_tag);
+      if (r < 0 && ((r != -EOPNOTSUPP) && (r != -EIO)))
+	return r;
+
+      *exclusive_lock = (lock_type == LOCK_EXCLUSIVE);
+      return 0;
+    }
+
     int create_image(librados::IoCtx *ioctx, const std::string &oid,
 		     uint64_t size, uint8_t order, uint64_t features,
 		     const std::string &object_prefix)
@@ -563,26 +658,37 @@ namespace librbd {
     int get_stripe_unit_count(librados::IoCtx *ioctx, const std::string &oid,
 			      uint64_t *stripe_unit, uint64_t *stripe_count)
     {
-      assert(stripe_unit);
-      assert(stripe_count);
-
       librados::ObjectReadOperation op;
-      bufferlist empty;
-      op.exec("rbd", "get_stripe_unit_count", empty);
+      get_stripe_unit_count_start(&op);
 
       bufferlist outbl;
       int r = ioctx->operate(oid, &op, &outbl);
       if (r < 0)
 	return r;
 
+      bufferlist::iterator iter = outbl.begin();
+      return get_stripe_unit_count_finish(&iter, stripe_unit, stripe_count);
+    }
+
+    void get_stripe_unit_count_start(librados::ObjectReadOperation *op)
+    {
+      bufferlist empty;
+      op->exec("rbd", "get_stripe_unit_count", empty);
+    }
+
+    int get_stripe_unit_count_finish(bufferlist::iterator *it,
+				     uint64_t *stripe_unit,
+				     uint64_t *stripe_count)
+    {
+      assert(stripe_unit);
+      assert(stripe_count);
+
       try {
-	bufferlist::iterator iter = outbl.begin();
-	::decode(*stripe_unit, iter);
-	::decode(*stripe_count, iter);
+	::decode(*stripe_unit, *it);
+	::decode(*stripe_count, *it);
       } catch (const buffer::error &err) {
 	return -EBADMSG;
       }
-
       return 0;
     }
 
@@ -600,18 +706,31 @@ namespace librbd {
 
     int get_id(librados::IoCtx *ioctx, const std::string &oid, std::string *id)
     {
-      bufferlist in, out;
-      int r = ioctx->exec(oid, "rbd", "get_id", in, out);
+      librados::ObjectReadOperation op;
+      get_id_start(&op);
+
+      bufferlist out;
+      int r = ioctx->operate(oid, &op, &out);
       if (r < 0)
 	return r;
 
       bufferlist::iterator iter = out.begin();
+      return get_id_finish(&iter, id);
+    }
+
+    void get_id_start(librados::ObjectReadOperation *op)
+    {
+      bufferlist empty;
+      op->exec("rbd", "get_id", empty);
+    }
+
+    int get_id_finish(bufferlist::iterator *it, std::string *id)
+    {
       try {
-	::decode(*id, iter);
+	::decode(*id, *it);
       } catch (const buffer::error &err) {
 	return -EBADMSG;
       }
-
       return 0;
     }
 
@@ -5,6 +5,7 @@
 #define CEPH_LIBRBD_CLS_RBD_CLIENT_H
 
 #include "cls/lock/cls_lock_types.h"
+#include "cls/rbd/cls_rbd.h"
 #include "common/bit_vector.hpp"
 #include "common/snap_types.h"
 #include "include/rados/librados.hpp"
@@ -19,6 +20,10 @@ namespace librbd {
     // high-level interface to the header
     int get_immutable_metadata(librados::IoCtx *ioctx, const std::string &oid,
 			       std::string *object_prefix, uint8_t *order);
+    void get_initial_metadata_start(librados::ObjectReadOperation *op);
+    int get_initial_metadata_finish(bufferlist::iterator *it,
+				    std::string *object_prefix,
+				    uint8_t *order, uint64_t *features);
     int get_mutable_metadata(librados::IoCtx *ioctx, const std::string &oid,
 			     bool read_only, uint64_t *size, uint64_t *features,
 			     uint64_t *incompatible_features,
@@ -28,6 +33,15 @@ namespace librbd {
 			     std::string *lock_tag,
 			     ::SnapContext *snapc,
 			     parent_info *parent);
+    void get_image_info_start(librados::ObjectReadOperation *op,
+			      bool read_only);
+    int get_image_info_finish(bufferlist::iterator *it,
+			      cls_rbd_image_info *info);
+    int get_image_info(librados::IoCtx *ioctx, const std::string &oid,
+		       bool read_only, cls_rbd_image_info *info,
+		       map<rados::cls::lock::locker_id_t,
+			   rados::cls::lock::locker_info_t> *lockers,
+		       bool *exclusive_lock, std::string *lock_tag);
 
     // low-level interface (mainly for testing)
     int create_image(librados::IoCtx *ioctx, const std::string &oid,
@@ -86,6 +100,10 @@ namespace librbd {
 			      snapid_t snap_id, uint8_t protection_status);
     int get_stripe_unit_count(librados::IoCtx *ioctx, const std::string &oid,
 			      uint64_t *stripe_unit, uint64_t *stripe_count);
+    void get_stripe_unit_count_start(librados::ObjectReadOperation *op);
+    int get_stripe_unit_count_finish(bufferlist::iterator *it,
+				     uint64_t *stripe_unit,
+				     uint64_t *stripe_count);
     int set_stripe_unit_count(librados::IoCtx *ioctx, const std::string &oid,
 			      uint64_t stripe_unit, uint64_t stripe_count);
     int metadata_list(librados::IoCtx *ioctx, const std::string &oid,
@@ -100,6 +118,8 @@ namespace librbd {
 
     // operations on rbd_id objects
     int get_id(librados::IoCtx *ioctx, const std::string &oid, std::string *id);
+    void get_id_start(librados::ObjectReadOperation *op);
+    int get_id_finish(bufferlist::iterator *it, std::string *id);
     int set_id(librados::IoCtx *ioctx, const std::string &oid, std::string id);
 
     // operations on rbd_directory objects
@@ -24,11 +24,13 @@ CLS_NAME(rgw)
 cls_handle_t h_class;
 cls_method_handle_t h_rgw_bucket_init_index;
 cls_method_handle_t h_rgw_bucket_set_tag_timeout;
+cls_method_handle_t h_rgw_bucket_set_resharding;
 cls_method_handle_t h_rgw_bucket_list;
 cls_method_handle_t h_rgw_bucket_check_index;
 cls_method_handle_t h_rgw_bucket_rebuild_index;
 cls_method_handle_t h_rgw_bucket_prepare_op;
 cls_method_handle_t h_rgw_bucket_complete_op;
+cls_method_handle_t h_rgw_bucket_complete_ops;
 cls_method_handle_t h_rgw_bucket_link_olh;
 cls_method_handle_t h_rgw_bucket_unlink_instance_op;
 cls_method_handle_t h_rgw_bucket_read_olh_log;
@@ -614,6 +616,49 @@ int rgw_bucket_set_tag_timeout(cls_method_context_t hctx, bufferlist *in, buffer
   return write_bucket_header(hctx, &header);
 }
 
+static int rgw_bucket_set_resharding(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  // decode request
+  rgw_cls_set_resharding_op op;
+  bufferlist::iterator iter = in->begin();
+  try {
+    ::decode(op, iter);
+  } catch (buffer::error& err) {
+    CLS_LOG(1, "ERROR: rgw_bucket_set_resharding(): failed to decode request\n");
+    return -EINVAL;
+  }
+
+  struct rgw_bucket_dir_header header;
+  int rc = read_bucket_header(hctx, &header);
+  if (rc < 0) {
+    CLS_LOG(1, "ERROR: rgw_bucket_set_resharding(): failed to read header\n");
+    return rc;
+  }
+
+  header.reshard_status = op.status;
+
+  return write_bucket_header(hctx, &header);
+}
+
+/*
+ * Once a reshard moved the entries of this shard to the new index, changes
+ * to it would be lost; the gateway retries them on the new index.
+ */
+static int check_index_resharded(cls_method_context_t hctx, const char *func)
+{
+  struct rgw_bucket_dir_header header;
+  int rc = read_bucket_header(hctx, &header);
+  if (rc < 0) {
+    CLS_LOG(1, "ERROR: %s(): failed to read header\n", func);
+    return rc;
+  }
+  if (header.resharded()) {
+    CLS_LOG(10, "%s(): index shard was resharded\n", func);
+    return -ERR_BUSY_RESHARDING;
+  }
+  return 0;
+}
+
 static int read_key_entry(cls_method_context_t hctx, cls_rgw_obj_key& key, string *idx, struct rgw_bucket_dir_entry *entry,
                           bool special_delete_marker_name = false);
 
@@ -670,6 +715,14 @@ int rgw_bucket_prepare_op(cls_method_context_t hctx, bufferlist *in, bufferlist
     return rc;
   }
 
+  if (header.resharded()) {
+    return -ERR_BUSY_RESHARDING;
+  }
+  if (header.resharding()) {
+    /* the index is being copied to new shards, every change needs to be logged */
+    op.log_op = true;
+  }
+
   if (op.log_op) {
     rc = log_index_operation(hctx, op.key, op.op, op.tag, entry.meta.mtime,
                              entry.ver, info.state, header.ver, header.max_marker, op.bilog_flags);
@@ -762,68 +815,76 @@ static int read_key_entry(cls_method_context_t hctx, cls_rgw_obj_key& key, strin
   return 0;
 }
 
-int rgw_bucket_complete_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+/*
+ * Look up the index entry a completion refers to and check that it can be
+ * applied. Nothing is written, so a failing completion can be dropped
+ * without leaving anything behind.
+ */
+static int prepare_index_op(cls_method_context_t hctx, rgw_cls_obj_complete_op& op,
+                            struct rgw_bucket_dir_header& header, string *idx,
+                            struct rgw_bucket_dir_entry *entry, bool *ondisk, bool *cancel)
 {
-  // decode request
-  rgw_cls_obj_complete_op op;
-  bufferlist::iterator iter = in->begin();
-  try {
-    ::decode(op, iter);
-  } catch (buffer::error& err) {
-    CLS_LOG(1, "ERROR: rgw_bucket_complete_op(): failed to decode request\n");
-    return -EINVAL;
+  if (header.resharded()) {
+    return -ERR_BUSY_RESHARDING;
   }
-  CLS_LOG(1, "rgw_bucket_complete_op(): request: op=%d name=%s instance=%s ver=%lu:%llu tag=%s\n",
-          op.op, op.key.name.c_str(), op.key.instance.c_str(),
-          (unsigned long)op.ver.pool, (unsigned long long)op.ver.epoch,
-          op.tag.c_str());
-
-  struct rgw_bucket_dir_header header;
-  int rc = read_bucket_header(hctx, &header);
-  if (rc < 0) {
-    CLS_LOG(1, "ERROR: rgw_bucket_complete_op(): failed to read header\n");
-    return -EINVAL;
+  if (header.resharding()) {
+    /* the index is being copied to new shards, every change needs to be logged */
+    op.log_op = true;
   }
 
-  struct rgw_bucket_dir_entry entry;
-  bool ondisk = true;
-
-  string idx;
-  rc = read_key_entry(hctx, op.key, &idx, &entry);
+  *ondisk = true;
+  int rc = read_key_entry(hctx, op.key, idx, entry);
   if (rc == -ENOENT) {
-    entry.key = op.key;
-    entry.ver = op.ver;
-    entry.meta = op.meta;
-    entry.locator = op.locator;
-    ondisk = false;
+    entry->key = op.key;
+    entry->ver = op.ver;
+    entry->meta = op.meta;
+    entry->locator = op.locator;
+    *ondisk = false;
   } else if (rc < 0) {
     return rc;
   }
 
-  entry.index_ver = header.ver;
-  entry.flags = 0; /* resetting entry flags, entry might have been previously a delete marker */
+  entry->index_ver = header.ver;
+  entry->flags = 0; /* resetting entry flags, entry might have been previously a delete marker */
 
   if (op.tag.size()) {
-    map<string, struct rgw_bucket_pending_info>::iterator pinter = entry.pending_map.find(op.tag);
-    if (pinter == entry.pending_map.end()) {
+    map<string, struct rgw_bucket_pending_info>::iterator pinter = entry->pending_map.find(op.tag);
+    if (pinter == entry->pending_map.end()) {
       CLS_LOG(1, "ERROR: couldn't find tag for pending operation\n");
       return -EINVAL;
     }
-    entry.pending_map.erase(pinter);
+    entry->pending_map.erase(pinter);
   }
 
-  bool cancel = false;
-  bufferlist update_bl;
-
+  *cancel = false;
   if (op.tag.size() && op.op == CLS_RGW_OP_CANCEL) {
     CLS_LOG(1, "rgw_bucket_complete_op(): cancel requested\n");
-    cancel = true;
-  } else if (op.ver.pool == entry.ver.pool &&
-             op.ver.epoch && op.ver.epoch <= entry.ver.epoch) {
+    *cancel = true;
+  } else if (op.ver.pool == entry->ver.pool &&
+             op.ver.epoch && op.ver.epoch <= entry->ver.epoch) {
     CLS_LOG(1, "rgw_bucket_complete_op(): skipping request, old epoch\n");
-    cancel = true;
+    *cancel = true;
+  }
+
+  if (!*cancel && op.op == CLS_RGW_OP_DEL && !*ondisk) {
+    return -ENOENT;
   }
 
+  return 0;
+}
+
+/*
+ * Apply a completion that prepare_index_op() accepted. The header is only
+ * updated in memory, *modified is set if the caller needs to write it.
+ */
+static int apply_index_op(cls_method_context_t hctx, rgw_cls_obj_complete_op& op,
+                          struct rgw_bucket_dir_header& header, const string& idx,
+                          struct rgw_bucket_dir_entry& entry, bool cancel, bool *modified)
+{
+  int rc;
+
+  *modified = false;
+
   bufferlist op_bl;
   if (cancel) {
     if (op.log_op) {
@@ -849,21 +910,17 @@ int rgw_bucket_complete_op(cls_method_context_t hctx, bufferlist *in, bufferlist
   entry.ver = op.ver;
   switch ((int)op.op) {
   case CLS_RGW_OP_DEL:
-    if (ondisk) {
-      if (!entry.pending_map.size()) {
-	int ret = cls_cxx_map_remove_key(hctx, idx);
-	if (ret < 0)
-	  return ret;
-      } else {
-        entry.exists = false;
-        bufferlist new_key_bl;
-        ::encode(entry, new_key_bl);
-	int ret = cls_cxx_map_set_val(hctx, idx, &new_key_bl);
-	if (ret < 0)
-	  return ret;
-      }
+    if (!entry.pending_map.size()) {
+      int ret = cls_cxx_map_remove_key(hctx, idx);
+      if (ret < 0)
+	return ret;
     } else {
-      return -ENOENT;
+      entry.exists = false;
+      bufferlist new_key_bl;
+      ::encode(entry, new_key_bl);
+      int ret = cls_cxx_map_set_val(hctx, idx, &new_key_bl);
+      if (ret < 0)
+	return ret;
     }
     break;
   case CLS_RGW_OP_ADD:
@@ -925,9 +982,139 @@ int rgw_bucket_complete_op(cls_method_context_t hctx, bufferlist *in, bufferlist
     }
   }
 
+  *modified = true;
+  return 0;
+}
+
+static int complete_index_op(cls_method_context_t hctx, rgw_cls_obj_complete_op& op,
+                             struct rgw_bucket_dir_header& header, bool *modified)
+{
+  string idx;
+  struct rgw_bucket_dir_entry entry;
+  bool ondisk, cancel;
+
+  *modified = false;
+  int rc = prepare_index_op(hctx, op, header, &idx, &entry, &ondisk, &cancel);
+  if (rc < 0)
+    return rc;
+  return apply_index_op(hctx, op, header, idx, entry, cancel, modified);
+}
+
+int rgw_bucket_complete_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  // decode request
+  rgw_cls_obj_complete_op op;
+  bufferlist::iterator iter = in->begin();
+  try {
+    ::decode(op, iter);
+  } catch (buffer::error& err) {
+    CLS_LOG(1, "ERROR: rgw_bucket_complete_op(): failed to decode request\n");
+    return -EINVAL;
+  }
+  CLS_LOG(1, "rgw_bucket_complete_op(): request: op=%d name=%s instance=%s ver=%lu:%llu tag=%s\n",
+          op.op, op.key.name.c_str(), op.key.instance.c_str(),
+          (unsigned long)op.ver.pool, (unsigned long long)op.ver.epoch,
+          op.tag.c_str());
+
+  struct rgw_bucket_dir_header header;
+  int rc = read_bucket_header(hctx, &header);
+  if (rc < 0) {
+    CLS_LOG(1, "ERROR: rgw_bucket_complete_op(): failed to read header\n");
+    return -EINVAL;
+  }
+
+  bool modified;
+  rc = complete_index_op(hctx, op, header, &modified);
+  if (rc < 0 || !modified)
+    return rc;
+
   return write_bucket_header(hctx, &header);
 }
 
+/*
+ * Apply a batch of completions with a single read and write of the header,
+ * as if they were sent one after the other. Writes aren't visible to reads
+ * within the same call, so the ops must all refer to different entries. A
+ * completion that fails is skipped, like it would have been on its own.
+ */
+int rgw_bucket_complete_ops(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  rgw_cls_obj_complete_ops batch;
+  bufferlist::iterator iter = in->begin();
+  try {
+    ::decode(batch, iter);
+  } catch (buffer::error& err) {
+    CLS_LOG(1, "ERROR: rgw_bucket_complete_ops(): failed to decode request\n");
+    return -EINVAL;
+  }
+  CLS_LOG(10, "rgw_bucket_complete_ops(): request: %d ops\n", (int)batch.ops.size());
+
+  set<cls_rgw_obj_key> keys;
+  list<rgw_cls_obj_complete_op>::iterator oiter;
+  for (oiter = batch.ops.begin(); oiter != batch.ops.end(); ++oiter) {
+    if (!keys.insert(oiter->key).second) {
+      CLS_LOG(1, "ERROR: rgw_bucket_complete_ops(): duplicate key name=%s instance=%s\n",
+              oiter->key.name.c_str(), oiter->key.instance.c_str());
+      return -EINVAL;
+    }
+    list<cls_rgw_obj_key>::iterator kiter;
+    for (kiter = oiter->remove_objs.begin(); kiter != oiter->remove_objs.end(); ++kiter) {
+      if (!keys.insert(*kiter).second) {
+        CLS_LOG(1, "ERROR: rgw_bucket_complete_ops(): duplicate key name=%s instance=%s\n",
+                kiter->name.c_str(), kiter->instance.c_str());
+        return -EINVAL;
+      }
+    }
+  }
+
+  struct rgw_bucket_dir_header header;
+  int rc = read_bucket_header(hctx, &header);
+  if (rc < 0) {
+    CLS_LOG(1, "ERROR: rgw_bucket_complete_ops(): failed to read header\n");
+    return -EINVAL;
+  }
+  if (header.resharded()) {
+    /* the whole batch goes to the new index */
+    return -ERR_BUSY_RESHARDING;
+  }
+
+  bool write_header = false;
+  for (oiter = batch.ops.begin(); oiter != batch.ops.end(); ++oiter) {
+    rgw_cls_obj_complete_op& op = *oiter;
+    string idx;
+    struct rgw_bucket_dir_entry entry;
+    bool ondisk, cancel, modified;
+    rc = prepare_index_op(hctx, op, header, &idx, &entry, &ondisk, &cancel);
+    if (rc < 0) {
+      /* nothing was changed for this op, the rest can still go in */
+      CLS_LOG(1, "rgw_bucket_complete_ops(): op=%d name=%s instance=%s returned %d, skipping\n",
+              op.op, op.key.name.c_str(), op.key.instance.c_str(), rc);
+      continue;
+    }
+    rc = apply_index_op(hctx, op, header, idx, entry, cancel, &modified);
+    if (rc < 0) {
+      /* the op is half applied; failing the whole batch drops everything it
+       * wrote, and the gateway sends the ops again one at a time */
+      CLS_LOG(1, "ERROR: rgw_bucket_complete_ops(): op=%d name=%s instance=%s failed to apply, returned %d\n",
+              op.op, op.key.name.c_str(), op.key.instance.c_str(), rc);
+      return rc;
+    }
+    if (modified || op.log_op) {
+      /* every op sees the index version it would have seen on its own, so
+       * that its bilog entry gets its own key */
+      header.ver++;
+      write_header = true;
+    }
+  }
+
+  if (!write_header)
+    return 0;
+
+  bufferlist header_bl;
+  ::encode(header, header_bl);
+  return cls_cxx_map_write_header(hctx, &header_bl);
+}
+
 template <class T>
 static int write_entry(cls_method_context_t hctx, T& entry, const string& key)
 {
@@ -1353,11 +1540,16 @@ static int rgw_bucket_link_olh(cls_method_context_t hctx, bufferlist *in, buffer
     return -EINVAL;
   }
 
+  int ret = check_index_resharded(hctx, __func__);
+  if (ret < 0) {
+    return ret;
+  }
+
   BIVerObjEntry obj(hctx, op.key);
   BIOLHEntry olh(hctx, op.key);
 
   /* read instance entry */
-  int ret = obj.init(op.delete_marker);
+  ret = obj.init(op.delete_marker);
   bool existed = (ret == 0);
   if (ret == -ENOENT && op.delete_marker) {
     ret = 0;
@@ -1480,6 +1672,11 @@ static int rgw_bucket_link_olh(cls_method_context_t hctx, bufferlist *in, buffer
     return ret;
   }
 
+  if (header.resharding()) {
+    /* the index is being copied to new shards, every change needs to be logged */
+    op.log_op = true;
+  }
+
   if (op.log_op) {
     rgw_bucket_dir_entry& entry = obj.get_dir_entry();
 
@@ -1512,6 +1709,11 @@ static int rgw_bucket_unlink_instance(cls_method_context_t hctx, bufferlist *in,
     return -EINVAL;
   }
 
+  int ret = check_index_resharded(hctx, __func__);
+  if (ret < 0) {
+    return ret;
+  }
+
   cls_rgw_obj_key dest_key = op.key;
   if (dest_key.instance == "null") {
     dest_key.instance.clear();
@@ -1520,7 +1722,7 @@ static int rgw_bucket_unlink_instance(cls_method_context_t hctx, bufferlist *in,
   BIVerObjEntry obj(hctx, dest_key);
   BIOLHEntry olh(hctx, dest_key);
 
-  int ret = obj.init();
+  ret = obj.init();
   if (ret == -ENOENT) {
     return 0; /* already removed */
   }
@@ -1612,6 +1814,11 @@ static int rgw_bucket_unlink_instance(cls_method_context_t hctx, bufferlist *in,
     return ret;
   }
 
+  if (header.resharding()) {
+    /* the index is being copied to new shards, every change needs to be logged */
+    op.log_op = true;
+  }
+
   if (op.log_op) {
     rgw_bucket_entry_ver ver;
     ver.epoch = (op.olh_epoch ? op.olh_epoch : olh.get_epoch());
@@ -1698,11 +1905,16 @@ static int rgw_bucket_trim_olh_log(cls_method_context_t hctx, bufferlist *in, bu
     return -EINVAL;
   }
 
+  int ret = check_index_resharded(hctx, __func__);
+  if (ret < 0) {
+    return ret;
+  }
+
   /* read olh entry */
   struct rgw_bucket_olh_entry olh_data_entry;
   string olh_data_key;
   encode_olh_data_key(op.olh, &olh_data_key);
-  int ret = read_index_entry(hctx, olh_data_key, &olh_data_entry);
+  ret = read_index_entry(hctx, olh_data_key, &olh_data_entry);
   if (ret < 0 && ret != -ENOENT) {
     CLS_LOG(0, "ERROR: read_index_entry() olh_key=%s ret=%d", olh_data_key.c_str(), ret);
     return ret;
@@ -1749,11 +1961,16 @@ static int rgw_bucket_clear_olh(cls_method_context_t hctx, bufferlist *in, buffe
     return -EINVAL;
   }
 
+  int ret = check_index_resharded(hctx, __func__);
+  if (ret < 0) {
+    return ret;
+  }
+
   /* read olh entry */
   struct rgw_bucket_olh_entry olh_data_entry;
   string olh_data_key;
   encode_olh_data_key(op.key, &olh_data_key);
-  int ret = read_index_entry(hctx, olh_data_key, &olh_data_entry);
+  ret = read_index_entry(hctx, olh_data_key, &olh_data_entry);
   if (ret < 0 && ret != -ENOENT) {
     CLS_LOG(0, "ERROR: read_index_entry() olh_key=%s ret=%d", olh_data_key.c_str(), ret);
     return ret;
@@ -1811,6 +2028,9 @@ int rgw_dir_suggest_changes(cls_method_context_t hctx, bufferlist *in, bufferlis
     CLS_LOG(1, "ERROR: rgw_dir_suggest_changes(): failed to read header\n");
     return rc;
   }
+  if (header.resharded()) {
+    return -ERR_BUSY_RESHARDING;
+  }
 
   tag_timeout = (header.tag_timeout ? header.tag_timeout : CEPH_RGW_TAG_TIMEOUT);
 
@@ -2081,6 +2301,7 @@ static int rgw_bi_put_op(cls_method_context_t hctx, bufferlist *in, bufferlist *
   int r = cls_cxx_map_set_val(hctx, entry.idx, &entry.data);
   if (r < 0) {
     CLS_LOG(0, "ERROR: %s(): cls_cxx_map_set_val() returned r=%d", __func__, r);
+    return r;
   }
 
   return 0;
@@ -2143,13 +2364,15 @@ static int list_instance_entries(cls_method_context_t hctx, const string& name,
   string first_instance_idx;
   encode_obj_versioned_data_key(key, &first_instance_idx);
   string start_key = first_instance_idx;
-  if (bi_entry_gt(marker, start_key)) {
+  bool started = true;
+  if (!marker.empty() && !bi_entry_gt(start_key, marker)) {
+    /* resume right after the marker */
     start_key = marker;
+    started = false;
   }
   int count = 0;
   map<string, bufferlist> keys;
   string filter = first_instance_idx;
-  bool started = true;
   do {
     if (count >= (int)max) {
       return count;
@@ -2203,6 +2426,69 @@ static int list_instance_entries(cls_method_context_t hctx, const string& name,
   return count;
 }
 
+/*
+ * list the raw index entries of all objects, in key order, skipping the bucket
+ * index log
+ */
+static int list_all_entries(cls_method_context_t hctx, const string& marker, uint32_t max,
+                            list<rgw_cls_bi_entry> *entries, bool *is_truncated)
+{
+  string start_key = marker;
+  string log_end_key;
+  log_end_key = BI_PREFIX_CHAR;
+  log_end_key.append(bucket_index_prefixes[BI_BUCKET_LOG_INDEX]);
+  log_end_key.append(1, (char)0xff);
+
+  int count = 0;
+  map<string, bufferlist> keys;
+  *is_truncated = false;
+  do {
+    keys.clear();
+    int ret = cls_cxx_map_get_vals(hctx, start_key, string(), BI_GET_NUM_KEYS, &keys);
+    if (ret < 0) {
+      return ret;
+    }
+
+    map<string, bufferlist>::iterator iter;
+    for (iter = keys.begin(); iter != keys.end(); ++iter) {
+      if (count >= (int)max) {
+        *is_truncated = true;
+        return count;
+      }
+
+      int type = bi_entry_type(iter->first);
+      if (type == BI_BUCKET_LOG_INDEX) {
+        /* jump over the rest of the log */
+        start_key = log_end_key;
+        break;
+      }
+      start_key = iter->first;
+
+      rgw_cls_bi_entry entry;
+      switch (type) {
+        case BI_BUCKET_OBJS_INDEX:
+          entry.type = PlainIdx;
+          break;
+        case BI_BUCKET_OBJ_INSTANCE_INDEX:
+          entry.type = InstanceIdx;
+          break;
+        case BI_BUCKET_OLH_DATA_INDEX:
+          entry.type = OLHIdx;
+          break;
+        default:
+          CLS_LOG(10, "%s(): skipping unknown key %s", __func__, escape_str(iter->first).c_str());
+          continue;
+      }
+      entry.idx = iter->first;
+      entry.data = iter->second;
+      entries->push_back(entry);
+      count++;
+    }
+  } while (!keys.empty());
+
+  return count;
+}
+
 static int rgw_bi_list_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 {
   // decode request
@@ -2221,6 +2507,17 @@ static int rgw_bi_list_op(cls_method_context_t hctx, bufferlist *in, bufferlist
 #define MAX_BI_LIST_ENTRIES 1000
   int32_t max = (op.max < MAX_BI_LIST_ENTRIES ? op.max : MAX_BI_LIST_ENTRIES);
   string start_key = op.marker;
+
+  if (op.name.empty()) {
+    int ret = list_all_entries(hctx, op.marker, max, &op_ret.entries, &op_ret.is_truncated);
+    if (ret < 0) {
+      CLS_LOG(0, "ERROR: %s(): list_all_entries retured ret=%d", __func__, ret);
+      return ret;
+    }
+    ::encode(op_ret, *out);
+    return 0;
+  }
+
   int ret = list_plain_entries(hctx, op.name, op.marker, max, &op_ret.entries);
   if (ret < 0) {
     CLS_LOG(0, "ERROR: %s(): list_plain_entries retured ret=%d", __func__, ret);
@@ -2233,17 +2530,21 @@ static int rgw_bi_list_op(cls_method_context_t hctx, bufferlist *in, bufferlist
     CLS_LOG(0, "ERROR: %s(): list_instance_entries retured ret=%d", __func__, ret);
     return ret;
   }
+  count += ret;
+  op_ret.is_truncated = (count >= max);
 
-  cls_rgw_obj_key key(op.name);
-  rgw_cls_bi_entry entry;
-  encode_olh_data_key(key, &entry.idx);
-  ret = cls_cxx_map_get_val(hctx, entry.idx, &entry.data);
-  if (ret < 0 && ret != -ENOENT) {
-    CLS_LOG(0, "ERROR: %s(): cls_cxx_map_get_val retured ret=%d", __func__, ret);
-    return ret;
-  } else if (ret >= 0) {
-    entry.type = OLHIdx;
-    op_ret.entries.push_back(entry);
+  if (!op_ret.is_truncated) {
+    cls_rgw_obj_key key(op.name);
+    rgw_cls_bi_entry entry;
+    encode_olh_data_key(key, &entry.idx);
+    ret = cls_cxx_map_get_val(hctx, entry.idx, &entry.data);
+    if (ret < 0 && ret != -ENOENT) {
+      CLS_LOG(0, "ERROR: %s(): cls_cxx_map_get_val retured ret=%d", __func__, ret);
+      return ret;
+    } else if (ret >= 0) {
+      entry.type = OLHIdx;
+      op_ret.entries.push_back(entry);
+    }
   }
 
   ::encode(op_ret, *out);
@@ -3051,11 +3352,13 @@ void __cls_init()
   /* bucket index */
   cls_register_cxx_method(h_class, "bucket_init_index", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_init_index, &h_rgw_bucket_init_index);
   cls_register_cxx_method(h_class, "bucket_set_tag_timeout", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_set_tag_timeout, &h_rgw_bucket_set_tag_timeout);
+  cls_register_cxx_method(h_class, "bucket_set_resharding", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_set_resharding, &h_rgw_bucket_set_resharding);
   cls_register_cxx_method(h_class, "bucket_list", CLS_METHOD_RD, rgw_bucket_list, &h_rgw_bucket_list);
   cls_register_cxx_method(h_class, "bucket_check_index", CLS_METHOD_RD, rgw_bucket_check_index, &h_rgw_bucket_check_index);
   cls_register_cxx_method(h_class, "bucket_rebuild_index", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_rebuild_index, &h_rgw_bucket_rebuild_index);
   cls_register_cxx_method(h_class, "bucket_prepare_op", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_prepare_op, &h_rgw_bucket_prepare_op);
   cls_register_cxx_method(h_class, "bucket_complete_op", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_complete_op, &h_rgw_bucket_complete_op);
+  cls_register_cxx_method(h_class, "bucket_complete_ops", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_complete_ops, &h_rgw_bucket_complete_ops);
   cls_register_cxx_method(h_class, "bucket_link_olh", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_link_olh, &h_rgw_bucket_link_olh);
   cls_register_cxx_method(h_class, "bucket_unlink_instance", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_unlink_instance, &h_rgw_bucket_unlink_instance_op);
   cls_register_cxx_method(h_class, "bucket_read_olh_log", CLS_METHOD_RD, rgw_bucket_read_olh_log, &h_rgw_bucket_read_olh_log);
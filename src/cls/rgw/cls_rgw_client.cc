@@ -138,6 +138,23 @@ int CLSRGWIssueSetTagTimeout::issue_op(int shard_id, const string& oid)
   return issue_bucket_set_tag_timeout_op(io_ctx, oid, tag_timeout, &manager);
 }
 
+static bool issue_bucket_set_resharding_op(librados::IoCtx& io_ctx,
+    const string& oid, uint8_t status, BucketIndexAioManager *manager) {
+  bufferlist in;
+  struct rgw_cls_set_resharding_op call;
+  call.status = status;
+  ::encode(call, in);
+  ObjectWriteOperation op;
+  op.assert_exists();
+  op.exec("rgw", "bucket_set_resharding", in);
+  return manager->aio_operate(io_ctx, oid, &op);
+}
+
+int CLSRGWIssueSetBucketResharding::issue_op(int shard_id, const string& oid)
+{
+  return issue_bucket_set_resharding_op(io_ctx, oid, status, &manager);
+}
+
 void cls_rgw_bucket_prepare_op(ObjectWriteOperation& o, RGWModifyOp op, string& tag,
                                const cls_rgw_obj_key& key, const string& locator, bool log_op,
                                uint16_t bilog_flags)
@@ -177,16 +194,26 @@ void cls_rgw_bucket_complete_op(ObjectWriteOperation& o, RGWModifyOp op, string&
   o.exec("rgw", "bucket_complete_op", in);
 }
 
+void cls_rgw_bucket_complete_op(ObjectWriteOperation& o, const rgw_cls_obj_complete_op& call)
+{
+  bufferlist in;
+  ::encode(call, in);
+  o.exec("rgw", "bucket_complete_op", in);
+}
+
+void cls_rgw_bucket_complete_ops(ObjectWriteOperation& o, const list<rgw_cls_obj_complete_op>& ops)
+{
+  bufferlist in;
+  struct rgw_cls_obj_complete_ops call;
+  call.ops = ops;
+  ::encode(call, in);
+  o.exec("rgw", "bucket_complete_ops", in);
+}
+
 static bool issue_bucket_list_op(librados::IoCtx& io_ctx,
-    const string& oid, const cls_rgw_obj_key& start_obj, const string& filter_prefix,
-    uint32_t num_entries, bool list_versions, BucketIndexAioManager *manager,
+    const string& oid, const struct rgw_cls_list_op& call, BucketIndexAioManager *manager,
     struct rgw_cls_list_ret *pdata) {
   bufferlist in;
-  struct rgw_cls_list_op call;
-  call.start_obj = start_obj;
-  call.filter_prefix = filter_prefix;
-  call.num_entries = num_entries;
-  call.list_versions = list_versions;
   ::encode(call, in);
 
   librados::ObjectReadOperation op;
@@ -196,7 +223,17 @@ static bool issue_bucket_list_op(librados::IoCtx& io_ctx,
 
 int CLSRGWIssueBucketList::issue_op(int shard_id, const string& oid)
 {
-  return issue_bucket_list_op(io_ctx, oid, start_obj, filter_prefix, num_entries, list_versions, &manager, &result[shard_id]);
+  struct rgw_cls_list_op call;
+  call.start_obj = start_obj;
+  call.filter_prefix = filter_prefix;
+  call.num_entries = num_entries;
+  call.list_versions = list_versions;
+  return issue_bucket_list_op(io_ctx, oid, call, &manager, &result[shard_id]);
+}
+
+int CLSRGWIssueBucketListShards::issue_op(int shard_id, const string& oid)
+{
+  return issue_bucket_list_op(io_ctx, oid, calls[shard_id], &manager, &result[shard_id]);
 }
 
 void cls_rgw_remove_obj(librados::ObjectWriteOperation& o, list<string>& keep_attr_prefixes)
@@ -257,6 +294,15 @@ int cls_rgw_bi_put(librados::IoCtx& io_ctx, const string oid, rgw_cls_bi_entry&
   return 0;
 }
 
+void cls_rgw_bi_put(librados::ObjectWriteOperation& op, rgw_cls_bi_entry& entry)
+{
+  bufferlist in;
+  struct rgw_cls_bi_put_op call;
+  call.entry = entry;
+  ::encode(call, in);
+  op.exec("rgw", "bi_put", in);
+}
+
 int cls_rgw_bi_list(librados::IoCtx& io_ctx, const string oid,
                    const string& name, const string& marker, uint32_t max,
                    list<rgw_cls_bi_entry> *entries, bool *is_truncated)
@@ -289,7 +335,7 @@ int cls_rgw_bucket_link_olh(librados::IoCtx& io_ctx, const string& oid, const cl
                             bool delete_marker, const string& op_tag, struct rgw_bucket_dir_entry_meta *meta,
                             uint64_t olh_epoch, bool log_op)
 {
-  bufferlist in, out;
+  bufferlist in;
   struct rgw_cls_link_olh_op call;
   call.key = key;
   call.olh_tag = string(olh_tag.c_str(), olh_tag.length());
@@ -301,7 +347,11 @@ int cls_rgw_bucket_link_olh(librados::IoCtx& io_ctx, const string& oid, const cl
   call.olh_epoch = olh_epoch;
   call.log_op = log_op;
   ::encode(call, in);
-  int r = io_ctx.exec(oid, "rgw", "bucket_link_olh", in, out);
+  librados::ObjectWriteOperation op;
+  /* don't recreate an index shard that was removed by a reshard */
+  op.assert_exists();
+  op.exec("rgw", "bucket_link_olh", in);
+  int r = io_ctx.operate(oid, &op);
   if (r < 0)
     return r;
 
@@ -312,14 +362,17 @@ int cls_rgw_bucket_unlink_instance(librados::IoCtx& io_ctx, const string& oid,
                                    const cls_rgw_obj_key& key, const string& op_tag,
                                    uint64_t olh_epoch, bool log_op)
 {
-  bufferlist in, out;
+  bufferlist in;
   struct rgw_cls_unlink_instance_op call;
   call.key = key;
   call.op_tag = op_tag;
   call.olh_epoch = olh_epoch;
   call.log_op = log_op;
   ::encode(call, in);
-  int r = io_ctx.exec(oid, "rgw", "bucket_unlink_instance", in, out);
+  librados::ObjectWriteOperation op;
+  op.assert_exists();
+  op.exec("rgw", "bucket_unlink_instance", in);
+  int r = io_ctx.operate(oid, &op);
   if (r < 0)
     return r;
 
@@ -383,6 +436,7 @@ int cls_rgw_clear_olh(IoCtx& io_ctx, string& oid, const cls_rgw_obj_key& olh, co
   call.olh_tag = olh_tag;
   ::encode(call, in);
   librados::ObjectWriteOperation op;
+  op.assert_exists();
   int op_ret;
   op.exec("rgw", "bucket_clear_olh", in, &out, &op_ret);
   int r = io_ctx.operate(oid, &op);
@@ -469,8 +523,8 @@ void cls_rgw_suggest_changes(ObjectWriteOperation& o, bufferlist& updates)
 
 int CLSRGWIssueGetDirHeader::issue_op(int shard_id, const string& oid)
 {
-  cls_rgw_obj_key nokey;
-  return issue_bucket_list_op(io_ctx, oid, nokey, "", 0, false, &manager, &result[shard_id]);
+  struct rgw_cls_list_op call; /* no entries, just the header */
+  return issue_bucket_list_op(io_ctx, oid, call, &manager, &result[shard_id]);
 }
 
 class GetDirHeaderCompletion : public ObjectOperationCompletion {
@@ -619,6 +673,14 @@ int cls_rgw_gc_list(IoCtx& io_ctx, string& oid, string& marker, uint32_t max, bo
  return r;
 }
 
+void cls_rgw_gc_list_marker(const cls_rgw_gc_obj_info& info, string *marker)
+{
+  /* same format as the time index keys of the gc objects */
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%011llu.%09u", (unsigned long long)info.time.sec(), info.time.nsec());
+  *marker = buf;
+}
+
 void cls_rgw_gc_remove(librados::ObjectWriteOperation& op, const list<string>& tags)
 {
   bufferlist in;
@@ -302,6 +302,22 @@ public:
     CLSRGWConcurrentIO(ioc, _bucket_objs, _max_aio), tag_timeout(_tag_timeout) {}
 };
 
+/**
+ * Set the reshard status (cls_rgw_reshard_status) of the bucket index shards.
+ * All changes to a shard that is being resharded are written to its bucket
+ * index log, and changes to a shard that was resharded are refused with
+ * ERR_BUSY_RESHARDING.
+ */
+class CLSRGWIssueSetBucketResharding : public CLSRGWConcurrentIO {
+  uint8_t status;
+protected:
+  int issue_op(int shard_id, const string& oid);
+public:
+  CLSRGWIssueSetBucketResharding(librados::IoCtx& ioc, map<int, string>& _bucket_objs,
+                                 uint32_t _max_aio, uint8_t _status) :
+    CLSRGWConcurrentIO(ioc, _bucket_objs, _max_aio), status(_status) {}
+};
+
 void cls_rgw_bucket_prepare_op(librados::ObjectWriteOperation& o, RGWModifyOp op, string& tag,
                                const cls_rgw_obj_key& key, const string& locator, bool log_op,
                                uint16_t bilog_op);
@@ -312,6 +328,13 @@ void cls_rgw_bucket_complete_op(librados::ObjectWriteOperation& o, RGWModifyOp o
                                 rgw_bucket_dir_entry_meta& dir_meta,
 				list<cls_rgw_obj_key> *remove_objs, bool log_op,
                                 uint16_t bilog_op);
+void cls_rgw_bucket_complete_op(librados::ObjectWriteOperation& o, const rgw_cls_obj_complete_op& call);
+/*
+ * Apply several completions with a single call, they must all refer to
+ * different entries of the index shard. Needs osds that support
+ * bucket_complete_ops, -EOPNOTSUPP otherwise.
+ */
+void cls_rgw_bucket_complete_ops(librados::ObjectWriteOperation& o, const list<rgw_cls_obj_complete_op>& ops);
 
 void cls_rgw_remove_obj(librados::ObjectWriteOperation& o, list<string>& keep_attr_prefixes);
 void cls_rgw_obj_check_attrs_prefix(librados::ObjectOperation& o, const string& prefix, bool fail_if_exist);
@@ -320,6 +343,7 @@ int cls_rgw_bi_get(librados::IoCtx& io_ctx, const string oid,
                    BIIndexType index_type, cls_rgw_obj_key& key,
                    rgw_cls_bi_entry *entry);
 int cls_rgw_bi_put(librados::IoCtx& io_ctx, const string oid, rgw_cls_bi_entry& entry);
+void cls_rgw_bi_put(librados::ObjectWriteOperation& op, rgw_cls_bi_entry& entry);
 int cls_rgw_bi_list(librados::IoCtx& io_ctx, const string oid,
                    const string& name, const string& marker, uint32_t max,
                    list<rgw_cls_bi_entry> *entries, bool *is_truncated);
@@ -372,6 +396,31 @@ public:
   start_obj(_start_obj), filter_prefix(_filter_prefix), num_entries(_num_entries), list_versions(_list_versions), result(list_results) {}
 };
 
+/*
+ * List the given bucket index shards, each one with its own listing request
+ * (start marker and number of entries).
+ *
+ * io_ctx        - IO context for rados.
+ * calls         - the listing requests keyed by shard id.
+ * oids          - the bucket index objects to list, keyed by shard id.
+ * list_results  - the list results keyed by shard id.
+ * max_aio       - the maximum number of AIO (for throttling).
+ *
+ * Return 0 on success, a failure code otherwise.
+ */
+class CLSRGWIssueBucketListShards : public CLSRGWConcurrentIO {
+  map<int, rgw_cls_list_op>& calls;
+  map<int, rgw_cls_list_ret>& result;
+protected:
+  int issue_op(int shard_id, const string& oid);
+public:
+  CLSRGWIssueBucketListShards(librados::IoCtx& io_ctx, map<int, rgw_cls_list_op>& _calls,
+                              map<int, string>& oids,
+                              map<int, struct rgw_cls_list_ret>& list_results,
+                              uint32_t max_aio) :
+  CLSRGWConcurrentIO(io_ctx, oids, max_aio), calls(_calls), result(list_results) {}
+};
+
 class CLSRGWIssueBILogList : public CLSRGWConcurrentIO {
   map<int, struct cls_rgw_bi_log_list_ret>& result;
   BucketIndexShardsManager& marker_mgr;
@@ -467,6 +516,8 @@ void cls_rgw_gc_defer_entry(librados::ObjectWriteOperation& op, uint32_t expirat
 
 int cls_rgw_gc_list(librados::IoCtx& io_ctx, string& oid, string& marker, uint32_t max, bool expired_only,
                     list<cls_rgw_gc_obj_info>& entries, bool *truncated);
+/* marker for listing the entries that follow a listed entry */
+void cls_rgw_gc_list_marker(const cls_rgw_gc_obj_info& info, string *marker);
 
 void cls_rgw_gc_remove(librados::ObjectWriteOperation& op, const list<string>& tags);
 
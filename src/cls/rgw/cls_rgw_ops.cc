@@ -16,6 +16,18 @@ void rgw_cls_tag_timeout_op::generate_test_instances(list<rgw_cls_tag_timeout_op
   ls.back()->tag_timeout = 23323;
 }
 
+void rgw_cls_set_resharding_op::dump(Formatter *f) const
+{
+  f->dump_int("status", status);
+}
+
+void rgw_cls_set_resharding_op::generate_test_instances(list<rgw_cls_set_resharding_op*>& ls)
+{
+  ls.push_back(new rgw_cls_set_resharding_op);
+  ls.push_back(new rgw_cls_set_resharding_op);
+  ls.back()->status = CLS_RGW_RESHARD_IN_PROGRESS;
+}
+
 void cls_rgw_gc_set_entry_op::dump(Formatter *f) const
 {
   f->dump_unsigned("expiration_secs", expiration_secs);
@@ -146,6 +158,25 @@ void rgw_cls_obj_complete_op::dump(Formatter *f) const
   f->dump_int("bilog_flags", bilog_flags);
 }
 
+void rgw_cls_obj_complete_ops::generate_test_instances(list<rgw_cls_obj_complete_ops*>& o)
+{
+  rgw_cls_obj_complete_ops *ops = new rgw_cls_obj_complete_ops;
+  list<rgw_cls_obj_complete_op *> l;
+  rgw_cls_obj_complete_op::generate_test_instances(l);
+  for (list<rgw_cls_obj_complete_op *>::iterator iter = l.begin(); iter != l.end(); ++iter) {
+    ops->ops.push_back(**iter);
+    delete *iter;
+  }
+  o.push_back(ops);
+
+  o.push_back(new rgw_cls_obj_complete_ops);
+}
+
+void rgw_cls_obj_complete_ops::dump(Formatter *f) const
+{
+  encode_json("ops", ops, f);
+}
+
 void rgw_cls_link_olh_op::generate_test_instances(list<rgw_cls_link_olh_op*>& o)
 {
   rgw_cls_link_olh_op *op = new rgw_cls_link_olh_op;
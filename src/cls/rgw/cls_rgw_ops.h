@@ -27,6 +27,27 @@ struct rgw_cls_tag_timeout_op
 };
 WRITE_CLASS_ENCODER(rgw_cls_tag_timeout_op)
 
+struct rgw_cls_set_resharding_op
+{
+  uint8_t status; /* cls_rgw_reshard_status */
+
+  rgw_cls_set_resharding_op() : status(CLS_RGW_RESHARD_NONE) {}
+
+  void encode(bufferlist &bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(status, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::iterator &bl) {
+    DECODE_START(1, bl);
+    ::decode(status, bl);
+    DECODE_FINISH(bl);
+  }
+  void dump(Formatter *f) const;
+  static void generate_test_instances(list<rgw_cls_set_resharding_op*>& ls);
+};
+WRITE_CLASS_ENCODER(rgw_cls_set_resharding_op)
+
 struct rgw_cls_obj_prepare_op
 {
   RGWModifyOp op;
@@ -155,6 +176,25 @@ struct rgw_cls_obj_complete_op
 };
 WRITE_CLASS_ENCODER(rgw_cls_obj_complete_op)
 
+struct rgw_cls_obj_complete_ops
+{
+  list<rgw_cls_obj_complete_op> ops;
+
+  void encode(bufferlist &bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(ops, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::iterator &bl) {
+    DECODE_START(1, bl);
+    ::decode(ops, bl);
+    DECODE_FINISH(bl);
+  }
+  void dump(Formatter *f) const;
+  static void generate_test_instances(list<rgw_cls_obj_complete_ops*>& o);
+};
+WRITE_CLASS_ENCODER(rgw_cls_obj_complete_ops)
+
 struct rgw_cls_link_olh_op {
   cls_rgw_obj_key key;
   string olh_tag;
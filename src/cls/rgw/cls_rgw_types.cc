@@ -211,6 +211,35 @@ void rgw_cls_bi_entry::decode_json(JSONObj *obj, cls_rgw_obj_key *effective_key)
   }
 }
 
+int rgw_cls_bi_entry::get_key(cls_rgw_obj_key *key)
+{
+  bufferlist::iterator iter = data.begin();
+  try {
+    switch (type) {
+      case PlainIdx:
+      case InstanceIdx:
+        {
+          rgw_bucket_dir_entry entry;
+          ::decode(entry, iter);
+          *key = entry.key;
+        }
+        break;
+      case OLHIdx:
+        {
+          rgw_bucket_olh_entry entry;
+          ::decode(entry, iter);
+          *key = entry.key;
+        }
+        break;
+      default:
+        return -EINVAL;
+    }
+  } catch (buffer::error& err) {
+    return -EIO;
+  }
+  return 0;
+}
+
 void rgw_cls_bi_entry::dump(Formatter *f) const
 {
   string type_str;
@@ -416,6 +445,7 @@ void rgw_bucket_dir_header::dump(Formatter *f) const
 {
   f->dump_int("ver", ver);
   f->dump_int("master_ver", master_ver);
+  f->dump_int("reshard_status", reshard_status);
   map<uint8_t, struct rgw_bucket_category_stats>::const_iterator iter = stats.begin();
   f->open_array_section("stats");
   for (; iter != stats.end(); ++iter) {
@@ -375,6 +375,9 @@ struct rgw_cls_bi_entry {
 
   void dump(Formatter *f) const;
   void decode_json(JSONObj *obj, cls_rgw_obj_key *effective_key = NULL);
+
+  /* decode the key of the object this entry belongs to */
+  int get_key(cls_rgw_obj_key *key);
 };
 WRITE_CLASS_ENCODER(rgw_cls_bi_entry)
 
@@ -539,22 +542,36 @@ struct rgw_bucket_category_stats {
 };
 WRITE_CLASS_ENCODER(rgw_bucket_category_stats)
 
+enum cls_rgw_reshard_status {
+  CLS_RGW_RESHARD_NONE        = 0,
+  CLS_RGW_RESHARD_IN_PROGRESS = 1, /* log all changes while the index is copied to new shards */
+  CLS_RGW_RESHARD_DONE        = 2, /* the entries live in the new shards, refuse all changes */
+};
+
+/* returned for changes to an index shard that was retired by a reshard */
+#define ERR_BUSY_RESHARDING 2300
+
 struct rgw_bucket_dir_header {
   map<uint8_t, rgw_bucket_category_stats> stats;
   uint64_t tag_timeout;
   uint64_t ver;
   uint64_t master_ver;
   string max_marker;
+  uint8_t reshard_status;
 
-  rgw_bucket_dir_header() : tag_timeout(0), ver(0), master_ver(0) {}
+  rgw_bucket_dir_header() : tag_timeout(0), ver(0), master_ver(0), reshard_status(CLS_RGW_RESHARD_NONE) {}
+
+  bool resharding() const { return reshard_status == CLS_RGW_RESHARD_IN_PROGRESS; }
+  bool resharded() const { return reshard_status == CLS_RGW_RESHARD_DONE; }
 
   void encode(bufferlist &bl) const {
-    ENCODE_START(5, 2, bl);
+    ENCODE_START(6, 2, bl);
     ::encode(stats, bl);
     ::encode(tag_timeout, bl);
     ::encode(ver, bl);
     ::encode(master_ver, bl);
     ::encode(max_marker, bl);
+    ::encode(reshard_status, bl);
     ENCODE_FINISH(bl);
   }
   void decode(bufferlist::iterator &bl) {
@@ -574,6 +591,11 @@ struct rgw_bucket_dir_header {
     if (struct_v >= 5) {
       ::decode(max_marker, bl);
     }
+    if (struct_v >= 6) {
+      ::decode(reshard_status, bl);
+    } else {
+      reshard_status = CLS_RGW_RESHARD_NONE;
+    }
     DECODE_FINISH(bl);
   }
   void dump(Formatter *f) const;
@@ -318,13 +318,18 @@ OPTION(client_tick_interval, OPT_DOUBLE, 1.0)
 OPTION(client_trace, OPT_STR, "")
 OPTION(client_readahead_min, OPT_LONGLONG, 128*1024)  // readahead at _least_ this much.
 OPTION(client_readahead_max_bytes, OPT_LONGLONG, 0)  //8 * 1024*1024
-OPTION(client_readahead_max_periods, OPT_LONGLONG, 4)  // as multiple of file layout period (object size * num stripes)
+OPTION(client_readahead_max_periods, OPT_LONGLONG, 0)  // as multiple of file layout period (object size * num stripes); readahead is off unless this or max_bytes is set
+OPTION(client_readahead_adaptive, OPT_BOOL, true)  // start each file's window at one stripe and grow it while sequential reads still wait on the osds
+OPTION(client_write_behind, OPT_BOOL, false)  // flush full stripe units behind a sequential writer, a stripe at a time
+OPTION(client_readdir_attr_prefetch, OPT_INT, 64)  // read the next N entries from the mds instead of the cache if half of the cached ones lack attr caps; 0 to disable
 OPTION(client_snapdir, OPT_STR, ".snap")
 OPTION(client_mountpoint, OPT_STR, "/")
 OPTION(client_notify_timeout, OPT_INT, 10) // in seconds
 OPTION(osd_client_watch_timeout, OPT_INT, 30) // in seconds
 OPTION(client_caps_release_delay, OPT_INT, 5) // in seconds
 OPTION(client_quota, OPT_BOOL, false)
+OPTION(client_async_dirops, OPT_BOOL, false)  // create/unlink without waiting for the mds when we hold Fx on the dir
+OPTION(client_cap_lease_ttl, OPT_FLOAT, 0)  // trust shared caps for this many seconds after hearing from the mds, so it needn't revoke them; 0 to disable
 OPTION(client_oc, OPT_BOOL, true)
 OPTION(client_oc_size, OPT_INT, 1024*1024* 200)    // MB * n
 OPTION(client_oc_max_dirty, OPT_INT, 1024*1024* 100)    // MB * n  (dirty OR tx.. bigish)
@@ -370,8 +375,11 @@ OPTION(mds_data, OPT_STR, "/var/lib/ceph/mds/$cluster-$id")
 OPTION(mds_max_file_size, OPT_U64, 1ULL << 40) // Used when creating new CephFS. Change with 'ceph mds set max_file_size <size>' afterwards
 OPTION(mds_cache_size, OPT_INT, 100000)
 OPTION(mds_cache_mid, OPT_FLOAT, .7)
+OPTION(mds_cache_memory_limit, OPT_U64, 0) // bytes; lowers mds_cache_size to fit (0 = off)
 OPTION(mds_max_file_recover, OPT_U32, 32)
 OPTION(mds_dir_max_commit_size, OPT_INT, 10) // MB
+OPTION(mds_dir_keys_per_op, OPT_INT, 16384) // max omap keys read or written by one dirfrag op
+OPTION(mds_dir_fetch_keys_min, OPT_INT, 10000) // lookups in dirs this big fetch just the wanted dentry (0 = off)
 OPTION(mds_decay_halflife, OPT_FLOAT, 5)
 OPTION(mds_beacon_interval, OPT_FLOAT, 4)
 OPTION(mds_beacon_grace, OPT_FLOAT, 15)
@@ -381,6 +389,9 @@ OPTION(mds_session_timeout, OPT_FLOAT, 60)    // cap bits and leases time out if
 OPTION(mds_sessionmap_keys_per_op, OPT_U32, 1024)    // how many sessions should I try to load/store in a single OMAP operation?
 OPTION(mds_revoke_cap_timeout, OPT_FLOAT, 60)    // detect clients which aren't revoking caps
 OPTION(mds_recall_state_timeout, OPT_FLOAT, 60)    // detect clients which aren't trimming caps
+OPTION(mds_cap_batch, OPT_BOOL, false)    // send a client's cap messages together, if it has the caps batch feature
+OPTION(mds_cap_batch_max, OPT_INT, 64)    // cap messages to one client sent together
+OPTION(mds_cap_lease_max_ttl, OPT_FLOAT, 30)    // longest cap lease a client may ask for; 0 to disable
 OPTION(mds_freeze_tree_timeout, OPT_FLOAT, 30)    // detecting freeze tree deadlock
 OPTION(mds_session_autoclose, OPT_FLOAT, 300) // autoclose idle session
 OPTION(mds_health_summarize_threshold, OPT_INT, 10) // collapse N-client health metrics to a single 'many'
@@ -390,6 +401,7 @@ OPTION(mds_tick_interval, OPT_FLOAT, 5)
 OPTION(mds_dirstat_min_interval, OPT_FLOAT, 1)    // try to avoid propagating more often than this
 OPTION(mds_scatter_nudge_interval, OPT_FLOAT, 5)  // how quickly dirstat changes propagate up the hierarchy
 OPTION(mds_client_prealloc_inos, OPT_INT, 1000)
+OPTION(mds_client_delegate_inos, OPT_INT, 500) // preallocated inos a client may hold for async creates
 OPTION(mds_early_reply, OPT_BOOL, true)
 OPTION(mds_default_dir_hash, OPT_INT, CEPH_STR_HASH_RJENKINS)
 OPTION(mds_log, OPT_BOOL, true)
@@ -400,6 +412,13 @@ OPTION(mds_log_segment_size, OPT_INT, 0)  // segment size for mds log,
 	      // defaults to g_default_file_layout.fl_object_size (4MB)
 OPTION(mds_log_max_segments, OPT_U32, 30)
 OPTION(mds_log_max_expiring, OPT_INT, 20)
+// group commit: while a journal write is in flight, flushes are held back
+// (for at most mds_log_batch_max_delay seconds, or until
+// mds_log_batch_max_bytes are unflushed) so the events submitted meanwhile
+// go out in one write
+OPTION(mds_log_batch_max_events, OPT_INT, 256) // events encoded per pass of the submit thread
+OPTION(mds_log_batch_max_bytes, OPT_U64, 1 << 20)
+OPTION(mds_log_batch_max_delay, OPT_DOUBLE, .005) // 0 = flush right away
 OPTION(mds_bal_sample_interval, OPT_FLOAT, 3.0)  // every 5 seconds
 OPTION(mds_bal_replicate_threshold, OPT_FLOAT, 8000)
 OPTION(mds_bal_unreplicate_threshold, OPT_FLOAT, 0)
@@ -425,7 +444,16 @@ OPTION(mds_bal_midchunk, OPT_FLOAT, .3)       // any sub bigger than this taken
 OPTION(mds_bal_minchunk, OPT_FLOAT, .001)     // never take anything smaller than this
 OPTION(mds_bal_target_removal_min, OPT_INT, 5) // min balance iterations before old target is removed
 OPTION(mds_bal_target_removal_max, OPT_INT, 10) // max balance iterations before old target is removed
+OPTION(mds_bal_cost_model, OPT_BOOL, false)   // weigh each export's cost against the load it sheds
+OPTION(mds_bal_heat_samples, OPT_INT, 5)      // rebalances of dirfrag load history the cost model looks at
+OPTION(mds_bal_cost_horizon, OPT_FLOAT, 30)   // seconds of projected load an export is credited with
+OPTION(mds_bal_export_item_cost, OPT_FLOAT, .01) // cost of migrating one cached dentry or cap
+OPTION(mds_bal_reexport_hold, OPT_FLOAT, 120) // seconds before the cost model moves an import on
+OPTION(mds_bal_dry_run, OPT_BOOL, false)      // plan rebalances (see "balancer plan") but don't export
 OPTION(mds_replay_interval, OPT_FLOAT, 1.0) // time to wait before starting replay again
+OPTION(mds_replay_decode_threads, OPT_INT, 2) // threads decoding journal events during replay; 0 to decode in the replay thread
+OPTION(mds_replay_max_inflight, OPT_INT, 1024) // journal events read ahead of the one being replayed
+OPTION(mds_replay_prefetch_periods, OPT_INT, 0) // journal objects to read ahead during replay; 0 for journaler_prefetch_periods
 OPTION(mds_shutdown_check, OPT_INT, 0)
 OPTION(mds_thrash_exports, OPT_INT, 0)
 OPTION(mds_thrash_fragments, OPT_INT, 0)
@@ -900,6 +928,7 @@ OPTION(rbd_cache_max_dirty_age, OPT_FLOAT, 1.0)      // seconds in cache before
 OPTION(rbd_cache_max_dirty_object, OPT_INT, 0)       // dirty limit for objects - set to 0 for auto calculate from rbd_cache_size
 OPTION(rbd_cache_block_writes_upfront, OPT_BOOL, false) // whether to block writes to the cache before the aio_write call completes (true), or block before the aio completion is called (false)
 OPTION(rbd_concurrent_management_ops, OPT_INT, 10) // how many operations can be in flight for a management operation like deleting or resizing an image
+OPTION(rbd_concurrent_flatten_ops, OPT_INT, 0) // how many objects can be copied up in parallel while flattening an image - set to 0 to use rbd_concurrent_management_ops
 OPTION(rbd_balance_snap_reads, OPT_BOOL, false)
 OPTION(rbd_localize_snap_reads, OPT_BOOL, false)
 OPTION(rbd_balance_parent_reads, OPT_BOOL, false)
@@ -908,11 +937,14 @@ OPTION(rbd_readahead_trigger_requests, OPT_INT, 10) // number of sequential requ
 OPTION(rbd_readahead_max_bytes, OPT_LONGLONG, 512 * 1024) // set to 0 to disable readahead
 OPTION(rbd_readahead_disable_after_bytes, OPT_LONGLONG, 50 * 1024 * 1024) // how many bytes are read in total before readahead is disabled
 OPTION(rbd_clone_copy_on_read, OPT_BOOL, false)
+OPTION(rbd_clone_copy_on_read_max_ops, OPT_INT, 16) // how many copy-on-read copyups can be in flight per image - set to 0 for no limit
 OPTION(rbd_blacklist_on_break_lock, OPT_BOOL, true) // whether to blacklist clients whose lock was broken
 OPTION(rbd_blacklist_expire_seconds, OPT_INT, 0) // number of seconds to blacklist - set to 0 for OSD default
 OPTION(rbd_request_timed_out_seconds, OPT_INT, 30) // number of seconds before maint request times out
 OPTION(rbd_skip_partial_discard, OPT_BOOL, false) // when trying to discard a range inside an object, set to true to skip zeroing the range.
 OPTION(rbd_enable_alloc_hint, OPT_BOOL, true) // when writing a object, it will issue a hint to osd backend to indicate the expected size object need
+OPTION(rbd_write_coalesce, OPT_BOOL, false) // when caching is disabled, merge sequential writes to an object while an earlier write to it is in flight
+OPTION(rbd_write_coalesce_max_bytes, OPT_U64, 1 << 20) // largest write that coalescing will build
 
 /*
  * The following options change the behavior for librbd's image creation methods that
@@ -962,16 +994,29 @@ OPTION(rgw_override_bucket_index_max_shards, OPT_U32, 0)
  */
 OPTION(rgw_bucket_index_max_aio, OPT_U32, 8)
 
+/**
+ * The maximum number of bucket index completions that are sent to an index
+ * shard with a single call while another call to that shard is in flight.
+ * A value of 1 or less sends every completion on its own.
+ */
+OPTION(rgw_bucket_index_complete_batch, OPT_INT, 64)
+
 /**
  * whether or not the quota/gc threads should be started
  */
 OPTION(rgw_enable_quota_threads, OPT_BOOL, true)
 OPTION(rgw_enable_gc_threads, OPT_BOOL, true)
+OPTION(rgw_enable_lc_threads, OPT_BOOL, true)
 
 OPTION(rgw_data, OPT_STR, "/var/lib/ceph/radosgw/$cluster-$id")
 OPTION(rgw_enable_apis, OPT_STR, "s3, swift, swift_auth, admin")
 OPTION(rgw_cache_enabled, OPT_BOOL, true)   // rgw cache enabled
 OPTION(rgw_cache_lru_size, OPT_INT, 10000)   // num of entries in rgw cache
+OPTION(rgw_cache_max_bytes, OPT_U64, 0)   // max size in bytes of the rgw cache, 0 for no limit
+OPTION(rgw_cache_shards, OPT_INT, 16)   // num of independently locked shards of the rgw cache
+OPTION(rgw_cache_expiry_interval, OPT_INT, 0)   // seconds an rgw cache entry is valid for, 0 for no expiry
+OPTION(rgw_cache_negative_expiry_interval, OPT_INT, 60)   // seconds a cached nonexistent object is valid for, 0 for no expiry
+OPTION(rgw_cache_notify_batch, OPT_BOOL, false)   // batch concurrent cache notifications, all gateways must support it
 OPTION(rgw_socket_path, OPT_STR, "")   // path to unix domain socket, if not specified, rgw will not run as external fcgi
 OPTION(rgw_host, OPT_STR, "")  // host for radosgw, can be an IP, default is 0.0.0.0
 OPTION(rgw_port, OPT_STR, "")  // port to listen, format as "8080" "5000", if not specified, rgw will not run external fcgi
@@ -1031,12 +1076,29 @@ OPTION(rgw_gc_max_objs, OPT_INT, 32)
 OPTION(rgw_gc_obj_min_wait, OPT_INT, 2 * 3600)    // wait time before object may be handled by gc
 OPTION(rgw_gc_processor_max_time, OPT_INT, 3600)  // total run time for a single gc processor work
 OPTION(rgw_gc_processor_period, OPT_INT, 3600)  // gc processor cycle time
+OPTION(rgw_gc_max_concurrent_shards, OPT_INT, 4)  // number of gc shards processed in parallel
+OPTION(rgw_gc_max_aio, OPT_INT, 16)  // max tail object removals in flight per gc shard
+OPTION(rgw_gc_aio_target_latency, OPT_DOUBLE, 0.5)  // gc shrinks its aio window when removals take longer than this (seconds)
+OPTION(rgw_gc_max_objs_per_sec, OPT_DOUBLE, 0)  // limit on tail object removals per second, 0 for no limit
+OPTION(rgw_lc_max_objs, OPT_INT, 32)  // number of lc shard objects buckets with lifecycle rules are registered in
+OPTION(rgw_lc_processor_max_time, OPT_INT, 3600)  // total run time for a single lc processor work
+OPTION(rgw_lc_processor_period, OPT_INT, 24 * 3600)  // lc processor cycle time
+OPTION(rgw_lc_max_concurrent_shards, OPT_INT, 8)  // number of bucket index shards expired in parallel
+OPTION(rgw_lc_max_batch, OPT_INT, 100)  // number of objects removed with a single bucket index operation
+OPTION(rgw_lc_max_aio, OPT_INT, 32)  // max head object removals in flight per bucket index shard
+OPTION(rgw_lc_debug_interval, OPT_INT, -1)  // if > 0, the length of an expiration day in seconds (for testing)
+OPTION(rgw_dynamic_resharding, OPT_BOOL, false) // reshard bucket indexes in the background once they grow past rgw_max_objs_per_shard
+OPTION(rgw_max_objs_per_shard, OPT_INT, 100000) // max number of objects per bucket index shard before the index is resharded
+OPTION(rgw_reshard_thread_interval, OPT_INT, 600) // time in seconds between scans for bucket indexes that need resharding
+OPTION(rgw_reshard_lock_duration, OPT_INT, 120) // time in seconds a resharding lock is held before it has to be renewed
+OPTION(rgw_reshard_old_index_grace, OPT_INT, 30) // time in seconds the old index objects of a resharded bucket are kept around for readers
 OPTION(rgw_s3_success_create_obj_status, OPT_INT, 0) // alternative success status response for create-obj (0 - default)
 OPTION(rgw_resolve_cname, OPT_BOOL, false)  // should rgw try to resolve hostname as a dns cname record
 OPTION(rgw_obj_stripe_size, OPT_INT, 4 << 20)
 OPTION(rgw_extended_http_attrs, OPT_STR, "") // list of extended attrs that can be set on objects (beyond the default)
 OPTION(rgw_exit_timeout_secs, OPT_INT, 120) // how many seconds to wait for process to go down before exiting unconditionally
-OPTION(rgw_get_obj_window_size, OPT_INT, 16 << 20) // window size in bytes for single get obj request
+OPTION(rgw_get_obj_window_size, OPT_INT, 16 << 20) // initial window size in bytes for single get obj request
+OPTION(rgw_get_obj_max_window_size, OPT_INT, 64 << 20) // max size the window of a single get obj request can grow to
 OPTION(rgw_get_obj_max_req_size, OPT_INT, 4 << 20) // max length of a single get obj rados op
 OPTION(rgw_relaxed_s3_bucket_names, OPT_BOOL, false) // enable relaxed bucket name rules for US region buckets
 OPTION(rgw_defer_to_bucket_acls, OPT_STR, "") // if the user has bucket perms, use those before key perms (recurse and full_control)
@@ -1069,6 +1131,7 @@ OPTION(rgw_user_quota_sync_wait_time, OPT_INT, 3600 * 24) // min time between tw
 
 OPTION(rgw_multipart_min_part_size, OPT_INT, 5 * 1024 * 1024) // min size for each part (except for last one) in multipart upload
 OPTION(rgw_multipart_part_upload_limit, OPT_INT, 10000) // parts limit in multipart upload
+OPTION(rgw_multipart_complete_max_aio, OPT_INT, 16) // max concurrent reads of part info when completing a multipart upload
 
 OPTION(rgw_olh_pending_timeout_sec, OPT_INT, 3600) // time until we retire a pending olh change
 
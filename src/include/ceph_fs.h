@@ -119,6 +119,7 @@ struct ceph_dir_layout {
 #define CEPH_MSG_CLIENT_SNAP            0x312
 #define CEPH_MSG_CLIENT_CAPRELEASE      0x313
 #define CEPH_MSG_CLIENT_QUOTA           0x314
+#define CEPH_MSG_CLIENT_CAPS_BATCH      0x315
 
 /* pool ops */
 #define CEPH_MSG_POOLOP_REPLY           48
@@ -425,6 +426,8 @@ union ceph_mds_request_args {
 
 #define CEPH_MDS_FLAG_REPLAY        1  /* this is a replayed op */
 #define CEPH_MDS_FLAG_WANT_DENTRY   2  /* want dentry in reply */
+#define CEPH_MDS_FLAG_WANT_INOS     4  /* delegate inos for async creates */
+#define CEPH_MDS_FLAG_ASYNC         8  /* client didn't wait for the reply */
 
 struct ceph_mds_request_head {
 	__le64 oldest_client_tid;
@@ -77,6 +77,9 @@ public:
   int open(IoCtx& io_ctx, Image& image, const char *name);
   int open(IoCtx& io_ctx, Image& image, const char *name, const char *snapname);
   // see librbd.h
+  int aio_open(IoCtx& io_ctx, Image& image, const char *name,
+	       const char *snapname, RBD::AioCompletion *c);
+  // see librbd.h
   int open_read_only(IoCtx& io_ctx, Image& image, const char *name,
 		     const char *snapname);
   int list(IoCtx& io_ctx, std::vector<std::string>& names);
@@ -109,6 +112,8 @@ public:
   ~Image();
 
   int close();
+  // see librbd.h
+  int aio_close(RBD::AioCompletion *c);
 
   int resize(uint64_t size);
   int resize_with_progress(uint64_t size, ProgressContext& pctx);
@@ -78,6 +78,9 @@ namespace librbd {
       ictx->perfcounter->tinc(l_librbd_discard_latency, elapsed); break;
     case AIO_TYPE_FLUSH:
       ictx->perfcounter->tinc(l_librbd_aio_flush_latency, elapsed); break;
+    case AIO_TYPE_OPEN:
+    case AIO_TYPE_CLOSE:
+      break;
     default:
       lderr(cct) << "completed invalid aio_type: " << aio_type << dendl;
       break;
@@ -26,6 +26,8 @@ namespace librbd {
     AIO_TYPE_WRITE,
     AIO_TYPE_DISCARD,
     AIO_TYPE_FLUSH,
+    AIO_TYPE_OPEN,
+    AIO_TYPE_CLOSE,
     AIO_TYPE_NONE,
   } aio_type_t;
 
@@ -98,6 +100,13 @@ namespace librbd {
       }
     }
 
+    void init_image_op(CephContext *cct, aio_type_t t) {
+      // open/close requests are not tracked against the ImageCtx
+      assert(ictx == NULL);
+      aio_type = t;
+      start_time = ceph_clock_now(cct);
+    }
+
     void fail(CephContext *cct, int r);
 
     void complete(CephContext *cct);
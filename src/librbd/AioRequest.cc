@@ -246,6 +246,14 @@ namespace librbd {
     }
 
     Mutex::Locker copyup_locker(m_ictx->copyup_list_lock);
+    if (m_ictx->clone_copy_on_read_max_ops > 0 &&
+        m_ictx->copy_on_read_ops >= m_ictx->clone_copy_on_read_max_ops) {
+      // too many copyups in flight -- a later read will retry
+      ldout(m_ictx->cct, 20) << "send_copyup " << this << " " << m_oid
+                             << ": copy-on-read throttled" << dendl;
+      return;
+    }
+
     map<uint64_t, CopyupRequest*>::iterator it =
       m_ictx->copyup_list.find(m_object_no);
     if (it == m_ictx->copyup_list.end()) {
@@ -283,7 +291,8 @@ namespace librbd {
                                Context *completion, bool hide_enoent)
     : AioRequest(ictx, oid, object_no, object_off, len, CEPH_NOSNAP, completion,
                  hide_enoent),
-      m_state(LIBRBD_AIO_WRITE_FLAT), m_snap_seq(snapc.seq.val)
+      m_state(LIBRBD_AIO_WRITE_FLAT), m_snap_seq(snapc.seq.val),
+      m_object_exist(true)
   {
     m_snaps.insert(m_snaps.end(), snapc.snaps.begin(), snapc.snaps.end());
   }
@@ -412,7 +421,13 @@ namespace librbd {
         boost::optional<uint8_t> current_state;
         pre_object_map_update(&new_state);
 
+        uint64_t flags;
+        m_ictx->get_flags(CEPH_NOSNAP, &flags);
+
         RWLock::WLocker object_map_locker(m_ictx->object_map_lock);
+        m_object_exist = ((flags & RBD_FLAG_OBJECT_MAP_INVALID) != 0 ||
+                          m_ictx->object_map[m_object_no] !=
+                            OBJECT_NONEXISTENT);
         if (m_ictx->object_map[m_object_no] != new_state) {
           FunctionContext *ctx = new FunctionContext(
             boost::bind(&AioRequest::complete, this, _1));
@@ -468,6 +483,20 @@ namespace librbd {
 
     m_state = LIBRBD_AIO_WRITE_FLAT;
     guard_write();
+    if (m_state == LIBRBD_AIO_WRITE_GUARD && !m_object_exist) {
+      // the guarded write would only fail with -ENOENT -- start
+      // reading from the parent right away
+      bool has_parent;
+      {
+        RWLock::RLocker snap_locker(m_ictx->snap_lock);
+        RWLock::RLocker parent_locker(m_ictx->parent_lock);
+        has_parent = compute_parent_extents();
+      }
+      if (has_parent) {
+        send_copyup();
+        return;
+      }
+    }
     add_write_ops(&m_write);
     assert(m_write.size() != 0);
 
@@ -161,7 +161,9 @@ namespace librbd {
      *
      * The _PRE/_POST states are skipped if the object map is disabled.
      * The write starts in _WRITE_GUARD or _FLAT depending on whether or not
-     * there is a parent overlap.
+     * there is a parent overlap.  If the object map shows that the object
+     * does not exist, the guarded write is skipped and the write proceeds
+     * directly to _WRITE_COPYUP.
      */
     enum write_state_d {
       LIBRBD_AIO_WRITE_GUARD,
@@ -177,6 +179,7 @@ namespace librbd {
     librados::ObjectWriteOperation m_write;
     uint64_t m_snap_seq;
     std::vector<librados::snap_t> m_snaps;
+    bool m_object_exist;
 
     virtual void add_write_ops(librados::ObjectWriteOperation *wr) = 0;
     virtual const char* get_write_type() const = 0;
@@ -101,7 +101,9 @@ void AsyncFlattenRequest::send() {
   AsyncObjectThrottle *throttle = new AsyncObjectThrottle(
     this, m_image_ctx, context_factory, create_callback_context(), &m_prog_ctx,
     0, m_overlap_objects);
-  throttle->start_ops(m_image_ctx.concurrent_management_ops);
+  throttle->start_ops(m_image_ctx.concurrent_flatten_ops > 0 ?
+                       m_image_ctx.concurrent_flatten_ops :
+                       m_image_ctx.concurrent_management_ops);
 }
 
 bool AsyncFlattenRequest::send_update_header() {
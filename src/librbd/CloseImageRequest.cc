@@ -0,0 +1,144 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#include "librbd/CloseImageRequest.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/internal.h"
+#include "common/ceph_context.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/Finisher.h"
+#include <boost/bind.hpp>
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::CloseImageRequest: "
+
+namespace librbd {
+
+namespace {
+
+class FinisherSingleton : public CephContext::AssociatedSingletonObject {
+public:
+  Finisher finisher;
+
+  FinisherSingleton(CephContext *cct) : finisher(cct) {
+    finisher.start();
+  }
+  virtual ~FinisherSingleton() {
+    finisher.stop();
+  }
+};
+
+} // anonymous namespace
+
+CloseImageRequest::CloseImageRequest(ImageCtx *image_ctx, Context *on_finish)
+  : m_image_ctx(image_ctx), m_on_finish(on_finish),
+    m_state(STATE_FLUSH_ASYNC_OPERATIONS), m_flush_r(0)
+{
+}
+
+void CloseImageRequest::send() {
+  send_flush_async_operations();
+}
+
+void CloseImageRequest::complete(int r) {
+  if (should_complete(r)) {
+    m_on_finish->complete(r);
+    delete this;
+  }
+}
+
+bool CloseImageRequest::should_complete(int r) {
+  if (m_state == STATE_SHUTDOWN) {
+    // image context has been deleted
+    return true;
+  }
+
+  CephContext *cct = m_image_ctx->cct;
+  ldout(cct, 20) << this << " should_complete: " << " r=" << r << dendl;
+
+  switch (m_state) {
+  case STATE_FLUSH_ASYNC_OPERATIONS:
+    ldout(cct, 20) << "FLUSH_ASYNC_OPERATIONS" << dendl;
+    send_flush();
+    break;
+
+  case STATE_FLUSH:
+    ldout(cct, 20) << "FLUSH" << dendl;
+    if (r < 0) {
+      // teardown will re-attempt the flush and report the final error
+      lderr(cct) << "error flushing IO: " << cpp_strerror(r) << dendl;
+      m_flush_r = r;
+    }
+    send_shutdown();
+    break;
+
+  default:
+    lderr(cct) << "invalid state: " << m_state << dendl;
+    assert(false);
+    break;
+  }
+  return false;
+}
+
+void CloseImageRequest::send_flush_async_operations() {
+  ldout(m_image_ctx->cct, 10) << this << " send_flush_async_operations"
+			      << dendl;
+  m_state = STATE_FLUSH_ASYNC_OPERATIONS;
+
+  m_image_ctx->flush_async_operations(create_callback_context());
+}
+
+void CloseImageRequest::send_flush() {
+  ldout(m_image_ctx->cct, 10) << this << " send_flush" << dendl;
+  m_state = STATE_FLUSH;
+
+  RWLock::RLocker owner_locker(m_image_ctx->owner_lock);
+  if (m_image_ctx->object_cacher != NULL) {
+    // cache flush completes with the cache_lock held
+    m_image_ctx->flush_cache_aio(create_async_callback_context());
+  } else {
+    librados::AioCompletion *rados_completion =
+      librados::Rados::aio_create_completion(create_callback_context(), NULL,
+					     rados_ctx_cb);
+    m_image_ctx->data_ctx.aio_flush_async(rados_completion);
+    rados_completion->release();
+  }
+}
+
+void CloseImageRequest::send_shutdown() {
+  ldout(m_image_ctx->cct, 10) << this << " send_shutdown" << dendl;
+  m_state = STATE_SHUTDOWN;
+
+  FinisherSingleton *finisher_singleton;
+  m_image_ctx->cct->lookup_or_create_singleton_object<FinisherSingleton>(
+    finisher_singleton, "librbd::close_image_finisher");
+  finisher_singleton->finisher.queue(new FunctionContext(
+    boost::bind(&CloseImageRequest::handle_shutdown, this)));
+}
+
+void CloseImageRequest::handle_shutdown() {
+  // all dirty data has been written back -- the synchronous close
+  // will only need to drain the (idle) work queues
+  int r = close_image(m_image_ctx);
+  if (r == 0) {
+    r = m_flush_r;
+  }
+  complete(r);
+}
+
+Context *CloseImageRequest::create_callback_context() {
+  return new FunctionContext(boost::bind(&CloseImageRequest::complete, this,
+					 _1));
+}
+
+Context *CloseImageRequest::create_async_callback_context() {
+  return new FunctionContext(boost::bind(&CloseImageRequest::async_complete,
+					 this, _1));
+}
+
+void CloseImageRequest::async_complete(int r) {
+  m_image_ctx->op_work_queue->queue(create_callback_context(), r);
+}
+
+} // namespace librbd
@@ -0,0 +1,80 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef CEPH_LIBRBD_CLOSE_IMAGE_REQUEST_H
+#define CEPH_LIBRBD_CLOSE_IMAGE_REQUEST_H
+
+#include "include/int_types.h"
+#include "include/Context.h"
+
+namespace librbd {
+
+struct ImageCtx;
+
+/**
+ * Closes an image without blocking the caller.  The ImageCtx is deleted
+ * before the completion fires.
+ */
+class CloseImageRequest
+{
+public:
+  CloseImageRequest(ImageCtx *image_ctx, Context *on_finish);
+
+  void send();
+
+private:
+  /**
+   * Close goes through the following state machine to write back any
+   * in-flight data before tearing down the image:
+   *
+   * @verbatim
+   *
+   * <start>
+   *    |
+   *    v
+   * STATE_FLUSH_ASYNC_OPERATIONS
+   *    |
+   *    v
+   * STATE_FLUSH
+   *    |
+   *    v
+   * STATE_SHUTDOWN
+   *    |
+   *    v
+   * <finish>
+   *
+   * @endverbatim
+   *
+   * The flush states are fully asynchronous.  Once all dirty data has been
+   * written back, the remaining teardown (draining the work queues,
+   * releasing the exclusive lock and unregistering the watch) is cheap but
+   * blocking, so it is executed from a dedicated finisher thread that is
+   * shared by all images within the CephContext.
+   */
+  enum State {
+    STATE_FLUSH_ASYNC_OPERATIONS,
+    STATE_FLUSH,
+    STATE_SHUTDOWN
+  };
+
+  ImageCtx *m_image_ctx;
+  Context *m_on_finish;
+  State m_state;
+  int m_flush_r;
+
+  void complete(int r);
+  bool should_complete(int r);
+
+  void send_flush_async_operations();
+  void send_flush();
+  void send_shutdown();
+
+  void handle_shutdown();
+
+  Context *create_callback_context();
+  Context *create_async_callback_context();
+  void async_complete(int r);
+};
+
+} // namespace librbd
+
+#endif // CEPH_LIBRBD_CLOSE_IMAGE_REQUEST_H
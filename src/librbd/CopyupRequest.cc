@@ -74,13 +74,19 @@ private:
                                uint64_t objectno,
 			       vector<pair<uint64_t,uint64_t> >& image_extents)
     : m_ictx(ictx), m_oid(oid), m_object_no(objectno),
-      m_image_extents(image_extents), m_state(STATE_READ_FROM_PARENT)
+      m_image_extents(image_extents), m_state(STATE_READ_FROM_PARENT),
+      m_copy_on_read(false)
   {
     m_async_op.start_op(*m_ictx);
   }
 
   CopyupRequest::~CopyupRequest() {
     assert(m_pending_requests.empty());
+    if (m_copy_on_read) {
+      Mutex::Locker copyup_locker(m_ictx->copyup_list_lock);
+      assert(m_ictx->copy_on_read_ops > 0);
+      --m_ictx->copy_on_read_ops;
+    }
     m_async_op.finish_op();
   }
 
@@ -190,6 +196,10 @@ private:
 
   void CopyupRequest::queue_send()
   {
+    assert(m_ictx->copyup_list_lock.is_locked());
+    m_copy_on_read = true;
+    ++m_ictx->copy_on_read_ops;
+
     // TODO: once the ObjectCacher allows reentrant read requests, the finisher
     // should be eliminated
     ldout(m_ictx->cct, 20) << __func__ << " " << this
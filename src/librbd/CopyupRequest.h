@@ -23,6 +23,12 @@ namespace librbd {
     void append_request(AioRequest *req);
 
     void send();
+
+    /**
+     * Start a copy-on-read copyup from the copyup finisher.  The request
+     * counts against the image's in-flight copy-on-read limit until it
+     * completes.  The caller must hold copyup_list_lock.
+     */
     void queue_send();
 
   private:
@@ -67,6 +73,7 @@ namespace librbd {
     ceph::bufferlist m_copyup_data;
     vector<AioRequest *> m_pending_requests;
     atomic_t m_pending_copyups;
+    bool m_copy_on_read;
 
     AsyncOperation m_async_op;
 
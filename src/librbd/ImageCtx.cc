@@ -16,6 +16,7 @@
 #include "librbd/ImageCtx.h"
 #include "librbd/ImageWatcher.h"
 #include "librbd/ObjectMap.h"
+#include "librbd/WriteCoalescer.h"
 
 #include <boost/bind.hpp>
 
@@ -83,7 +84,8 @@ public:
       stripe_unit(0), stripe_count(0), flags(0),
       object_cacher(NULL), writeback_handler(NULL), object_set(NULL),
       readahead(),
-      total_bytes_read(0), copyup_finisher(NULL),
+      total_bytes_read(0), copyup_finisher(NULL), copy_on_read_ops(0),
+      write_coalescer(NULL),
       object_map(*this), aio_work_queue(NULL), op_work_queue(NULL)
   {
     md_ctx.dup(p);
@@ -123,6 +125,10 @@ public:
       delete copyup_finisher;
       copyup_finisher = NULL;
     }
+    if (write_coalescer != NULL) {
+      delete write_coalescer;
+      write_coalescer = NULL;
+    }
     delete[] format_string;
 
     delete op_work_queue;
@@ -162,20 +168,33 @@ public:
 
       header_oid = header_name(id);
       apply_metadata_confs();
-      r = cls_client::get_immutable_metadata(&md_ctx, header_oid,
-					     &object_prefix, &order);
+
+      // fetch the size, object prefix and features in a single round trip
+      librados::ObjectReadOperation op;
+      cls_client::get_initial_metadata_start(&op);
+
+      bufferlist outbl;
+      r = md_ctx.operate(header_oid, &op, &outbl);
+      if (r == 0) {
+	bufferlist::iterator it = outbl.begin();
+	r = cls_client::get_initial_metadata_finish(&it, &object_prefix,
+						    &order, &features);
+      }
       if (r < 0) {
 	lderr(cct) << "error reading immutable metadata: "
 		   << cpp_strerror(r) << dendl;
 	return r;
       }
 
-      r = cls_client::get_stripe_unit_count(&md_ctx, header_oid,
-					    &stripe_unit, &stripe_count);
-      if (r < 0 && r != -ENOEXEC && r != -EINVAL) {
-	lderr(cct) << "error reading striping metadata: "
-		   << cpp_strerror(r) << dendl;
-	return r;
+      // only images with fancy striping store their stripe settings
+      if ((features & RBD_FEATURE_STRIPINGV2) != 0) {
+	r = cls_client::get_stripe_unit_count(&md_ctx, header_oid,
+					      &stripe_unit, &stripe_count);
+	if (r < 0 && r != -ENOEXEC && r != -EINVAL) {
+	  lderr(cct) << "error reading striping metadata: "
+		     << cpp_strerror(r) << dendl;
+	  return r;
+	}
       }
 
       init_layout();
@@ -184,6 +203,11 @@ public:
       header_oid = old_header_name(name);
     }
 
+    init_cache(pname);
+    return 0;
+  }
+
+  void ImageCtx::init_cache(const string &pname) {
     if (cache) {
       Mutex::Locker l(cache_lock);
       ldout(cct, 20) << "enabling caching..." << dendl;
@@ -228,10 +252,13 @@ public:
       copyup_finisher->start();
     }
 
+    if (object_cacher == NULL && write_coalesce) {
+      ldout(cct, 20) << "enabling write coalescing..." << dendl;
+      write_coalescer = new WriteCoalescer(*this, write_coalesce_max_bytes);
+    }
+
     readahead.set_trigger_requests(readahead_trigger_requests);
     readahead.set_max_readahead_size(readahead_max_bytes);
-
-    return 0;
   }
 
   void ImageCtx::init_layout()
@@ -292,6 +319,8 @@ public:
     plb.add_u64_counter(l_librbd_resize, "resize", "Resizes");
     plb.add_u64_counter(l_librbd_readahead, "readahead", "Read ahead");
     plb.add_u64_counter(l_librbd_readahead_bytes, "readahead_bytes", "Data size in read ahead");
+    plb.add_u64_counter(l_librbd_wr_coalesced, "wr_coalesced", "Writes merged into a preceding write");
+    plb.add_u64_counter(l_librbd_wr_coalesced_bytes, "wr_coalesced_bytes", "Data size in merged writes");
 
     perfcounter = plb.create_perf_counters();
     cct->get_perfcounters_collection()->add(perfcounter);
@@ -845,6 +874,7 @@ public:
         "rbd_cache_max_dirty_object", false)(
         "rbd_cache_block_writes_upfront", false)(
         "rbd_concurrent_management_ops", false)(
+        "rbd_concurrent_flatten_ops", false)(
         "rbd_balance_snap_reads", false)(
         "rbd_localize_snap_reads", false)(
         "rbd_balance_parent_reads", false)(
@@ -853,9 +883,12 @@ public:
         "rbd_readahead_max_bytes", false)(
         "rbd_readahead_disable_after_bytes", false)(
         "rbd_clone_copy_on_read", false)(
+        "rbd_clone_copy_on_read_max_ops", false)(
         "rbd_blacklist_on_break_lock", false)(
         "rbd_blacklist_expire_seconds", false)(
-        "rbd_request_timed_out_seconds", false);
+        "rbd_request_timed_out_seconds", false)(
+        "rbd_write_coalesce", false)(
+        "rbd_write_coalesce_max_bytes", false);
 
     string start = METADATA_CONF_PREFIX;
     int r = 0, j = 0;
@@ -911,6 +944,7 @@ public:
     ASSIGN_OPTION(cache_max_dirty_object);
     ASSIGN_OPTION(cache_block_writes_upfront);
     ASSIGN_OPTION(concurrent_management_ops);
+    ASSIGN_OPTION(concurrent_flatten_ops);
     ASSIGN_OPTION(balance_snap_reads);
     ASSIGN_OPTION(localize_snap_reads);
     ASSIGN_OPTION(balance_parent_reads);
@@ -919,9 +953,12 @@ public:
     ASSIGN_OPTION(readahead_max_bytes);
     ASSIGN_OPTION(readahead_disable_after_bytes);
     ASSIGN_OPTION(clone_copy_on_read);
+    ASSIGN_OPTION(clone_copy_on_read_max_ops);
     ASSIGN_OPTION(blacklist_on_break_lock);
     ASSIGN_OPTION(blacklist_expire_seconds);
     ASSIGN_OPTION(request_timed_out_seconds);
     ASSIGN_OPTION(enable_alloc_hint);
+    ASSIGN_OPTION(write_coalesce);
+    ASSIGN_OPTION(write_coalesce_max_bytes);
   }
 }
@@ -42,6 +42,7 @@ namespace librbd {
   class AsyncResizeRequest;
   class CopyupRequest;
   class ImageWatcher;
+  class WriteCoalescer;
 
   struct ImageCtx {
     CephContext *cct;
@@ -120,6 +121,9 @@ namespace librbd {
 
     Finisher *copyup_finisher;
     std::map<uint64_t, CopyupRequest*> copyup_list;
+    uint32_t copy_on_read_ops; // protected by copyup_list_lock
+
+    WriteCoalescer *write_coalescer;
 
     xlist<AsyncOperation*> async_ops;
     xlist<AsyncRequest*> async_requests;
@@ -146,6 +150,7 @@ namespace librbd {
     uint32_t cache_max_dirty_object;
     bool cache_block_writes_upfront;
     uint32_t concurrent_management_ops;
+    uint32_t concurrent_flatten_ops;
     bool balance_snap_reads;
     bool localize_snap_reads;
     bool balance_parent_reads;
@@ -154,10 +159,13 @@ namespace librbd {
     uint64_t readahead_max_bytes;
     uint64_t readahead_disable_after_bytes;
     bool clone_copy_on_read;
+    uint32_t clone_copy_on_read_max_ops;
     bool blacklist_on_break_lock;
     uint32_t blacklist_expire_seconds;
     uint32_t request_timed_out_seconds;
     bool enable_alloc_hint;
+    bool write_coalesce;
+    uint64_t write_coalesce_max_bytes;
     static bool _filter_metadata_confs(const string &prefix, std::map<string, bool> &configs,
                                        map<string, bufferlist> &pairs, map<string, bufferlist> *res);
 
@@ -171,6 +179,7 @@ namespace librbd {
     ~ImageCtx();
     int init();
     void init_layout();
+    void init_cache(const std::string &pname);
     void perf_start(std::string name);
     void perf_stop();
     void set_read_flag(unsigned flag);
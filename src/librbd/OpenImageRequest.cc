@@ -0,0 +1,268 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#include "librbd/OpenImageRequest.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/internal.h"
+#include "cls/rbd/cls_rbd_client.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include <boost/bind.hpp>
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::OpenImageRequest: "
+
+namespace librbd {
+
+namespace {
+
+class C_OpenImageFailed : public Context {
+public:
+  C_OpenImageFailed(Context *on_finish, int r)
+    : m_on_finish(on_finish), m_r(r) {
+  }
+protected:
+  virtual void finish(int r) {
+    m_on_finish->complete(m_r);
+  }
+private:
+  Context *m_on_finish;
+  int m_r;
+};
+
+} // anonymous namespace
+
+OpenImageRequest::OpenImageRequest(ImageCtx &image_ctx, Context *on_finish)
+  : m_image_ctx(image_ctx), m_on_finish(on_finish), m_state(STATE_GET_ID),
+    m_header_size(0), m_header_mtime(0)
+{
+}
+
+void OpenImageRequest::send() {
+  m_perf_name = std::string("librbd-") + m_image_ctx.id + std::string("-") +
+    m_image_ctx.data_ctx.get_pool_name() + std::string("/") +
+    m_image_ctx.name;
+  if (!m_image_ctx.snap_name.empty()) {
+    m_perf_name += "@";
+    m_perf_name += m_image_ctx.snap_name;
+  }
+  m_image_ctx.perf_start(m_perf_name);
+
+  if (m_image_ctx.id.empty()) {
+    send_get_id();
+  } else {
+    m_image_ctx.old_format = false;
+    m_image_ctx.header_oid = header_name(m_image_ctx.id);
+    send_get_initial_metadata();
+  }
+}
+
+void OpenImageRequest::complete(int r) {
+  if (should_complete(r)) {
+    finish(r);
+  }
+}
+
+bool OpenImageRequest::should_complete(int r) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << this << " should_complete: " << " r=" << r << dendl;
+
+  switch (m_state) {
+  case STATE_GET_ID:
+    ldout(cct, 20) << "GET_ID" << dendl;
+    if (r == -ENOENT) {
+      send_stat_old_header();
+      break;
+    } else if (r == 0) {
+      r = handle_get_id();
+    }
+    if (r < 0) {
+      lderr(cct) << "error reading image id: " << cpp_strerror(r) << dendl;
+      return true;
+    }
+    send_get_initial_metadata();
+    break;
+
+  case STATE_STAT_OLD_HEADER:
+    ldout(cct, 20) << "STAT_OLD_HEADER" << dendl;
+    if (r < 0) {
+      lderr(cct) << "error finding header: " << cpp_strerror(r) << dendl;
+      return true;
+    }
+    m_image_ctx.old_format = true;
+    m_image_ctx.header_oid = old_header_name(m_image_ctx.name);
+    send_refresh();
+    break;
+
+  case STATE_GET_INITIAL_METADATA:
+    ldout(cct, 20) << "GET_INITIAL_METADATA" << dendl;
+    if (r == 0) {
+      r = handle_get_initial_metadata();
+    }
+    if (r < 0) {
+      lderr(cct) << "error reading immutable metadata: " << cpp_strerror(r)
+		 << dendl;
+      return true;
+    }
+
+    if ((m_image_ctx.features & RBD_FEATURE_STRIPINGV2) != 0) {
+      send_get_stripe_unit_count();
+    } else {
+      m_image_ctx.init_layout();
+      send_refresh();
+    }
+    break;
+
+  case STATE_GET_STRIPE_UNIT_COUNT:
+    ldout(cct, 20) << "GET_STRIPE_UNIT_COUNT" << dendl;
+    r = handle_get_stripe_unit_count(r);
+    if (r < 0) {
+      lderr(cct) << "error reading striping metadata: " << cpp_strerror(r)
+		 << dendl;
+      return true;
+    }
+    m_image_ctx.init_layout();
+    send_refresh();
+    break;
+
+  case STATE_REFRESH:
+    ldout(cct, 20) << "REFRESH" << dendl;
+    return true;
+
+  default:
+    lderr(cct) << "invalid state: " << m_state << dendl;
+    assert(false);
+    break;
+  }
+  return false;
+}
+
+void OpenImageRequest::finish(int r) {
+  ldout(m_image_ctx.cct, 10) << this << " finish: r=" << r << dendl;
+
+  Context *on_finish = m_on_finish;
+  if (r < 0) {
+    // match the synchronous open_image semantics: a failed open releases
+    // the image context before notifying the caller
+    aio_close_image(&m_image_ctx, new C_OpenImageFailed(on_finish, r));
+  } else {
+    on_finish->complete(0);
+  }
+  delete this;
+}
+
+void OpenImageRequest::send_get_id() {
+  ldout(m_image_ctx.cct, 10) << this << " send_get_id" << dendl;
+  m_state = STATE_GET_ID;
+
+  librados::ObjectReadOperation op;
+  cls_client::get_id_start(&op);
+
+  m_out_bl.clear();
+  librados::AioCompletion *rados_completion = create_callback_completion();
+  int r = m_image_ctx.md_ctx.aio_operate(id_obj_name(m_image_ctx.name),
+					 rados_completion, &op, &m_out_bl);
+  assert(r == 0);
+  rados_completion->release();
+}
+
+void OpenImageRequest::send_stat_old_header() {
+  ldout(m_image_ctx.cct, 10) << this << " send_stat_old_header" << dendl;
+  m_state = STATE_STAT_OLD_HEADER;
+
+  librados::AioCompletion *rados_completion = create_callback_completion();
+  int r = m_image_ctx.md_ctx.aio_stat(old_header_name(m_image_ctx.name),
+				      rados_completion, &m_header_size,
+				      &m_header_mtime);
+  assert(r == 0);
+  rados_completion->release();
+}
+
+void OpenImageRequest::send_get_initial_metadata() {
+  ldout(m_image_ctx.cct, 10) << this << " send_get_initial_metadata" << dendl;
+  m_state = STATE_GET_INITIAL_METADATA;
+
+  librados::ObjectReadOperation op;
+  cls_client::get_initial_metadata_start(&op);
+
+  m_out_bl.clear();
+  librados::AioCompletion *rados_completion = create_callback_completion();
+  int r = m_image_ctx.md_ctx.aio_operate(m_image_ctx.header_oid,
+					 rados_completion, &op, &m_out_bl);
+  assert(r == 0);
+  rados_completion->release();
+}
+
+void OpenImageRequest::send_get_stripe_unit_count() {
+  ldout(m_image_ctx.cct, 10) << this << " send_get_stripe_unit_count" << dendl;
+  m_state = STATE_GET_STRIPE_UNIT_COUNT;
+
+  librados::ObjectReadOperation op;
+  cls_client::get_stripe_unit_count_start(&op);
+
+  m_out_bl.clear();
+  librados::AioCompletion *rados_completion = create_callback_completion();
+  int r = m_image_ctx.md_ctx.aio_operate(m_image_ctx.header_oid,
+					 rados_completion, &op, &m_out_bl);
+  assert(r == 0);
+  rados_completion->release();
+}
+
+void OpenImageRequest::send_refresh() {
+  ldout(m_image_ctx.cct, 10) << this << " send_refresh" << dendl;
+  m_state = STATE_REFRESH;
+
+  // the remaining steps issue synchronous librados calls -- avoid blocking
+  // the librados callback thread
+  m_image_ctx.op_work_queue->queue(new FunctionContext(
+    boost::bind(&OpenImageRequest::handle_refresh, this)), 0);
+}
+
+int OpenImageRequest::handle_get_id() {
+  bufferlist::iterator it = m_out_bl.begin();
+  int r = cls_client::get_id_finish(&it, &m_image_ctx.id);
+  if (r < 0) {
+    return r;
+  }
+
+  m_image_ctx.old_format = false;
+  m_image_ctx.header_oid = header_name(m_image_ctx.id);
+  return 0;
+}
+
+int OpenImageRequest::handle_get_initial_metadata() {
+  bufferlist::iterator it = m_out_bl.begin();
+  return cls_client::get_initial_metadata_finish(&it,
+						 &m_image_ctx.object_prefix,
+						 &m_image_ctx.order,
+						 &m_image_ctx.features);
+}
+
+int OpenImageRequest::handle_get_stripe_unit_count(int r) {
+  if (r == 0) {
+    bufferlist::iterator it = m_out_bl.begin();
+    r = cls_client::get_stripe_unit_count_finish(&it,
+						 &m_image_ctx.stripe_unit,
+						 &m_image_ctx.stripe_count);
+  }
+  if (r == -ENOEXEC || r == -EINVAL) {
+    r = 0;
+  }
+  return r;
+}
+
+void OpenImageRequest::handle_refresh() {
+  m_image_ctx.apply_metadata_confs();
+  m_image_ctx.init_cache(m_perf_name);
+
+  int r = finish_open_image(&m_image_ctx);
+  complete(r);
+}
+
+librados::AioCompletion *OpenImageRequest::create_callback_completion() {
+  return librados::Rados::aio_create_completion(
+    new FunctionContext(boost::bind(&OpenImageRequest::complete, this, _1)),
+    NULL, rados_ctx_cb);
+}
+
+} // namespace librbd
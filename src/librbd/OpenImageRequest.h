@@ -0,0 +1,103 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef CEPH_LIBRBD_OPEN_IMAGE_REQUEST_H
+#define CEPH_LIBRBD_OPEN_IMAGE_REQUEST_H
+
+#include "include/int_types.h"
+#include "include/buffer.h"
+#include "include/Context.h"
+#include "include/rados/librados.hpp"
+#include <string>
+
+namespace librbd {
+
+struct ImageCtx;
+
+/**
+ * Opens an image without blocking the caller.  Unlike AsyncRequest-derived
+ * operations, the open request is not registered with the image's async
+ * request list since the image is not yet usable (and a failed open will
+ * close the image).  On failure, the ImageCtx is closed and deleted before
+ * the completion fires.
+ */
+class OpenImageRequest
+{
+public:
+  OpenImageRequest(ImageCtx &image_ctx, Context *on_finish);
+
+  void send();
+
+private:
+  /**
+   * Open goes through the following state machine to locate the image
+   * header and load the image metadata:
+   *
+   * @verbatim
+   *
+   * <start>
+   *    |
+   *    | (image id known)
+   *    |--------------------------------------\
+   *    |                                      |
+   *    v                                      |
+   * STATE_GET_ID --------------------\        |
+   *    |                             |        |
+   *    | (id object missing)         |        |
+   *    v                             v        v
+   * STATE_STAT_OLD_HEADER   STATE_GET_INITIAL_METADATA
+   *    |                             |        |
+   *    |                             |        | (striping v2)
+   *    |                             |        v
+   *    |                             |  STATE_GET_STRIPE_UNIT_COUNT
+   *    |                             |        |
+   *    |                             v        |
+   *    \--------------------> STATE_REFRESH <-/
+   *                                  |
+   *                                  v
+   *                              <finish>
+   *
+   * @endverbatim
+   *
+   * The header lookups are issued as librados AIO so that many images can
+   * be opened concurrently.  New format images are probed first since the
+   * id object lookup is needed to locate their header anyway.  The refresh
+   * state (metadata config overrides, watch registration and the full
+   * header refresh) is executed from the image's op work queue.
+   */
+  enum State {
+    STATE_GET_ID,
+    STATE_STAT_OLD_HEADER,
+    STATE_GET_INITIAL_METADATA,
+    STATE_GET_STRIPE_UNIT_COUNT,
+    STATE_REFRESH
+  };
+
+  ImageCtx &m_image_ctx;
+  Context *m_on_finish;
+  State m_state;
+  std::string m_perf_name;
+  bufferlist m_out_bl;
+  uint64_t m_header_size;
+  time_t m_header_mtime;
+
+  void complete(int r);
+  bool should_complete(int r);
+  void finish(int r);
+
+  void send_get_id();
+  void send_stat_old_header();
+  void send_get_initial_metadata();
+  void send_get_stripe_unit_count();
+  void send_refresh();
+
+  int handle_get_id();
+  int handle_get_initial_metadata();
+  int handle_get_stripe_unit_count(int r);
+  void handle_refresh();
+
+  librados::AioCompletion *create_callback_completion();
+};
+
+} // namespace librbd
+
+#endif // CEPH_LIBRBD_OPEN_IMAGE_REQUEST_H
@@ -0,0 +1,186 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#include "librbd/WriteCoalescer.h"
+#include "librbd/AioRequest.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/internal.h"
+#include "common/dout.h"
+#include "common/perf_counters.h"
+#include "include/Context.h"
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::WriteCoalescer: "
+
+namespace librbd {
+
+struct WriteCoalescer::C_WriteComplete : public Context {
+  WriteCoalescer *coalescer;
+  uint64_t object_no;
+  std::list<Context *> on_finish;
+
+  C_WriteComplete(WriteCoalescer *coalescer, uint64_t object_no)
+    : coalescer(coalescer), object_no(object_no) {
+  }
+
+  virtual void finish(int r) {
+    coalescer->handle_write_complete(object_no);
+    for (std::list<Context *>::iterator it = on_finish.begin();
+	 it != on_finish.end(); ++it) {
+      (*it)->complete(r);
+    }
+  }
+};
+
+WriteCoalescer::WriteCoalescer(ImageCtx &image_ctx, uint64_t max_bytes)
+  : m_image_ctx(image_ctx), m_max_bytes(max_bytes),
+    m_lock(unique_lock_name("librbd::WriteCoalescer::m_lock", this))
+{
+}
+
+WriteCoalescer::~WriteCoalescer() {
+  // image close flushes all AIO before tearing down
+  assert(m_object_writes.empty());
+}
+
+void WriteCoalescer::write(const std::string &oid, uint64_t object_no,
+			   uint64_t object_off, const bufferlist &bl,
+			   const ::SnapContext &snapc, int op_flags,
+			   Context *on_finish) {
+  assert(m_image_ctx.owner_lock.is_locked());
+  CephContext *cct = m_image_ctx.cct;
+
+  PendingWrite *send_first = NULL;
+  PendingWrite *send_now = NULL;
+  {
+    Mutex::Locker locker(m_lock);
+    ObjectWrites &object_writes = m_object_writes[object_no];
+    PendingWrite *pending = object_writes.pending;
+    if (pending != NULL) {
+      if (can_merge(*pending, object_off, bl, snapc, op_flags)) {
+	ldout(cct, 20) << "merging " << oid << " " << object_off << "~"
+		       << bl.length() << " into " << pending->object_off << "~"
+		       << pending->bl.length() << dendl;
+	pending->bl.append(bl);
+	pending->on_finish.push_back(on_finish);
+
+	m_image_ctx.perfcounter->inc(l_librbd_wr_coalesced);
+	m_image_ctx.perfcounter->inc(l_librbd_wr_coalesced_bytes,
+				     bl.length());
+	return;
+      }
+
+      // cannot be merged -- the pending write must go out first
+      send_first = take_pending(object_writes);
+    }
+
+    PendingWrite *write = new PendingWrite();
+    write->oid = oid;
+    write->object_no = object_no;
+    write->object_off = object_off;
+    write->bl = bl;
+    write->snapc = snapc;
+    write->op_flags = op_flags;
+    write->on_finish.push_back(on_finish);
+
+    if (object_writes.in_flight > 0 && bl.length() < m_max_bytes) {
+      // hold the write back until the in-flight write completes
+      object_writes.pending = write;
+    } else {
+      ++object_writes.in_flight;
+      send_now = write;
+    }
+  }
+
+  if (send_first != NULL) {
+    send_write(send_first);
+  }
+  if (send_now != NULL) {
+    send_write(send_now);
+  }
+}
+
+void WriteCoalescer::flush() {
+  assert(m_image_ctx.owner_lock.is_locked());
+
+  std::list<PendingWrite *> writes;
+  {
+    Mutex::Locker locker(m_lock);
+    for (ObjectWritesMap::iterator it = m_object_writes.begin();
+	 it != m_object_writes.end(); ++it) {
+      if (it->second.pending != NULL) {
+	writes.push_back(take_pending(it->second));
+      }
+    }
+  }
+
+  ldout(m_image_ctx.cct, 20) << "flush: sending " << writes.size()
+			     << " pending writes" << dendl;
+  for (std::list<PendingWrite *>::iterator it = writes.begin();
+       it != writes.end(); ++it) {
+    send_write(*it);
+  }
+}
+
+bool WriteCoalescer::can_merge(const PendingWrite &pending,
+			       uint64_t object_off, const bufferlist &bl,
+			       const ::SnapContext &snapc,
+			       int op_flags) const {
+  assert(m_lock.is_locked());
+  return (pending.object_off + pending.bl.length() == object_off &&
+	  pending.bl.length() + bl.length() <= m_max_bytes &&
+	  pending.snapc.seq == snapc.seq &&
+	  pending.op_flags == op_flags);
+}
+
+WriteCoalescer::PendingWrite *WriteCoalescer::take_pending(
+    ObjectWrites &object_writes) {
+  assert(m_lock.is_locked());
+  PendingWrite *pending = object_writes.pending;
+  object_writes.pending = NULL;
+  ++object_writes.in_flight;
+  return pending;
+}
+
+void WriteCoalescer::send_write(PendingWrite *write) {
+  assert(m_image_ctx.owner_lock.is_locked());
+  ldout(m_image_ctx.cct, 20) << "send_write " << write->oid << " "
+			     << write->object_off << "~"
+			     << write->bl.length() << " ("
+			     << write->on_finish.size() << " writes)"
+			     << dendl;
+
+  C_WriteComplete *ctx = new C_WriteComplete(this, write->object_no);
+  ctx->on_finish.swap(write->on_finish);
+
+  AioWrite *req = new AioWrite(&m_image_ctx, write->oid, write->object_no,
+			       write->object_off, write->bl, write->snapc, ctx);
+  req->set_op_flags(write->op_flags);
+  delete write;
+
+  req->send();
+}
+
+void WriteCoalescer::handle_write_complete(uint64_t object_no) {
+  PendingWrite *pending = NULL;
+  {
+    Mutex::Locker locker(m_lock);
+    ObjectWritesMap::iterator it = m_object_writes.find(object_no);
+    assert(it != m_object_writes.end());
+    assert(it->second.in_flight > 0);
+
+    --it->second.in_flight;
+    if (it->second.pending != NULL) {
+      pending = take_pending(it->second);
+    } else if (it->second.in_flight == 0) {
+      m_object_writes.erase(it);
+    }
+  }
+
+  if (pending != NULL) {
+    RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+    send_write(pending);
+  }
+}
+
+} // namespace librbd
@@ -0,0 +1,94 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef CEPH_LIBRBD_WRITE_COALESCER_H
+#define CEPH_LIBRBD_WRITE_COALESCER_H
+
+#include "include/int_types.h"
+#include "include/buffer.h"
+#include "common/Mutex.h"
+#include "common/snap_types.h"
+#include <list>
+#include <map>
+#include <string>
+
+class Context;
+
+namespace librbd {
+
+struct ImageCtx;
+
+/**
+ * Merges small sequential writes to the same object into a single
+ * AioWrite when the cache is disabled.
+ *
+ * A write to an object without any in-flight writes is sent immediately.
+ * While a write to an object is in flight, subsequent writes that extend
+ * the same byte range are held back and appended to a single pending
+ * write, which is sent as soon as the in-flight write completes.  A write
+ * that cannot be merged sends the pending write first to preserve
+ * ordering.  Since pending writes are always released by an in-flight
+ * completion, no timer is needed and an idle image sees no extra latency.
+ */
+class WriteCoalescer {
+public:
+  WriteCoalescer(ImageCtx &image_ctx, uint64_t max_bytes);
+  virtual ~WriteCoalescer();
+
+  /**
+   * Queue a write for an object extent.  The caller must hold owner_lock.
+   */
+  void write(const std::string &oid, uint64_t object_no, uint64_t object_off,
+	     const bufferlist &bl, const ::SnapContext &snapc, int op_flags,
+	     Context *on_finish);
+
+  /**
+   * Send all pending writes without waiting for in-flight writes to
+   * complete.  The caller must hold owner_lock.
+   */
+  void flush();
+
+protected:
+  struct PendingWrite {
+    std::string oid;
+    uint64_t object_no;
+    uint64_t object_off;
+    bufferlist bl;
+    ::SnapContext snapc;
+    int op_flags;
+    std::list<Context *> on_finish;
+  };
+
+  /**
+   * Issue a write that was accounted as in flight.  Tests override this
+   * to hold a write back and so control what gets merged.
+   */
+  virtual void send_write(PendingWrite *write);
+
+private:
+  struct ObjectWrites {
+    uint32_t in_flight;
+    PendingWrite *pending;
+
+    ObjectWrites() : in_flight(0), pending(NULL) {}
+  };
+
+  typedef std::map<uint64_t, ObjectWrites> ObjectWritesMap;
+
+  struct C_WriteComplete;
+
+  ImageCtx &m_image_ctx;
+  uint64_t m_max_bytes;
+
+  Mutex m_lock;
+  ObjectWritesMap m_object_writes;
+
+  bool can_merge(const PendingWrite &pending, uint64_t object_off,
+		 const bufferlist &bl, const ::SnapContext &snapc,
+		 int op_flags) const;
+  PendingWrite *take_pending(ObjectWrites &object_writes);
+  void handle_write_complete(uint64_t object_no);
+};
+
+} // namespace librbd
+
+#endif // CEPH_LIBRBD_WRITE_COALESCER_H
@@ -21,13 +21,16 @@
 #include "librbd/AsyncFlattenRequest.h"
 #include "librbd/AsyncResizeRequest.h"
 #include "librbd/AsyncTrimRequest.h"
+#include "librbd/CloseImageRequest.h"
 #include "librbd/CopyupRequest.h"
 #include "librbd/ImageCtx.h"
 #include "librbd/ImageWatcher.h"
 #include "librbd/internal.h"
 #include "librbd/ObjectMap.h"
+#include "librbd/OpenImageRequest.h"
 #include "librbd/parent_types.h"
 #include "librbd/RebuildObjectMapRequest.h"
+#include "librbd/WriteCoalescer.h"
 #include "include/util.h"
 
 #include "librados/snap_set_diff.h"
@@ -2281,6 +2284,78 @@ reprotect_and_return_err:
     return 0;
   }
 
+  static int refresh_mutable_metadata(ImageCtx *ictx, bool read_only,
+				      ::SnapContext *new_snapc,
+				      vector<string> *snap_names,
+				      vector<uint64_t> *snap_sizes,
+				      vector<parent_info> *snap_parents,
+				      vector<uint8_t> *snap_protection,
+				      vector<uint64_t> *snap_flags)
+  {
+    CephContext *cct = ictx->cct;
+    int r;
+    do {
+      uint64_t incompatible_features;
+      r = cls_client::get_mutable_metadata(&ictx->md_ctx, ictx->header_oid,
+					   read_only,
+					   &ictx->size, &ictx->features,
+					   &incompatible_features,
+					   &ictx->lockers,
+					   &ictx->exclusive_locked,
+					   &ictx->lock_tag,
+					   new_snapc,
+					   &ictx->parent_md);
+      if (r < 0) {
+	lderr(cct) << "Error reading mutable metadata: " << cpp_strerror(r)
+		   << dendl;
+	return r;
+      }
+
+      uint64_t unsupported = incompatible_features & ~RBD_FEATURES_ALL;
+      if (unsupported) {
+	lderr(ictx->cct) << "Image uses unsupported features: "
+			 << unsupported << dendl;
+	return -ENOSYS;
+      }
+
+      r = cls_client::get_flags(&ictx->md_ctx, ictx->header_oid,
+				&ictx->flags, new_snapc->snaps,
+				snap_flags);
+      if (r == -EOPNOTSUPP || r == -EIO) {
+	// Older OSD doesn't support RBD flags, need to assume the worst
+	ldout(ictx->cct, 10) << "OSD does not support RBD flags"
+			     << "disabling object map optimizations"
+			     << dendl;
+	ictx->flags = RBD_FLAG_OBJECT_MAP_INVALID;
+	if ((ictx->features & RBD_FEATURE_FAST_DIFF) != 0) {
+	  ictx->flags |= RBD_FLAG_FAST_DIFF_INVALID;
+	}
+
+	vector<uint64_t> default_flags(new_snapc->snaps.size(), ictx->flags);
+	snap_flags->swap(default_flags);
+      } else if (r == -ENOENT) {
+	ldout(ictx->cct, 10) << "Image at invalid snapshot" << dendl;
+	continue;
+      } else if (r < 0) {
+	lderr(cct) << "Error reading flags: " << cpp_strerror(r) << dendl;
+	return r;
+      }
+
+      r = cls_client::snapshot_list(&(ictx->md_ctx), ictx->header_oid,
+				    new_snapc->snaps, snap_names,
+				    snap_sizes, snap_parents,
+				    snap_protection);
+      // -ENOENT here means we raced with snapshot deletion
+      if (r < 0 && r != -ENOENT) {
+	lderr(ictx->cct) << "snapc = " << *new_snapc << dendl;
+	lderr(ictx->cct) << "Error listing snapshots: " << cpp_strerror(r)
+			 << dendl;
+	return r;
+      }
+    } while (r == -ENOENT);
+    return 0;
+  }
+
   int ictx_refresh(ImageCtx *ictx)
   {
     assert(ictx->owner_lock.is_locked());
@@ -2345,66 +2420,60 @@ reprotect_and_return_err:
 	  ictx->object_prefix = ictx->header.block_name;
 	  ictx->init_layout();
 	} else {
-	  do {
-	    uint64_t incompatible_features;
-	    bool read_only = ictx->read_only || ictx->snap_id != CEPH_NOSNAP;
-	    r = cls_client::get_mutable_metadata(&ictx->md_ctx, ictx->header_oid,
-						 read_only,
-						 &ictx->size, &ictx->features,
-						 &incompatible_features,
-						 &ictx->lockers,
-						 &ictx->exclusive_locked,
-						 &ictx->lock_tag,
-						 &new_snapc,
-						 &ictx->parent_md);
-	    if (r < 0) {
-	      lderr(cct) << "Error reading mutable metadata: " << cpp_strerror(r)
-			 << dendl;
-	      return r;
-	    }
-
-	    uint64_t unsupported = incompatible_features & ~RBD_FEATURES_ALL;
+	  bool read_only = ictx->read_only || ictx->snap_id != CEPH_NOSNAP;
+	  cls_rbd_image_info info;
+	  r = cls_client::get_image_info(&ictx->md_ctx, ictx->header_oid,
+					 read_only, &info, &ictx->lockers,
+					 &ictx->exclusive_locked,
+					 &ictx->lock_tag);
+	  if (r == 0) {
+	    uint64_t unsupported = info.incompatible_features &
+				   ~RBD_FEATURES_ALL;
 	    if (unsupported) {
 	      lderr(ictx->cct) << "Image uses unsupported features: "
 			       << unsupported << dendl;
 	      return -ENOSYS;
 	    }
 
-	    r = cls_client::get_flags(&ictx->md_ctx, ictx->header_oid,
-				      &ictx->flags, new_snapc.snaps,
-				      &snap_flags);
-	    if (r == -EOPNOTSUPP || r == -EIO) {
-	      // Older OSD doesn't support RBD flags, need to assume the worst
-	      ldout(ictx->cct, 10) << "OSD does not support RBD flags"
-				   << "disabling object map optimizations"
-				   << dendl;
-	      ictx->flags = RBD_FLAG_OBJECT_MAP_INVALID;
-              if ((ictx->features & RBD_FEATURE_FAST_DIFF) != 0) {
-                ictx->flags |= RBD_FLAG_FAST_DIFF_INVALID;
-              }
-
-	      vector<uint64_t> default_flags(new_snapc.snaps.size(), ictx->flags);
-	      snap_flags.swap(default_flags);
-            } else if (r == -ENOENT) {
-              ldout(ictx->cct, 10) << "Image at invalid snapshot" << dendl;
-	      continue;
-            } else if (r < 0) {
-              lderr(cct) << "Error reading flags: " << cpp_strerror(r) << dendl;
-              return r;
-            }
-
-	    r = cls_client::snapshot_list(&(ictx->md_ctx), ictx->header_oid,
-					  new_snapc.snaps, &snap_names,
-                                          &snap_sizes, &snap_parents,
-                                          &snap_protection);
-	    // -ENOENT here means we raced with snapshot deletion
-	    if (r < 0 && r != -ENOENT) {
-	      lderr(ictx->cct) << "snapc = " << new_snapc << dendl;
-	      lderr(ictx->cct) << "Error listing snapshots: " << cpp_strerror(r)
-			       << dendl;
+	    ictx->size = info.size;
+	    ictx->features = info.features;
+	    ictx->flags = info.flags;
+	    ictx->parent_md.spec.pool_id = info.parent.pool;
+	    ictx->parent_md.spec.image_id = info.parent.id;
+	    ictx->parent_md.spec.snap_id = info.parent.snapid;
+	    ictx->parent_md.overlap = info.parent.overlap;
+
+	    new_snapc.seq = info.snap_seq;
+	    for (vector<cls_rbd_snap>::const_iterator it = info.snaps.begin();
+		 it != info.snaps.end(); ++it) {
+	      parent_info parent;
+	      parent.spec.pool_id = it->parent.pool;
+	      parent.spec.image_id = it->parent.id;
+	      parent.spec.snap_id = it->parent.snapid;
+	      parent.overlap = it->parent.overlap;
+
+	      new_snapc.snaps.push_back(it->id);
+	      snap_names.push_back(it->name);
+	      snap_sizes.push_back(it->image_size);
+	      snap_parents.push_back(parent);
+	      snap_protection.push_back(it->protection_status);
+	      snap_flags.push_back(it->flags);
+	    }
+	  } else if (r != -EOPNOTSUPP && r != -EIO) {
+	    lderr(cct) << "Error reading image info: " << cpp_strerror(r)
+		       << dendl;
+	    return r;
+	  } else {
+	    // older OSDs lack get_image_info -- fall back to individual calls
+	    ldout(cct, 10) << "OSD does not support get_image_info" << dendl;
+	    r = refresh_mutable_metadata(ictx, read_only, &new_snapc,
+					 &snap_names, &snap_sizes,
+					 &snap_parents, &snap_protection,
+					 &snap_flags);
+	    if (r < 0) {
 	      return r;
 	    }
-	  } while (r == -ENOENT);
+	  }
 	}
 
 	for (size_t i = 0; i < new_snapc.snaps.size(); ++i) {
@@ -2795,12 +2864,26 @@ reprotect_and_return_err:
     if (r < 0)
       goto err_close;
 
+    r = finish_open_image(ictx);
+    if (r < 0)
+      goto err_close;
+
+    return 0;
+
+  err_close:
+    close_image(ictx);
+    return r;
+  }
+
+  int finish_open_image(ImageCtx *ictx)
+  {
+    int r;
     if (!ictx->read_only) {
       r = ictx->register_watch();
       if (r < 0) {
 	lderr(ictx->cct) << "error registering a watch: " << cpp_strerror(r)
 			 << dendl;
-	goto err_close;
+	return r;
       }
     }
 
@@ -2809,16 +2892,21 @@ reprotect_and_return_err:
       r = ictx_refresh(ictx);
     }
     if (r < 0)
-      goto err_close;
+      return r;
 
-    if ((r = _snap_set(ictx, ictx->snap_name.c_str())) < 0)
-      goto err_close;
+    return _snap_set(ictx, ictx->snap_name.c_str());
+  }
 
-    return 0;
+  void aio_open_image(ImageCtx *ictx, Context *on_finish)
+  {
+    ldout(ictx->cct, 20) << "aio_open_image: ictx = " << ictx
+			 << " name = '" << ictx->name
+			 << "' id = '" << ictx->id
+			 << "' snap_name = '"
+			 << ictx->snap_name << "'" << dendl;
 
-  err_close:
-    close_image(ictx);
-    return r;
+    OpenImageRequest *req = new OpenImageRequest(*ictx, on_finish);
+    req->send();
   }
 
   int close_image(ImageCtx *ictx)
@@ -2885,6 +2973,14 @@ reprotect_and_return_err:
     return r;
   }
 
+  void aio_close_image(ImageCtx *ictx, Context *on_finish)
+  {
+    ldout(ictx->cct, 20) << "aio_close_image " << ictx << dendl;
+
+    CloseImageRequest *req = new CloseImageRequest(ictx, on_finish);
+    req->send();
+  }
+
   // 'flatten' child image by copying all parent's blocks
   int flatten(ImageCtx *ictx, ProgressContext &prog_ctx)
   {
@@ -3700,6 +3796,9 @@ reprotect_and_return_err:
     if (ictx->object_cacher) {
       ictx->flush_cache_aio(req_comp);
     } else {
+      if (ictx->write_coalescer != NULL) {
+	ictx->write_coalescer->flush();
+      }
       librados::AioCompletion *rados_completion =
 	librados::Rados::aio_create_completion(req_comp, NULL, rados_ctx_cb);
       ictx->data_ctx.aio_flush_async(rados_completion);
@@ -3835,6 +3934,10 @@ reprotect_and_return_err:
       if (ictx->object_cacher) {
 	c->add_request();
 	ictx->write_to_cache(p->oid, bl, p->length, p->offset, req_comp, op_flags);
+      } else if (ictx->write_coalescer != NULL) {
+	c->add_request();
+	ictx->write_coalescer->write(p->oid.name, p->objectno, p->offset, bl,
+				     snapc, op_flags, req_comp);
       } else {
 	AioWrite *req = new AioWrite(ictx, p->oid.name, p->objectno, p->offset,
 				     bl, snapc, req_comp);
@@ -3960,6 +4063,11 @@ reprotect_and_return_err:
 			       &ictx->layout, off, clip_len, 0, extents);
     }
 
+    if (ictx->write_coalescer != NULL) {
+      // don't let the discard overtake held back writes
+      ictx->write_coalescer->flush();
+    }
+
     for (vector<ObjectExtent>::iterator p = extents.begin(); p != extents.end(); ++p) {
       ldout(cct, 20) << " oid " << p->oid << " " << p->offset << "~" << p->length
 		     << " from " << p->buffer_extents << dendl;
@@ -41,6 +41,9 @@ enum {
   l_librbd_readahead,
   l_librbd_readahead_bytes,
 
+  l_librbd_wr_coalesced,
+  l_librbd_wr_coalesced_bytes,
+
   l_librbd_last,
 };
 
@@ -125,7 +128,10 @@ namespace librbd {
 
   int open_parent(ImageCtx *ictx);
   int open_image(ImageCtx *ictx);
+  int finish_open_image(ImageCtx *ictx);
   int close_image(ImageCtx *ictx);
+  void aio_open_image(ImageCtx *ictx, Context *on_finish);
+  void aio_close_image(ImageCtx *ictx, Context *on_finish);
 
   int copyup_block(ImageCtx *ictx, uint64_t offset, size_t len,
 		   const char *buf);
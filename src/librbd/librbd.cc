@@ -168,6 +168,45 @@ librbd::AioCompletion* get_aio_completion(librbd::RBD::AioCompletion *comp) {
   return reinterpret_cast<librbd::AioCompletion *>(comp->pc);
 }
 
+class C_OpenComplete : public Context {
+public:
+  C_OpenComplete(librbd::ImageCtx *ictx, librbd::AioCompletion* comp,
+		 void **ictxp)
+    : m_cct(ictx->cct), m_ictx(ictx), m_comp(comp), m_ictxp(ictxp) {
+    m_comp->init_image_op(m_cct, librbd::AIO_TYPE_OPEN);
+    m_comp->add_request();
+    m_comp->finish_adding_requests(m_cct);
+  }
+protected:
+  virtual void finish(int r) {
+    // image context is deleted on failure
+    *m_ictxp = (r < 0 ? NULL : m_ictx);
+    m_comp->complete_request(m_cct, r);
+  }
+private:
+  CephContext *m_cct;
+  librbd::ImageCtx *m_ictx;
+  librbd::AioCompletion *m_comp;
+  void **m_ictxp;
+};
+
+class C_CloseComplete : public Context {
+public:
+  C_CloseComplete(CephContext *cct, librbd::AioCompletion* comp)
+    : m_cct(cct), m_comp(comp) {
+    m_comp->init_image_op(m_cct, librbd::AIO_TYPE_CLOSE);
+    m_comp->add_request();
+    m_comp->finish_adding_requests(m_cct);
+  }
+protected:
+  virtual void finish(int r) {
+    m_comp->complete_request(m_cct, r);
+  }
+private:
+  CephContext *m_cct;
+  librbd::AioCompletion *m_comp;
+};
+
 } // anonymous namespace
 
 namespace librbd {
@@ -234,6 +273,23 @@ namespace librbd {
     return 0;
   }
 
+  int RBD::aio_open(IoCtx& io_ctx, Image& image, const char *name,
+		    const char *snap_name, RBD::AioCompletion *c)
+  {
+    ImageCtx *ictx = new ImageCtx(name, "", snap_name, io_ctx, false);
+    tracepoint(librbd, aio_open_image_enter, ictx, ictx->name.c_str(), ictx->id.c_str(), ictx->snap_name.c_str(), ictx->read_only, c->pc);
+
+    if (image.ctx != NULL) {
+      close_image(reinterpret_cast<ImageCtx*>(image.ctx));
+      image.ctx = NULL;
+    }
+
+    librbd::aio_open_image(ictx, new C_OpenComplete(ictx, get_aio_completion(c),
+						    &image.ctx));
+    tracepoint(librbd, aio_open_image_exit, 0);
+    return 0;
+  }
+
   int RBD::open_read_only(IoCtx& io_ctx, Image& image, const char *name,
 			  const char *snap_name)
   {
@@ -404,6 +460,23 @@ namespace librbd {
     return r;
   }
 
+  int Image::aio_close(RBD::AioCompletion *c)
+  {
+    if (!ctx) {
+      return -EINVAL;
+    }
+
+    ImageCtx *ictx = (ImageCtx *)ctx;
+    tracepoint(librbd, aio_close_image_enter, ictx, ictx->name.c_str(), ictx->id.c_str(), c->pc);
+
+    librbd::aio_close_image(ictx, new C_CloseComplete(ictx->cct,
+						      get_aio_completion(c)));
+    ctx = NULL;
+
+    tracepoint(librbd, aio_close_image_exit, 0);
+    return 0;
+  }
+
   int Image::resize(uint64_t size)
   {
     ImageCtx *ictx = (ImageCtx *)ctx;
@@ -1245,6 +1318,23 @@ extern "C" int rbd_open(rados_ioctx_t p, const char *name, rbd_image_t *image,
   return r;
 }
 
+extern "C" int rbd_aio_open(rados_ioctx_t p, const char *name,
+			    rbd_image_t *image, const char *snap_name,
+			    rbd_completion_t c)
+{
+  librados::IoCtx io_ctx;
+  librados::IoCtx::from_rados_ioctx_t(p, io_ctx);
+  librbd::ImageCtx *ictx = new librbd::ImageCtx(name, "", snap_name, io_ctx,
+						false);
+  librbd::RBD::AioCompletion *comp = (librbd::RBD::AioCompletion *)c;
+  tracepoint(librbd, aio_open_image_enter, ictx, ictx->name.c_str(), ictx->id.c_str(), ictx->snap_name.c_str(), ictx->read_only, comp->pc);
+  librbd::aio_open_image(ictx, new C_OpenComplete(ictx,
+						  get_aio_completion(comp),
+						  image));
+  tracepoint(librbd, aio_open_image_exit, 0);
+  return 0;
+}
+
 extern "C" int rbd_open_read_only(rados_ioctx_t p, const char *name,
 				  rbd_image_t *image, const char *snap_name)
 {
@@ -1269,6 +1359,17 @@ extern "C" int rbd_close(rbd_image_t image)
   return r;
 }
 
+extern "C" int rbd_aio_close(rbd_image_t image, rbd_completion_t c)
+{
+  librbd::ImageCtx *ctx = (librbd::ImageCtx *)image;
+  librbd::RBD::AioCompletion *comp = (librbd::RBD::AioCompletion *)c;
+  tracepoint(librbd, aio_close_image_enter, ctx, ctx->name.c_str(), ctx->id.c_str(), comp->pc);
+  librbd::aio_close_image(ctx, new C_CloseComplete(ctx->cct,
+						   get_aio_completion(comp)));
+  tracepoint(librbd, aio_close_image_exit, 0);
+  return 0;
+}
+
 extern "C" int rbd_resize(rbd_image_t image, uint64_t size)
 {
   librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
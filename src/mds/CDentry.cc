@@ -159,6 +159,7 @@ void CDentry::_mark_dirty(LogSegment *ls)
   if (!state_test(STATE_DIRTY)) {
     state_set(STATE_DIRTY);
     dir->inc_num_dirty();
+    dir->dirty_dentries.push_back(&item_dir_dirty);
     get(PIN_DIRTY);
     assert(ls);
   }
@@ -194,6 +195,7 @@ void CDentry::mark_clean()
   put(PIN_DIRTY);
   
   item_dirty.remove_myself();
+  item_dir_dirty.remove_myself();
 
   clear_new();
 }    
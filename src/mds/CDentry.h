@@ -146,7 +146,7 @@ protected:
   version_t projected_version;  // what it will be when i unlock/commit.
 
 public:
-  elist<CDentry*>::item item_dirty;
+  elist<CDentry*>::item item_dirty, item_dir_dirty;
   elist<CDentry*>::item item_stray;
 
 protected:
@@ -174,7 +174,7 @@ public:
     first(f), last(l),
     dir(0),
     version(0), projected_version(0),
-    item_dirty(this),
+    item_dirty(this), item_dir_dirty(this),
     lock(this, &lock_type),
     versionlock(this, &versionlock_type) {
     g_num_dn++;
@@ -186,7 +186,7 @@ public:
     first(f), last(l),
     dir(0),
     version(0), projected_version(0),
-    item_dirty(this),
+    item_dirty(this), item_dir_dirty(this),
     lock(this, &lock_type),
     versionlock(this, &versionlock_type) {
     g_num_dn++;
@@ -361,7 +361,7 @@ public:
   // ---------------------------------------------
   // replicas (on clients)
  public:
-  map<client_t,ClientLease*> client_lease_map;
+  compact_map<client_t,ClientLease*> client_lease_map;
 
   bool is_any_leases() const {
     return !client_lease_map.empty();
@@ -181,6 +181,7 @@ ostream& CDir::print_db_line_prefix(ostream& out)
 
 CDir::CDir(CInode *in, frag_t fg, MDCache *mdcache, bool auth) :
   dirty_rstat_inodes(member_offset(CInode, dirty_rstat_item)),
+  dirty_dentries(member_offset(CDentry, item_dir_dirty)),
   item_dirty(this), item_new(this),
   pop_me(ceph_clock_now(g_ceph_context)),
   pop_nested(ceph_clock_now(g_ceph_context)),
@@ -841,8 +842,10 @@ void CDir::steal_dentry(CDentry *dn)
     dn->dir->adjust_nested_auth_pins(-ap, -dap, NULL);
   }
 
-  if (dn->is_dirty()) 
+  if (dn->is_dirty()) {
     num_dirty++;
+    dirty_dentries.push_back(&dn->item_dir_dirty);
+  }
 
   dn->dir = this;
 }
@@ -1500,6 +1503,13 @@ void CDir::_tmap_fetched(bufferlist& bl, const string& want_dn, int r)
   _omap_fetched(header, omap, want_dn, r);
 }
 
+static uint64_t dir_keys_per_op()
+{
+  if (g_conf->mds_dir_keys_per_op > 0)
+    return g_conf->mds_dir_keys_per_op;
+  return (uint64_t)-1;
+}
+
 class C_IO_Dir_OMAP_Fetched : public CDirIOContext {
  protected:
   string want_dn;
@@ -1516,7 +1526,51 @@ class C_IO_Dir_OMAP_Fetched : public CDirIOContext {
       dir->inode->verify_diri_backtrace(btbl, ret3);
     if (r >= 0) r = ret1;
     if (r >= 0) r = ret2;
-    dir->_omap_fetched(hdrbl, omap, want_dn, r);
+    if (r >= 0 && hdrbl.length() > 0 && omap.size() >= dir_keys_per_op())
+      dir->_omap_fetch_more(hdrbl, omap, want_dn);
+    else
+      dir->_omap_fetched(hdrbl, omap, want_dn, r);
+  }
+};
+
+class C_IO_Dir_OMAP_FetchedMore : public CDirIOContext {
+ protected:
+  string want_dn;
+ public:
+  bufferlist hdrbl;
+  map<string, bufferlist> omap;       // what we have so far
+  map<string, bufferlist> omap_more;  // this chunk
+  int ret;
+
+  C_IO_Dir_OMAP_FetchedMore(CDir *d, const string& w)
+    : CDirIOContext(d), want_dn(w), ret(0) { }
+  void finish(int r) {
+    if (r >= 0) r = ret;
+    bool more = r >= 0 && omap_more.size() >= dir_keys_per_op();
+    omap.insert(omap_more.begin(), omap_more.end());
+    if (more)
+      dir->_omap_fetch_more(hdrbl, omap, want_dn);
+    else
+      dir->_omap_fetched(hdrbl, omap, want_dn, r);
+  }
+};
+
+class C_IO_Dir_OMAP_FetchedKeys : public CDirIOContext {
+ protected:
+  set<string> dnames;
+  MDSInternalContextBase *fin;
+ public:
+  bufferlist hdrbl;
+  map<string, bufferlist> omap;
+  int ret1, ret2;
+
+  C_IO_Dir_OMAP_FetchedKeys(CDir *d, const set<string>& n,
+			    MDSInternalContextBase *c)
+    : CDirIOContext(d), dnames(n), fin(c), ret1(0), ret2(0) { }
+  void finish(int r) {
+    if (r >= 0) r = ret1;
+    if (r >= 0) r = ret2;
+    dir->_omap_fetched_keys(hdrbl, omap, dnames, r, fin);
   }
 };
 
@@ -1527,7 +1581,8 @@ void CDir::_omap_fetch(const string& want_dn)
   object_locator_t oloc(cache->mds->mdsmap->get_metadata_pool());
   ObjectOperation rd;
   rd.omap_get_header(&fin->hdrbl, &fin->ret1);
-  rd.omap_get_vals("", "", (uint64_t)-1, &fin->omap, &fin->ret2);
+  // huge dirfrags are read a chunk at a time, see _omap_fetch_more()
+  rd.omap_get_vals("", "", dir_keys_per_op(), &fin->omap, &fin->ret2);
   // check the correctness of backtrace
   if (g_conf->mds_verify_backtrace > 0 && frag == frag_t()) {
     rd.getxattr("parent", &fin->btbl, &fin->ret3);
@@ -1540,6 +1595,139 @@ void CDir::_omap_fetch(const string& want_dn)
 			     new C_OnFinisher(fin, &cache->mds->finisher));
 }
 
+void CDir::_omap_fetch_more(bufferlist& hdrbl, map<string, bufferlist>& omap,
+			    const string& want_dn)
+{
+  dout(10) << "_omap_fetch_more after " << omap.size() << " keys" << dendl;
+
+  C_IO_Dir_OMAP_FetchedMore *fin = new C_IO_Dir_OMAP_FetchedMore(this, want_dn);
+  fin->hdrbl.claim(hdrbl);
+  fin->omap.swap(omap);
+  object_t oid = get_ondisk_object();
+  object_locator_t oloc(cache->mds->mdsmap->get_metadata_pool());
+  ObjectOperation rd;
+  rd.omap_get_vals(fin->omap.rbegin()->first, "", dir_keys_per_op(),
+		   &fin->omap_more, &fin->ret);
+  cache->mds->objecter->read(oid, oloc, rd, CEPH_NOSNAP, NULL, 0,
+			     new C_OnFinisher(fin, &cache->mds->finisher));
+}
+
+void CDir::fetch_keys(MDSInternalContextBase *c, const set<string>& dnames)
+{
+  dout(10) << "fetch_keys " << dnames << " on " << *this << dendl;
+
+  assert(is_auth());
+  assert(!is_complete());
+  assert(c);
+
+  // leave the odd cases to a full fetch
+  if ((inode->inode.nlink == 0 && !inode->snaprealm) ||
+      state_test(STATE_REJOINUNDEF)) {
+    fetch(c);
+    return;
+  }
+
+  if (!can_auth_pin()) {
+    dout(7) << "fetch_keys waiting for authpinnable" << dendl;
+    add_waiter(WAIT_UNFREEZE, c);
+    return;
+  }
+  if (state_test(CDir::STATE_FETCHING)) {
+    dout(7) << "fetch_keys waiting for full fetch" << dendl;
+    add_waiter(WAIT_COMPLETE, c);
+    return;
+  }
+
+  auth_pin(this);
+
+  if (cache->mds->logger) cache->mds->logger->inc(l_mds_dir_fetch_keys);
+
+  C_IO_Dir_OMAP_FetchedKeys *fin = new C_IO_Dir_OMAP_FetchedKeys(this, dnames, c);
+  set<string> keys;
+  for (set<string>::const_iterator p = dnames.begin(); p != dnames.end(); ++p) {
+    string key;
+    dentry_key_t(CEPH_NOSNAP, p->c_str()).encode(key);
+    keys.insert(key);
+  }
+  object_t oid = get_ondisk_object();
+  object_locator_t oloc(cache->mds->mdsmap->get_metadata_pool());
+  ObjectOperation rd;
+  rd.omap_get_header(&fin->hdrbl, &fin->ret1);
+  rd.omap_get_vals_by_keys(keys, &fin->omap, &fin->ret2);
+  cache->mds->objecter->read(oid, oloc, rd, CEPH_NOSNAP, NULL, 0,
+			     new C_OnFinisher(fin, &cache->mds->finisher));
+}
+
+void CDir::_omap_fetched_keys(bufferlist& hdrbl, map<string, bufferlist>& omap,
+			      const set<string>& dnames, int r,
+			      MDSInternalContextBase *c)
+{
+  dout(10) << "_omap_fetched_keys " << omap.size() << " of " << dnames.size()
+	   << " keys for " << *this << " r=" << r << dendl;
+
+  assert(is_auth());
+  assert(!is_frozen());
+
+  if (is_complete()) {
+    // a full fetch got there first
+    cache->mds->queue_waiter(c);
+    auth_unpin(this);
+    return;
+  }
+
+  // a missing or tmap object, or a corrupt fnode: let a full fetch deal
+  // with it
+  fnode_t got_fnode;
+  if (r < 0 || hdrbl.length() == 0 || _decode_fnode(hdrbl, &got_fnode) < 0) {
+    fetch(c);
+    auth_unpin(this);
+    return;
+  }
+  _take_fnode(got_fnode);
+
+  list<CInode*> undef_inodes;
+  bool force_dirty = false;
+  int pos = 0;
+  for (map<string, bufferlist>::iterator p = omap.begin();
+       p != omap.end();
+       ++p, ++pos) {
+    string dname;
+    snapid_t last;
+    dentry_key_t::decode_helper(p->first, dname, last);
+    try {
+      _load_dentry(p->first, dname, last, p->second, pos, NULL,
+		   &force_dirty, &undef_inodes);
+    } catch (const buffer::error &err) {
+      cache->mds->clog->warn() << "Corrupt dentry '" << dname << "' in "
+                                  "dir frag " << dirfrag() << ": "
+                               << err;
+      fetch(c);
+      auth_unpin(this);
+      return;
+    }
+  }
+
+  while (!undef_inodes.empty()) {
+    CInode *in = undef_inodes.front();
+    undef_inodes.pop_front();
+    in->state_clear(CInode::STATE_REJOINUNDEF);
+    cache->opened_undef_inode(in);
+  }
+
+  // the dentries we wanted but that aren't on disk don't exist
+  for (set<string>::const_iterator p = dnames.begin(); p != dnames.end(); ++p) {
+    CDentry *dn = lookup(*p);
+    if (!dn) {
+      dn = add_null_dentry(*p);
+      dout(12) << "_omap_fetched_keys  added null " << *dn << dendl;
+    }
+    cache->touch_dentry(dn);
+  }
+
+  cache->mds->queue_waiter(c);
+  auth_unpin(this);
+}
+
 CDentry *CDir::_load_dentry(
     const std::string &key,
     const std::string &dname,
@@ -1743,42 +1931,13 @@ void CDir::_omap_fetched(bufferlist& hdrbl, map<string, bufferlist>& omap,
   }
 
   fnode_t got_fnode;
-  {
-    bufferlist::iterator p = hdrbl.begin();
-    try {
-      ::decode(got_fnode, p);
-    } catch (const buffer::error &err) {
-      derr << "Corrupt fnode in dirfrag " << dirfrag()
-        << ": " << err << dendl;
-      clog->warn() << "Corrupt fnode header in " << dirfrag() << ": "
-		  << err;
-      go_bad();
-      return;
-    }
-    if (!p.end()) {
-      clog->warn() << "header buffer of dir " << dirfrag() << " has "
-		  << hdrbl.length() - p.get_off() << " extra bytes\n";
-      go_bad();
-      return;
-    }
+  if (_decode_fnode(hdrbl, &got_fnode) < 0) {
+    go_bad();
+    return;
   }
 
   dout(10) << "_fetched version " << got_fnode.version << dendl;
-  
-  // take the loaded fnode?
-  // only if we are a fresh CDir* with no prior state.
-  if (get_version() == 0) {
-    assert(!is_projected());
-    assert(!state_test(STATE_COMMITTING));
-    fnode = got_fnode;
-    projected_version = committing_version = committed_version = got_fnode.version;
-
-    if (state_test(STATE_REJOINUNDEF)) {
-      assert(cache->mds->is_rejoin());
-      state_clear(STATE_REJOINUNDEF);
-      cache->opened_undef_dirfrag(this);
-    }
-  }
+  _take_fnode(got_fnode);
 
   list<CInode*> undef_inodes;
 
@@ -1877,6 +2036,45 @@ void CDir::_omap_fetched(bufferlist& hdrbl, map<string, bufferlist>& omap,
   finish_waiting(WAIT_COMPLETE, 0);
 }
 
+int CDir::_decode_fnode(bufferlist& hdrbl, fnode_t *got_fnode)
+{
+  LogChannelRef clog = cache->mds->clog;
+  bufferlist::iterator p = hdrbl.begin();
+  try {
+    ::decode(*got_fnode, p);
+  } catch (const buffer::error &err) {
+    derr << "Corrupt fnode in dirfrag " << dirfrag()
+      << ": " << err << dendl;
+    clog->warn() << "Corrupt fnode header in " << dirfrag() << ": "
+		<< err;
+    return -EINVAL;
+  }
+  if (!p.end()) {
+    clog->warn() << "header buffer of dir " << dirfrag() << " has "
+		<< hdrbl.length() - p.get_off() << " extra bytes\n";
+    return -EINVAL;
+  }
+  return 0;
+}
+
+void CDir::_take_fnode(const fnode_t& got_fnode)
+{
+  // take the loaded fnode?
+  // only if we are a fresh CDir* with no prior state.
+  if (get_version() == 0) {
+    assert(!is_projected());
+    assert(!state_test(STATE_COMMITTING));
+    fnode = got_fnode;
+    projected_version = committing_version = committed_version = got_fnode.version;
+
+    if (state_test(STATE_REJOINUNDEF)) {
+      assert(cache->mds->is_rejoin());
+      state_clear(STATE_REJOINUNDEF);
+      cache->opened_undef_dirfrag(this);
+    }
+  }
+}
+
 void CDir::go_bad()
 {
   state_set(STATE_BADFRAG);
@@ -1942,7 +2140,7 @@ public:
 
 /**
  * Flush out the modified dentries in this dir. Keep the bufferlist
- * below max_write_size;
+ * below max_write_size, and the keys per op below mds_dir_keys_per_op;
  */
 void CDir::_omap_commit(int op_prio)
 {
@@ -1950,6 +2148,7 @@ void CDir::_omap_commit(int op_prio)
 
   unsigned max_write_size = cache->max_dir_commit_size;
   unsigned write_size = 0;
+  uint64_t max_write_keys = dir_keys_per_op();
 
   if (op_prio < 0)
     op_prio = CEPH_MSG_PRIO_DEFAULT;
@@ -1989,10 +2188,23 @@ void CDir::_omap_commit(int op_prio)
     stale_items.clear();
   }
 
-  for (map_t::iterator p = items.begin();
-      p != items.end(); ) {
-    CDentry *dn = p->second;
-    ++p;
+  // only the dirty dentries need a look, unless stale snap dentries are
+  // to be trimmed or we are fragmenting
+  vector<CDentry*> dns;
+  if (snaps || state_test(CDir::STATE_FRAGMENTING)) {
+    dns.reserve(items.size());
+    for (map_t::iterator p = items.begin(); p != items.end(); ++p)
+      dns.push_back(p->second);
+  } else {
+    dns.reserve(num_dirty);
+    for (elist<CDentry*>::iterator p = dirty_dentries.begin(); !p.end(); ++p)
+      dns.push_back(*p);
+  }
+  dout(10) << "_omap_commit " << dns.size() << " of " << items.size()
+	   << " dentries" << dendl;
+
+  for (vector<CDentry*>::iterator p = dns.begin(); p != dns.end(); ++p) {
+    CDentry *dn = *p;
 
     string key;
     dn->key().encode(key);
@@ -2021,7 +2233,8 @@ void CDir::_omap_commit(int op_prio)
       to_set[key].swap(dnbl);
     }
 
-    if (write_size >= max_write_size) {
+    if (write_size >= max_write_size ||
+	to_set.size() + to_remove.size() >= max_write_keys) {
       ObjectOperation op;
       op.priority = op_prio;
 
@@ -175,6 +175,9 @@ public:
   // my inodes with dirty rstat data
   elist<CInode*> dirty_rstat_inodes;     
 
+  // my dirty dentries, so that a commit doesn't walk all of items
+  elist<CDentry*> dirty_dentries;
+
   void resync_accounted_fragstat();
   void resync_accounted_rstat();
   void assimilate_dirty_rstat_inodes();
@@ -288,6 +291,8 @@ protected:
   friend class CDirExport;
   friend class C_IO_Dir_TMAP_Fetched;
   friend class C_IO_Dir_OMAP_Fetched;
+  friend class C_IO_Dir_OMAP_FetchedMore;
+  friend class C_IO_Dir_OMAP_FetchedKeys;
   friend class C_IO_Dir_Committed;
 
   bloom_filter *bloom;
@@ -495,8 +500,20 @@ private:
   }
   void fetch(MDSInternalContextBase *c, bool ignore_authpinnability=false);
   void fetch(MDSInternalContextBase *c, const std::string& want_dn, bool ignore_authpinnability=false);
+  /*
+   * Load just the given head dentries, adding null dentries for those
+   * that don't exist on disk, without marking the dirfrag complete.
+   */
+  void fetch_keys(MDSInternalContextBase *c, const std::set<std::string>& dnames);
 protected:
   void _omap_fetch(const std::string& want_dn);
+  void _omap_fetch_more(bufferlist& hdrbl, std::map<std::string, bufferlist>& omap,
+			const std::string& want_dn);
+  void _omap_fetched_keys(bufferlist& hdrbl, std::map<std::string, bufferlist>& omap,
+			  const std::set<std::string>& dnames, int r,
+			  MDSInternalContextBase *c);
+  int _decode_fnode(bufferlist& hdrbl, fnode_t *got_fnode);
+  void _take_fnode(const fnode_t& got_fnode);
   CDentry *_load_dentry(
       const std::string &key,
       const std::string &dname,
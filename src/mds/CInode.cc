@@ -210,7 +210,7 @@ ostream& operator<<(ostream& out, const CInode& in)
 
   if (!in.get_client_caps().empty()) {
     out << " caps={";
-    for (map<client_t,Capability*>::const_iterator it = in.get_client_caps().begin();
+    for (compact_map<client_t,Capability*>::const_iterator it = in.get_client_caps().begin();
          it != in.get_client_caps().end();
          ++it) {
       if (it != in.get_client_caps().begin()) out << ",";
@@ -2608,7 +2608,7 @@ client_t CInode::calc_ideal_loner()
   
   int n = 0;
   client_t loner = -1;
-  for (map<client_t,Capability*>::iterator it = client_caps.begin();
+  for (compact_map<client_t,Capability*>::iterator it = client_caps.begin();
        it != client_caps.end();
        ++it) 
     if (!it->second->is_stale() &&
@@ -2774,7 +2774,7 @@ void CInode::move_to_realm(SnapRealm *realm)
 {
   dout(10) << "move_to_realm joining realm " << *realm
 	   << ", leaving realm " << *containing_realm << dendl;
-  for (map<client_t,Capability*>::iterator q = client_caps.begin();
+  for (compact_map<client_t,Capability*>::iterator q = client_caps.begin();
        q != client_caps.end();
        ++q) {
     containing_realm->remove_cap(q->first, q->second);
@@ -2813,7 +2813,7 @@ void CInode::clear_client_caps_after_export()
 
 void CInode::export_client_caps(map<client_t,Capability::Export>& cl)
 {
-  for (map<client_t,Capability*>::iterator it = client_caps.begin();
+  for (compact_map<client_t,Capability*>::iterator it = client_caps.begin();
        it != client_caps.end();
        ++it) {
     cl[it->first] = it->second->make_export();
@@ -2899,7 +2899,7 @@ int CInode::get_caps_issued(int *ploner, int *pother, int *pxlocker,
     loner_cap = -1;
   }
 
-  for (map<client_t,Capability*>::const_iterator it = client_caps.begin();
+  for (compact_map<client_t,Capability*>::iterator it = client_caps.begin();
        it != client_caps.end();
        ++it) {
     int i = it->second->issued();
@@ -2918,7 +2918,7 @@ int CInode::get_caps_issued(int *ploner, int *pother, int *pxlocker,
 
 bool CInode::is_any_caps_wanted() const
 {
-  for (map<client_t,Capability*>::const_iterator it = client_caps.begin();
+  for (compact_map<client_t,Capability*>::const_iterator it = client_caps.begin();
        it != client_caps.end();
        ++it)
     if (it->second->wanted())
@@ -2930,7 +2930,7 @@ int CInode::get_caps_wanted(int *ploner, int *pother, int shift, int mask) const
 {
   int w = 0;
   int loner = 0, other = 0;
-  for (map<client_t,Capability*>::const_iterator it = client_caps.begin();
+  for (compact_map<client_t,Capability*>::const_iterator it = client_caps.begin();
        it != client_caps.end();
        ++it) {
     if (!it->second->is_stale()) {
@@ -3949,7 +3949,7 @@ void CInode::dump(Formatter *f) const
   f->close_section();
 
   f->open_array_section("client_caps");
-  for (map<client_t,Capability*>::const_iterator it = client_caps.begin();
+  for (compact_map<client_t,Capability*>::const_iterator it = client_caps.begin();
        it != client_caps.end(); ++it) {
     f->open_object_section("client_cap");
     f->dump_int("client_id", it->first.v);
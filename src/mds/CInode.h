@@ -441,7 +441,7 @@ public:
   // -- distributed state --
 protected:
   // file capabilities
-  std::map<client_t, Capability*> client_caps;         // client -> caps
+  compact_map<client_t, Capability*> client_caps;     // client -> caps
   compact_map<int32_t, int32_t>      mds_caps_wanted;     // [auth] mds -> caps wanted
   int                   replica_caps_wanted; // [replica] what i've requested from auth
 
@@ -816,7 +816,7 @@ public:
 
   int count_nonstale_caps() {
     int n = 0;
-    for (std::map<client_t,Capability*>::iterator it = client_caps.begin();
+    for (compact_map<client_t,Capability*>::iterator it = client_caps.begin();
          it != client_caps.end();
          ++it) 
       if (!it->second->is_stale())
@@ -825,7 +825,7 @@ public:
   }
   bool multiple_nonstale_caps() {
     int n = 0;
-    for (std::map<client_t,Capability*>::iterator it = client_caps.begin();
+    for (compact_map<client_t,Capability*>::iterator it = client_caps.begin();
          it != client_caps.end();
          ++it) 
       if (!it->second->is_stale()) {
@@ -842,7 +842,7 @@ public:
   const compact_map<int32_t,int32_t>& get_mds_caps_wanted() const { return mds_caps_wanted; }
   compact_map<int32_t,int32_t>& get_mds_caps_wanted() { return mds_caps_wanted; }
 
-  const std::map<client_t,Capability*>& get_client_caps() const { return client_caps; }
+  const compact_map<client_t,Capability*>& get_client_caps() const { return client_caps; }
   Capability *get_client_cap(client_t client) {
     if (client_caps.count(client))
       return client_caps[client];
@@ -850,7 +850,7 @@ public:
   }
   int get_client_cap_pending(client_t client) const {
     if (client_caps.count(client)) {
-      std::map<client_t, Capability*>::const_iterator found = client_caps.find(client);
+      compact_map<client_t,Capability*>::const_iterator found = client_caps.find(client);
       return found->second->pending();
     } else {
       return 0;
@@ -1854,13 +1854,12 @@ bool Locker::issue_caps(CInode *in, Capability *only_cap)
 
   // count conflicts with
   int nissued = 0;        
+  bool lease_skipped = false;
+  utime_t now = ceph_clock_now(g_ceph_context);
 
   // client caps
-  map<client_t, Capability*>::iterator it;
-  if (only_cap)
-    it = in->client_caps.find(only_cap->get_client());
-  else
-    it = in->client_caps.begin();
+  compact_map<client_t,Capability*>::iterator it = only_cap ?
+    in->client_caps.find(only_cap->get_client()) : in->client_caps.begin();
   for (; it != in->client_caps.end(); ++it) {
     Capability *cap = it->second;
     if (cap->is_stale())
@@ -1911,6 +1910,7 @@ bool Locker::issue_caps(CInode *in, Capability *only_cap)
       // include caps that clients generally like, while we're at it.
       int likes = in->get_caps_liked();      
       int before = pending;
+      bool revoking = cap->issued() != pending;
       long seq;
       if (pending & ~allowed)
 	seq = cap->issue((wanted|likes) & allowed & pending);  // if revoking, don't issue anything new.
@@ -1922,6 +1922,19 @@ bool Locker::issue_caps(CInode *in, Capability *only_cap)
 	// haven't send caps to client yet
 	if (before & ~after)
 	  cap->confirm_receipt(seq, after);
+      } else if ((before & ~after) &&
+		 !((before & ~after) & ~CEPH_CAP_ANY_SHARED) &&
+		 !revoking &&
+		 cap_lease_lapsed(cap, session, now)) {
+	// the client stopped trusting these when its lease ran out and
+	// will ask before using them again, so there's no need to tell it
+	dout(7) << "   client." << it->first << " lease on "
+		<< ccap_string(before & ~after) << " has run out, not revoking"
+		<< dendl;
+	cap->confirm_receipt(seq, after);
+	lease_skipped = true;
+	if (mds->logger)
+	  mds->logger->inc(l_mds_cap_lease_skip);
       } else {
         dout(7) << "   sending MClientCaps to client." << it->first
 		<< " seq " << cap->get_last_seq()
@@ -1945,6 +1958,8 @@ bool Locker::issue_caps(CInode *in, Capability *only_cap)
 	in->encode_cap_message(m, cap);
 
 	mds->send_message_client_counted(m, it->first);
+	// after it's queued, so it's no earlier than the batch stamp
+	cap->set_last_issue_stamp(ceph_clock_now(g_ceph_context));
       }
     }
 
@@ -1952,14 +1967,38 @@ bool Locker::issue_caps(CInode *in, Capability *only_cap)
       break;
   }
 
+  // no ack is coming for revokes we didn't send, so move any locks
+  // gathering them along ourselves
+  if (lease_skipped)
+    mds->queue_waiter(new C_Locker_Eval(this, in, CEPH_CAP_LOCKS));
+
   return (nissued == 0);  // true if no re-issued, no callbacks
 }
 
+/*
+ * Has the client's lease on the shared caps it holds here run out?  It
+ * trusts them for cap_lease_ttl from when it sent the request we
+ * answered, or from the stamp on the cap batch, so never past our stamp
+ * plus the ttl however late the message got there.  We allow as long
+ * again for our clock being ahead of the client's.
+ */
+bool Locker::cap_lease_lapsed(Capability *cap, Session *session, utime_t now)
+{
+  if (!session)
+    return false;
+  double ttl = session->get_cap_lease_ttl();
+  if (ttl <= 0)
+    return false;
+  utime_t until = cap->get_last_issue_stamp();
+  until += ttl * 2;
+  return now > until;
+}
+
 void Locker::issue_truncate(CInode *in)
 {
   dout(7) << "issue_truncate on " << *in << dendl;
   
-  for (map<client_t, Capability*>::iterator it = in->client_caps.begin();
+  for (compact_map<client_t,Capability*>::iterator it = in->client_caps.begin();
        it != in->client_caps.end();
        ++it) {
     Capability *cap = it->second;
@@ -2153,7 +2192,7 @@ void Locker::calc_new_client_ranges(CInode *in, uint64_t size, map<client_t,clie
 
   // increase ranges as appropriate.
   // shrink to 0 if no WR|BUFFER caps issued.
-  for (map<client_t,Capability*>::iterator p = in->client_caps.begin();
+  for (compact_map<client_t,Capability*>::iterator p = in->client_caps.begin();
        p != in->client_caps.end();
        ++p) {
     if ((p->second->issued() | p->second->wanted()) & (CEPH_CAP_FILE_WR|CEPH_CAP_FILE_BUFFER)) {
@@ -2302,11 +2341,8 @@ void Locker::share_inode_max_size(CInode *in, Capability *only_cap)
    * the cap later.
    */
   dout(10) << "share_inode_max_size on " << *in << dendl;
-  map<client_t, Capability*>::iterator it;
-  if (only_cap)
-    it = in->client_caps.find(only_cap->get_client());
-  else
-    it = in->client_caps.begin();
+  compact_map<client_t,Capability*>::iterator it = only_cap ?
+    in->client_caps.find(only_cap->get_client()) : in->client_caps.begin();
   for (; it != in->client_caps.end(); ++it) {
     const client_t client = it->first;
     Capability *cap = it->second;
@@ -2324,6 +2360,7 @@ void Locker::share_inode_max_size(CInode *in, Capability *only_cap)
                                        mds->get_osd_epoch_barrier());
       in->encode_cap_message(m, cap);
       mds->send_message_client_counted(m, client);
+      cap->set_last_issue_stamp(ceph_clock_now(g_ceph_context));
     }
     if (only_cap)
       break;
@@ -3447,7 +3484,7 @@ void Locker::revoke_client_leases(SimpleLock *lock)
 {
   int n = 0;
   CDentry *dn = static_cast<CDentry*>(lock->get_parent());
-  for (map<client_t, ClientLease*>::iterator p = dn->client_lease_map.begin();
+  for (compact_map<client_t,ClientLease*>::iterator p = dn->client_lease_map.begin();
        p != dn->client_lease_map.end();
        ++p) {
     ClientLease *l = p->second;
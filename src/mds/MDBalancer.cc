@@ -24,10 +24,12 @@
 #include "Migrator.h"
 
 #include "include/Context.h"
+#include "common/Formatter.h"
 #include "msg/Messenger.h"
 #include "messages/MHeartbeat.h"
 #include "messages/MMDSLoadTargets.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <vector>
@@ -597,7 +599,10 @@ void MDBalancer::prep_rebalance(int beat)
 
 void MDBalancer::try_rebalance()
 {
-  if (!check_targets())
+  // a dry run only reports what it would do, so it doesn't ask the
+  // monitor for export targets either
+  bool dry_run = g_conf->mds_bal_dry_run;
+  if (!dry_run && !check_targets())
     return;
 
   if (g_conf->mds_thrash_exports) {
@@ -606,6 +611,10 @@ void MDBalancer::try_rebalance()
     return;
   }
 
+  plan.clear();
+  plan_stamp = ceph_clock_now(g_ceph_context);
+  trim_history();
+
   // make a sorted list of my imports
   map<double,CDir*>    import_pop_map;
   multimap<mds_rank_t,CDir*>  import_from_map;
@@ -626,7 +635,9 @@ void MDBalancer::try_rebalance()
       dout(0) << " exporting idle (" << pop << ") import " << *im
 	      << " back to mds." << im->inode->authority().first
 	      << dendl;
-      mds->mdcache->migrator->export_dir_nicely(im, im->inode->authority().first);
+      note_decision(im, im->inode->authority().first, pop, 0, 0, "idle");
+      if (!dry_run)
+	mds->mdcache->migrator->export_dir_nicely(im, im->inode->authority().first);
       continue;
     }
 
@@ -674,16 +685,20 @@ void MDBalancer::try_rebalance()
 	  continue;
 	if (dir->is_freezing() || dir->is_frozen()) continue;  // export pbly already in progress
 	double pop = dir->pop_auth_subtree.meta_load(rebalance_time, mds->mdcache->decayrate);
+	double load = dirfrag_load(dir);
 	assert(dir->inode->authority().first == target);  // cuz that's how i put it in the map, dummy
 
-	if (pop <= amount-have) {
-	  dout(0) << "reexporting " << *dir
-		  << " pop " << pop
-		  << " back to mds." << target << dendl;
-	  mds->mdcache->migrator->export_dir_nicely(dir, target);
-	  have += pop;
-	  import_from_map.erase(plast);
-	  import_pop_map.erase(pop);
+	if (load <= amount-have) {
+	  if (check_export(dir, target, load)) {
+	    dout(0) << "reexporting " << *dir
+		    << " pop " << pop
+		    << " back to mds." << target << dendl;
+	    if (!dry_run)
+	      mds->mdcache->migrator->export_dir_nicely(dir, target);
+	    have += load;
+	    import_from_map.erase(plast);
+	    import_pop_map.erase(pop);
+	  }
 	} else {
 	  dout(5) << "can't reexport " << *dir << ", too big " << pop << dendl;
 	}
@@ -730,21 +745,22 @@ void MDBalancer::try_rebalance()
 	 pot != candidates.end();
 	 ++pot) {
       if ((*pot)->get_inode()->is_stray()) continue;
-      find_exports(*pot, amount, exports, have, already_exporting);
+      find_exports(*pot, target, amount, exports, have, already_exporting);
       if (have > amount-MIN_OFFLOAD)
 	break;
     }
     //fudge = amount - have;
 
     for (list<CDir*>::iterator it = exports.begin(); it != exports.end(); ++it) {
-      dout(0) << "   - exporting "
+      dout(0) << (dry_run ? "   - would export " : "   - exporting ")
 	       << (*it)->pop_auth_subtree
 	       << " "
 	       << (*it)->pop_auth_subtree.meta_load(rebalance_time, mds->mdcache->decayrate)
 	       << " to mds." << target
 	       << " " << **it
 	       << dendl;
-      mds->mdcache->migrator->export_dir_nicely(*it, target);
+      if (!dry_run)
+	mds->mdcache->migrator->export_dir_nicely(*it, target);
     }
   }
 
@@ -812,6 +828,7 @@ bool MDBalancer::check_targets()
 }
 
 void MDBalancer::find_exports(CDir *dir,
+                              mds_rank_t target,
                               double amount,
                               list<CDir*>& exports,
                               double& have,
@@ -851,7 +868,7 @@ void MDBalancer::find_exports(CDir *dir,
       if (subdir->is_frozen()) continue;  // can't export this right now!
 
       // how popular?
-      double pop = subdir->pop_auth_subtree.meta_load(rebalance_time, mds->mdcache->decayrate);
+      double pop = dirfrag_load(subdir);
       subdir_sum += pop;
       dout(15) << "   subdir pop " << pop << " " << *subdir << dendl;
 
@@ -859,6 +876,8 @@ void MDBalancer::find_exports(CDir *dir,
 
       // lucky find?
       if (pop > needmin && pop < needmax) {
+	if (!check_export(subdir, target, pop))
+	  continue;
 	exports.push_back(subdir);
 	already_exporting.insert(subdir);
 	have += pop;
@@ -885,6 +904,8 @@ void MDBalancer::find_exports(CDir *dir,
     if ((*it).first < midchunk)
       break;  // try later
 
+    if (!check_export(it->second, target, it->first))
+      continue;
     dout(7) << "   taking smaller " << *(*it).second << dendl;
 
     exports.push_back((*it).second);
@@ -899,7 +920,7 @@ void MDBalancer::find_exports(CDir *dir,
        it != bigger_unrep.end();
        ++it) {
     dout(15) << "   descending into " << **it << dendl;
-    find_exports(*it, amount, exports, have, already_exporting);
+    find_exports(*it, target, amount, exports, have, already_exporting);
     if (have > needmin)
       return;
   }
@@ -908,6 +929,8 @@ void MDBalancer::find_exports(CDir *dir,
   for (;
        it != smaller.rend();
        ++it) {
+    if (!check_export(it->second, target, it->first))
+      continue;
     dout(7) << "   taking (much) smaller " << it->first << " " << *(*it).second << dendl;
 
     exports.push_back((*it).second);
@@ -922,13 +945,197 @@ void MDBalancer::find_exports(CDir *dir,
        it != bigger_rep.end();
        ++it) {
     dout(7) << "   descending into replicated " << **it << dendl;
-    find_exports(*it, amount, exports, have, already_exporting);
+    find_exports(*it, target, amount, exports, have, already_exporting);
     if (have > needmin)
       return;
   }
 
 }
 
+/*
+ * The load of a dirfrag's subtree that exporting it would take off us.
+ * With the cost model that is the median of what we saw at the last
+ * mds_bal_heat_samples rebalances we saw it at, so a short burst
+ * doesn't get a subtree moved.
+ */
+double MDBalancer::dirfrag_load(CDir *dir)
+{
+  double load = dir->pop_auth_subtree.meta_load(rebalance_time, mds->mdcache->decayrate);
+  if (!g_conf->mds_bal_cost_model)
+    return load;
+
+  return project_load(heat_history[dir->dirfrag()], rebalance_time, load);
+}
+
+/*
+ * Note the load seen at a rebalance (once per rebalance) and return the
+ * median of the samples recorded, never more than the load now.
+ */
+double MDBalancer::project_load(heat_history_t& h, utime_t now, double load)
+{
+  if (h.samples.empty() || h.last != now) {
+    h.last = now;
+    h.samples.push_back(load);
+  }
+  unsigned num = MAX(g_conf->mds_bal_heat_samples, 1);
+  while (h.samples.size() > num)
+    h.samples.pop_front();
+
+  vector<float> v(h.samples.begin(), h.samples.end());
+  nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+  return MIN(load, (double)v[v.size() / 2]);
+}
+
+/*
+ * Does the load we expect to shed over mds_bal_cost_horizon outweigh
+ * migrating items cached dentries and caps?
+ */
+bool MDBalancer::export_pays_off(double load, uint64_t items, double *cost, double *gain)
+{
+  *gain = load * g_conf->mds_bal_cost_horizon;
+  *cost = items * g_conf->mds_bal_export_item_cost;
+  return *cost < *gain;
+}
+
+/*
+ * Count the cached dentries and client caps an export of this subtree
+ * would have to freeze and ship, giving up once we pass max.
+ */
+uint64_t MDBalancer::count_export_items(CDir *dir, uint64_t max)
+{
+  uint64_t items = 0;
+  list<CDir*> q;
+  q.push_back(dir);
+  while (!q.empty() && items <= max) {
+    CDir *d = q.front();
+    q.pop_front();
+    for (CDir::map_t::iterator p = d->begin(); p != d->end(); ++p) {
+      ++items;
+      CInode *in = p->second->get_linkage()->get_inode();
+      if (!in)
+	continue;
+      items += in->get_client_caps().size();
+      if (!in->is_dir())
+	continue;
+      list<CDir*> dfls;
+      in->get_dirfrags(dfls);
+      for (list<CDir*>::iterator s = dfls.begin(); s != dfls.end(); ++s)
+	if ((*s)->is_auth() && !(*s)->is_subtree_root())
+	  q.push_back(*s);
+    }
+  }
+  return items;
+}
+
+/*
+ * Is it worth exporting this dirfrag's subtree to target?  Without the
+ * cost model anything find_exports picks is.  With it, the load we
+ * expect to shed over mds_bal_cost_horizon has to outweigh freezing and
+ * migrating everything cached under it, and we leave alone subtrees we
+ * imported only recently rather than bounce them between ranks.
+ */
+bool MDBalancer::check_export(CDir *dir, mds_rank_t target, double load)
+{
+  if (!g_conf->mds_bal_cost_model) {
+    note_decision(dir, target, load, 0, 0, "export");
+    return true;
+  }
+
+  map<dirfrag_t, utime_t>::iterator p = recent_imports.find(dir->dirfrag());
+  if (p != recent_imports.end() &&
+      (double)(plan_stamp - p->second) < g_conf->mds_bal_reexport_hold) {
+    note_decision(dir, target, load, 0, 0, "recently imported");
+    return false;
+  }
+
+  // no need to count past what would make it too costly anyway
+  uint64_t items = 0;
+  if (g_conf->mds_bal_export_item_cost > 0) {
+    double max = MIN(load * g_conf->mds_bal_cost_horizon / g_conf->mds_bal_export_item_cost, 1e9);
+    items = count_export_items(dir, (uint64_t)max);
+  }
+  double cost, gain;
+  if (!export_pays_off(load, items, &cost, &gain)) {
+    note_decision(dir, target, load, cost, gain, "too costly");
+    return false;
+  }
+  note_decision(dir, target, load, cost, gain, "export");
+  return true;
+}
+
+void MDBalancer::note_decision(CDir *dir, mds_rank_t target, double load,
+			       double cost, double gain, const char *result)
+{
+  plan.push_back(decision_t());
+  decision_t& d = plan.back();
+  d.dirfrag = dir->dirfrag();
+  dir->get_inode()->make_path_string(d.path);
+  d.target = target;
+  d.load = dir->pop_auth_subtree.meta_load(rebalance_time, mds->mdcache->decayrate);
+  d.projected = load;
+  d.cost = cost;
+  d.gain = gain;
+  d.result = result;
+  dout(7) << "   " << result << " " << *dir << " to mds." << target
+	  << " load " << d.load << " projected " << load
+	  << " cost " << cost << " gain " << gain << dendl;
+}
+
+void MDBalancer::trim_history()
+{
+  double heat_age = g_conf->mds_bal_interval * MAX(g_conf->mds_bal_heat_samples, 1);
+  map<dirfrag_t, heat_history_t>::iterator p = heat_history.begin();
+  while (p != heat_history.end()) {
+    if ((double)(plan_stamp - p->second.last) > heat_age)
+      heat_history.erase(p++);
+    else
+      ++p;
+  }
+
+  map<dirfrag_t, utime_t>::iterator q = recent_imports.begin();
+  while (q != recent_imports.end()) {
+    if ((double)(plan_stamp - q->second) > g_conf->mds_bal_reexport_hold)
+      recent_imports.erase(q++);
+    else
+      ++q;
+  }
+}
+
+void MDBalancer::dump_plan(Formatter *f)
+{
+  f->open_object_section("balancer_plan");
+  f->dump_stream("stamp") << plan_stamp;
+  f->dump_bool("cost_model", g_conf->mds_bal_cost_model);
+  f->dump_bool("dry_run", g_conf->mds_bal_dry_run);
+  f->dump_float("my_load", my_load);
+  f->dump_float("target_load", target_load);
+  f->open_array_section("targets");
+  for (map<mds_rank_t,double>::iterator p = my_targets.begin();
+       p != my_targets.end();
+       ++p) {
+    f->open_object_section("target");
+    f->dump_int("rank", p->first);
+    f->dump_float("amount", p->second);
+    f->close_section();
+  }
+  f->close_section();
+  f->open_array_section("decisions");
+  for (list<decision_t>::iterator p = plan.begin(); p != plan.end(); ++p) {
+    f->open_object_section("decision");
+    f->dump_stream("dirfrag") << p->dirfrag;
+    f->dump_string("path", p->path);
+    f->dump_int("target", p->target);
+    f->dump_float("load", p->load);
+    f->dump_float("projected", p->projected);
+    f->dump_float("cost", p->cost);
+    f->dump_float("gain", p->gain);
+    f->dump_string("result", p->result);
+    f->close_section();
+  }
+  f->close_section();
+  f->close_section();
+}
+
 void MDBalancer::hit_inode(utime_t now, CInode *in, int type, int who)
 {
   // hit inode
@@ -1108,6 +1315,7 @@ void MDBalancer::subtract_export(CDir *dir, utime_t now)
 void MDBalancer::add_import(CDir *dir, utime_t now)
 {
   dirfrag_load_vec_t subload = dir->pop_auth_subtree;
+  recent_imports[dir->dirfrag()] = now;
 
   while (true) {
     dir = dir->inode->get_parent_dir();
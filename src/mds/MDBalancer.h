@@ -17,8 +17,10 @@
 #ifndef CEPH_MDBALANCER_H
 #define CEPH_MDBALANCER_H
 
+#include <deque>
 #include <list>
 #include <map>
+using std::deque;
 using std::list;
 using std::map;
 
@@ -34,6 +36,13 @@ class CInode;
 class CDir;
 
 class MDBalancer {
+ public:
+  // the load a dirfrag had at the last few rebalances
+  struct heat_history_t {
+    utime_t last;
+    deque<float> samples;
+  };
+
  protected:
   MDS *mds;
   int beat_epoch;
@@ -72,7 +81,34 @@ class MDBalancer {
     return mds_meta_load[ex] - target_load - exported[ex];    
   }
 
+  // cost model (mds_bal_cost_model): the load each candidate dirfrag had
+  // at the last few rebalances, and when we imported subtrees, so that we
+  // only move what stays hot and don't bounce a subtree straight back
+  map<dirfrag_t, heat_history_t> heat_history;
+  map<dirfrag_t, utime_t> recent_imports;
+
+  // what the last rebalance decided, for the "balancer plan" command
+  struct decision_t {
+    dirfrag_t dirfrag;
+    string path;
+    mds_rank_t target;
+    double load, projected, cost, gain;
+    string result;
+  };
+  list<decision_t> plan;
+  utime_t plan_stamp;
+
+  double dirfrag_load(CDir *dir);
+  uint64_t count_export_items(CDir *dir, uint64_t max);
+  bool check_export(CDir *dir, mds_rank_t target, double load);
+  void note_decision(CDir *dir, mds_rank_t target, double load,
+		     double cost, double gain, const char *result);
+  void trim_history();
+
 public:
+  static double project_load(heat_history_t& h, utime_t now, double load);
+  static bool export_pays_off(double load, uint64_t items, double *cost, double *gain);
+
   MDBalancer(MDS *m) : 
     mds(m),
     beat_epoch(0),
@@ -98,6 +134,7 @@ public:
     export targets message again*/
   void try_rebalance();
   void find_exports(CDir *dir, 
+                    mds_rank_t target,
                     double amount, 
                     list<CDir*>& exports, 
                     double& have,
@@ -114,6 +151,8 @@ public:
 
   void show_imports(bool external=false);
 
+  void dump_plan(Formatter *f);
+
   void queue_split(CDir *dir);
   void queue_merge(CDir *dir);
 
@@ -234,7 +234,7 @@ MDCache::~MDCache()
 
 void MDCache::log_stat()
 {
-  mds->logger->set(l_mds_inode_max, g_conf->mds_cache_size);
+  mds->logger->set(l_mds_inode_max, get_cache_inode_limit());
   mds->logger->set(l_mds_inodes, lru.lru_get_size());
   mds->logger->set(l_mds_inodes_pinned, lru.lru_get_num_pinned());
   mds->logger->set(l_mds_inodes_top, lru.lru_get_top());
@@ -1542,7 +1542,7 @@ CInode *MDCache::cow_inode(CInode *in, snapid_t last)
   }
 
   // clone caps?
-  for (map<client_t,Capability*>::iterator p = in->client_caps.begin();
+  for (compact_map<client_t,Capability*>::iterator p = in->client_caps.begin();
       p != in->client_caps.end();
       ++p) {
     client_t client = p->first;
@@ -1975,7 +1975,7 @@ void MDCache::broadcast_quota_to_client(CInode *in)
   if (!i->quota.is_enable())
     return;
 
-  for (map<client_t,Capability*>::iterator it = in->client_caps.begin();
+  for (compact_map<client_t,Capability*>::iterator it = in->client_caps.begin();
        it != in->client_caps.end();
        ++it) {
     Session *session = mds->get_session(it->first);
@@ -5561,7 +5561,6 @@ void MDCache::do_cap_import(Session *session, CInode *in, Capability *cap,
     if (cap->get_last_seq() == 0) // reconnected cap
       cap->inc_last_seq();
     cap->set_last_issue();
-    cap->set_last_issue_stamp(ceph_clock_now(g_ceph_context));
     cap->clear_new();
     MClientCaps *reap = new MClientCaps(CEPH_CAP_OP_IMPORT,
 					in->ino(),
@@ -5573,6 +5572,7 @@ void MDCache::do_cap_import(Session *session, CInode *in, Capability *cap,
     realm->build_snap_trace(reap->snapbl);
     reap->set_cap_peer(p_cap_id, p_seq, p_mseq, peer, p_flags);
     mds->send_message_client_counted(reap, session);
+    cap->set_last_issue_stamp(ceph_clock_now(g_ceph_context));
   } else {
     dout(10) << "do_cap_import missing past snap parents, delaying " << session->info.inst.name << " mseq "
 	     << cap->get_mseq() << " on " << *in << dendl;
@@ -6221,7 +6221,7 @@ bool MDCache::trim(int max, int count)
     if (max <= 0)
       max = 1;
   } else if (max < 0) {
-    max = g_conf->mds_cache_size;
+    max = get_cache_inode_limit();
     if (max <= 0)
       return false;
   }
@@ -7200,8 +7200,9 @@ void MDCache::check_memory_usage()
   mds->mlogger->set(l_mdm_heap, last.get_heap());
   mds->mlogger->set(l_mdm_malloc, last.malloc);
 
-  if (num_inodes_with_caps > g_conf->mds_cache_size) {
-    float ratio = (float)g_conf->mds_cache_size * .9 / (float)num_inodes_with_caps;
+  int max_inodes = get_cache_inode_limit();
+  if (max_inodes > 0 && num_inodes_with_caps > max_inodes) {
+    float ratio = (float)max_inodes * .9 / (float)num_inodes_with_caps;
     if (ratio < 1.0)
       mds->server->recall_client_state(ratio);
   }
@@ -7210,6 +7211,39 @@ void MDCache::check_memory_usage()
 
 
 
+/*
+ * Memory taken by the cache objects themselves. What hangs off them
+ * (xattrs, names that don't fit inline, ...) isn't counted, but it is
+ * enough to scale mds_cache_memory_limit to a number of inodes.
+ */
+uint64_t MDCache::cache_memory_used()
+{
+  return (uint64_t)g_num_ino * sizeof(CInode) +
+    (uint64_t)g_num_dn * sizeof(CDentry) +
+    (uint64_t)g_num_dir * sizeof(CDir) +
+    (uint64_t)g_num_cap * sizeof(Capability);
+}
+
+/*
+ * mds_cache_size, lowered to the number of inodes that fit in
+ * mds_cache_memory_limit at the current cost per inode (which includes
+ * its share of dentries, dirfrags and caps).
+ */
+int MDCache::get_cache_inode_limit()
+{
+  int max = g_conf->mds_cache_size;
+  uint64_t mem_limit = g_conf->mds_cache_memory_limit;
+  if (mem_limit == 0 || g_num_ino <= 0)
+    return max;
+
+  uint64_t per_inode = MAX(cache_memory_used() / g_num_ino, (uint64_t)1);
+  uint64_t fit = MAX(mem_limit / per_inode, (uint64_t)1);
+  if (max <= 0 || fit < (uint64_t)max)
+    max = MIN(fit, (uint64_t)INT_MAX);
+  return max;
+}
+
+
 // =========================================================================================
 // shutdown
 
@@ -7846,7 +7880,17 @@ int MDCache::path_traverse(MDRequestRef& mdr, Message *req, MDSInternalContextBa
 	// directory isn't complete; reload
         dout(7) << "traverse: incomplete dir contents for " << *cur << ", fetching" << dendl;
         touch_inode(cur);
-        curdir->fetch(_get_waiter(mdr, req, fin), path[depth]);
+	MDSInternalContextBase *c = _get_waiter(mdr, req, fin);
+	if (c && snapid == CEPH_NOSNAP &&
+	    g_conf->mds_dir_fetch_keys_min > 0 &&
+	    cur->get_projected_inode()->dirstat.size() >= g_conf->mds_dir_fetch_keys_min) {
+	  // big directory: just load the dentry we want
+	  set<string> dnames;
+	  dnames.insert(path[depth]);
+	  curdir->fetch_keys(c, dnames);
+	} else {
+	  curdir->fetch(c, path[depth]);
+	}
 	if (mds->logger) mds->logger->inc(l_mds_traverse_dir_fetch);
         return 1;
       }
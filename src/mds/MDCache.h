@@ -673,6 +673,9 @@ public:
   void trim_client_leases();
   void check_memory_usage();
 
+  static uint64_t cache_memory_used();
+  static int get_cache_inode_limit();
+
   // shutdown
   void shutdown_start();
   void shutdown_check();
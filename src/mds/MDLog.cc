@@ -17,6 +17,7 @@
 #include "MDCache.h"
 #include "LogEvent.h"
 #include "MDSContext.h"
+#include "ReplayDecoder.h"
 
 #include "osdc/Journaler.h"
 #include "mds/JournalPointer.h"
@@ -74,6 +75,10 @@ void MDLog::create_logger()
   plb.add_u64(l_mdl_wrpos, "wrpos", "Journaler  write position");
   plb.add_u64(l_mdl_rdpos, "rdpos", "Journaler  read position");
   plb.add_u64(l_mdl_jlat, "jlat", "Journaler flush latency");
+  plb.add_u64_counter(l_mdl_jflush, "jflush", "Journal flushes");
+  plb.add_u64_avg(l_mdl_jflushev, "jflushev", "Events per journal flush");
+  plb.add_time_avg(l_mdl_jflushdelay, "jflushdelay",
+      "Time a flush was held back for the journal write in flight");
 
   // logger
   logger = plb.create_perf_counters();
@@ -330,6 +335,9 @@ class C_MDL_Flushed : public MDSIOContextBase {
     mdlog->submit_mutex.Lock();
     assert(mdlog->safe_pos <= flushed_to);
     mdlog->safe_pos = flushed_to;
+    // a held back flush may go now
+    if (mdlog->flush_wanted)
+      mdlog->submit_cond.Signal();
     mdlog->submit_mutex.Unlock();
   }
 
@@ -345,23 +353,52 @@ void MDLog::_submit_thread()
   submit_mutex.Lock();
 
   while (!mds->stopping) {
+    // take what is pending, in order, up to a batch.  a drained segment
+    // keeps its key until its events are appended: trim() must not expire
+    // a segment whose events are still in our hands.
+    list<PendingEvent> batch;
+    int num = 0;
     map<uint64_t,list<PendingEvent> >::iterator it = pending_events.begin();
-    if (it == pending_events.end()) {
-      submit_cond.Wait(submit_mutex);
-      continue;
+    while (it != pending_events.end() &&
+	   num < g_conf->mds_log_batch_max_events) {
+      if (it->second.empty()) {
+	++it;
+	continue;
+      }
+      batch.push_back(it->second.front());
+      it->second.pop_front();
+      ++num;
     }
 
-    if (it->second.empty()) {
-      pending_events.erase(it);
+    if (batch.empty()) {
+      if (!flush_wanted) {
+	submit_cond.Wait(submit_mutex);
+      } else if (_should_flush(ceph_clock_now(g_ceph_context))) {
+	_flush_journal();
+      } else {
+	// C_MDL_Flushed wakes us up when the write in flight is safe
+	utime_t until = flush_wanted_stamp;
+	until += g_conf->mds_log_batch_max_delay;
+	submit_cond.WaitUntil(submit_mutex, until);
+      }
       continue;
     }
 
-    PendingEvent data = it->second.front();
-    it->second.pop_front();
-
     submit_mutex.Unlock();
 
-    if (data.le) {
+    bool flush = false;
+    int appended = 0;
+    for (list<PendingEvent>::iterator p = batch.begin(); p != batch.end(); ++p) {
+      PendingEvent& data = *p;
+      if (data.flush)
+	flush = true;
+
+      if (!data.le) {
+	journaler->wait_for_flush(new C_MDL_Flushed(
+	      this, journaler->get_write_pos(), data.fin));
+	continue;
+      }
+
       LogEvent *le = data.le;
       LogSegment *ls = le->_segment;
       // encode it, with event type
@@ -384,28 +421,73 @@ void MDLog::_submit_thread()
       journaler->wait_for_flush(new C_MDL_Flushed(
             this, new_write_pos, data.fin));
 
-      if (data.flush)
-	journaler->flush();
-
       if (logger)
 	logger->set(l_mdl_wrpos, ls->end);
 
       delete le;
-    } else {
-      journaler->wait_for_flush(new C_MDL_Flushed(
-            this, journaler->get_write_pos(), data.fin));
-      if (data.flush)
-	journaler->flush();
+      ++appended;
     }
 
     submit_mutex.Lock();
-    if (data.flush)
-      unflushed = 0;
-    else if (data.le)
-      unflushed++;
+    // the batch is appended, drop the segments it drained
+    it = pending_events.begin();
+    while (it != pending_events.end()) {
+      if (it->second.empty())
+	pending_events.erase(it++);
+      else
+	++it;
+    }
+    unflushed += appended;
+    flush_events += appended;
+    utime_t now = ceph_clock_now(g_ceph_context);
+    if (flush && !flush_wanted) {
+      flush_wanted = true;
+      flush_wanted_stamp = now;
+    }
+    if (flush_wanted && _should_flush(now))
+      _flush_journal();
+  }
+
+  submit_mutex.Unlock();
+}
+
+/*
+ * Group commit: while a journal write is in flight, hold a flush back so
+ * that the events submitted in the meantime go out with it in one write,
+ * unless it has waited long enough or enough has piled up.
+ */
+bool MDLog::_should_flush(utime_t now)
+{
+  assert(submit_mutex.is_locked_by_me());
+  if (safe_pos >= flush_pos)
+    return true;
+  if (g_conf->mds_log_batch_max_delay <= 0)
+    return true;
+  if (journaler->get_write_pos() - flush_pos >= g_conf->mds_log_batch_max_bytes)
+    return true;
+  return (double)(now - flush_wanted_stamp) >= g_conf->mds_log_batch_max_delay;
+}
+
+void MDLog::_flush_journal()
+{
+  assert(submit_mutex.is_locked_by_me());
+  utime_t now = ceph_clock_now(g_ceph_context);
+  dout(10) << "_flush_journal " << flush_events << " events, held "
+	   << (now - flush_wanted_stamp) << dendl;
+  if (logger) {
+    logger->inc(l_mdl_jflush);
+    logger->inc(l_mdl_jflushev, flush_events);
+    logger->tinc(l_mdl_jflushdelay, now - flush_wanted_stamp);
   }
+  flush_wanted = false;
+  flush_events = 0;
+  unflushed = 0;
+  // only the submit thread appends, so nothing gets past this position
+  flush_pos = journaler->get_write_pos();
 
   submit_mutex.Unlock();
+  journaler->flush();
+  submit_mutex.Lock();
 }
 
 void MDLog::wait_for_safe(MDSInternalContextBase *c)
@@ -441,6 +523,14 @@ void MDLog::flush()
     pending_events.rbegin()->second.push_back(PendingEvent(NULL, NULL, true));
     do_flush = false;
     submit_cond.Signal();
+  } else if (do_flush && submit_thread.is_started()) {
+    // let the submit thread batch it with the write in flight
+    if (!flush_wanted) {
+      flush_wanted = true;
+      flush_wanted_stamp = ceph_clock_now(g_ceph_context);
+    }
+    do_flush = false;
+    submit_cond.Signal();
   }
 
   submit_mutex.Unlock();
@@ -1189,9 +1279,29 @@ void MDLog::_replay_thread()
 {
   dout(10) << "_replay_thread start" << dendl;
 
+  // read ahead of what we replay, and decode on the side
+  ReplayDecoder decoder(g_conf->mds_replay_decode_threads);
+  decoder.start();
+  size_t max_inflight = MAX(g_conf->mds_replay_max_inflight, 1);
+  if (g_conf->mds_replay_prefetch_periods > 0)
+    journaler->set_prefetch_periods(g_conf->mds_replay_prefetch_periods);
+
   // loop
   int r = 0;
   while (1) {
+    while (decoder.size() < max_inflight && journaler->is_readable()) {
+      uint64_t pos = journaler->get_read_pos();
+      bufferlist bl;
+      if (!journaler->try_read_entry(bl))
+	break;
+      decoder.queue(pos, journaler->get_read_pos(), bl);
+    }
+    if (decoder.size() > 0) {
+      if (!_replay_decoded(decoder))
+	return;
+      continue;
+    }
+
     // wait for read?
     while (!journaler->is_readable() &&
 	   journaler->get_read_pos() < journaler->get_write_pos() &&
@@ -1263,18 +1373,55 @@ void MDLog::_replay_thread()
       break;
     
     assert(journaler->is_readable() || mds->stopping);
-    
-    // read it
-    uint64_t pos = journaler->get_read_pos();
-    bufferlist bl;
-    bool r = journaler->try_read_entry(bl);
-    if (!r && journaler->get_error())
-      continue;
-    assert(r);
-    
+  }
+
+  // done!
+  if (r == 0) {
+    assert(journaler->get_read_pos() == journaler->get_write_pos());
+    dout(10) << "_replay - complete, " << num_events
+	     << " events" << dendl;
+
+    logger->set(l_mdl_expos, journaler->get_expire_pos());
+  }
+  journaler->set_prefetch_periods(0);
+
+  safe_pos = journaler->get_write_safe_pos();
+
+  dout(10) << "_replay_thread kicking waiters" << dendl;
+  {
+    Mutex::Locker l(mds->mds_lock);
+    if (mds->stopping) {
+      return;
+    }
+    finish_contexts(g_ceph_context, waitfor_replay, r);  
+  }
+
+  dout(10) << "_replay_thread finish" << dendl;
+}
+
+/*
+ * Replay the oldest events the decoder has ready, in journal order.  A
+ * run of events is replayed under a single mds_lock.  Returns false if
+ * the mds is stopping.
+ */
+bool MDLog::_replay_decoded(ReplayDecoder& decoder)
+{
+  list<ReplayDecoder::Entry> ls;
+  decoder.take(ls);
+
+  bool locked = false;
+  while (!ls.empty()) {
+    ReplayDecoder::Entry& e = ls.front();
+    uint64_t pos = e.pos;
+    bufferlist& bl = e.bl;
+    LogEvent *le = e.le;
+
     // unpack event
-    LogEvent *le = LogEvent::decode(bl);
     if (!le) {
+      if (locked) {
+	mds->mds_lock.Unlock();
+	locked = false;
+      }
       dout(0) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos() 
 	      << " -- unable to decode event" << dendl;
       dout(0) << "dump of unknown or corrupt event:\n";
@@ -1285,6 +1432,7 @@ void MDLog::_replay_thread()
                          << bl.length() << " / "
                          << journaler->get_write_pos();
       if (g_conf->mds_log_skip_corrupt_events) {
+	ls.pop_front();
         continue;
       } else {
         mds->damaged_unlocked();
@@ -1318,43 +1466,29 @@ void MDLog::_replay_thread()
 	       << " " << le->get_stamp() << ": " << *le << dendl;
       le->_segment = get_current_segment();    // replay may need this
       le->_segment->num_events++;
-      le->_segment->end = journaler->get_read_pos();
+      le->_segment->end = e.end;
       num_events++;
 
-      {
-        Mutex::Locker l(mds->mds_lock);
-        if (mds->stopping) {
-          return;
-        }
-        le->replay(mds);
+      if (!locked) {
+	mds->mds_lock.Lock();
+	locked = true;
+	if (mds->stopping) {
+	  mds->mds_lock.Unlock();
+	  for (list<ReplayDecoder::Entry>::iterator p = ls.begin(); p != ls.end(); ++p)
+	    delete p->le;
+	  return false;
+	}
       }
+      le->replay(mds);
     }
     delete le;
+    ls.pop_front();
 
     logger->set(l_mdl_rdpos, pos);
   }
-
-  // done!
-  if (r == 0) {
-    assert(journaler->get_read_pos() == journaler->get_write_pos());
-    dout(10) << "_replay - complete, " << num_events
-	     << " events" << dendl;
-
-    logger->set(l_mdl_expos, journaler->get_expire_pos());
-  }
-
-  safe_pos = journaler->get_write_safe_pos();
-
-  dout(10) << "_replay_thread kicking waiters" << dendl;
-  {
-    Mutex::Locker l(mds->mds_lock);
-    if (mds->stopping) {
-      return;
-    }
-    finish_contexts(g_ceph_context, waitfor_replay, r);  
-  }
-
-  dout(10) << "_replay_thread finish" << dendl;
+  if (locked)
+    mds->mds_lock.Unlock();
+  return true;
 }
 
 void MDLog::standby_trim_segments()
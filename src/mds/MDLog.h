@@ -34,6 +34,9 @@ enum {
   l_mdl_wrpos,
   l_mdl_rdpos,
   l_mdl_jlat,
+  l_mdl_jflush,
+  l_mdl_jflushev,
+  l_mdl_jflushdelay,
   l_mdl_last,
 };
 
@@ -53,6 +56,7 @@ class LogEvent;
 class MDS;
 class LogSegment;
 class ESubtreeMap;
+class ReplayDecoder;
 
 class PerfCounters;
 
@@ -77,6 +81,13 @@ protected:
   // been called.
   uint64_t safe_pos;
 
+  // group commit: a flush was asked for but is held back until the
+  // journal write in flight (up to flush_pos) is safe
+  bool flush_wanted;
+  utime_t flush_wanted_stamp;
+  uint64_t flush_pos;
+  int flush_events;  // events appended since the last flush
+
   inodeno_t ino;
   Journaler *journaler;
 
@@ -102,6 +113,7 @@ protected:
 
   void _replay();         // old way
   void _replay_thread();  // new way
+  bool _replay_decoded(ReplayDecoder& decoder);
 
   // Journal recovery/rewrite logic
   class RecoveryThread : public Thread {
@@ -138,6 +150,8 @@ protected:
   Cond submit_cond;
 
   void _submit_thread();
+  bool _should_flush(utime_t now);
+  void _flush_journal();
   class SubmitThread : public Thread {
     MDLog *log;
   public:
@@ -187,6 +201,9 @@ public:
 		  unflushed(0),
 		  capped(false),
 		  safe_pos(0),
+		  flush_wanted(false),
+		  flush_pos(0),
+		  flush_events(0),
 		  journaler(0),
 		  logger(0),
 		  replay_thread(this),
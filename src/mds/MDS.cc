@@ -60,6 +60,7 @@
 
 #include "messages/MGenericMessage.h"
 
+#include "messages/MClientCapsBatch.h"
 #include "messages/MClientRequest.h"
 #include "messages/MClientRequestForward.h"
 
@@ -150,6 +151,7 @@ MDS::MDS(const std::string &n, Messenger *m, MonClient *mc) :
   
   // tick
   tick_event = 0;
+  cap_flush_event = 0;
 
   req_rate = 0;
 
@@ -374,6 +376,9 @@ bool MDS::asok_command(string command, cmdmap_t& cmdmap, string format,
     } else if (command == "dirfrag ls") {
       Mutex::Locker l(mds_lock);
       command_dirfrag_ls(cmdmap, ss, f);
+    } else if (command == "balancer plan") {
+      Mutex::Locker l(mds_lock);
+      balancer->dump_plan(f);
     }
   }
   f->flush(ss);
@@ -845,6 +850,11 @@ void MDS::set_up_admin_socket()
 				     asok_hook,
 				     "List fragments in directory");
   assert(r == 0);
+  r = admin_socket->register_command("balancer plan",
+				     "balancer plan",
+				     asok_hook,
+				     "Show what the last rebalance decided");
+  assert(r == 0);
 }
 
 void MDS::clean_up_admin_socket()
@@ -860,6 +870,7 @@ void MDS::clean_up_admin_socket()
   admin_socket->unregister_command("session ls");
   admin_socket->unregister_command("flush journal");
   admin_socket->unregister_command("force_readonly");
+  admin_socket->unregister_command("balancer plan");
   delete asok_hook;
   asok_hook = NULL;
 }
@@ -928,6 +939,7 @@ void MDS::create_logger()
     mds_plb.add_u64_counter(l_mds_dir_fetch, "dir_fetch", "Directory fetch");
     mds_plb.add_u64_counter(l_mds_dir_commit, "dir_commit", "Directory commit");
     mds_plb.add_u64_counter(l_mds_dir_split, "dir_split", "Directory split");
+    mds_plb.add_u64_counter(l_mds_dir_fetch_keys, "dir_fetch_keys", "Directory fetch of single dentries");
 
     mds_plb.add_u64(l_mds_inode_max, "inode_max", "Max inodes, cache size");
     mds_plb.add_u64(l_mds_inodes, "inodes", "Inodes", "inos");
@@ -955,6 +967,11 @@ void MDS::create_logger()
     mds_plb.add_u64_counter(l_mds_exported_inodes, "exported_inodes", "Exported inodes");
     mds_plb.add_u64_counter(l_mds_imported, "imported", "Imports");
     mds_plb.add_u64_counter(l_mds_imported_inodes, "imported_inodes", "Imported inodes");
+    mds_plb.add_u64_counter(l_mds_cap_batch, "cap_batch", "Batches of cap messages sent");
+    mds_plb.add_u64_counter(l_mds_cap_batched, "cap_batched", "Cap messages sent in batches");
+    mds_plb.add_u64_counter(l_mds_cap_lease_skip, "cap_lease_skip", "Cap revokes not sent because the client's lease ran out");
+    mds_plb.add_time_avg(l_mds_dispatch_lock_wait, "dispatch_lock_wait", "Time the dispatch thread waited for mds_lock");
+    mds_plb.add_time(l_mds_dispatch_busy, "dispatch_busy", "Time the dispatch thread spent processing messages");
     logger = mds_plb.create_perf_counters();
     g_ceph_context->get_perfcounters_collection()->add(logger);
   }
@@ -977,6 +994,8 @@ void MDS::create_logger()
     mdm_plb.add_u64(l_mdm_heap, "heap", "Heap size");
     mdm_plb.add_u64(l_mdm_malloc, "malloc", "Malloc size");
     mdm_plb.add_u64(l_mdm_buf, "buf", "Buffer size");
+    mdm_plb.add_u64(l_mdm_cache_bytes, "cache_bytes", "Memory of cached inodes, dentries, dirfrags and caps");
+    mdm_plb.add_u64(l_mdm_ino_bytes, "ino_bytes", "Cache memory per cached inode");
     mlogger = mdm_plb.create_perf_counters();
     g_ceph_context->get_perfcounters_collection()->add(mlogger);
   }
@@ -1059,9 +1078,9 @@ void MDS::forward_message_mds(Message *m, mds_rank_t mds)
     bool client_must_resend = true;  //!creq->can_forward();
 
     // tell the client where it should go
-    messenger->send_message(new MClientRequestForward(creq->get_tid(), mds, creq->get_num_fwd(),
-						      client_must_resend),
-			    creq->get_source_inst());
+    send_message_client(new MClientRequestForward(creq->get_tid(), mds, creq->get_num_fwd(),
+						  client_must_resend),
+			creq->get_connection());
     
     if (client_must_resend) {
       m->put();
@@ -1114,6 +1133,34 @@ void MDS::send_message_client_counted(Message *m, Session *session)
   version_t seq = session->inc_push_seq();
   dout(10) << "send_message_client_counted " << session->info.inst.name << " seq "
 	   << seq << " " << *m << dendl;
+
+  // cap messages to a client with a cap lease always go in a batch: it
+  // carries the stamp the client's lease runs from
+  if (m->get_type() == CEPH_MSG_CLIENT_CAPS &&
+      (session->get_cap_lease_ttl() > 0 ||
+       (g_conf->mds_cap_batch &&
+	g_conf->mds_cap_batch_max > 1 &&
+	session->connection &&
+	session->connection->has_feature(CEPH_FEATURE_MDS_CAPS_BATCH)))) {
+    // hold on to it until we're done with whatever we're doing now, in
+    // case there are more for this client.  the timer can't fire before
+    // we drop mds_lock.
+    if (session->batched_caps.empty())
+      session->batched_caps_stamp = ceph_clock_now(g_ceph_context);
+    session->batched_caps.push_back(m);
+    if ((int)session->batched_caps.size() >= g_conf->mds_cap_batch_max) {
+      flush_client_caps(session);
+    } else if (session->batched_caps.size() == 1) {
+      clients_with_batched_caps.insert(session->get_client());
+      if (!cap_flush_event) {
+	cap_flush_event = new C_MDS_FlushCaps(this);
+	timer.add_event_after(0, cap_flush_event);
+      }
+    }
+    return;
+  }
+
+  flush_client_caps(session);
   if (session->connection) {
     session->connection->send_message(m);
   } else {
@@ -1124,6 +1171,60 @@ void MDS::send_message_client_counted(Message *m, Session *session)
 void MDS::send_message_client(Message *m, Session *session)
 {
   dout(10) << "send_message_client " << session->info.inst << " " << *m << dendl;
+  flush_client_caps(session);
+  if (session->connection) {
+    session->connection->send_message(m);
+  } else {
+    session->preopen_out_queue.push_back(m);
+  }
+}
+
+/*
+ * Answer a client on the connection its message came in on, behind any
+ * cap messages we're holding for it.
+ */
+void MDS::send_message_client(Message *m, Connection *connection)
+{
+  Session *session = static_cast<Session *>(connection->get_priv());
+  if (session) {
+    session->put();  // do not carry ref
+    flush_client_caps(session);
+  }
+  connection->send_message(m);
+}
+
+/*
+ * Send the cap messages we've been holding for a client, in one message
+ * if there's more than one or it leases caps.  Anything else we send a
+ * client has to go after these.
+ */
+void MDS::flush_client_caps(Session *session)
+{
+  if (session->batched_caps.empty())
+    return;
+  clients_with_batched_caps.erase(session->get_client());
+
+  Message *m;
+  if (session->batched_caps.size() == 1 &&
+      session->get_cap_lease_ttl() <= 0) {
+    m = session->batched_caps.front();
+  } else {
+    MClientCapsBatch *batch = new MClientCapsBatch;
+    batch->stamp = session->batched_caps_stamp;  // what a cap lease runs from
+    for (list<Message*>::iterator p = session->batched_caps.begin();
+	 p != session->batched_caps.end();
+	 ++p)
+      batch->caps.push_back(static_cast<MClientCaps*>(*p));
+    dout(10) << "flush_client_caps " << session->info.inst.name
+	     << " " << batch->caps.size() << " caps" << dendl;
+    if (logger) {
+      logger->inc(l_mds_cap_batch);
+      logger->inc(l_mds_cap_batched, batch->caps.size());
+    }
+    m = batch;
+  }
+  session->batched_caps.clear();
+
   if (session->connection) {
     session->connection->send_message(m);
   } else {
@@ -1131,6 +1232,17 @@ void MDS::send_message_client(Message *m, Session *session)
   }
 }
 
+void MDS::flush_all_client_caps()
+{
+  set<client_t> clients;
+  clients.swap(clients_with_batched_caps);
+  for (set<client_t>::iterator p = clients.begin(); p != clients.end(); ++p) {
+    Session *session = sessionmap.get_session(entity_name_t::CLIENT(p->v));
+    if (session)
+      flush_client_caps(session);
+  }
+}
+
 int MDS::init(MDSMap::DaemonState wanted_state)
 {
   dout(10) << sizeof(MDSCacheObject) << "\tMDSCacheObject" << dendl;
@@ -2676,6 +2788,10 @@ void MDS::suicide(bool fast)
     timer.cancel_event(tick_event);
     tick_event = 0;
   }
+  if (cap_flush_event) {
+    timer.cancel_event(cap_flush_event);
+    cap_flush_event = 0;
+  }
   timer.cancel_all_events();
   //timer.join();
   timer.shutdown();
@@ -2773,10 +2889,12 @@ bool MDS::ms_dispatch(Message *m)
 {
   bool ret = false;
 
+  utime_t start = ceph_clock_now(g_ceph_context);
   Mutex::Locker l(mds_lock);
   if (stopping) {
     return false;
   }
+  utime_t locked = ceph_clock_now(g_ceph_context);
 
   heartbeat_reset();
 
@@ -2790,6 +2908,12 @@ bool MDS::ms_dispatch(Message *m)
     dec_dispatch_depth();
   }
 
+  // how much the big lock costs the dispatch thread
+  if (logger) {
+    logger->tinc(l_mds_dispatch_lock_wait, locked - start);
+    logger->tinc(l_mds_dispatch_busy, ceph_clock_now(g_ceph_context) - locked);
+  }
+
   return ret;
 }
 
@@ -3154,6 +3278,10 @@ bool MDS::_dispatch(Message *m, bool new_msg)
 
     mlogger->set(l_mdm_buf, buffer::get_total_alloc());
 
+    uint64_t cache_bytes = MDCache::cache_memory_used();
+    mlogger->set(l_mdm_cache_bytes, cache_bytes);
+    mlogger->set(l_mdm_ino_bytes, g_num_ino > 0 ? cache_bytes / g_num_ino : 0);
+
   }
 
   // shut down?
@@ -50,6 +50,7 @@ enum {
   l_mds_dir_fetch,
   l_mds_dir_commit,
   l_mds_dir_split,
+  l_mds_dir_fetch_keys,
   l_mds_inode_max,
   l_mds_inodes,
   l_mds_inodes_top,
@@ -73,6 +74,11 @@ enum {
   l_mds_exported_inodes,
   l_mds_imported,
   l_mds_imported_inodes,
+  l_mds_cap_batch,
+  l_mds_cap_batched,
+  l_mds_cap_lease_skip,
+  l_mds_dispatch_lock_wait,
+  l_mds_dispatch_busy,
   l_mds_last,
 };
 
@@ -95,6 +101,8 @@ enum {
   l_mdm_heap,
   l_mdm_malloc,
   l_mdm_buf,
+  l_mdm_cache_bytes,
+  l_mdm_ino_bytes,
   l_mdm_last,
 };
 
@@ -302,6 +310,17 @@ public:
   } *tick_event;
   void     reset_tick();
 
+  // cap messages held back to go out together, see send_message_client_counted
+  class C_MDS_FlushCaps : public MDSInternalContext {
+  public:
+    C_MDS_FlushCaps(MDS *m) : MDSInternalContext(m) {}
+    void finish(int r) {
+      mds->cap_flush_event = 0;
+      mds->flush_all_client_caps();
+    }
+  } *cap_flush_event;
+  set<client_t> clients_with_batched_caps;
+
   // -- client map --
   SessionMap   sessionmap;
   epoch_t      last_client_mdsmap_bcast;
@@ -365,6 +384,12 @@ private:
     send_message_client_counted(m, con.get());
   }
   void send_message_client(Message *m, Session *session);
+  void send_message_client(Message *m, Connection *connection);
+  void send_message_client(Message *m, const ConnectionRef& con) {
+    send_message_client(m, con.get());
+  }
+  void flush_client_caps(Session *session);
+  void flush_all_client_caps();
   void send_message(Message *m, Connection *c);
   void send_message(Message *m, const ConnectionRef& c) {
     send_message(m, c.get());
@@ -1094,7 +1094,7 @@ void Migrator::get_export_client_set(CDir *dir, set<client_t>& client_set)
 	  }
 	}
       }
-      for (map<client_t, Capability*>::iterator q = in->client_caps.begin();
+      for (compact_map<client_t,Capability*>::iterator q = in->client_caps.begin();
 	   q != in->client_caps.end();
 	   ++q)
 	client_set.insert(q->first);
@@ -1104,7 +1104,7 @@ void Migrator::get_export_client_set(CDir *dir, set<client_t>& client_set)
 
 void Migrator::get_export_client_set(CInode *in, set<client_t>& client_set)
 {
-  for (map<client_t, Capability*>::iterator q = in->client_caps.begin();
+  for (compact_map<client_t,Capability*>::iterator q = in->client_caps.begin();
       q != in->client_caps.end();
       ++q)
     client_set.insert(q->first);
@@ -1301,7 +1301,7 @@ void Migrator::encode_export_inode_caps(CInode *in, bool auth_cap, bufferlist& b
   }
 
   // make note of clients named by exported capabilities
-  for (map<client_t, Capability*>::iterator it = in->client_caps.begin();
+  for (compact_map<client_t,Capability*>::iterator it = in->client_caps.begin();
        it != in->client_caps.end();
        ++it) 
     exported_client_map[it->first] = mds->sessionmap.get_inst(entity_name_t::CLIENT(it->first.v));
@@ -1316,7 +1316,7 @@ void Migrator::finish_export_inode_caps(CInode *in, mds_rank_t peer,
   in->put(CInode::PIN_EXPORTINGCAPS);
 
   // tell (all) clients about migrating caps.. 
-  for (map<client_t, Capability*>::iterator it = in->client_caps.begin();
+  for (compact_map<client_t,Capability*>::iterator it = in->client_caps.begin();
        it != in->client_caps.end();
        ++it) {
     Capability *cap = it->second;
@@ -0,0 +1,126 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "ReplayDecoder.h"
+#include "LogEvent.h"
+
+#include "common/debug.h"
+
+#define dout_subsys ceph_subsys_mds
+#undef dout_prefix
+#define dout_prefix *_dout << "mds.replay_decoder "
+
+
+ReplayDecoder::ReplayDecoder(int num_threads)
+  : lock("ReplayDecoder::lock"), stopping(false)
+{
+  next_item = items.end();
+  for (int i = 0; i < num_threads; ++i)
+    workers.push_back(new Worker(this));
+}
+
+ReplayDecoder::~ReplayDecoder()
+{
+  stop();
+  for (std::vector<Worker*>::iterator p = workers.begin(); p != workers.end(); ++p)
+    delete *p;
+  for (std::list<Item>::iterator p = items.begin(); p != items.end(); ++p)
+    delete p->le;
+}
+
+void ReplayDecoder::start()
+{
+  dout(10) << "start " << workers.size() << " threads" << dendl;
+  for (std::vector<Worker*>::iterator p = workers.begin(); p != workers.end(); ++p)
+    (*p)->create();
+}
+
+void ReplayDecoder::stop()
+{
+  lock.Lock();
+  stopping = true;
+  work_cond.SignalAll();
+  lock.Unlock();
+  for (std::vector<Worker*>::iterator p = workers.begin(); p != workers.end(); ++p)
+    if ((*p)->is_started())
+      (*p)->join();
+}
+
+void ReplayDecoder::worker_entry()
+{
+  lock.Lock();
+  while (!stopping) {
+    if (next_item == items.end()) {
+      work_cond.Wait(lock);
+      continue;
+    }
+    // the item can't go away until we mark it decoded
+    Item *item = &*next_item;
+    ++next_item;
+    lock.Unlock();
+
+    item->le = LogEvent::decode(item->bl);
+
+    lock.Lock();
+    item->decoded = true;
+    if (item == &items.front())
+      done_cond.Signal();
+  }
+  lock.Unlock();
+}
+
+void ReplayDecoder::queue(uint64_t pos, uint64_t end, bufferlist& bl)
+{
+  Mutex::Locker l(lock);
+  items.push_back(Item());
+  Item& item = items.back();
+  item.pos = pos;
+  item.end = end;
+  item.bl.claim(bl);
+
+  if (workers.empty()) {
+    item.le = LogEvent::decode(item.bl);
+    item.decoded = true;
+    return;
+  }
+  if (next_item == items.end())
+    next_item = --items.end();
+  work_cond.Signal();
+}
+
+size_t ReplayDecoder::size()
+{
+  Mutex::Locker l(lock);
+  return items.size();
+}
+
+int ReplayDecoder::take(std::list<Entry>& ls)
+{
+  Mutex::Locker l(lock);
+  if (items.empty())
+    return 0;
+  while (!items.front().decoded)
+    done_cond.Wait(lock);
+
+  int n = 0;
+  while (!items.empty() && items.front().decoded) {
+    Item& item = items.front();
+    ls.push_back(Entry());
+    ls.back().pos = item.pos;
+    ls.back().end = item.end;
+    ls.back().bl.claim(item.bl);
+    ls.back().le = item.le;
+    items.pop_front();
+    ++n;
+  }
+  return n;
+}
@@ -0,0 +1,88 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MDS_REPLAYDECODER_H
+#define CEPH_MDS_REPLAYDECODER_H
+
+#include <list>
+#include <vector>
+
+#include "include/buffer.h"
+#include "common/Mutex.h"
+#include "common/Cond.h"
+#include "common/Thread.h"
+
+class LogEvent;
+
+/*
+ * Decodes journal entries for replay on worker threads.
+ *
+ * The replay thread queues raw entries in journal order as it reads them
+ * and takes the decoded events back out in the same order, however the
+ * workers happen to finish them, so it can go on applying them one by
+ * one.  With no threads, entries are decoded as they are queued.
+ */
+class ReplayDecoder {
+public:
+  struct Entry {
+    uint64_t pos, end;  // where the entry starts and ends in the journal
+    bufferlist bl;
+    LogEvent *le;       // NULL if the entry didn't decode
+
+    Entry() : pos(0), end(0), le(NULL) {}
+  };
+
+private:
+  class Worker : public Thread {
+    ReplayDecoder *decoder;
+  public:
+    Worker(ReplayDecoder *d) : decoder(d) {}
+    void *entry() {
+      decoder->worker_entry();
+      return NULL;
+    }
+  };
+
+  struct Item : public Entry {
+    bool decoded;
+    Item() : decoded(false) {}
+  };
+
+  Mutex lock;
+  Cond work_cond;      // workers wait for entries to decode
+  Cond done_cond;      // the replay thread waits for the oldest one
+  std::list<Item> items;
+  std::list<Item>::iterator next_item;  // oldest entry nobody is decoding
+  std::vector<Worker*> workers;
+  bool stopping;
+
+  void worker_entry();
+
+public:
+  ReplayDecoder(int num_threads);
+  ~ReplayDecoder();
+
+  void start();
+  void stop();
+
+  /* queue the entry read from pos to end; takes over bl */
+  void queue(uint64_t pos, uint64_t end, bufferlist& bl);
+  /* entries queued and not yet taken */
+  size_t size();
+  /*
+   * wait for the oldest entry to be decoded and move it, and any decoded
+   * entries right behind it, onto ls.  returns how many were taken.
+   */
+  int take(std::list<Entry>& ls);
+};
+
+#endif
@@ -290,7 +290,7 @@ void Server::handle_client_session(MClientSession *m)
 	mds->locker->resume_stale_caps(session);
 	mds->sessionmap.touch_session(session);
       }
-      m->get_connection()->send_message(new MClientSession(CEPH_SESSION_RENEWCAPS, m->get_seq()));
+      mds->send_message_client(new MClientSession(CEPH_SESSION_RENEWCAPS, m->get_seq()), session);
     } else {
       dout(10) << "ignoring renewcaps on non open|stale session (" << session->get_state_name() << ")" << dendl;
     }
@@ -382,9 +382,9 @@ void Server::_session_logged(Session *session, uint64_t state_seq, bool open, ve
     mds->sessionmap.set_state(session, Session::STATE_OPEN);
     mds->sessionmap.touch_session(session);
     assert(session->connection != NULL);
-    session->connection->send_message(new MClientSession(CEPH_SESSION_OPEN));
+    mds->send_message_client(new MClientSession(CEPH_SESSION_OPEN), session);
     if (mdcache->is_readonly())
-      session->connection->send_message(new MClientSession(CEPH_SESSION_FORCE_RO));
+      mds->send_message_client(new MClientSession(CEPH_SESSION_FORCE_RO), session);
   } else if (session->is_closing() ||
 	     session->is_killing()) {
     // kill any lingering capabilities, leases, requests
@@ -732,13 +732,13 @@ void Server::handle_client_reconnect(MClientReconnect *m)
   }
 
   if (deny) {
-    m->get_connection()->send_message(new MClientSession(CEPH_SESSION_CLOSE));
+    mds->send_message_client(new MClientSession(CEPH_SESSION_CLOSE), m->get_connection());
     m->put();
     return;
   }
 
   // notify client of success with an OPEN
-  m->get_connection()->send_message(new MClientSession(CEPH_SESSION_OPEN));
+  mds->send_message_client(new MClientSession(CEPH_SESSION_OPEN), m->get_connection());
   mds->clog->debug() << "reconnect by " << session->info.inst << " after " << delay << "\n";
   
   // snaprealms
@@ -867,7 +867,7 @@ void Server::recover_filelocks(CInode *in, bufferlist locks, int64_t client)
  */
 void Server::recall_client_state(float ratio)
 {
-  int max_caps_per_client = (int)(g_conf->mds_cache_size * .8);
+  int max_caps_per_client = (int)(mdcache->get_cache_inode_limit() * .8);
   int min_caps_per_client = 100;
 
   dout(10) << "recall_client_state " << ratio
@@ -1052,7 +1052,7 @@ void Server::early_reply(MDRequestRef& mdr, CInode *tracei, CDentry *tracedn)
   }
 
   reply->set_extra_bl(mdr->reply_extra_bl);
-  req->get_connection()->send_message(reply);
+  mds->send_message_client(reply, req->get_connection());
 
   mdr->did_early_reply = true;
 
@@ -1152,7 +1152,7 @@ void Server::reply_client_request(MDRequestRef& mdr, MClientReply *reply)
     reply->set_extra_bl(mdr->reply_extra_bl);
 
     reply->set_mdsmap_epoch(mds->mdsmap->get_epoch());
-    client_con->send_message(reply);
+    mds->send_message_client(reply, client_con);
   }
 
   if (mdr->has_completed && mds->is_clientreplay())
@@ -1339,7 +1339,7 @@ void Server::handle_client_request(MClientRequest *req)
 	  ::encode(created, extra);
 	  reply->set_extra_bl(extra);
 	}
-	req->get_connection()->send_message(reply);
+	mds->send_message_client(reply, req->get_connection());
 
 	if (req->is_replay())
 	  mds->queue_one_replay();
@@ -2197,7 +2197,7 @@ CInode* Server::prepare_new_inode(MDRequestRef& mdr, CDir *dir, inodeno_t useino
   CInode *in = new CInode(mdcache);
   
   // assign ino
-  if (mdr->session->info.prealloc_inos.size()) {
+  if (mdr->session->can_take_ino(useino)) {
     mdr->used_prealloc_ino = 
       in->inode.ino = mdr->session->take_ino(useino);  // prealloc -> used
     mds->sessionmap.mark_projected(mdr->session);
@@ -3058,6 +3058,16 @@ void Server::handle_client_openc(MDRequestRef& mdr)
   }
 
   // created null dn.
+
+  // the client of an async create already uses the ino it picked, we
+  // can't substitute another one.  it fails the create.
+  if ((req->get_flags() & CEPH_MDS_FLAG_ASYNC) && !req->is_replay() &&
+      !mdr->session->info.prealloc_inos.contains(inodeno_t(req->head.ino))) {
+    dout(10) << "async create with ino " << inodeno_t(req->head.ino)
+	     << " not preallocated to " << mdr->session->info.inst << ", -EAGAIN" << dendl;
+    respond_to_request(mdr, -EAGAIN);
+    return;
+  }
     
   // create inode.
   SnapRealm *realm = diri->find_snaprealm();   // use directory's realm; inode isn't attached yet.
@@ -3094,6 +3104,11 @@ void Server::handle_client_openc(MDRequestRef& mdr)
   le->metablob.add_primary_dentry(dn, in, true, true, true);
 
   // do the open
+  if (req->get_flags() & CEPH_MDS_FLAG_ASYNC) {
+    // the client is already using the caps it expects for a new file
+    in->filelock.set_state(LOCK_EXCL);
+    in->linklock.set_state(LOCK_EXCL);
+  }
   mds->locker->issue_new_caps(in, cmode, mdr->session, realm, req->is_replay());
   in->authlock.set_state(LOCK_EXCL);
   in->xattrlock.set_state(LOCK_EXCL);
@@ -3109,6 +3124,18 @@ void Server::handle_client_openc(MDRequestRef& mdr)
     dout(10) << "adding ino to reply to indicate inode was created" << dendl;
     // add the file created flag onto the reply if create_flags features is supported
     ::encode(in->inode.ino, mdr->reply_extra_bl);
+
+    // top up the inos the client may use for creates without waiting
+    // for us
+    if ((req->get_flags() & CEPH_MDS_FLAG_WANT_INOS) &&
+	!req->is_replay() &&
+	(int)mdr->session->delegated_inos.size() < g_conf->mds_client_delegate_inos / 2) {
+      interval_set<inodeno_t> inos;
+      mdr->session->delegate_inos(g_conf->mds_client_delegate_inos -
+				  mdr->session->delegated_inos.size(), inos);
+      dout(10) << "delegating " << inos << " to " << mdr->session->info.inst << dendl;
+      ::encode(inos, mdr->reply_extra_bl);
+    }
   }
 
   journal_and_reply(mdr, in, dn, le, fin);
@@ -644,10 +644,27 @@ void Session::notify_recall_sent(int const new_limit)
 void Session::set_client_metadata(map<string, string> const &meta)
 {
   info.client_metadata = meta;
+  cap_lease_ttl = -1;
 
   _update_human_name();
 }
 
+double Session::get_cap_lease_ttl()
+{
+  if (cap_lease_ttl < 0) {
+    cap_lease_ttl = 0;
+    map<string, string>::iterator p = info.client_metadata.find("cap_lease_ttl");
+    if (p != info.client_metadata.end()) {
+      // we and the client have to agree on when a lease runs out, so a
+      // longer one than we allow isn't shortened, it's refused
+      double ttl = atof(p->second.c_str());
+      if (ttl > 0 && ttl <= g_conf->mds_cap_lease_max_ttl)
+	cap_lease_ttl = ttl;
+    }
+  }
+  return cap_lease_ttl;
+}
+
 /**
  * Use client metadata to generate a somewhat-friendlier
  * name for the client than its session ID.
@@ -132,36 +132,76 @@ public:
   xlist<Session*>::item item_session_list;
 
   list<Message*> preopen_out_queue;  ///< messages for client, queued before they connect
+  list<Message*> batched_caps;  ///< cap messages waiting for MDS::flush_client_caps
+  utime_t batched_caps_stamp;  ///< when the first of them was queued
+
+  // how long after hearing from us the client stops trusting the shared
+  // caps it holds (its "cap_lease_ttl" metadata); 0 if it doesn't lease
+  // them, -1 until we've looked
+  double cap_lease_ttl;
+  double get_cap_lease_ttl();
 
   elist<MDRequestImpl*> requests;
   size_t get_request_count();
 
   interval_set<inodeno_t> pending_prealloc_inos; // journaling prealloc, will be added to prealloc_inos
 
+  // subset of prealloc_inos handed to the client for async creates.  not
+  // journaled: they stay in prealloc_inos, and the client forgets them
+  // when it reconnects.
+  interval_set<inodeno_t> delegated_inos;
+
   void notify_cap_release(size_t n_caps);
   void notify_recall_sent(int const new_limit);
 
-  inodeno_t next_ino() {
+  interval_set<inodeno_t> get_undelegated_inos() const {
+    interval_set<inodeno_t> avail(info.prealloc_inos);
+    avail.subtract(delegated_inos);
+    return avail;
+  }
+  inodeno_t next_ino() const {
     if (info.prealloc_inos.empty())
       return 0;
-    return info.prealloc_inos.range_start();
+    if (delegated_inos.empty())
+      return info.prealloc_inos.range_start();
+    interval_set<inodeno_t> avail = get_undelegated_inos();
+    if (avail.empty())
+      return 0;
+    return avail.range_start();
+  }
+  bool can_take_ino(inodeno_t ino) const {
+    return (ino && info.prealloc_inos.contains(ino)) || next_ino();
   }
   inodeno_t take_ino(inodeno_t ino = 0) {
     assert(!info.prealloc_inos.empty());
 
     if (ino) {
-      if (info.prealloc_inos.contains(ino))
+      if (info.prealloc_inos.contains(ino)) {
 	info.prealloc_inos.erase(ino);
-      else
+	if (delegated_inos.contains(ino))
+	  delegated_inos.erase(ino);
+      } else
 	ino = 0;
     }
     if (!ino) {
-      ino = info.prealloc_inos.range_start();
+      ino = next_ino();
+      assert(ino);
       info.prealloc_inos.erase(ino);
     }
     info.used_inos.insert(ino, 1);
     return ino;
   }
+  void delegate_inos(int want, interval_set<inodeno_t>& inos) {
+    interval_set<inodeno_t> avail = get_undelegated_inos();
+    for (interval_set<inodeno_t>::const_iterator p = avail.begin();
+	 p != avail.end() && want > 0;
+	 ++p) {
+      uint64_t len = MIN((uint64_t)p.get_len(), (uint64_t)want);
+      inos.insert(p.get_start(), len);
+      delegated_inos.insert(p.get_start(), len);
+      want -= len;
+    }
+  }
   int get_num_projected_prealloc_inos() {
     return info.prealloc_inos.size() + pending_prealloc_inos.size();
   }
@@ -281,6 +321,7 @@ public:
     state(STATE_CLOSED), state_seq(0), importing_count(0),
     recalled_at(), recall_count(0), recall_release_count(0),
     connection(NULL), item_session_list(this),
+    cap_lease_ttl(-1),
     requests(0),  // member_offset passed to front() manually
     cap_push_seq(0),
     lease_seq(0),
@@ -292,6 +333,10 @@ public:
       preopen_out_queue.front()->put();
       preopen_out_queue.pop_front();
     }
+    while (!batched_caps.empty()) {
+      batched_caps.front()->put();
+      batched_caps.pop_front();
+    }
   }
 
   void clear() {
@@ -0,0 +1,97 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MCLIENTCAPSBATCH_H
+#define CEPH_MCLIENTCAPSBATCH_H
+
+#include "msg/Message.h"
+#include "MClientCaps.h"
+
+/*
+ * Several cap messages for one client in a single message.  Each is
+ * encoded as it would be on its own, and the client handles them in
+ * order as if they had come separately.
+ */
+class MClientCapsBatch : public Message {
+ public:
+  list<MClientCaps*> caps;
+  utime_t stamp;  // when the mds sent it
+
+  MClientCapsBatch() : Message(CEPH_MSG_CLIENT_CAPS_BATCH) {}
+private:
+  ~MClientCapsBatch() {
+    while (!caps.empty()) {
+      caps.front()->put();
+      caps.pop_front();
+    }
+  }
+
+public:
+  const char *get_type_name() const { return "client_caps_batch"; }
+  void print(ostream& out) const {
+    out << "client_caps_batch(" << caps.size() << ")";
+  }
+
+  /*
+   * Hand over the batched messages, as if they had come in on our
+   * connection from our sender.  A cap lease runs from when we got them
+   * or when the mds sent them, whichever is earlier, so one held up on
+   * the way doesn't outlast what the mds allows for.
+   */
+  void claim_caps(list<MClientCaps*>& ls) {
+    utime_t recv = get_recv_stamp();
+    if (stamp != utime_t() && stamp < recv)
+      recv = stamp;
+    for (list<MClientCaps*>::iterator p = caps.begin(); p != caps.end(); ++p) {
+      (*p)->get_header().src = get_header().src;
+      (*p)->set_connection(get_connection());
+      (*p)->set_recv_stamp(recv);
+    }
+    ls.splice(ls.end(), caps);
+  }
+
+  void encode_payload(uint64_t features) {
+    ::encode(stamp, payload);
+    __u32 n = caps.size();
+    ::encode(n, payload);
+    for (list<MClientCaps*>::iterator p = caps.begin(); p != caps.end(); ++p) {
+      MClientCaps *m = *p;
+      if (m->get_payload().length() == 0)
+	m->encode_payload(features);
+      __u16 version = m->get_header().version;
+      ::encode(version, payload);
+      ::encode(m->get_payload(), payload);
+      ::encode(m->get_middle(), payload);
+    }
+  }
+  void decode_payload() {
+    bufferlist::iterator p = payload.begin();
+    ::decode(stamp, p);
+    __u32 n;
+    ::decode(n, p);
+    while (n--) {
+      MClientCaps *m = new MClientCaps;
+      __u16 version;
+      bufferlist bl, middle;
+      ::decode(version, p);
+      ::decode(bl, p);
+      ::decode(middle, p);
+      m->get_header().version = version;
+      m->set_payload(bl);
+      m->set_middle(middle);
+      m->decode_payload();
+      caps.push_back(m);
+    }
+  }
+};
+
+#endif
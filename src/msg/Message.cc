@@ -107,6 +107,7 @@ using namespace std;
 #include "messages/MClientLease.h"
 #include "messages/MClientSnap.h"
 #include "messages/MClientQuota.h"
+#include "messages/MClientCapsBatch.h"
 
 #include "messages/MMDSSlaveRequest.h"
 
@@ -556,6 +557,9 @@ Message *decode_message(CephContext *cct, int crcflags,
   case CEPH_MSG_CLIENT_QUOTA:
     m = new MClientQuota;
     break;
+  case CEPH_MSG_CLIENT_CAPS_BATCH:
+    m = new MClientCapsBatch;
+    break;
 
     // mds
   case MSG_MDS_SLAVE_REQUEST:
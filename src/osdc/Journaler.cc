@@ -67,6 +67,21 @@ void Journaler::set_layout(ceph_file_layout const *l)
     _set_layout(l);
 }
 
+/*
+ * Read further ahead than journaler_prefetch_periods, e.g. for a reader
+ * that wants the whole journal as fast as it can get it.  The reads of
+ * the objects in the window are all in flight at once.  0 goes back to
+ * the default.
+ */
+void Journaler::set_prefetch_periods(uint64_t periods)
+{
+  Mutex::Locker l(lock);
+  prefetch_periods = periods;
+  if (layout.fl_object_size)
+    _set_layout(&layout);
+  ldout(cct, 10) << "set_prefetch_periods " << periods << ", fetch_len now " << fetch_len << dendl;
+}
+
 void Journaler::_set_layout(ceph_file_layout const *l)
 {
   layout = *l;
@@ -77,7 +92,8 @@ void Journaler::_set_layout(ceph_file_layout const *l)
 
   // prefetch intelligently.
   // (watch out, this is big if you use big objects or weird striping)
-  uint64_t periods = cct->_conf->journaler_prefetch_periods;
+  uint64_t periods = prefetch_periods ? prefetch_periods :
+    cct->_conf->journaler_prefetch_periods;
   if (periods < 2)
     periods = 2;  // we need at least 2 periods to make progress.
   fetch_len = layout.fl_stripe_count * layout.fl_object_size * periods;
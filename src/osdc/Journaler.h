@@ -315,6 +315,7 @@ private:
 
   uint64_t fetch_len;     // how much to read at a time
   uint64_t temp_fetch_len;
+  uint64_t prefetch_periods;  // overrides journaler_prefetch_periods if set
 
   // for wait_for_readable()
   C_OnFinisher    *on_readable;
@@ -385,7 +386,7 @@ public:
     prezeroing_pos(0), prezero_pos(0), write_pos(0), flush_pos(0), safe_pos(0),
     waiting_for_zero(false),
     read_pos(0), requested_pos(0), received_pos(0),
-    fetch_len(0), temp_fetch_len(0),
+    fetch_len(0), temp_fetch_len(0), prefetch_periods(0),
     on_readable(0), on_write_error(NULL), called_write_error(false),
     expire_pos(0), trimming_pos(0), trimmed_pos(0), readable(false),
     stopping(false)
@@ -437,6 +438,7 @@ public:
   // Synchronous setters
   // ===================
   void set_layout(ceph_file_layout const *l);
+  void set_prefetch_periods(uint64_t periods);
   void set_readonly();
   void set_writeable();
   void set_write_pos(int64_t p) { 
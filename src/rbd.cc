@@ -157,6 +157,9 @@ void usage()
 "                 --io-threads <num>             ios in flight\n"
 "                 --io-total <bytes>             total bytes to write\n"
 "                 --io-pattern <seq|rand>        write pattern\n"
+"  bench-open <image-name>                     image open/close benchmark\n"
+"                 --io-threads <num>             opens in flight\n"
+"                 --open-total <num>             total number of opens\n"
 "\n"
 "<image-name>, <snap-name> are [pool/]name[@snap], or you may specify\n"
 "individual pieces of names with -p/--pool, --image, and/or --snap.\n"
@@ -1077,6 +1080,161 @@ static int do_bench_write(librbd::Image& image, uint64_t io_size,
   return 0;
 }
 
+static void rbd_open_bencher_open_completion(void *c, void *pc);
+static void rbd_open_bencher_close_completion(void *c, void *pc);
+
+struct rbd_open_bencher {
+  librados::IoCtx *io_ctx;
+  const char *imgname;
+  Mutex lock;
+  Cond cond;
+  int in_flight;
+  int errors;
+  utime_t open_time;
+  utime_t close_time;
+
+  rbd_open_bencher(librados::IoCtx *ioctx, const char *name)
+    : io_ctx(ioctx), imgname(name),
+      lock("rbd_open_bencher::lock"),
+      in_flight(0), errors(0)
+  { }
+
+  bool start_open(int max);
+
+  void wait_for(int max) {
+    Mutex::Locker l(lock);
+    while (in_flight > max) {
+      utime_t dur;
+      dur.set_from_double(.2);
+      cond.WaitInterval(g_ceph_context, lock, dur);
+    }
+  }
+};
+
+struct rbd_open_bench_op {
+  rbd_open_bencher *bencher;
+  librbd::Image image;
+  utime_t start;
+  utime_t opened;
+
+  rbd_open_bench_op(rbd_open_bencher *b) : bencher(b) {}
+};
+
+bool rbd_open_bencher::start_open(int max)
+{
+  {
+    Mutex::Locker l(lock);
+    if (in_flight >= max)
+      return false;
+    in_flight++;
+  }
+
+  librbd::RBD rbd;
+  rbd_open_bench_op *op = new rbd_open_bench_op(this);
+  op->start = ceph_clock_now(NULL);
+  librbd::RBD::AioCompletion *c =
+    new librbd::RBD::AioCompletion((void *)op,
+				   rbd_open_bencher_open_completion);
+  rbd.aio_open(*io_ctx, op->image, imgname, NULL, c);
+  return true;
+}
+
+void rbd_open_bencher_open_completion(void *vc, void *pc)
+{
+  librbd::RBD::AioCompletion *c = (librbd::RBD::AioCompletion *)vc;
+  rbd_open_bench_op *op = static_cast<rbd_open_bench_op *>(pc);
+  rbd_open_bencher *b = op->bencher;
+  int ret = c->get_return_value();
+  c->release();
+
+  if (ret < 0) {
+    cout << "open error: " << cpp_strerror(ret) << std::endl;
+    b->lock.Lock();
+    b->errors++;
+    b->in_flight--;
+    b->cond.Signal();
+    b->lock.Unlock();
+    delete op;
+    return;
+  }
+
+  op->opened = ceph_clock_now(NULL);
+  librbd::RBD::AioCompletion *close_comp =
+    new librbd::RBD::AioCompletion((void *)op,
+				   rbd_open_bencher_close_completion);
+  op->image.aio_close(close_comp);
+}
+
+void rbd_open_bencher_close_completion(void *vc, void *pc)
+{
+  librbd::RBD::AioCompletion *c = (librbd::RBD::AioCompletion *)vc;
+  rbd_open_bench_op *op = static_cast<rbd_open_bench_op *>(pc);
+  rbd_open_bencher *b = op->bencher;
+  int ret = c->get_return_value();
+  c->release();
+  if (ret < 0) {
+    cout << "close error: " << cpp_strerror(ret) << std::endl;
+  }
+
+  utime_t now = ceph_clock_now(NULL);
+  b->lock.Lock();
+  if (ret < 0) {
+    b->errors++;
+  }
+  b->open_time += op->opened - op->start;
+  b->close_time += now - op->opened;
+  b->in_flight--;
+  b->cond.Signal();
+  b->lock.Unlock();
+  delete op;
+}
+
+static int do_bench_open(librados::IoCtx& io_ctx, const char *imgname,
+			 uint64_t io_threads, uint64_t open_total)
+{
+  rbd_open_bencher b(&io_ctx, imgname);
+
+  cout << "bench-open "
+       << " io_threads " << io_threads
+       << " opens " << open_total
+       << std::endl;
+
+  if (io_threads == 0 || open_total == 0)
+    return -EINVAL;
+
+  utime_t start = ceph_clock_now(NULL);
+  utime_t last;
+  uint64_t opens = 0;
+
+  printf("  SEC     OPENS  OPENS/SEC\n");
+  while (opens < open_total) {
+    b.wait_for(io_threads - 1);
+    while (opens < open_total && b.start_open(io_threads)) {
+      ++opens;
+    }
+
+    utime_t elapsed = ceph_clock_now(NULL) - start;
+    if (elapsed.sec() != last.sec()) {
+      printf("%5d  %8d  %9.2lf\n", (int)elapsed, (int)opens,
+	     (double)opens / (double)elapsed);
+      last = elapsed;
+    }
+  }
+  b.wait_for(0);
+
+  utime_t now = ceph_clock_now(NULL);
+  double elapsed = now - start;
+  uint64_t completed = opens - b.errors;
+
+  printf("elapsed: %5d  opens: %8d  opens/sec: %8.2lf\n",
+	 (int)elapsed, (int)opens, (double)opens / elapsed);
+  if (completed > 0) {
+    printf("avg open latency: %8.6lf sec  avg close latency: %8.6lf sec\n",
+	   (double)b.open_time / completed, (double)b.close_time / completed);
+  }
+  return b.errors > 0 ? -EIO : 0;
+}
+
 struct ExportContext {
   librbd::Image *image;
   int fd;
@@ -2793,6 +2951,7 @@ enum {
   OPT_LOCK_ADD,
   OPT_LOCK_REMOVE,
   OPT_BENCH_WRITE,
+  OPT_BENCH_OPEN,
   OPT_MERGE_DIFF,
   OPT_METADATA_LIST,
   OPT_METADATA_SET,
@@ -2857,6 +3016,8 @@ static int get_cmd(const char *cmd, CommandType command_type)
       return OPT_UNMAP;
     if (strcmp(cmd, "bench-write") == 0)
       return OPT_BENCH_WRITE;
+    if (strcmp(cmd, "bench-open") == 0)
+      return OPT_BENCH_OPEN;
     break;
   case COMMAND_TYPE_SNAP:
     if (strcmp(cmd, "create") == 0 ||
@@ -2973,6 +3134,7 @@ int main(int argc, const char **argv)
   int pretty_format = 0;
   long long stripe_unit = 0, stripe_count = 0;
   long long bench_io_size = 4096, bench_io_threads = 16, bench_bytes = 1 << 30;
+  long long bench_opens = 1000;
   string bench_pattern = "seq";
   bool diff_object_extents = false;
 
@@ -3053,6 +3215,7 @@ int main(int argc, const char **argv)
       }
     } else if (ceph_argparse_witharg(args, i, &bench_io_threads, err, "--io-threads", (char*)NULL)) {
     } else if (ceph_argparse_witharg(args, i, &bench_bytes, err, "--io-total", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &bench_opens, err, "--open-total", (char*)NULL)) {
     } else if (ceph_argparse_witharg(args, i, &bench_pattern, "--io-pattern", (char*)NULL)) {
     } else if (ceph_argparse_witharg(args, i, &val, "--path", (char*)NULL)) {
       path = strdup(val.c_str());
@@ -3193,6 +3356,7 @@ if (!set_conf_param(v, p1, p2, p3)) { \
       case OPT_MAP:
       case OPT_UNMAP:
       case OPT_BENCH_WRITE:
+      case OPT_BENCH_OPEN:
       case OPT_LOCK_LIST:
       case OPT_METADATA_LIST:
       case OPT_DIFF:
@@ -3914,6 +4078,14 @@ if (!set_conf_param(v, p1, p2, p3)) { \
     }
     break;
 
+  case OPT_BENCH_OPEN:
+    r = do_bench_open(io_ctx, imgname, bench_io_threads, bench_opens);
+    if (r < 0) {
+      cerr << "bench-open failed: " << cpp_strerror(-r) << std::endl;
+      return -r;
+    }
+    break;
+
   case OPT_METADATA_LIST:
     r = do_metadata_list(image, formatter.get());
     if (r < 0) {
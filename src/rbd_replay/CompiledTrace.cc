@@ -0,0 +1,260 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "CompiledTrace.hpp"
+#include <boost/foreach.hpp>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+#include "include/compat.h"
+#include "rbd_replay_debug.hpp"
+
+
+using namespace std;
+using namespace rbd_replay;
+
+
+const char CompiledTrace::MAGIC[8] = {'R', 'B', 'D', 'R', 'P', 'L', 'C', '\0'};
+
+CompiledTrace::CompiledTrace()
+  : m_mapping(NULL),
+    m_mapping_length(0),
+    m_header(NULL),
+    m_actions(NULL),
+    m_deps(NULL),
+    m_strings(NULL) {
+}
+
+CompiledTrace::~CompiledTrace() {
+  if (m_mapping) {
+    munmap(m_mapping, m_mapping_length);
+  }
+}
+
+static uint32_t add_string(const string &s, string *strings) {
+  uint32_t offset = strings->size();
+  strings->append(s.c_str(), s.size() + 1);
+  return offset;
+}
+
+int CompiledTrace::compile(const string &replay_file, ostream &out) {
+  ifstream input(replay_file.c_str(), ios::in | ios::binary);
+  if (!input.is_open()) {
+    cerr << "Unable to open " << replay_file << std::endl;
+    return -ENOENT;
+  }
+
+  header_d header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = FORMAT_VERSION;
+  header.byte_order = BYTE_ORDER_MARK;
+
+  vector<action_d> actions;
+  vector<dep_d> deps;
+  string strings;
+  map<thread_id_t, uint32_t> streams;
+  map<action_id_t, uint32_t> indexes;
+  map<action_id_t, uint64_t> latencies;
+
+  Deser deser(input);
+  while (true) {
+    Action::ptr action = Action::read_from(deser);
+    if (!action) {
+      break;
+    }
+    if (action->is_completion()) {
+      CompletionAction *completion = static_cast<CompletionAction*>(action.get());
+      latencies[completion->predecessors()[0].id] = completion->latency();
+      header.flags |= FLAG_LATENCIES;
+      continue;
+    }
+
+    action_d a;
+    memset(&a, 0, sizeof(a));
+    a.id = action->id();
+    a.name = NO_STRING;
+    a.snap_name = NO_STRING;
+    map<thread_id_t, uint32_t>::iterator s = streams.find(action->thread_id());
+    if (s == streams.end()) {
+      uint32_t stream = streams.size();
+      s = streams.insert(make_pair(action->thread_id(), stream)).first;
+    }
+    a.stream = s->second;
+
+    if (action->is_start_thread()) {
+      a.type = IO_START_THREAD;
+    } else if (dynamic_cast<StopThreadAction*>(action.get())) {
+      a.type = IO_STOP_THREAD;
+    } else if (ReadAction *r = dynamic_cast<ReadAction*>(action.get())) {
+      a.type = IO_READ;
+      a.imagectx_id = r->imagectx_id();
+      a.offset = r->offset();
+      a.length = r->length();
+    } else if (WriteAction *w = dynamic_cast<WriteAction*>(action.get())) {
+      a.type = IO_WRITE;
+      a.imagectx_id = w->imagectx_id();
+      a.offset = w->offset();
+      a.length = w->length();
+    } else if (AioReadAction *r = dynamic_cast<AioReadAction*>(action.get())) {
+      a.type = IO_ASYNC_READ;
+      a.imagectx_id = r->imagectx_id();
+      a.offset = r->offset();
+      a.length = r->length();
+    } else if (AioWriteAction *w = dynamic_cast<AioWriteAction*>(action.get())) {
+      a.type = IO_ASYNC_WRITE;
+      a.imagectx_id = w->imagectx_id();
+      a.offset = w->offset();
+      a.length = w->length();
+    } else if (OpenImageAction *o = dynamic_cast<OpenImageAction*>(action.get())) {
+      a.type = IO_OPEN_IMAGE;
+      a.imagectx_id = o->imagectx_id();
+      a.readonly = o->readonly();
+      a.name = add_string(o->name(), &strings);
+      a.snap_name = add_string(o->snap_name(), &strings);
+    } else if (CloseImageAction *c = dynamic_cast<CloseImageAction*>(action.get())) {
+      a.type = IO_CLOSE_IMAGE;
+      a.imagectx_id = c->imagectx_id();
+    } else {
+      cerr << "Unable to compile " << *action << std::endl;
+      return -EINVAL;
+    }
+
+    a.first_dep = deps.size();
+    BOOST_FOREACH(const dependency_d &d, action->predecessors()) {
+      // completions are numbered one higher than their action
+      map<action_id_t, uint32_t>::iterator i = indexes.find(d.id & ~1);
+      if (i == indexes.end()) {
+	cerr << "Action " << a.id << " depends on unknown action " << d.id << std::endl;
+	return -EINVAL;
+      }
+      dep_d dep;
+      memset(&dep, 0, sizeof(dep));
+      dep.action = i->second;
+      dep.completion = d.id & 1;
+      dep.time_delta = d.time_delta;
+      deps.push_back(dep);
+    }
+    a.num_deps = action->predecessors().size();
+
+    indexes[a.id] = actions.size();
+    actions.push_back(a);
+  }
+
+  for (map<action_id_t, uint64_t>::iterator i = latencies.begin(); i != latencies.end(); ++i) {
+    map<action_id_t, uint32_t>::iterator index = indexes.find(i->first);
+    if (index != indexes.end()) {
+      actions[index->second].latency = i->second;
+    }
+  }
+
+  // keep the sections 8-byte aligned when mapped
+  strings.resize((strings.size() + 7) & ~7, '\0');
+
+  header.num_streams = streams.size();
+  header.num_actions = actions.size();
+  header.num_deps = deps.size();
+  header.strings_length = strings.size();
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  if (!actions.empty()) {
+    out.write(reinterpret_cast<const char*>(&actions[0]), actions.size() * sizeof(action_d));
+  }
+  if (!deps.empty()) {
+    out.write(reinterpret_cast<const char*>(&deps[0]), deps.size() * sizeof(dep_d));
+  }
+  out.write(strings.data(), strings.size());
+  if (!out.good()) {
+    cerr << "Unable to write compiled trace" << std::endl;
+    return -EIO;
+  }
+  dout(THREAD_LEVEL) << "Compiled " << actions.size() << " actions in " << streams.size() << " streams" << dendl;
+  return 0;
+}
+
+int CompiledTrace::load(const string &path) {
+  assert(m_header == NULL);
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    int r = -errno;
+    cerr << "Unable to open " << path << ": " << strerror(-r) << std::endl;
+    return r;
+  }
+
+  char magic[sizeof(MAGIC)];
+  bool compiled = (pread(fd, magic, sizeof(magic), 0) == sizeof(magic) &&
+		   memcmp(magic, MAGIC, sizeof(MAGIC)) == 0);
+  if (!compiled) {
+    VOID_TEMP_FAILURE_RETRY(::close(fd));
+    ostringstream out;
+    int r = compile(path, out);
+    if (r < 0) {
+      return r;
+    }
+    m_buffer = out.str();
+    return attach(m_buffer.data(), m_buffer.size());
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    int r = -errno;
+    VOID_TEMP_FAILURE_RETRY(::close(fd));
+    return r;
+  }
+  void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  VOID_TEMP_FAILURE_RETRY(::close(fd));
+  if (addr == MAP_FAILED) {
+    int r = -errno;
+    cerr << "Unable to map " << path << ": " << strerror(-r) << std::endl;
+    return r;
+  }
+  // fault the trace in before the replay clock starts
+  madvise(addr, st.st_size, MADV_WILLNEED);
+  m_mapping = addr;
+  m_mapping_length = st.st_size;
+  return attach(static_cast<const char*>(addr), st.st_size);
+}
+
+int CompiledTrace::attach(const char *data, size_t length) {
+  if (length < sizeof(header_d)) {
+    cerr << "Compiled trace is truncated" << std::endl;
+    return -EINVAL;
+  }
+  const header_d *header = reinterpret_cast<const header_d*>(data);
+  if (header->byte_order != BYTE_ORDER_MARK) {
+    cerr << "Compiled trace was written on an architecture with a different byte order" << std::endl;
+    return -EINVAL;
+  }
+  if (header->version != FORMAT_VERSION) {
+    cerr << "Unsupported compiled trace version " << header->version << std::endl;
+    return -EINVAL;
+  }
+  uint64_t expected = sizeof(header_d) + header->num_actions * sizeof(action_d) +
+    header->num_deps * sizeof(dep_d) + header->strings_length;
+  if (length != expected) {
+    cerr << "Compiled trace has length " << length << ", expected " << expected << std::endl;
+    return -EINVAL;
+  }
+
+  m_header = header;
+  m_actions = reinterpret_cast<const action_d*>(data + sizeof(header_d));
+  m_deps = reinterpret_cast<const dep_d*>(m_actions + header->num_actions);
+  m_strings = reinterpret_cast<const char*>(m_deps + header->num_deps);
+  return 0;
+}
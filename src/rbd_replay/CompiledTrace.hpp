@@ -0,0 +1,152 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef _INCLUDED_RBD_REPLAY_COMPILEDTRACE_HPP
+#define _INCLUDED_RBD_REPLAY_COMPILEDTRACE_HPP
+
+#include <iostream>
+#include <string>
+#include <stdint.h>
+#include "actions.hpp"
+
+namespace rbd_replay {
+
+/**
+   A replay file compiled into fixed-size, native-endian records.
+   Replay files written by rbd-replay-prep are portable, but every action has
+   to be deserialized field by field before it can be scheduled.
+   A compiled trace can be memory-mapped and scanned in place, dependencies
+   are resolved to record indexes, and traced threads are numbered densely
+   as streams.  Compiled traces are not portable between architectures.
+
+   The file layout is a header, followed by the action records, the
+   dependency records and finally a table of NUL-terminated strings.
+ */
+class CompiledTrace {
+public:
+  static const uint32_t NO_STRING = 0xffffffff;
+
+  struct action_d {
+    /// One of io_type
+    uint8_t type;
+    /// Open image only: whether the image was opened read-only
+    uint8_t readonly;
+    uint16_t reserved;
+    /// ID of the action in the replay file
+    action_id_t id;
+    /// Dense index of the traced thread that issued the action
+    uint32_t stream;
+    uint32_t num_deps;
+    /// Index of the first dependency record
+    uint64_t first_dep;
+    imagectx_id_t imagectx_id;
+    uint64_t offset;
+    uint64_t length;
+    /// Open image only: offsets into the string table
+    uint32_t name;
+    uint32_t snap_name;
+    /// Original latency in nanoseconds, or 0 if it was not recorded
+    uint64_t latency;
+  };
+
+  struct dep_d {
+    /// Index of the action record this dependency refers to
+    uint32_t action;
+    /// Non-zero if the dependency is on the completion of the action
+    uint8_t completion;
+    uint8_t reserved[3];
+    /// Nanoseconds of delay after the action or completion fired
+    uint64_t time_delta;
+  };
+
+  CompiledTrace();
+
+  ~CompiledTrace();
+
+  /**
+     Compiles a replay file written by rbd-replay-prep.
+     @return 0 on success, or a negative error code
+   */
+  static int compile(const std::string &replay_file, std::ostream &out);
+
+  /**
+     Loads a trace for replay.
+     A compiled trace is memory-mapped, while a replay file written by
+     rbd-replay-prep is compiled into memory first.
+     @return 0 on success, or a negative error code
+   */
+  int load(const std::string &path);
+
+  uint32_t num_streams() const {
+    return m_header->num_streams;
+  }
+
+  uint64_t num_actions() const {
+    return m_header->num_actions;
+  }
+
+  const action_d &action(uint64_t index) const {
+    return m_actions[index];
+  }
+
+  const dep_d &dep(uint64_t index) const {
+    return m_deps[index];
+  }
+
+  /// Returns true if the original latencies were recorded in the trace.
+  bool has_latencies() const {
+    return m_header->flags & FLAG_LATENCIES;
+  }
+
+  const char *string_at(uint32_t offset) const {
+    return offset == NO_STRING ? "" : m_strings + offset;
+  }
+
+private:
+  static const uint32_t FORMAT_VERSION = 1;
+  static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+  static const uint32_t FLAG_LATENCIES = 1;
+
+  struct header_d {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t flags;
+    uint32_t num_streams;
+    uint64_t num_actions;
+    uint64_t num_deps;
+    uint64_t strings_length;
+  };
+
+  static const char MAGIC[8];
+
+  int attach(const char *data, size_t length);
+
+  /// Disallow copying
+  CompiledTrace(const CompiledTrace& rhs);
+  /// Disallow assignment
+  const CompiledTrace& operator=(const CompiledTrace& rhs);
+
+  /// Memory-mapped file, or NULL if the trace was compiled into m_buffer.
+  void *m_mapping;
+  size_t m_mapping_length;
+  std::string m_buffer;
+
+  const header_d *m_header;
+  const action_d *m_actions;
+  const dep_d *m_deps;
+  const char *m_strings;
+};
+
+}
+
+#endif
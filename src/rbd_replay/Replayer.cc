@@ -184,6 +184,10 @@ void Replayer::run(const std::string& replay_file) {
 	if (!action) {
 	  break;
 	}
+	if (action->is_completion()) {
+	  // only used to report original latencies in throughput mode
+	  continue;
+	}
 	if (action->is_start_thread()) {
 	  Worker *worker = new Worker(*this);
 	  workers[action->thread_id()] = worker;
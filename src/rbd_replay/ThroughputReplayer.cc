@@ -0,0 +1,446 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "ThroughputReplayer.hpp"
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <iomanip>
+#include "common/Clock.h"
+#include "global/global_context.h"
+#include "rbd_replay_debug.hpp"
+
+
+using namespace std;
+using namespace rbd_replay;
+
+
+static bool is_io(uint8_t type) {
+  return (type == IO_READ || type == IO_WRITE ||
+	  type == IO_ASYNC_READ || type == IO_ASYNC_WRITE);
+}
+
+static bool is_write(uint8_t type) {
+  return type == IO_WRITE || type == IO_ASYNC_WRITE;
+}
+
+/**
+   Issues the actions of a set of streams from a single thread.
+ */
+class ThroughputReplayer::Worker {
+public:
+  Worker(ThroughputReplayer &replayer, const CompiledTrace &trace)
+    : m_replayer(replayer),
+      m_trace(trace),
+      m_in_flight(0),
+      m_skipped(0) {
+  }
+
+  void add_stream(std::vector<uint32_t> *actions) {
+    m_streams.push_back(stream_d());
+    m_streams.back().actions.swap(*actions);
+  }
+
+  void start() {
+    m_thread = boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&Worker::run, this)));
+  }
+
+  void join() {
+    m_thread->join();
+  }
+
+  static void handle_complete(librbd::completion_t cb, void *arg);
+
+  results_d &reads() {
+    return m_reads;
+  }
+
+  results_d &writes() {
+    return m_writes;
+  }
+
+  uint64_t skipped() const {
+    return m_skipped;
+  }
+
+private:
+  struct stream_d {
+    /// Indexes of the actions in the stream, in trace order
+    std::vector<uint32_t> actions;
+    size_t next;
+    /// Synchronous action that has to complete before the stream continues
+    int64_t blocked_on;
+
+    stream_d() : next(0), blocked_on(-1) {
+    }
+  };
+
+  struct io_d {
+    Worker *worker;
+    uint32_t index;
+    utime_t start;
+    ceph::bufferlist bl;
+    librbd::RBD::AioCompletion *completion;
+
+    io_d(Worker *worker, uint32_t index)
+      : worker(worker), index(index), completion(NULL) {
+    }
+  };
+
+  void run();
+
+  bool ready(uint32_t index) const;
+
+  void issue(uint32_t index);
+
+  void completed(io_d *io);
+
+  ThroughputReplayer &m_replayer;
+  const CompiledTrace &m_trace;
+  std::vector<stream_d> m_streams;
+  boost::shared_ptr<boost::thread> m_thread;
+
+  boost::mutex m_lock;
+  boost::condition m_cond;
+  uint64_t m_in_flight;
+  results_d m_reads;
+  results_d m_writes;
+  uint64_t m_skipped;
+};
+
+void ThroughputReplayer::Worker::run() {
+  dout(THREAD_LEVEL) << "Throughput worker started with " << m_streams.size() << " streams" << dendl;
+  boost::mutex::scoped_lock lock(m_lock);
+  while (true) {
+    vector<uint32_t> to_issue;
+    bool done = true;
+    for (vector<stream_d>::iterator s = m_streams.begin(); s != m_streams.end(); ++s) {
+      while (s->next < s->actions.size()) {
+	if (s->blocked_on >= 0 && !m_replayer.m_complete[s->blocked_on]) {
+	  break;
+	}
+	s->blocked_on = -1;
+
+	uint32_t index = s->actions[s->next];
+	if (!ready(index)) {
+	  break;
+	}
+	++s->next;
+
+	const CompiledTrace::action_d &a = m_trace.action(index);
+	if (!is_io(a.type)) {
+	  // images are opened up front and threads are implied by the streams
+	  m_replayer.m_complete[index] = 1;
+	  continue;
+	}
+	if (m_replayer.m_readonly && is_write(a.type)) {
+	  ++m_skipped;
+	  m_replayer.m_complete[index] = 1;
+	  continue;
+	}
+	if (a.type == IO_READ || a.type == IO_WRITE) {
+	  s->blocked_on = index;
+	}
+	to_issue.push_back(index);
+      }
+      if (s->next < s->actions.size()) {
+	done = false;
+      }
+    }
+
+    if (to_issue.empty()) {
+      if (done && m_in_flight == 0) {
+	break;
+      }
+      m_cond.wait(lock);
+      continue;
+    }
+
+    m_in_flight += to_issue.size();
+    lock.unlock();
+    for (vector<uint32_t>::iterator i = to_issue.begin(); i != to_issue.end(); ++i) {
+      issue(*i);
+    }
+    lock.lock();
+  }
+  dout(THREAD_LEVEL) << "Throughput worker stopped" << dendl;
+}
+
+bool ThroughputReplayer::Worker::ready(uint32_t index) const {
+  const CompiledTrace::action_d &a = m_trace.action(index);
+  for (uint64_t i = a.first_dep; i < a.first_dep + a.num_deps; ++i) {
+    const CompiledTrace::dep_d &dep = m_trace.dep(i);
+    // earlier actions in the stream have already been issued, and
+    // other streams are independent
+    if (dep.completion && m_trace.action(dep.action).stream == a.stream &&
+	!m_replayer.m_complete[dep.action]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ThroughputReplayer::Worker::issue(uint32_t index) {
+  const CompiledTrace::action_d &a = m_trace.action(index);
+  dout(ACTION_LEVEL) << "Issuing action " << a.id << " (type " << (int)a.type << ", offset " << a.offset << ", length " << a.length << ")" << dendl;
+  map<imagectx_id_t, librbd::Image*>::iterator image = m_replayer.m_images.find(a.imagectx_id);
+  assertf(image != m_replayer.m_images.end(), "id = %d", a.id);
+
+  io_d *io = new io_d(this, index);
+  io->completion = new librbd::RBD::AioCompletion(io, &Worker::handle_complete);
+  io->start = ceph_clock_now(g_ceph_context);
+  int r;
+  if (is_write(a.type)) {
+    io->bl.append(ceph::bufferptr(m_replayer.m_zero, 0, a.length));
+    r = image->second->aio_write(a.offset, a.length, io->bl, io->completion);
+  } else {
+    r = image->second->aio_read(a.offset, a.length, io->bl, io->completion);
+  }
+  assertf(r >= 0, "id = %d, r = %d", a.id, r);
+}
+
+void ThroughputReplayer::Worker::handle_complete(librbd::completion_t cb, void *arg) {
+  io_d *io = static_cast<io_d*>(arg);
+  io->worker->completed(io);
+}
+
+void ThroughputReplayer::Worker::completed(io_d *io) {
+  utime_t latency = ceph_clock_now(g_ceph_context) - io->start;
+  const CompiledTrace::action_d &a = m_trace.action(io->index);
+  ssize_t r = io->completion->get_return_value();
+  assertf(r >= 0, "id = %d, r = %d", a.id, r);
+  io->completion->release();
+
+  {
+    boost::mutex::scoped_lock lock(m_lock);
+    results_d &results = is_write(a.type) ? m_writes : m_reads;
+    results.achieved.push_back(latency.to_nsec());
+    if (a.latency > 0) {
+      results.original.push_back(a.latency);
+    }
+    results.bytes += a.length;
+    m_replayer.m_complete[io->index] = 1;
+    --m_in_flight;
+    m_cond.notify_all();
+  }
+  delete io;
+}
+
+
+ThroughputReplayer::ThroughputReplayer(int num_threads)
+  : m_num_threads(num_threads),
+    m_pool_name("rbd"),
+    m_readonly(false),
+    m_skipped(0) {
+  assertf(num_threads > 0, "num_threads = %d", num_threads);
+}
+
+ThroughputReplayer::~ThroughputReplayer() {
+  for (vector<Worker*>::iterator w = m_workers.begin(); w != m_workers.end(); ++w) {
+    delete *w;
+  }
+  close_images();
+}
+
+int ThroughputReplayer::run(const CompiledTrace &trace) {
+  librados::Rados rados;
+  int r = rados.init_with_context(g_ceph_context);
+  if (r < 0) {
+    cerr << "Unable to read conf file: " << r << std::endl;
+    return r;
+  }
+  r = rados.connect();
+  if (r < 0) {
+    cerr << "Unable to connect to Rados: " << r << std::endl;
+    return r;
+  }
+  librados::IoCtx ioctx;
+  r = rados.ioctx_create(m_pool_name.c_str(), ioctx);
+  if (r < 0) {
+    cerr << "Unable to create IoCtx: " << r << std::endl;
+    return r;
+  }
+
+  librbd::RBD rbd;
+  r = open_images(rbd, ioctx, trace);
+  if (r < 0) {
+    close_images();
+    return r;
+  }
+
+  m_complete.assign(trace.num_actions(), 0);
+  partition_streams(trace);
+
+  utime_t start = ceph_clock_now(g_ceph_context);
+  for (vector<Worker*>::iterator w = m_workers.begin(); w != m_workers.end(); ++w) {
+    (*w)->start();
+  }
+  for (vector<Worker*>::iterator w = m_workers.begin(); w != m_workers.end(); ++w) {
+    (*w)->join();
+  }
+  utime_t elapsed = ceph_clock_now(g_ceph_context) - start;
+
+  close_images();
+  report(trace, (double)elapsed);
+  return 0;
+}
+
+int ThroughputReplayer::open_images(librbd::RBD &rbd, librados::IoCtx &ioctx,
+				    const CompiledTrace &trace) {
+  uint64_t max_write = 0;
+  for (uint64_t i = 0; i < trace.num_actions(); ++i) {
+    const CompiledTrace::action_d &a = trace.action(i);
+    if (is_write(a.type)) {
+      max_write = std::max(max_write, a.length);
+    }
+    if (a.type != IO_OPEN_IMAGE || m_images.count(a.imagectx_id) > 0) {
+      continue;
+    }
+
+    string image_name(trace.string_at(a.name));
+    string snap_name(trace.string_at(a.snap_name));
+    rbd_loc name(m_image_name_map.map(rbd_loc("", image_name, snap_name)));
+    librbd::Image *image = new librbd::Image();
+    int r;
+    if (a.readonly || m_readonly) {
+      r = rbd.open_read_only(ioctx, *image, name.image.c_str(), name.snap.c_str());
+    } else {
+      r = rbd.open(ioctx, *image, name.image.c_str(), name.snap.c_str());
+    }
+    if (r < 0) {
+      cerr << "Unable to open image '" << image_name
+	   << "' with snap '" << snap_name
+	   << "' (mapped to '" << name.str()
+	   << "'): (" << -r << ") " << strerror(-r) << std::endl;
+      delete image;
+      return r;
+    }
+    m_images[a.imagectx_id] = image;
+  }
+
+  for (uint64_t i = 0; i < trace.num_actions(); ++i) {
+    const CompiledTrace::action_d &a = trace.action(i);
+    if (is_io(a.type) && m_images.count(a.imagectx_id) == 0) {
+      cerr << "Action " << a.id << " uses an image that is never opened" << std::endl;
+      return -EINVAL;
+    }
+  }
+
+  m_zero = ceph::buffer::create(max_write);
+  m_zero.zero();
+  return 0;
+}
+
+void ThroughputReplayer::close_images() {
+  for (map<imagectx_id_t, librbd::Image*>::iterator i = m_images.begin(); i != m_images.end(); ++i) {
+    delete i->second;
+  }
+  m_images.clear();
+}
+
+void ThroughputReplayer::partition_streams(const CompiledTrace &trace) {
+  vector<vector<uint32_t> > streams(trace.num_streams());
+  vector<pair<uint64_t, uint32_t> > weights(trace.num_streams());
+  for (uint32_t s = 0; s < trace.num_streams(); ++s) {
+    weights[s].second = s;
+  }
+  for (uint64_t i = 0; i < trace.num_actions(); ++i) {
+    const CompiledTrace::action_d &a = trace.action(i);
+    streams[a.stream].push_back(i);
+    if (is_io(a.type)) {
+      weights[a.stream].first += a.length;
+    }
+  }
+
+  // hand out the heaviest streams first, each to the least loaded worker
+  sort(weights.rbegin(), weights.rend());
+  size_t num_workers = std::min<size_t>(m_num_threads, std::max<size_t>(1, streams.size()));
+  vector<uint64_t> load(num_workers, 0);
+  for (size_t w = 0; w < num_workers; ++w) {
+    m_workers.push_back(new Worker(*this, trace));
+  }
+  for (vector<pair<uint64_t, uint32_t> >::iterator s = weights.begin(); s != weights.end(); ++s) {
+    size_t w = min_element(load.begin(), load.end()) - load.begin();
+    dout(THREAD_LEVEL) << "Assigning stream " << s->second << " (" << s->first << " bytes) to worker " << w << dendl;
+    m_workers[w]->add_stream(&streams[s->second]);
+    load[w] += s->first;
+  }
+}
+
+static void print_distribution(const string &name, vector<uint64_t> *samples) {
+  cout << setw(16) << left << name << right << setw(10) << samples->size();
+  if (samples->empty()) {
+    cout << std::endl;
+    return;
+  }
+
+  sort(samples->begin(), samples->end());
+  uint64_t total = 0;
+  for (vector<uint64_t>::iterator i = samples->begin(); i != samples->end(); ++i) {
+    total += *i;
+  }
+  cout << setw(10) << total / samples->size() / 1000;
+  const double percentiles[] = {0.5, 0.9, 0.99, 0.999};
+  for (size_t p = 0; p < sizeof(percentiles) / sizeof(percentiles[0]); ++p) {
+    size_t i = std::min<size_t>(samples->size() - 1, percentiles[p] * samples->size());
+    cout << setw(10) << (*samples)[i] / 1000;
+  }
+  cout << setw(10) << samples->back() / 1000 << std::endl;
+}
+
+void ThroughputReplayer::report(const CompiledTrace &trace, double elapsed) {
+  for (vector<Worker*>::iterator w = m_workers.begin(); w != m_workers.end(); ++w) {
+    results_d *results[] = {&(*w)->reads(), &(*w)->writes()};
+    results_d *totals[] = {&m_reads, &m_writes};
+    for (int i = 0; i < 2; ++i) {
+      totals[i]->achieved.insert(totals[i]->achieved.end(), results[i]->achieved.begin(), results[i]->achieved.end());
+      totals[i]->original.insert(totals[i]->original.end(), results[i]->original.begin(), results[i]->original.end());
+      totals[i]->bytes += results[i]->bytes;
+    }
+    m_skipped += (*w)->skipped();
+  }
+
+  uint64_t ios = m_reads.achieved.size() + m_writes.achieved.size();
+  if (elapsed <= 0) {
+    elapsed = 1e-9;
+  }
+  cout << "Replayed " << ios << " IOs from " << trace.num_streams()
+       << " streams on " << m_workers.size() << " threads in " << elapsed
+       << " sec" << std::endl;
+  if (m_skipped > 0) {
+    cout << "Skipped " << m_skipped << " writes (read-only)" << std::endl;
+  }
+  cout << "IOPS: " << (uint64_t)(ios / elapsed)
+       << ", read: " << m_reads.bytes / elapsed / (1 << 20) << " MB/sec"
+       << ", write: " << m_writes.bytes / elapsed / (1 << 20) << " MB/sec"
+       << std::endl;
+
+  cout << std::endl;
+  cout << setw(16) << left << "latency (usec)" << right << setw(10) << "count"
+       << setw(10) << "mean" << setw(10) << "p50" << setw(10) << "p90"
+       << setw(10) << "p99" << setw(10) << "p99.9" << setw(10) << "max"
+       << std::endl;
+  print_distribution("read achieved", &m_reads.achieved);
+  if (trace.has_latencies()) {
+    print_distribution("read original", &m_reads.original);
+  }
+  print_distribution("write achieved", &m_writes.achieved);
+  if (trace.has_latencies()) {
+    print_distribution("write original", &m_writes.original);
+  }
+  if (!trace.has_latencies()) {
+    cout << "Original latencies were not recorded, use rbd-replay-prep --record-latencies" << std::endl;
+  }
+}
@@ -0,0 +1,111 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef _INCLUDED_RBD_REPLAY_THROUGHPUTREPLAYER_HPP
+#define _INCLUDED_RBD_REPLAY_THROUGHPUTREPLAYER_HPP
+
+#include <map>
+#include <vector>
+#include "include/buffer.h"
+#include "CompiledTrace.hpp"
+#include "ImageNameMap.hpp"
+
+namespace rbd_replay {
+
+/**
+   Replays a compiled trace as fast as possible to use it as a benchmark.
+
+   Each traced thread becomes an independent stream of actions.  Actions
+   within a stream are issued in trace order and keep waiting for the
+   completions they depended on in the same stream, so a stream keeps the
+   queue depth it had in the original trace.  Dependencies on other streams
+   and the original think times are ignored, which lets the streams be
+   partitioned across a fixed number of replay threads.  All images in the
+   trace are opened before the replay starts and closed after it finishes.
+
+   Once the replay is complete, the achieved latency distribution is
+   reported next to the original distribution if the trace recorded it.
+ */
+class ThroughputReplayer {
+public:
+  explicit ThroughputReplayer(int num_threads);
+
+  ~ThroughputReplayer();
+
+  /**
+     Replays the trace and writes the report to standard out.
+     @return 0 on success, or a negative error code
+   */
+  int run(const CompiledTrace &trace);
+
+  void set_pool_name(std::string pool_name) {
+    m_pool_name = pool_name;
+  }
+
+  void set_readonly(bool readonly) {
+    m_readonly = readonly;
+  }
+
+  void set_image_name_map(const ImageNameMap &map) {
+    m_image_name_map = map;
+  }
+
+private:
+  class Worker;
+  friend class Worker;
+
+  struct results_d {
+    std::vector<uint64_t> achieved;
+    std::vector<uint64_t> original;
+    uint64_t bytes;
+
+    results_d() : bytes(0) {
+    }
+  };
+
+  int open_images(librbd::RBD &rbd, librados::IoCtx &ioctx,
+		  const CompiledTrace &trace);
+
+  void close_images();
+
+  void partition_streams(const CompiledTrace &trace);
+
+  void report(const CompiledTrace &trace, double elapsed);
+
+  /// Disallow copying
+  ThroughputReplayer(const ThroughputReplayer& rhs);
+  /// Disallow assignment
+  const ThroughputReplayer& operator=(const ThroughputReplayer& rhs);
+
+  const int m_num_threads;
+  std::string m_pool_name;
+  bool m_readonly;
+  ImageNameMap m_image_name_map;
+
+  /// Only modified before and after the replay
+  std::map<imagectx_id_t, librbd::Image*> m_images;
+
+  /// Zeroes shared by all writes
+  ceph::bufferptr m_zero;
+
+  /// Set once an action has completed, only accessed by the worker owning its stream
+  std::vector<uint8_t> m_complete;
+
+  std::vector<Worker*> m_workers;
+  results_d m_reads;
+  results_d m_writes;
+  uint64_t m_skipped;
+};
+
+}
+
+#endif
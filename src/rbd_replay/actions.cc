@@ -72,6 +72,8 @@ Action::ptr Action::read_from(Deser &d) {
     return OpenImageAction::read_from(dummy, d);
   case IO_CLOSE_IMAGE:
     return CloseImageAction::read_from(dummy, d);
+  case IO_COMPLETION:
+    return CompletionAction::read_from(dummy, d);
   default:
     cerr << "Invalid action type: " << type << std::endl;
     exit(1);
@@ -103,6 +105,35 @@ std::ostream& DummyAction::dump(std::ostream& o) const {
 }
 
 
+CompletionAction::CompletionAction(Action &src)
+  : Action(src) {
+  assertf(predecessors().size() == 1, "id = %d", id());
+}
+
+void CompletionAction::perform(ActionCtx &ctx) {
+  cerr << "CompletionAction should never actually be performed" << std::endl;
+  exit(1);
+}
+
+bool CompletionAction::is_completion() {
+  return true;
+}
+
+uint64_t CompletionAction::latency() const {
+  return predecessors()[0].time_delta;
+}
+
+Action::ptr CompletionAction::read_from(Action &src, Deser &d) {
+  return Action::ptr(new CompletionAction(src));
+}
+
+std::ostream& CompletionAction::dump(std::ostream& o) const {
+  o << "CompletionAction[";
+  dump_action_fields(o);
+  return o << ", latency=" << latency() << "]";
+}
+
+
 StartThreadAction::StartThreadAction(Action &src)
   : Action(src) {
 }
@@ -63,6 +63,7 @@ enum io_type {
   IO_ASYNC_WRITE,
   IO_OPEN_IMAGE,
   IO_CLOSE_IMAGE,
+  IO_COMPLETION,
 };
 
 
@@ -151,6 +152,10 @@ public:
     return false;
   }
 
+  virtual bool is_completion() {
+    return false;
+  }
+
   action_id_t id() const {
     return m_id;
   }
@@ -232,6 +237,18 @@ public:
 
   static Action::ptr read_from(Action &src, Deser &d);
 
+  imagectx_id_t imagectx_id() const {
+    return m_imagectx_id;
+  }
+
+  uint64_t offset() const {
+    return m_offset;
+  }
+
+  uint64_t length() const {
+    return m_length;
+  }
+
 private:
   std::ostream& dump(std::ostream& o) const;
 
@@ -252,6 +269,18 @@ public:
 
   static Action::ptr read_from(Action &src, Deser &d);
 
+  imagectx_id_t imagectx_id() const {
+    return m_imagectx_id;
+  }
+
+  uint64_t offset() const {
+    return m_offset;
+  }
+
+  uint64_t length() const {
+    return m_length;
+  }
+
 private:
   std::ostream& dump(std::ostream& o) const;
 
@@ -272,6 +301,18 @@ public:
 
   static Action::ptr read_from(Action &src, Deser &d);
 
+  imagectx_id_t imagectx_id() const {
+    return m_imagectx_id;
+  }
+
+  uint64_t offset() const {
+    return m_offset;
+  }
+
+  uint64_t length() const {
+    return m_length;
+  }
+
 private:
   std::ostream& dump(std::ostream& o) const;
 
@@ -292,6 +333,18 @@ public:
 
   static Action::ptr read_from(Action &src, Deser &d);
 
+  imagectx_id_t imagectx_id() const {
+    return m_imagectx_id;
+  }
+
+  uint64_t offset() const {
+    return m_offset;
+  }
+
+  uint64_t length() const {
+    return m_length;
+  }
+
 private:
   std::ostream& dump(std::ostream& o) const;
 
@@ -313,6 +366,22 @@ public:
 
   static Action::ptr read_from(Action &src, Deser &d);
 
+  imagectx_id_t imagectx_id() const {
+    return m_imagectx_id;
+  }
+
+  const std::string& name() const {
+    return m_name;
+  }
+
+  const std::string& snap_name() const {
+    return m_snap_name;
+  }
+
+  bool readonly() const {
+    return m_readonly;
+  }
+
 private:
   std::ostream& dump(std::ostream& o) const;
 
@@ -332,6 +401,10 @@ public:
 
   static Action::ptr read_from(Action &src, Deser &d);
 
+  imagectx_id_t imagectx_id() const {
+    return m_imagectx_id;
+  }
+
 private:
   std::ostream& dump(std::ostream& o) const;
 
@@ -339,6 +412,30 @@ private:
 };
 
 
+/**
+   Records when the completion of an earlier action fired in the original trace.
+   The only predecessor is the completed action, and its time delta is the
+   original latency of that action.  Only written by rbd-replay-prep when
+   --record-latencies is given, and never performed.
+ */
+class CompletionAction : public Action {
+public:
+  explicit CompletionAction(Action &src);
+
+  void perform(ActionCtx &ctx);
+
+  bool is_completion();
+
+  /// Returns the original latency of the completed action, in nanoseconds.
+  uint64_t latency() const;
+
+  static Action::ptr read_from(Action &src, Deser &d);
+
+private:
+  std::ostream& dump(std::ostream& o) const;
+};
+
+
 class StartThreadAction : public Action {
 public:
   explicit StartThreadAction(Action &src);
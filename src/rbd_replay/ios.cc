@@ -86,7 +86,8 @@ void IO::write_to(Ser& out, io_type iotype) const {
 
 IO::ptr IO::create_completion(uint64_t start_time, thread_id_t thread_id) {
   assert(!m_completion.lock());
-  IO::ptr completion(new CompletionIO(m_ionum + 1, start_time, thread_id));
+  IO::ptr completion(new CompletionIO(m_ionum + 1, start_time, thread_id,
+				       m_start_time));
   m_completion = completion;
   completion->m_dependencies.insert(shared_from_this());
   return completion;
@@ -185,6 +186,17 @@ ostream& operator<<(ostream& out, IO::ptr io) {
   return out;
 }
 
+void CompletionIO::write_latency_to(Ser& out) const {
+  out.write_uint8_t(IO_COMPLETION);
+  out.write_uint32_t(ionum());
+  out.write_uint64_t(thread_id());
+  out.write_uint32_t(0);
+  out.write_uint32_t(0);
+  out.write_uint32_t(1);
+  out.write_uint32_t(ionum() - 1);
+  out.write_uint64_t(start_time() - m_io_start_time);
+}
+
 void StartThreadIO::write_to(Ser& out) const {
   IO::write_to(out, IO_START_THREAD);
 }
@@ -121,6 +121,10 @@ public:
     return m_ionum;
   }
 
+  thread_id_t thread_id() const {
+    return m_thread_id;
+  }
+
   ptr prev() const {
     return m_prev;
   }
@@ -345,15 +349,26 @@ private:
 
 class CompletionIO : public IO {
 public:
+  /**
+     @param io_start_time start time of the completed %IO, in nanoseconds
+   */
   CompletionIO(action_id_t ionum,
 	       uint64_t start_time,
-	       thread_id_t thread_id)
-    : IO(ionum, start_time, thread_id, IO::ptr()) {
+	       thread_id_t thread_id,
+	       uint64_t io_start_time)
+    : IO(ionum, start_time, thread_id, IO::ptr()),
+      m_io_start_time(io_start_time) {
   }
 
   void write_to(Ser& out) const {
   }
 
+  /**
+     Writes a record of when the completion fired relative to the start of
+     the completed %IO, i.e. the original latency of the %IO.
+   */
+  void write_latency_to(Ser& out) const;
+
   bool is_completion() const {
     return true;
   }
@@ -361,6 +376,8 @@ public:
   void write_debug(std::ostream& out) const {
     write_debug_base(out, "completion");
   }
+private:
+  uint64_t m_io_start_time;
 };
 
 /// @related IO
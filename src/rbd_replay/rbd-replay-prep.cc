@@ -119,7 +119,7 @@ private:
 };
 
 static void usage(string prog) {
-  cout << "Usage: " << prog << " [ --window <seconds> ] [ --anonymize ] <trace-input> <replay-output>" << endl;
+  cout << "Usage: " << prog << " [ --window <seconds> ] [ --anonymize ] [ --record-latencies ] <trace-input> <replay-output>" << endl;
 }
 
 __attribute__((noreturn)) static void usage_exit(string prog, string msg) {
@@ -139,6 +139,7 @@ public:
       m_ios(vector<IO::ptr>()),
       m_pending_ios(map<uint64_t, IO::ptr>()),
       m_anonymize(false),
+      m_record_latencies(false),
       m_anonymized_images(map<string, AnonymizedImage>()) {
   }
 
@@ -160,6 +161,8 @@ public:
 	m_window = (uint64_t)(1e9 * atof(arg.c_str() + sizeof("--window=")));
       } else if (arg == "--anonymize") {
 	m_anonymize = true;
+      } else if (arg == "--record-latencies") {
+	m_record_latencies = true;
       } else if (arg == "-h" || arg == "--help") {
 	usage(args[0]);
 	exit(0);
@@ -248,7 +251,14 @@ public:
     myfile.open(output_file_name.c_str(), ios::out | ios::binary);
     Ser ser(myfile);
     for (vector<IO::ptr>::iterator itr = m_ios.begin(); itr != m_ios.end(); ++itr) {
-      (*itr)->write_to(ser);
+      if (m_record_latencies && (*itr)->is_completion()) {
+	// older versions of rbd-replay cannot read these records
+	boost::shared_ptr<CompletionIO> completion(boost::dynamic_pointer_cast<CompletionIO>(*itr));
+	assert(completion);
+	completion->write_latency_to(ser);
+      } else {
+	(*itr)->write_to(ser);
+      }
     }
     myfile.close();
   }
@@ -524,6 +534,7 @@ private:
   map<uint64_t, IO::ptr> m_pending_ios;
 
   bool m_anonymize;
+  bool m_record_latencies;
   map<string, AnonymizedImage> m_anonymized_images;
 };
 
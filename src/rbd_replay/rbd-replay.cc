@@ -12,11 +12,14 @@
  *
  */
 
+#include <fstream>
 #include <vector>
 #include <boost/thread.hpp>
 #include "common/ceph_argparse.h"
 #include "global/global_init.h"
+#include "CompiledTrace.hpp"
 #include "Replayer.hpp"
+#include "ThroughputReplayer.hpp"
 #include "rbd_replay_debug.hpp"
 #include "ImageNameMap.hpp"
 
@@ -42,6 +45,12 @@ static void usage(const char* program) {
   cout << "  --read-only                     Only perform non-destructive operations." << std::endl;
   cout << "  --map-image <rule>              Add a rule to map image names in the trace to" << std::endl;
   cout << "                                  image names in the replay cluster." << std::endl;
+  cout << "  --throughput                    Replay as fast as possible as a benchmark and" << std::endl;
+  cout << "                                  report achieved and original latencies." << std::endl;
+  cout << "  --threads <n>                   Number of threads for --throughput." << std::endl;
+  cout << "                                  Default: number of CPUs" << std::endl;
+  cout << "  --compile <file>                Compile the replay file into <file> for --throughput" << std::endl;
+  cout << "                                  and exit." << std::endl;
   cout << "  --dump-perf-counters            *Experimental*" << std::endl;
   cout << "                                  Dump performance counters to standard out before" << std::endl;
   cout << "                                  an image is closed. Performance counters may be dumped" << std::endl;
@@ -70,6 +79,9 @@ int main(int argc, const char **argv) {
   std::string val;
   std::ostringstream err;
   bool dump_perf_counters = false;
+  bool throughput = false;
+  int num_threads = boost::thread::hardware_concurrency();
+  string compile_file;
   for (i = args.begin(); i != args.end(); ) {
     if (ceph_argparse_double_dash(args, i)) {
       break;
@@ -96,6 +108,14 @@ int main(int argc, const char **argv) {
       return 0;
     } else if (ceph_argparse_flag(args, i, "--dump-perf-counters", (char*)NULL)) {
       dump_perf_counters = true;
+    } else if (ceph_argparse_flag(args, i, "--throughput", (char*)NULL)) {
+      throughput = true;
+    } else if (ceph_argparse_witharg(args, i, &num_threads, err, "--threads", (char*)NULL)) {
+      if (!err.str().empty() || num_threads <= 0) {
+	cerr << "Invalid number of threads: " << err.str() << std::endl;
+	return 1;
+      }
+    } else if (ceph_argparse_witharg(args, i, &compile_file, "--compile", (char*)NULL)) {
     } else if (get_remainder(*i, "-")) {
       cerr << "Unrecognized argument: " << *i << std::endl;
       return 1;
@@ -116,6 +136,27 @@ int main(int argc, const char **argv) {
     return 1;
   }
 
+  if (!compile_file.empty()) {
+    ofstream out(compile_file.c_str(), ios::out | ios::binary | ios::trunc);
+    if (!out.is_open()) {
+      cerr << "Unable to open " << compile_file << std::endl;
+      return 1;
+    }
+    return CompiledTrace::compile(replay_file, out) < 0 ? 1 : 0;
+  }
+
+  if (throughput) {
+    CompiledTrace trace;
+    if (trace.load(replay_file) < 0) {
+      return 1;
+    }
+    ThroughputReplayer replayer(num_threads);
+    replayer.set_pool_name(pool_name);
+    replayer.set_readonly(readonly);
+    replayer.set_image_name_map(image_name_map);
+    return replayer.run(trace) < 0 ? 1 : 0;
+  }
+
   unsigned int nthreads = boost::thread::hardware_concurrency();
   Replayer replayer(2 * nthreads + 1);
   replayer.set_latency_multiplier(latency_multiplier);
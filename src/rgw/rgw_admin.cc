@@ -32,6 +32,9 @@ using namespace std;
 #include "rgw_usage.h"
 #include "rgw_replica_log.h"
 #include "rgw_orphan.h"
+#include "rgw_reshard.h"
+#include "rgw_gc.h"
+#include "rgw_lc.h"
 
 #define dout_subsys ceph_subsys_rgw
 
@@ -65,6 +68,7 @@ void _usage()
   cerr << "  bucket stats               returns bucket statistics\n";
   cerr << "  bucket rm                  remove bucket\n";
   cerr << "  bucket check               check bucket index\n";
+  cerr << "  bucket reshard             reshard bucket index (requires --num-shards)\n";
   cerr << "  object rm                  remove object\n";
   cerr << "  object unlink              unlink object from bucket index\n";
   cerr << "  quota set                  set quota params\n";
@@ -94,6 +98,14 @@ void _usage()
   cerr << "  gc list                    dump expired garbage collection objects (specify\n";
   cerr << "                             --include-all to list all entries, including unexpired)\n";
   cerr << "  gc process                 manually process garbage\n";
+  cerr << "  gc stats                   show garbage collection backlog and drain rate\n";
+  cerr << "                             (of all shards, or of --shard-id)\n";
+  cerr << "  lc list                    list buckets that have lifecycle rules\n";
+  cerr << "  lc get                     get the lifecycle rules of a bucket\n";
+  cerr << "  lc set                     set the lifecycle rules of a bucket (requires infile)\n";
+  cerr << "  lc rm                      remove the lifecycle rules of a bucket\n";
+  cerr << "  lc process                 manually apply lifecycle rules (of all buckets, or\n";
+  cerr << "                             of --bucket)\n";
   cerr << "  metadata get               get metadata info\n";
   cerr << "  metadata put               put metadata info\n";
   cerr << "  metadata rm                remove metadata info\n";
@@ -144,6 +156,7 @@ void _usage()
   cerr << "   --fix                     besides checking bucket index, will also fix it\n";
   cerr << "   --check-objects           bucket check: rebuilds bucket index according to\n";
   cerr << "                             actual objects state\n";
+  cerr << "   --num-shards=<num>        bucket reshard: number of index shards\n";
   cerr << "   --format=<format>         specify output format for certain operations: xml,\n";
   cerr << "                             json\n";
   cerr << "   --purge-data              when specified, user removal will also purge all the\n";
@@ -210,6 +223,7 @@ enum {
   OPT_BUCKET_CHECK,
   OPT_BUCKET_RM,
   OPT_BUCKET_REWRITE,
+  OPT_BUCKET_RESHARD,
   OPT_POLICY,
   OPT_POOL_ADD,
   OPT_POOL_RM,
@@ -233,6 +247,12 @@ enum {
   OPT_QUOTA_DISABLE,
   OPT_GC_LIST,
   OPT_GC_PROCESS,
+  OPT_GC_STATS,
+  OPT_LC_LIST,
+  OPT_LC_GET,
+  OPT_LC_SET,
+  OPT_LC_RM,
+  OPT_LC_PROCESS,
   OPT_ORPHANS_FIND,
   OPT_ORPHANS_FINISH,
   OPT_REGION_GET,
@@ -278,6 +298,7 @@ static int get_cmd(const char *cmd, const char *prev_cmd, bool *need_more)
       strcmp(cmd, "datalog") == 0 ||
       strcmp(cmd, "gc") == 0 || 
       strcmp(cmd, "key") == 0 ||
+      strcmp(cmd, "lc") == 0 ||
       strcmp(cmd, "log") == 0 ||
       strcmp(cmd, "mdlog") == 0 ||
       strcmp(cmd, "metadata") == 0 ||
@@ -355,6 +376,8 @@ static int get_cmd(const char *cmd, const char *prev_cmd, bool *need_more)
       return OPT_BUCKET_REWRITE;
     if (strcmp(cmd, "check") == 0)
       return OPT_BUCKET_CHECK;
+    if (strcmp(cmd, "reshard") == 0)
+      return OPT_BUCKET_RESHARD;
   } else if (strcmp(prev_cmd, "log") == 0) {
     if (strcmp(cmd, "list") == 0)
       return OPT_LOG_LIST;
@@ -445,6 +468,19 @@ static int get_cmd(const char *cmd, const char *prev_cmd, bool *need_more)
       return OPT_GC_LIST;
     if (strcmp(cmd, "process") == 0)
       return OPT_GC_PROCESS;
+    if (strcmp(cmd, "stats") == 0)
+      return OPT_GC_STATS;
+  } else if (strcmp(prev_cmd, "lc") == 0) {
+    if (strcmp(cmd, "list") == 0)
+      return OPT_LC_LIST;
+    if (strcmp(cmd, "get") == 0)
+      return OPT_LC_GET;
+    if (strcmp(cmd, "set") == 0)
+      return OPT_LC_SET;
+    if (strcmp(cmd, "rm") == 0)
+      return OPT_LC_RM;
+    if (strcmp(cmd, "process") == 0)
+      return OPT_LC_PROCESS;
   } else if (strcmp(prev_cmd, "orphans") == 0) {
     if (strcmp(cmd, "find") == 0)
       return OPT_ORPHANS_FIND;
@@ -2384,11 +2420,12 @@ next:
     formatter->open_object_section("result");
     formatter->dump_string("bucket", bucket_name);
     formatter->open_array_section("objects");
+    RGWBucketListShards list_shards;
     while (is_truncated) {
       map<string, RGWObjEnt> result;
       int r = store->cls_bucket_list(bucket, marker, prefix, 1000, true,
                                      result, &is_truncated, &marker,
-                                     bucket_object_check_filter);
+                                     bucket_object_check_filter, &list_shards);
 
       if (r < 0 && r != -ENOENT) {
         cerr << "ERROR: failed operation r=" << r << std::endl;
@@ -2536,6 +2573,39 @@ next:
     RGWBucketAdminOp::remove_bucket(store, bucket_op);
   }
 
+  if (opt_cmd == OPT_BUCKET_RESHARD) {
+    if (bucket_name.empty()) {
+      cerr << "ERROR: bucket not specified" << std::endl;
+      return EINVAL;
+    }
+    if (num_shards <= 0) {
+      cerr << "ERROR: --num-shards not specified" << std::endl;
+      return EINVAL;
+    }
+
+    RGWBucketInfo bucket_info;
+    int ret = init_bucket(bucket_name, bucket_id, bucket_info, bucket);
+    if (ret < 0) {
+      cerr << "ERROR: could not init bucket: " << cpp_strerror(-ret) << std::endl;
+      return -ret;
+    }
+
+    RGWObjectCtx obj_ctx(store);
+    map<string, bufferlist> attrs;
+    ret = store->get_bucket_instance_info(obj_ctx, bucket, bucket_info, NULL, &attrs);
+    if (ret < 0) {
+      cerr << "ERROR: could not get bucket instance info: " << cpp_strerror(-ret) << std::endl;
+      return -ret;
+    }
+
+    RGWBucketReshard reshard(store, bucket_info, attrs);
+    ret = reshard.execute(num_shards);
+    if (ret < 0) {
+      cerr << "ERROR: bucket reshard returned: " << cpp_strerror(-ret) << std::endl;
+      return -ret;
+    }
+  }
+
   if (opt_cmd == OPT_GC_LIST) {
     int index = 0;
     bool truncated;
@@ -2580,6 +2650,163 @@ next:
     }
   }
 
+  if (opt_cmd == OPT_GC_STATS) {
+    int num_shards = store->get_gc_num_shards();
+    int first = 0;
+    int last = num_shards;
+    if (specified_shard_id) {
+      if (shard_id < 0 || shard_id >= num_shards) {
+        cerr << "ERROR: --shard-id should be between 0 and " << num_shards - 1 << std::endl;
+        return EINVAL;
+      }
+      first = shard_id;
+      last = shard_id + 1;
+    }
+
+    RGWGCShardBacklog total;
+    double total_secs = 0;
+
+    formatter->open_object_section("gc_stats");
+    formatter->open_array_section("shards");
+    for (int i = first; i < last; i++) {
+      RGWGCShardBacklog backlog;
+      int ret = store->get_gc_shard_backlog(i, backlog);
+      if (ret < 0) {
+        cerr << "ERROR: failed to read gc shard " << i << ": " << cpp_strerror(-ret) << std::endl;
+        return -ret;
+      }
+      double secs = (double)backlog.stats.duration;
+
+      formatter->open_object_section("shard");
+      formatter->dump_int("index", i);
+      formatter->dump_unsigned("chains", backlog.chains);
+      formatter->dump_unsigned("expired_chains", backlog.expired_chains);
+      formatter->dump_unsigned("objs", backlog.objs);
+      formatter->dump_stream("oldest") << backlog.oldest;
+      encode_json("last_pass", backlog.stats, formatter);
+      formatter->dump_float("removal_rate", (secs > 0 ? backlog.stats.chains_removed / secs : 0));
+      formatter->close_section();
+      formatter->flush(cout);
+
+      total.chains += backlog.chains;
+      total.expired_chains += backlog.expired_chains;
+      total.objs += backlog.objs;
+      if (!backlog.oldest.is_zero() && (total.oldest.is_zero() || backlog.oldest < total.oldest))
+        total.oldest = backlog.oldest;
+      total.stats.chains_removed += backlog.stats.chains_removed;
+      total.stats.objs_removed += backlog.stats.objs_removed;
+      total.stats.errors += backlog.stats.errors;
+      total_secs += secs;
+    }
+    formatter->close_section();
+
+    /* shards are processed rgw_gc_max_concurrent_shards at a time, so the
+     * per shard rate is scaled by it to estimate the drain time */
+    double rate = (total_secs > 0 ? total.stats.chains_removed / total_secs : 0);
+    int concurrency = MAX(MIN(g_ceph_context->_conf->rgw_gc_max_concurrent_shards, last - first), 1);
+    formatter->open_object_section("total");
+    formatter->dump_unsigned("chains", total.chains);
+    formatter->dump_unsigned("expired_chains", total.expired_chains);
+    formatter->dump_unsigned("objs", total.objs);
+    formatter->dump_stream("oldest") << total.oldest;
+    formatter->dump_unsigned("chains_removed", total.stats.chains_removed);
+    formatter->dump_unsigned("objs_removed", total.stats.objs_removed);
+    formatter->dump_unsigned("errors", total.stats.errors);
+    formatter->dump_float("removal_rate", rate * concurrency);
+    if (rate > 0)
+      formatter->dump_float("estimated_drain_secs", total.expired_chains / (rate * concurrency));
+    formatter->close_section();
+    formatter->close_section();
+    formatter->flush(cout);
+  }
+
+  if (opt_cmd == OPT_LC_LIST) {
+    RGWLC *lc = store->get_lc();
+    int index;
+    bool truncated;
+    lc->list_init(&index);
+    formatter->open_array_section("buckets");
+    do {
+      list<string> result;
+      int ret = lc->list_buckets(&index, marker, 1000, result, &truncated);
+      if (ret < 0) {
+        cerr << "ERROR: failed to list buckets: " << cpp_strerror(-ret) << std::endl;
+        return -ret;
+      }
+      for (list<string>::iterator iter = result.begin(); iter != result.end(); ++iter) {
+        formatter->dump_string("bucket", *iter);
+      }
+      formatter->flush(cout);
+    } while (truncated);
+    formatter->close_section();
+    formatter->flush(cout);
+  }
+
+  if (opt_cmd == OPT_LC_GET || opt_cmd == OPT_LC_SET || opt_cmd == OPT_LC_RM) {
+    if (bucket_name.empty()) {
+      cerr << "ERROR: bucket not specified" << std::endl;
+      return EINVAL;
+    }
+
+    RGWLC *lc = store->get_lc();
+    RGWBucketInfo bucket_info;
+    map<string, bufferlist> attrs;
+    RGWLifecycleConfiguration config;
+    int ret = lc->get_bucket_config(bucket_name, bucket_info, attrs, &config);
+    /* -ENOENT with the bucket info read means there are no rules yet */
+    bool no_config = (ret == -ENOENT && !bucket_info.bucket.name.empty());
+    if (ret < 0 && (!no_config || opt_cmd == OPT_LC_GET)) {
+      cerr << "ERROR: failed to read lifecycle rules of bucket " << bucket_name << ": " << cpp_strerror(-ret) << std::endl;
+      return -ret;
+    }
+
+    if (opt_cmd == OPT_LC_GET) {
+      encode_json("lifecycle", config, formatter);
+      formatter->flush(cout);
+    } else if (opt_cmd == OPT_LC_SET) {
+      RGWLifecycleConfiguration new_config;
+      ret = read_decode_json(infile, new_config);
+      if (ret < 0) {
+        return 1;
+      }
+      ret = lc->set_bucket_config(bucket_info, new_config);
+      if (ret < 0) {
+        cerr << "ERROR: failed to set lifecycle rules of bucket " << bucket_name << ": " << cpp_strerror(-ret) << std::endl;
+        return -ret;
+      }
+      encode_json("lifecycle", new_config, formatter);
+      formatter->flush(cout);
+    } else {
+      ret = lc->remove_bucket_config(bucket_info, attrs);
+      if (ret < 0) {
+        cerr << "ERROR: failed to remove lifecycle rules of bucket " << bucket_name << ": " << cpp_strerror(-ret) << std::endl;
+        return -ret;
+      }
+    }
+  }
+
+  if (opt_cmd == OPT_LC_PROCESS) {
+    RGWLC *lc = store->get_lc();
+    int ret;
+    if (!bucket_name.empty()) {
+      uint64_t num_expired;
+      ret = lc->process_bucket(bucket_name, &num_expired);
+      if (ret >= 0) {
+        formatter->open_object_section("lc_process");
+        formatter->dump_string("bucket", bucket_name);
+        formatter->dump_unsigned("expired", num_expired);
+        formatter->close_section();
+        formatter->flush(cout);
+      }
+    } else {
+      ret = lc->process();
+    }
+    if (ret < 0) {
+      cerr << "ERROR: lifecycle processing returned error: " << cpp_strerror(-ret) << std::endl;
+      return 1;
+    }
+  }
+
   if (opt_cmd == OPT_ORPHANS_FIND) {
     RGWOrphanSearch search(store, max_concurrent_ios, orphan_stale_secs);
 
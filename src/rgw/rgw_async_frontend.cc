@@ -0,0 +1,1147 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#include "common/errno.h"
+#include "common/Clock.h"
+#include "msg/async/net_handler.h"
+
+#include "rgw_common.h"
+#include "rgw_async_frontend.h"
+
+#define dout_subsys ceph_subsys_rgw
+
+#define TIME_BUF_SIZE 128
+
+#define ASYNC_READ_SIZE (64 * 1024)
+#define ASYNC_MAX_HEADER_SIZE (64 * 1024)
+#define ASYNC_MAX_CHUNK_LINE 1024
+#define ASYNC_MAX_IOV 64
+#define ASYNC_LISTEN_BACKLOG 1024
+#define ASYNC_EVENT_WAIT_US (30 * 1000 * 1000)
+#define ASYNC_SWEEP_INTERVAL_US (1000 * 1000)
+
+class C_ConnRead : public EventCallback {
+  RGWAsyncConnection *conn;
+public:
+  C_ConnRead(RGWAsyncConnection *_conn) : conn(_conn) {}
+  void do_request(int fd);
+};
+
+class C_ConnWrite : public EventCallback {
+  RGWAsyncConnection *conn;
+public:
+  C_ConnWrite(RGWAsyncConnection *_conn) : conn(_conn) {}
+  void do_request(int fd);
+};
+
+class C_ConnNotify : public EventCallback {
+  RGWAsyncConnection *conn;
+public:
+  C_ConnNotify(RGWAsyncConnection *_conn) : conn(_conn) {}
+  void do_request(int id);
+};
+
+class RGWAsyncReactor::C_AddConnection : public EventCallback {
+  RGWAsyncReactor *reactor;
+  int fd;
+public:
+  C_AddConnection(RGWAsyncReactor *_reactor, int _fd) : reactor(_reactor), fd(_fd) {}
+  void do_request(int id) {
+    reactor->add_connection(fd);
+  }
+};
+
+class RGWAsyncReactor::C_Sweep : public EventCallback {
+  RGWAsyncReactor *reactor;
+public:
+  C_Sweep(RGWAsyncReactor *_reactor) : reactor(_reactor) {}
+  void do_request(int id) {
+    reactor->sweep();
+    reactor->center.create_time_event(ASYNC_SWEEP_INTERVAL_US, reactor->sweep_handler);
+  }
+};
+
+class RGWAsyncServer::C_Accept : public EventCallback {
+  RGWAsyncServer *server;
+public:
+  C_Accept(RGWAsyncServer *_server) : server(_server) {}
+  void do_request(int fd) {
+    server->handle_accept();
+  }
+};
+
+static const char *bad_request = "400 Bad Request";
+static const char *header_too_large = "431 Request Header Fields Too Large";
+static const char *not_implemented = "501 Not Implemented";
+
+RGWAsyncConnection::RGWAsyncConnection(CephContext *_cct, RGWAsyncReactor *_reactor, int _fd)
+  : cct(_cct), reactor(_reactor), fd(_fd),
+    read_handler(new C_ConnRead(this)),
+    write_handler(new C_ConnWrite(this)),
+    notify_handler(new C_ConnNotify(this)),
+    state(STATE_READ_HEADER), read_paused(false), body_left(0),
+    chunk_state(CHUNK_SIZE), chunk_left(0),
+    lock("RGWAsyncConnection::lock"), body_complete(false), unsent(0),
+    notify_pending(false), request_done(false), force_close(false),
+    closed(false), http_minor(1), keepalive(true), chunked(false),
+    expect_continue(false), content_length(0)
+{
+  last_active = ceph_clock_now(cct);
+}
+
+RGWAsyncConnection::~RGWAsyncConnection()
+{
+  assert(fd < 0);
+}
+
+void C_ConnRead::do_request(int fd)
+{
+  conn->handle_read();
+}
+
+void C_ConnWrite::do_request(int fd)
+{
+  conn->handle_write();
+}
+
+void C_ConnNotify::do_request(int id)
+{
+  conn->handle_notify();
+}
+
+void RGWAsyncConnection::reset_request()
+{
+  state = STATE_READ_HEADER;
+  read_paused = false;
+  body_left = 0;
+  chunk_state = CHUNK_SIZE;
+  chunk_left = 0;
+
+  method.clear();
+  uri.clear();
+  query_string.clear();
+  http_minor = 1;
+  headers.clear();
+  keepalive = true;
+  chunked = false;
+  expect_continue = false;
+  content_length = 0;
+
+  Mutex::Locker l(lock);
+  body.clear();
+  body_complete = false;
+  request_done = false;
+  force_close = false;
+}
+
+static int parse_content_length(const string& val, uint64_t *len)
+{
+  if (val.empty())
+    return -EINVAL;
+  uint64_t l = 0;
+  for (string::const_iterator iter = val.begin(); iter != val.end(); ++iter) {
+    if (*iter < '0' || *iter > '9')
+      return -EINVAL;
+    uint64_t n = l * 10 + (*iter - '0');
+    if (n < l)
+      return -EINVAL;
+    l = n;
+  }
+  *len = l;
+  return 0;
+}
+
+int RGWAsyncConnection::parse_header(const string& header)
+{
+  size_t pos = header.find("\r\n");
+  string line = header.substr(0, pos);
+
+  size_t sp1 = line.find(' ');
+  size_t sp2 = line.rfind(' ');
+  if (sp1 == string::npos || sp1 == sp2 || sp1 == 0)
+    return -EINVAL;
+
+  method = line.substr(0, sp1);
+  string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+  string version = line.substr(sp2 + 1);
+  if (target.empty())
+    return -EINVAL;
+
+  if (version == "HTTP/1.1") {
+    http_minor = 1;
+  } else if (version == "HTTP/1.0") {
+    http_minor = 0;
+  } else {
+    return -EINVAL;
+  }
+  keepalive = (http_minor == 1);
+
+  size_t q = target.find('?');
+  uri = target.substr(0, q);
+  if (q != string::npos)
+    query_string = target.substr(q + 1);
+
+  bool has_content_length = false;
+
+  while (pos != string::npos) {
+    size_t start = pos + 2;
+    pos = header.find("\r\n", start);
+    string hline = header.substr(start, (pos == string::npos ? string::npos : pos - start));
+    if (hline.empty())
+      continue;
+
+    size_t colon = hline.find(':');
+    if (colon == string::npos || colon == 0)
+      return -EINVAL;
+
+    string name = hline.substr(0, colon);
+    string val = rgw_trim_whitespace(hline.substr(colon + 1));
+
+    if (strcasecmp(name.c_str(), "content-length") == 0) {
+      uint64_t len;
+      if (parse_content_length(val, &len) < 0)
+        return -EINVAL;
+      /* we can't tell which one the client means */
+      if (has_content_length && len != content_length)
+        return -EINVAL;
+      content_length = len;
+      has_content_length = true;
+    } else if (strcasecmp(name.c_str(), "transfer-encoding") == 0) {
+      if (strcasecmp(val.c_str(), "chunked") == 0) {
+        chunked = true;
+      } else if (strcasecmp(val.c_str(), "identity") != 0) {
+        return -ENOTSUP;
+      }
+    } else if (strcasecmp(name.c_str(), "connection") == 0) {
+      if (strcasecmp(val.c_str(), "close") == 0) {
+        keepalive = false;
+      } else if (strcasecmp(val.c_str(), "keep-alive") == 0) {
+        keepalive = true;
+      }
+    } else if (strcasecmp(name.c_str(), "expect") == 0) {
+      expect_continue = (strcasecmp(val.c_str(), "100-continue") == 0);
+    }
+
+    headers.push_back(make_pair(name, val));
+  }
+
+  /*
+   * a proxy in front of us may have framed the body by the other one, so
+   * the request could end where we don't expect it to
+   */
+  if (chunked && has_content_length)
+    return -EINVAL;
+
+  return 0;
+}
+
+bool RGWAsyncConnection::want_read()
+{
+  switch (state) {
+  case STATE_READ_HEADER:
+    return true;
+  case STATE_CLOSING:
+    return false;
+  default:
+    break;
+  }
+  Mutex::Locker l(lock);
+  return !body_complete && body.length() < reactor->server->conf.buffer_size;
+}
+
+void RGWAsyncConnection::process_input()
+{
+  if (state == STATE_READ_HEADER) {
+    size_t pos = in_buf.find("\r\n\r\n");
+    if (pos == string::npos) {
+      if (in_buf.size() > ASYNC_MAX_HEADER_SIZE)
+        send_error(header_too_large);
+      return;
+    }
+    if (pos > ASYNC_MAX_HEADER_SIZE) {
+      send_error(header_too_large);
+      return;
+    }
+
+    string header = in_buf.substr(0, pos);
+    in_buf.erase(0, pos + 4);
+
+    int r = parse_header(header);
+    if (r < 0) {
+      ldout(cct, 10) << "async frontend: failed to parse request header, fd=" << fd << dendl;
+      send_error(r == -ENOTSUP ? not_implemented : bad_request);
+      return;
+    }
+
+    ldout(cct, 20) << "async frontend: fd=" << fd << " " << method << " " << uri << dendl;
+
+    state = STATE_READ_BODY;
+    body_left = content_length;
+
+    Mutex::Locker l(lock);
+    body_complete = (!chunked && body_left == 0);
+  }
+
+  if (state != STATE_READ_BODY && state != STATE_DISPATCHED)
+    return;
+
+  consume_body();
+
+  if (state == STATE_READ_BODY) {
+    bool ready;
+    {
+      Mutex::Locker l(lock);
+      ready = body_complete || expect_continue ||
+              body.length() >= reactor->server->conf.buffer_size;
+    }
+    if (ready)
+      dispatch();
+  }
+}
+
+void RGWAsyncConnection::consume_body()
+{
+  if (chunked) {
+    if (!consume_chunked_body()) {
+      ldout(cct, 10) << "async frontend: bad chunked encoding, fd=" << fd << dendl;
+      if (state == STATE_DISPATCHED) {
+        /* the request thread will see the connection close */
+        reactor->close_connection(this);
+      } else {
+        send_error(bad_request);
+      }
+    }
+    return;
+  }
+
+  uint64_t n = MIN(body_left, (uint64_t)in_buf.size());
+  if (!n)
+    return;
+
+  Mutex::Locker l(lock);
+  body.append(in_buf.data(), n);
+  body_left -= n;
+  if (!body_left)
+    body_complete = true;
+  cond.Signal();
+  in_buf.erase(0, n);
+}
+
+/*
+ * Decode whatever is buffered of a chunked body. Returns false if the
+ * encoding is broken.
+ */
+bool RGWAsyncConnection::consume_chunked_body()
+{
+  while (true) {
+    {
+      Mutex::Locker l(lock);
+      if (body_complete)
+        return true;
+    }
+
+    switch (chunk_state) {
+    case CHUNK_SIZE:
+      {
+        size_t pos = in_buf.find("\r\n");
+        if (pos == string::npos)
+          return (in_buf.size() <= ASYNC_MAX_CHUNK_LINE);
+        string line = in_buf.substr(0, pos);
+        in_buf.erase(0, pos + 2);
+        size_t ext = line.find(';');
+        if (ext != string::npos)
+          line.resize(ext);
+        line = rgw_trim_whitespace(line);
+        if (line.empty() || line.size() > 16)
+          return false;
+        char *end;
+        unsigned long long size = strtoull(line.c_str(), &end, 16);
+        if (*end)
+          return false;
+        chunk_left = size;
+        chunk_state = (size ? CHUNK_DATA : CHUNK_TRAILER);
+      }
+      break;
+    case CHUNK_DATA:
+      {
+        uint64_t n = MIN(chunk_left, (uint64_t)in_buf.size());
+        if (!n)
+          return true;
+        Mutex::Locker l(lock);
+        body.append(in_buf.data(), n);
+        cond.Signal();
+        in_buf.erase(0, n);
+        chunk_left -= n;
+        if (!chunk_left)
+          chunk_state = CHUNK_DATA_END;
+      }
+      break;
+    case CHUNK_DATA_END:
+      if (in_buf.size() < 2)
+        return true;
+      if (in_buf.compare(0, 2, "\r\n") != 0)
+        return false;
+      in_buf.erase(0, 2);
+      chunk_state = CHUNK_SIZE;
+      break;
+    case CHUNK_TRAILER:
+      {
+        size_t pos = in_buf.find("\r\n");
+        if (pos == string::npos)
+          return (in_buf.size() <= ASYNC_MAX_HEADER_SIZE);
+        in_buf.erase(0, pos + 2);
+        if (pos == 0) {
+          Mutex::Locker l(lock);
+          body_complete = true;
+          cond.Signal();
+        }
+        /* trailer fields are ignored */
+      }
+      break;
+    }
+  }
+}
+
+void RGWAsyncConnection::dispatch()
+{
+  state = STATE_DISPATCHED;
+  reactor->server->dispatcher->dispatch(this);
+}
+
+void RGWAsyncConnection::send_error(const char *status)
+{
+  state = STATE_CLOSING;
+  in_buf.clear();
+
+  string msg = "HTTP/1.1 ";
+  msg.append(status);
+  msg.append("\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+  pending_out.append(msg);
+
+  flush_output();
+  if (fd >= 0 && !pending_out.length())
+    reactor->close_connection(this);
+}
+
+/*
+ * The socket is edge triggered: keep reading until it is drained, unless
+ * there is no room left for the body.
+ */
+void RGWAsyncConnection::handle_read()
+{
+  char buf[ASYNC_READ_SIZE];
+
+  while (fd >= 0) {
+    if (!want_read()) {
+      if (state == STATE_READ_BODY || state == STATE_DISPATCHED) {
+        Mutex::Locker l(lock);
+        read_paused = !body_complete;
+      }
+      return;
+    }
+
+    ssize_t r = ::recv(fd, buf, sizeof(buf), 0);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return;
+      ldout(cct, 10) << "async frontend: recv on fd=" << fd << " failed: " << cpp_strerror(errno) << dendl;
+      reactor->close_connection(this);
+      return;
+    }
+    if (r == 0) {
+      ldout(cct, 20) << "async frontend: fd=" << fd << " closed by peer" << dendl;
+      reactor->close_connection(this);
+      return;
+    }
+
+    last_active = ceph_clock_now(cct);
+    in_buf.append(buf, r);
+    process_input();
+  }
+}
+
+void RGWAsyncConnection::handle_write()
+{
+  flush_output();
+  if (fd < 0)
+    return;
+
+  if (state == STATE_CLOSING) {
+    if (!pending_out.length())
+      reactor->close_connection(this);
+    return;
+  }
+
+  bool done;
+  {
+    Mutex::Locker l(lock);
+    done = request_done && !notify_pending;
+  }
+  if (done)
+    finish_request();
+}
+
+void RGWAsyncConnection::handle_notify()
+{
+  bool done;
+  {
+    Mutex::Locker l(lock);
+    notify_pending = false;
+    done = request_done;
+  }
+
+  if (fd < 0) {
+    /* the connection was closed while the request was running */
+    reactor->close_connection(this);
+    return;
+  }
+
+  flush_output();
+  if (fd < 0)
+    return;
+
+  if (read_paused && state == STATE_DISPATCHED && want_read()) {
+    read_paused = false;
+    handle_read();
+    if (fd < 0)
+      return;
+  }
+
+  if (done)
+    finish_request();
+}
+
+void RGWAsyncConnection::flush_output()
+{
+  {
+    Mutex::Locker l(lock);
+    if (out.length())
+      pending_out.claim_append(out);
+  }
+
+  while (fd >= 0 && pending_out.length()) {
+    struct iovec iov[ASYNC_MAX_IOV];
+    int iovcnt = 0;
+    for (list<bufferptr>::const_iterator iter = pending_out.buffers().begin();
+         iter != pending_out.buffers().end() && iovcnt < ASYNC_MAX_IOV; ++iter) {
+      if (!iter->length())
+        continue;
+      iov[iovcnt].iov_base = (void *)iter->c_str();
+      iov[iovcnt].iov_len = iter->length();
+      iovcnt++;
+    }
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+
+    ssize_t r = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      ldout(cct, 10) << "async frontend: send on fd=" << fd << " failed: " << cpp_strerror(errno) << dendl;
+      reactor->close_connection(this);
+      return;
+    }
+    pending_out.splice(0, r);
+    last_active = ceph_clock_now(cct);
+  }
+
+  Mutex::Locker l(lock);
+  unsent = pending_out.length() + out.length();
+  if (unsent < reactor->server->conf.buffer_size)
+    cond.Signal();
+}
+
+/*
+ * Called once the request thread is done with the request: wait for the
+ * response to be sent out, then either close the connection or go on with
+ * the next request.
+ */
+void RGWAsyncConnection::finish_request()
+{
+  if (pending_out.length())
+    return;
+
+  bool keep;
+  {
+    Mutex::Locker l(lock);
+    if (out.length())
+      return;
+    keep = keepalive && body_complete && !force_close && !closed;
+  }
+  if (!keep) {
+    reactor->close_connection(this);
+    return;
+  }
+
+  reset_request();
+  last_active = ceph_clock_now(cct);
+
+  /* a pipelined request may already be buffered */
+  process_input();
+  if (fd >= 0)
+    handle_read();
+}
+
+/* called with lock held */
+void RGWAsyncConnection::notify()
+{
+  if (notify_pending)
+    return;
+  notify_pending = true;
+  reactor->center.dispatch_event_external(notify_handler);
+}
+
+int RGWAsyncConnection::read_body(char *buf, int max)
+{
+  Mutex::Locker l(lock);
+  while (!body.length() && !body_complete && !closed)
+    cond.Wait(lock);
+
+  if (!body.length())
+    return (body_complete ? 0 : -EIO);
+
+  bool was_full = (body.length() >= reactor->server->conf.buffer_size);
+
+  int n = MIN((unsigned)max, body.length());
+  body.copy(0, n, buf);
+  body.splice(0, n);
+
+  if (was_full)
+    notify();
+
+  return n;
+}
+
+int RGWAsyncConnection::write(const char *buf, int len)
+{
+  bufferlist bl;
+  bl.append(buf, len);
+  return write(bl);
+}
+
+int RGWAsyncConnection::write(bufferlist& bl)
+{
+  int len = bl.length();
+
+  Mutex::Locker l(lock);
+  if (closed)
+    return -EIO;
+
+  out.claim_append(bl);
+  unsent += len;
+  notify();
+
+  while (unsent >= reactor->server->conf.buffer_size && !closed)
+    cond.Wait(lock);
+
+  if (closed)
+    return -EIO;
+
+  return len;
+}
+
+void RGWAsyncConnection::complete(bool close)
+{
+  Mutex::Locker l(lock);
+  request_done = true;
+  force_close = close;
+  notify();
+}
+
+RGWAsyncReactor::RGWAsyncReactor(CephContext *_cct, RGWAsyncServer *_server)
+  : cct(_cct), server(_server), center(_cct), done(false),
+    sweep_handler(new C_Sweep(this))
+{
+}
+
+RGWAsyncReactor::~RGWAsyncReactor()
+{
+  while (!connections.empty()) {
+    RGWAsyncConnection *conn = *connections.begin();
+    close_connection(conn);
+    if (connections.count(conn)) {
+      /* nobody is left to complete the request */
+      connections.erase(conn);
+      dead.push_back(conn);
+    }
+  }
+  while (!dead.empty()) {
+    delete dead.front();
+    dead.pop_front();
+  }
+}
+
+int RGWAsyncReactor::init()
+{
+  return center.init(5000);
+}
+
+void RGWAsyncReactor::add_connection(int fd)
+{
+  RGWAsyncConnection *conn = new RGWAsyncConnection(cct, this, fd);
+  connections.insert(conn);
+
+  int r = center.create_file_event(fd, EVENT_READABLE, conn->read_handler);
+  if (r >= 0)
+    r = center.create_file_event(fd, EVENT_WRITABLE, conn->write_handler);
+  if (r < 0) {
+    lderr(cct) << "async frontend: failed to add fd=" << fd << " to the event loop: " << cpp_strerror(-r) << dendl;
+    close_connection(conn);
+    return;
+  }
+
+  ldout(cct, 20) << "async frontend: new connection fd=" << fd << dendl;
+
+  /* data may have arrived before the socket was registered */
+  conn->handle_read();
+}
+
+/*
+ * Close the socket of a connection. The connection itself goes away at the
+ * end of the event loop iteration, unless a request thread still refers to
+ * it, in which case it is released once the request completes.
+ */
+void RGWAsyncReactor::close_connection(RGWAsyncConnection *conn)
+{
+  if (conn->fd >= 0) {
+    ldout(cct, 20) << "async frontend: closing fd=" << conn->fd << dendl;
+    center.delete_file_event(conn->fd, EVENT_READABLE | EVENT_WRITABLE);
+    ::close(conn->fd);
+    conn->fd = -1;
+    server->num_connections.dec();
+  }
+
+  bool busy;
+  {
+    Mutex::Locker l(conn->lock);
+    conn->closed = true;
+    conn->cond.Signal();
+    busy = conn->notify_pending ||
+           (conn->state == RGWAsyncConnection::STATE_DISPATCHED && !conn->request_done);
+  }
+  if (busy)
+    return;
+
+  if (connections.erase(conn))
+    dead.push_back(conn);
+}
+
+void RGWAsyncReactor::sweep()
+{
+  utime_t now = ceph_clock_now(cct);
+  utime_t timeout(server->conf.idle_timeout, 0);
+
+  list<RGWAsyncConnection *> idle;
+  for (set<RGWAsyncConnection *>::iterator iter = connections.begin(); iter != connections.end(); ++iter) {
+    RGWAsyncConnection *conn = *iter;
+    if (conn->fd < 0 || conn->state == RGWAsyncConnection::STATE_DISPATCHED)
+      continue;
+    if (conn->last_active + timeout < now)
+      idle.push_back(conn);
+  }
+
+  for (list<RGWAsyncConnection *>::iterator iter = idle.begin(); iter != idle.end(); ++iter) {
+    ldout(cct, 20) << "async frontend: closing idle connection fd=" << (*iter)->fd << dendl;
+    close_connection(*iter);
+  }
+}
+
+void *RGWAsyncReactor::entry()
+{
+  center.set_owner(pthread_self());
+  center.create_time_event(ASYNC_SWEEP_INTERVAL_US, sweep_handler);
+
+  while (!done) {
+    int r = center.process_events(ASYNC_EVENT_WAIT_US);
+    if (r < 0) {
+      ldout(cct, 20) << "async frontend: process_events returned " << r << dendl;
+    }
+    while (!dead.empty()) {
+      delete dead.front();
+      dead.pop_front();
+    }
+  }
+
+  return NULL;
+}
+
+void RGWAsyncReactor::stop()
+{
+  done = true;
+  center.wakeup();
+  join();
+}
+
+RGWAsyncServer::RGWAsyncServer(CephContext *_cct, Dispatcher *_dispatcher, const Config& _conf)
+  : cct(_cct), dispatcher(_dispatcher), conf(_conf), listen_fd(-1),
+    next_reactor(0), accept_handler(new C_Accept(this))
+{
+  if (conf.num_reactors < 1)
+    conf.num_reactors = 1;
+}
+
+RGWAsyncServer::~RGWAsyncServer()
+{
+  if (listen_fd >= 0)
+    ::close(listen_fd);
+  for (vector<RGWAsyncReactor *>::iterator iter = reactors.begin(); iter != reactors.end(); ++iter)
+    delete *iter;
+}
+
+int RGWAsyncServer::init()
+{
+  struct addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+
+  char port_buf[16];
+  snprintf(port_buf, sizeof(port_buf), "%d", conf.port);
+
+  int r = getaddrinfo((conf.host.empty() ? NULL : conf.host.c_str()), port_buf, &hints, &res);
+  if (r != 0) {
+    lderr(cct) << "async frontend: failed to resolve " << conf.host << ": " << gai_strerror(r) << dendl;
+    return -EINVAL;
+  }
+
+  r = -EADDRNOTAVAIL;
+  for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+    int fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+      r = -errno;
+      continue;
+    }
+    int on = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (::bind(fd, ai->ai_addr, ai->ai_addrlen) < 0 ||
+        ::listen(fd, ASYNC_LISTEN_BACKLOG) < 0) {
+      r = -errno;
+      ::close(fd);
+      continue;
+    }
+    listen_fd = fd;
+    r = 0;
+    break;
+  }
+  freeaddrinfo(res);
+
+  if (r < 0) {
+    lderr(cct) << "async frontend: failed to listen on port " << conf.port << ": " << cpp_strerror(-r) << dendl;
+    return r;
+  }
+
+  if (!conf.port) {
+    /* find out which one we got */
+    struct sockaddr_storage ss;
+    socklen_t len = sizeof(ss);
+    if (::getsockname(listen_fd, (struct sockaddr *)&ss, &len) < 0)
+      return -errno;
+    if (ss.ss_family == AF_INET6)
+      conf.port = ntohs(((struct sockaddr_in6 *)&ss)->sin6_port);
+    else
+      conf.port = ntohs(((struct sockaddr_in *)&ss)->sin_port);
+  }
+
+  ceph::NetHandler net(cct);
+  r = net.set_nonblock(listen_fd);
+  if (r < 0)
+    return r;
+
+  for (int i = 0; i < conf.num_reactors; i++) {
+    RGWAsyncReactor *reactor = new RGWAsyncReactor(cct, this);
+    reactors.push_back(reactor);
+    r = reactor->init();
+    if (r < 0) {
+      lderr(cct) << "async frontend: failed to init event loop: " << cpp_strerror(-r) << dendl;
+      return r;
+    }
+  }
+
+  return reactors[0]->center.create_file_event(listen_fd, EVENT_READABLE, accept_handler);
+}
+
+void RGWAsyncServer::start()
+{
+  for (vector<RGWAsyncReactor *>::iterator iter = reactors.begin(); iter != reactors.end(); ++iter)
+    (*iter)->create();
+}
+
+void RGWAsyncServer::handle_accept()
+{
+  ceph::NetHandler net(cct);
+
+  while (listen_fd >= 0) {
+    int fd = ::accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        ldout(cct, 0) << "async frontend: accept failed: " << cpp_strerror(errno) << dendl;
+      return;
+    }
+
+    if (num_connections.read() >= (unsigned)conf.max_connections) {
+      ldout(cct, 1) << "async frontend: too many connections (" << conf.max_connections << "), dropping new connection" << dendl;
+      ::close(fd);
+      continue;
+    }
+
+    if (net.set_nonblock(fd) < 0) {
+      ::close(fd);
+      continue;
+    }
+    net.set_socket_options(fd);
+    num_connections.inc();
+
+    RGWAsyncReactor *reactor = reactors[next_reactor++ % reactors.size()];
+    if (reactor == reactors[0]) {
+      reactor->add_connection(fd);
+    } else {
+      reactor->center.dispatch_event_external(EventCallbackRef(new RGWAsyncReactor::C_AddConnection(reactor, fd)));
+    }
+  }
+}
+
+void RGWAsyncServer::stop_accepting()
+{
+  if (listen_fd < 0)
+    return;
+
+  reactors[0]->center.delete_file_event(listen_fd, EVENT_READABLE);
+  ::close(listen_fd);
+  listen_fd = -1;
+}
+
+void RGWAsyncServer::stop()
+{
+  stop_accepting();
+  for (vector<RGWAsyncReactor *>::iterator iter = reactors.begin(); iter != reactors.end(); ++iter)
+    (*iter)->stop();
+}
+
+RGWAsyncClientIO::RGWAsyncClientIO(RGWAsyncConnection *_conn, int _port)
+  : conn(_conn), port(_port), header_done(false), sent_header(false),
+    has_content_length(false), content_length(0), sent_data(0), failed(false)
+{
+}
+
+void RGWAsyncClientIO::init_env(CephContext *cct)
+{
+  env.init(cct);
+
+  for (vector<pair<string, string> >::iterator iter = conn->headers.begin();
+       iter != conn->headers.end(); ++iter) {
+    const string& name = iter->first;
+    const string& val = iter->second;
+
+    if (strcasecmp(name.c_str(), "content-length") == 0) {
+      /* the length of a chunked body isn't known until it has been read */
+      if (!conn->chunked)
+        env.set("CONTENT_LENGTH", val.c_str());
+      continue;
+    }
+
+    if (strcasecmp(name.c_str(), "content-type") == 0) {
+      env.set("CONTENT_TYPE", val.c_str());
+      continue;
+    }
+
+    string key = "HTTP_";
+    for (string::const_iterator c = name.begin(); c != name.end(); ++c) {
+      key.push_back(*c == '-' ? '_' : toupper(*c));
+    }
+    env.set(key.c_str(), val.c_str());
+  }
+
+  env.set("REQUEST_METHOD", conn->method.c_str());
+  env.set("REQUEST_URI", conn->uri.c_str());
+  env.set("QUERY_STRING", conn->query_string.c_str());
+  /* just the path, as with the other frontends: it prefixes the Location of POST uploads */
+  env.set("SCRIPT_URI", conn->uri.c_str());
+
+  char port_buf[16];
+  snprintf(port_buf, sizeof(port_buf), "%d", port);
+  env.set("SERVER_PORT", port_buf);
+}
+
+int RGWAsyncClientIO::write_data(const char *buf, int len)
+{
+  if (!header_done) {
+    header_data.append(buf, len);
+    return len;
+  }
+  if (!sent_header) {
+    data.append(buf, len);
+    return len;
+  }
+  int r = conn->write(buf, len);
+  if (r < 0) {
+    failed = true;
+    return r;
+  }
+  sent_data += len;
+  return r;
+}
+
+/* hand the buffers (e.g., the ones librados read into) to the reactor as is */
+int RGWAsyncClientIO::write_data_bl(bufferlist& bl, off_t ofs, off_t len)
+{
+  bufferlist sub;
+  sub.substr_of(bl, ofs, len);
+
+  if (!header_done) {
+    header_data.claim_append(sub);
+    return len;
+  }
+  if (!sent_header) {
+    data.claim_append(sub);
+    return len;
+  }
+  int r = conn->write(sub);
+  if (r < 0) {
+    failed = true;
+    return r;
+  }
+  sent_data += len;
+  return len;
+}
+
+int RGWAsyncClientIO::read_data(char *buf, int len)
+{
+  int total = 0;
+  while (total < len) {
+    int r = conn->read_body(buf + total, len - total);
+    if (r < 0) {
+      failed = true;
+      return r;
+    }
+    if (r == 0)
+      break;
+    total += r;
+  }
+  return total;
+}
+
+void RGWAsyncClientIO::flush()
+{
+}
+
+int RGWAsyncClientIO::send_status(const char *status, const char *status_name)
+{
+  char buf[128];
+
+  if (!status_name)
+    status_name = "";
+
+  snprintf(buf, sizeof(buf), "HTTP/1.1 %s %s\r\n", status, status_name);
+
+  bufferlist bl;
+  bl.append(buf);
+  bl.append(header_data);
+  header_data = bl;
+
+  return 0;
+}
+
+int RGWAsyncClientIO::send_100_continue()
+{
+  char buf[] = "HTTP/1.1 100 CONTINUE\r\n\r\n";
+
+  return conn->write(buf, sizeof(buf) - 1);
+}
+
+static void dump_date_header(bufferlist &out)
+{
+  char timestr[TIME_BUF_SIZE];
+  const time_t gtime = time(NULL);
+  struct tm result;
+  struct tm const * const tmp = gmtime_r(&gtime, &result);
+
+  if (tmp == NULL)
+    return;
+
+  if (strftime(timestr, sizeof(timestr), "Date: %a, %d %b %Y %H:%M:%S %Z\r\n", tmp))
+    out.append(timestr);
+}
+
+int RGWAsyncClientIO::complete_header()
+{
+  header_done = true;
+
+  if (!has_content_length) {
+    return 0;
+  }
+
+  dump_date_header(header_data);
+
+  if (!conn->keepalive)
+    header_data.append("Connection: close\r\n");
+  else if (conn->http_minor == 0)
+    header_data.append("Connection: Keep-Alive\r\n");
+
+  header_data.append("\r\n");
+
+  sent_header = true;
+
+  int r = conn->write(header_data.c_str(), header_data.length());
+  if (r < 0)
+    failed = true;
+  return r;
+}
+
+int RGWAsyncClientIO::send_content_length(uint64_t len)
+{
+  has_content_length = true;
+  content_length = len;
+  char buf[21];
+  snprintf(buf, sizeof(buf), "%" PRIu64, len);
+  return print("Content-Length: %s\r\n", buf);
+}
+
+int RGWAsyncClientIO::complete_request()
+{
+  int r = 0;
+
+  if (!sent_header) {
+    if (!has_content_length) {
+      header_done = false; /* let's go back to writing the header */
+      r = send_content_length(data.length());
+    }
+    if (r >= 0)
+      r = complete_header();
+  }
+
+  if (r >= 0 && data.length()) {
+    r = write_data(data.c_str(), data.length());
+    data.clear();
+  }
+
+  /*
+   * The connection can only be reused if the client got exactly the body it
+   * was promised.
+   */
+  bool close = failed || r < 0 ||
+               (conn->method != "HEAD" && sent_data != content_length);
+  conn->complete(close);
+
+  return (r < 0 ? r : 0);
+}
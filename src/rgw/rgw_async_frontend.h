@@ -0,0 +1,245 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_RGW_ASYNC_FRONTEND_H
+#define CEPH_RGW_ASYNC_FRONTEND_H
+
+#include <list>
+#include <set>
+#include <vector>
+
+#include "include/atomic.h"
+#include "include/buffer.h"
+#include "common/Mutex.h"
+#include "common/Cond.h"
+#include "common/Thread.h"
+#include "msg/async/Event.h"
+
+#include "rgw_client_io.h"
+
+class RGWAsyncReactor;
+class RGWAsyncServer;
+
+/*
+ * An HTTP connection of the event driven frontend.
+ *
+ * The socket is only ever touched by the reactor thread that owns the
+ * connection: it reads and parses the request headers, buffers the request
+ * body and sends out the response. Once a request is ready it is handed to a
+ * request thread, which reads the body and writes the response through
+ * buffers shared with the reactor. A request thread only waits on the
+ * connection when the body it wants to read hasn't arrived yet, or when the
+ * client doesn't keep up with the response.
+ */
+class RGWAsyncConnection {
+  friend class RGWAsyncReactor;
+  friend class C_ConnRead;
+  friend class C_ConnWrite;
+  friend class C_ConnNotify;
+
+  enum State {
+    STATE_READ_HEADER,
+    STATE_READ_BODY,   /* buffering the body before dispatching the request */
+    STATE_DISPATCHED,  /* a request thread owns the request */
+    STATE_CLOSING,     /* sending out an error, then closing */
+  };
+
+  enum ChunkState {
+    CHUNK_SIZE,
+    CHUNK_DATA,
+    CHUNK_DATA_END,
+    CHUNK_TRAILER,
+  };
+
+  CephContext *cct;
+  RGWAsyncReactor *reactor;
+  int fd;
+
+  EventCallbackRef read_handler;
+  EventCallbackRef write_handler;
+  EventCallbackRef notify_handler;
+
+  /* only accessed by the reactor */
+  State state;
+  string in_buf;
+  bufferlist pending_out;
+  bool read_paused;   /* stopped reading because the body buffer is full */
+  utime_t last_active;
+  uint64_t body_left;
+  ChunkState chunk_state;
+  uint64_t chunk_left;
+
+  /* shared with the request thread */
+  Mutex lock;
+  Cond cond;
+  bufferlist body;
+  bool body_complete;
+  bufferlist out;
+  uint64_t unsent;
+  bool notify_pending;
+  bool request_done;
+  bool force_close;
+  bool closed;
+
+  void reset_request();
+  int parse_header(const string& header);
+  void process_input();
+  void consume_body();
+  bool consume_chunked_body();
+  bool want_read();
+  void dispatch();
+  void send_error(const char *status);
+
+  void handle_read();
+  void handle_write();
+  void handle_notify();
+  void flush_output();
+  void finish_request();
+  void notify();
+
+public:
+  /* the parsed request, read-only once the request is dispatched */
+  string method;
+  string uri;
+  string query_string;
+  int http_minor;
+  vector<pair<string, string> > headers;
+  bool keepalive;
+  bool chunked;
+  bool expect_continue;
+  uint64_t content_length;
+
+  RGWAsyncConnection(CephContext *_cct, RGWAsyncReactor *_reactor, int _fd);
+  ~RGWAsyncConnection();
+
+  /*
+   * Called by the request thread. read_body() returns the number of bytes
+   * read, 0 at the end of the body, or a negative error code if the
+   * connection was closed.
+   */
+  int read_body(char *buf, int max);
+  int write(const char *buf, int len);
+  /* takes the buffers of bl */
+  int write(bufferlist& bl);
+  void complete(bool close);
+};
+
+/*
+ * A thread running an event loop that owns a set of connections.
+ */
+class RGWAsyncReactor : public Thread {
+  friend class RGWAsyncConnection;
+  friend class RGWAsyncServer;
+
+  CephContext *cct;
+  RGWAsyncServer *server;
+  EventCenter center;
+  bool done;
+  set<RGWAsyncConnection *> connections;
+  list<RGWAsyncConnection *> dead;
+  EventCallbackRef sweep_handler;
+
+  void add_connection(int fd);
+  void close_connection(RGWAsyncConnection *conn);
+  void sweep();
+
+public:
+  RGWAsyncReactor(CephContext *_cct, RGWAsyncServer *_server);
+  ~RGWAsyncReactor();
+
+  int init();
+  void *entry();
+  void stop();
+
+  class C_AddConnection;
+  class C_Sweep;
+};
+
+/*
+ * Event driven HTTP server. Connections are spread over a few reactor
+ * threads, requests are handed to the dispatcher once their headers (and a
+ * bounded amount of their body) have been read.
+ */
+class RGWAsyncServer {
+public:
+  class Dispatcher {
+  public:
+    virtual ~Dispatcher() {}
+    /* called from a reactor thread, must not block */
+    virtual void dispatch(RGWAsyncConnection *conn) = 0;
+  };
+
+  struct Config {
+    string host;
+    int port;              /* 0 for any free one */
+    int num_reactors;
+    int max_connections;
+    uint64_t buffer_size;  /* per connection, for both the body and the response */
+    int idle_timeout;      /* seconds */
+
+    Config() : port(80), num_reactors(1), max_connections(10000),
+               buffer_size(1 << 20), idle_timeout(60) {}
+  };
+
+private:
+  friend class RGWAsyncConnection;
+  friend class RGWAsyncReactor;
+
+  CephContext *cct;
+  Dispatcher *dispatcher;
+  Config conf;
+  int listen_fd;
+  vector<RGWAsyncReactor *> reactors;
+  unsigned next_reactor;
+  atomic_t num_connections;
+  EventCallbackRef accept_handler;
+
+  void handle_accept();
+
+public:
+  RGWAsyncServer(CephContext *_cct, Dispatcher *_dispatcher, const Config& _conf);
+  ~RGWAsyncServer();
+
+  int init();
+  int get_port() const { return conf.port; }
+  void start();
+  /* stop accepting new connections */
+  void stop_accepting();
+  void stop();
+
+  class C_Accept;
+};
+
+class RGWAsyncClientIO : public RGWClientIO
+{
+  RGWAsyncConnection *conn;
+  int port;
+
+  bufferlist header_data;
+  bufferlist data;
+
+  bool header_done;
+  bool sent_header;
+  bool has_content_length;
+  uint64_t content_length;
+  uint64_t sent_data;
+  bool failed;
+
+public:
+  void init_env(CephContext *cct);
+
+  int write_data(const char *buf, int len);
+  int write_data_bl(bufferlist& bl, off_t ofs, off_t len);
+  int read_data(char *buf, int len);
+
+  int send_status(const char *status, const char *status_name);
+  int send_100_continue();
+  int complete_header();
+  int complete_request();
+  int send_content_length(uint64_t len);
+
+  RGWAsyncClientIO(RGWAsyncConnection *_conn, int _port);
+  void flush();
+};
+
+#endif
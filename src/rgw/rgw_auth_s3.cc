@@ -1,8 +1,13 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab
 
+#include <algorithm>
+
 #include "common/armor.h"
+#include "common/strtol.h"
+#include "include/str_list.h"
 #include "rgw_common.h"
+#include "rgw_auth_s3.h"
 
 #define dout_subsys ceph_subsys_rgw
 
@@ -211,3 +216,465 @@ bool rgw_create_s3_canonical_header(req_info& info, utime_t *header_time, string
 
   return true;
 }
+
+/*
+ * AWS signature version 4
+ */
+
+static string aws4_sha256_hex(const char *data, size_t len)
+{
+  ceph::crypto::SHA256 hash;
+  unsigned char digest[CEPH_CRYPTO_SHA256_DIGESTSIZE];
+  hash.Update((const unsigned char *)data, len);
+  hash.Final(digest);
+
+  char hex[CEPH_CRYPTO_SHA256_DIGESTSIZE * 2 + 1];
+  buf_to_hex(digest, CEPH_CRYPTO_SHA256_DIGESTSIZE, hex);
+  return string(hex);
+}
+
+static string aws4_hmac(const string& key, const string& msg)
+{
+  char digest[CEPH_CRYPTO_HMACSHA256_DIGESTSIZE];
+  calc_hmac_sha256(key.c_str(), key.size(), msg.c_str(), msg.size(), digest);
+  return string(digest, sizeof(digest));
+}
+
+static string aws4_hmac_hex(const string& key, const string& msg)
+{
+  string digest = aws4_hmac(key, msg);
+
+  char hex[CEPH_CRYPTO_HMACSHA256_DIGESTSIZE * 2 + 1];
+  buf_to_hex((const unsigned char *)digest.c_str(), digest.size(), hex);
+  return string(hex);
+}
+
+/* uri-encode as required by aws: everything but the unreserved characters */
+static void aws4_uri_encode(const string& src, bool encode_slash, string& dest)
+{
+  const char *hex = "0123456789ABCDEF";
+  for (string::const_iterator iter = src.begin(); iter != src.end(); ++iter) {
+    unsigned char c = *iter;
+    if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' ||
+        (c == '/' && !encode_slash)) {
+      dest.append(1, c);
+    } else {
+      dest.append(1, '%');
+      dest.append(1, hex[c >> 4]);
+      dest.append(1, hex[c & 0xf]);
+    }
+  }
+}
+
+static void aws4_trim(const string& src, string& dest)
+{
+  dest.clear();
+  bool space = false;
+  for (string::const_iterator iter = src.begin(); iter != src.end(); ++iter) {
+    if (isspace(*iter)) {
+      space = !dest.empty();
+      continue;
+    }
+    if (space) {
+      dest.append(1, ' ');
+      space = false;
+    }
+    dest.append(1, *iter);
+  }
+}
+
+bool rgw_is_aws4_request(req_info& info, const char *http_auth)
+{
+  if (http_auth && *http_auth) {
+    return strncmp(http_auth, AWS4_HMAC_SHA256_STR " ", sizeof(AWS4_HMAC_SHA256_STR)) == 0;
+  }
+  return info.args.exists("X-Amz-Algorithm");
+}
+
+static int parse_aws4_credential(const string& credential, rgw_aws4_auth *auth)
+{
+  /* <access key id>/<date>/<region>/<service>/aws4_request */
+  size_t pos = credential.find('/');
+  if (pos == string::npos) {
+    return -EINVAL;
+  }
+  auth->access_key_id = credential.substr(0, pos);
+  auth->credential_scope = credential.substr(pos + 1);
+
+  list<string> scope;
+  get_str_list(auth->credential_scope, "/", scope);
+  if (scope.size() != 4 || scope.back() != "aws4_request") {
+    dout(10) << "NOTICE: bad aws4 credential scope: " << auth->credential_scope << dendl;
+    return -EINVAL;
+  }
+  return 0;
+}
+
+int rgw_parse_aws4_auth(req_info& info, const char *http_auth, rgw_aws4_auth *auth,
+                        utime_t *header_time, utime_t *expires)
+{
+  string credential;
+  bool qsr = !(http_auth && *http_auth);
+
+  if (qsr) {
+    /* presigned url */
+    if (info.args.get("X-Amz-Algorithm") != AWS4_HMAC_SHA256_STR) {
+      return -EINVAL;
+    }
+    credential = info.args.get("X-Amz-Credential");
+    auth->signed_headers = info.args.get("X-Amz-SignedHeaders");
+    auth->signature = info.args.get("X-Amz-Signature");
+    auth->date = info.args.get("X-Amz-Date");
+  } else {
+    /* AWS4-HMAC-SHA256 Credential=...,SignedHeaders=...,Signature=... */
+    string auth_str(http_auth + sizeof(AWS4_HMAC_SHA256_STR));
+    list<string> fields;
+    get_str_list(auth_str, ", ", fields);
+    for (list<string>::iterator iter = fields.begin(); iter != fields.end(); ++iter) {
+      size_t pos = iter->find('=');
+      if (pos == string::npos) {
+        return -EINVAL;
+      }
+      string key = iter->substr(0, pos);
+      string val = iter->substr(pos + 1);
+      if (key == "Credential") {
+        credential = val;
+      } else if (key == "SignedHeaders") {
+        auth->signed_headers = val;
+      } else if (key == "Signature") {
+        auth->signature = val;
+      }
+    }
+    const char *date = info.env->get("HTTP_X_AMZ_DATE");
+    if (date) {
+      auth->date = date;
+    }
+  }
+
+  if (credential.empty() || auth->signed_headers.empty() || auth->signature.empty()) {
+    dout(10) << "NOTICE: incomplete aws4 auth" << dendl;
+    return -EINVAL;
+  }
+
+  int ret = parse_aws4_credential(credential, auth);
+  if (ret < 0) {
+    return ret;
+  }
+
+  struct tm t;
+  memset(&t, 0, sizeof(t));
+  const char *p = strptime(auth->date.c_str(), "%Y%m%dT%H%M%SZ", &t);
+  if (!p || *p) {
+    dout(0) << "NOTICE: failed to parse aws4 date: " << auth->date << dendl;
+    return -EINVAL;
+  }
+  if (auth->credential_scope.compare(0, 8, auth->date, 0, 8) != 0) {
+    dout(10) << "NOTICE: aws4 credential scope doesn't match the request date" << dendl;
+    return -EINVAL;
+  }
+  *header_time = utime_t(timegm(&t), 0);
+
+  const char *payload_hash = info.env->get("HTTP_X_AMZ_CONTENT_SHA256");
+  if (payload_hash) {
+    auth->payload_hash = payload_hash;
+  } else if (qsr) {
+    auth->payload_hash = AWS4_UNSIGNED_PAYLOAD_HASH;
+  } else {
+    dout(10) << "NOTICE: missing x-amz-content-sha256" << dendl;
+    return -EINVAL;
+  }
+
+  *expires = utime_t();
+  if (qsr) {
+    string err;
+    int64_t secs = strict_strtoll(info.args.get("X-Amz-Expires").c_str(), 10, &err);
+    if (!err.empty() || secs < 0 || secs > 7 * 24 * 3600) {
+      return -EINVAL;
+    }
+    *expires = *header_time;
+    *expires += utime_t(secs, 0);
+  }
+
+  return 0;
+}
+
+void rgw_get_aws4_signing_key(const string& secret, const string& credential_scope, string& dest)
+{
+  list<string> scope;
+  get_str_list(credential_scope, "/", scope);
+
+  /* date, region, service and the aws4_request terminator */
+  dest = "AWS4" + secret;
+  for (list<string>::iterator iter = scope.begin(); iter != scope.end(); ++iter) {
+    dest = aws4_hmac(dest, *iter);
+  }
+}
+
+static void get_aws4_canonical_qs(req_info& info, bool qsr, string& dest)
+{
+  vector<pair<string, string> > params;
+
+  list<string> args;
+  get_str_list(info.request_params, "&", args);
+  for (list<string>::iterator iter = args.begin(); iter != args.end(); ++iter) {
+    string name = *iter;
+    string val;
+    size_t pos = iter->find('=');
+    if (pos != string::npos) {
+      name = iter->substr(0, pos);
+      val = iter->substr(pos + 1);
+    }
+    string dname, dval;
+    url_decode(name, dname, true);
+    url_decode(val, dval, true);
+    if (qsr && dname == "X-Amz-Signature")
+      continue;
+
+    string ename, eval;
+    aws4_uri_encode(dname, true, ename);
+    aws4_uri_encode(dval, true, eval);
+    params.push_back(make_pair(ename, eval));
+  }
+  sort(params.begin(), params.end());
+
+  dest.clear();
+  for (vector<pair<string, string> >::iterator iter = params.begin(); iter != params.end(); ++iter) {
+    if (!dest.empty())
+      dest.append("&");
+    dest.append(iter->first);
+    dest.append("=");
+    dest.append(iter->second);
+  }
+}
+
+static const char *get_aws4_header(req_info& info, const string& name)
+{
+  if (name == "content-type")
+    return info.env->get("CONTENT_TYPE");
+  if (name == "content-length") {
+    const char *len = info.env->get("CONTENT_LENGTH");
+    return (len ? len : info.env->get("HTTP_CONTENT_LENGTH"));
+  }
+
+  string env_name = "HTTP_";
+  for (string::const_iterator iter = name.begin(); iter != name.end(); ++iter) {
+    env_name.append(1, (*iter == '-' ? '_' : toupper(*iter)));
+  }
+  return info.env->get(env_name.c_str());
+}
+
+void rgw_get_aws4_canonical_request(req_info& info, rgw_aws4_auth *auth, bool qsr, string& dest)
+{
+  /*
+   * info.request_uri is rewritten for virtual-hosted-style requests, the
+   * client signed the path it sent
+   */
+  string raw_uri;
+  const char *req_uri = info.env->get("REQUEST_URI");
+  if (req_uri) {
+    raw_uri = req_uri;
+    size_t pos = raw_uri.find('?');
+    if (pos != string::npos)
+      raw_uri.resize(pos);
+  } else {
+    raw_uri = info.request_uri;
+  }
+
+  string canonical_uri;
+  string uri;
+  url_decode(raw_uri, uri);
+  aws4_uri_encode(uri, false, canonical_uri);
+  if (canonical_uri.empty())
+    canonical_uri = "/";
+
+  string canonical_qs;
+  get_aws4_canonical_qs(info, qsr, canonical_qs);
+
+  string canonical_hdrs;
+  list<string> hdrs;
+  get_str_list(auth->signed_headers, ";", hdrs);
+  for (list<string>::iterator iter = hdrs.begin(); iter != hdrs.end(); ++iter) {
+    const char *val = get_aws4_header(info, *iter);
+    string trimmed;
+    if (val) {
+      aws4_trim(val, trimmed);
+    } else {
+      dout(10) << "NOTICE: signed header " << *iter << " is missing" << dendl;
+    }
+    canonical_hdrs.append(*iter + ":" + trimmed + "\n");
+  }
+
+  dest = string(info.method) + "\n" + canonical_uri + "\n" +
+         canonical_qs + "\n" + canonical_hdrs + "\n" +
+         auth->signed_headers + "\n" + auth->payload_hash;
+}
+
+void rgw_get_aws4_string_to_sign(rgw_aws4_auth *auth, const string& canonical_req, string& dest)
+{
+  dest = AWS4_HMAC_SHA256_STR "\n" + auth->date + "\n" +
+         auth->credential_scope + "\n" +
+         aws4_sha256_hex(canonical_req.c_str(), canonical_req.size());
+}
+
+void rgw_get_aws4_signature(req_info& info, rgw_aws4_auth *auth, bool qsr, string& dest)
+{
+  string canonical_req;
+  rgw_get_aws4_canonical_request(info, auth, qsr, canonical_req);
+  dout(10) << "canonical request:\n" << canonical_req << dendl;
+
+  string string_to_sign;
+  rgw_get_aws4_string_to_sign(auth, canonical_req, string_to_sign);
+  dout(10) << "string to sign:\n" << string_to_sign << dendl;
+
+  dest = aws4_hmac_hex(auth->signing_key, string_to_sign);
+}
+
+RGWAWS4PayloadVerifier::RGWAWS4PayloadVerifier(rgw_aws4_auth *_auth)
+  : auth(_auth), streaming(_auth->is_streaming()), state(STATE_CHUNK_HEADER),
+    chunk_left(0), last_chunk(false), crlf_pos(0), prev_signature(_auth->signature)
+{
+}
+
+int RGWAWS4PayloadVerifier::parse_chunk_header()
+{
+  /* hex(size);chunk-signature=<signature> */
+  static const string sig_prefix = ";chunk-signature=";
+
+  size_t pos = chunk_header.find(sig_prefix);
+  if (pos == string::npos || pos == 0) {
+    dout(10) << "NOTICE: bad aws-chunked chunk header: " << chunk_header << dendl;
+    return -EINVAL;
+  }
+  string size_str = chunk_header.substr(0, pos);
+  bool valid = (size_str.size() <= 16);
+  for (string::iterator iter = size_str.begin(); valid && iter != size_str.end(); ++iter) {
+    valid = isxdigit(*iter);
+  }
+  char *end = NULL;
+  if (valid)
+    chunk_left = strtoull(size_str.c_str(), &end, 16);
+  if (!valid || *end) {
+    dout(10) << "NOTICE: bad aws-chunked chunk size: " << size_str << dendl;
+    return -EINVAL;
+  }
+  chunk_signature = chunk_header.substr(pos + sig_prefix.size());
+  last_chunk = (chunk_left == 0);
+  hash.Restart();
+  return 0;
+}
+
+int RGWAWS4PayloadVerifier::verify_chunk()
+{
+  static const string empty_hash = aws4_sha256_hex("", 0);
+
+  unsigned char digest[CEPH_CRYPTO_SHA256_DIGESTSIZE];
+  hash.Final(digest);
+  char hex[CEPH_CRYPTO_SHA256_DIGESTSIZE * 2 + 1];
+  buf_to_hex(digest, CEPH_CRYPTO_SHA256_DIGESTSIZE, hex);
+
+  string string_to_sign = AWS4_HMAC_SHA256_STR "-PAYLOAD\n" + auth->date + "\n" +
+                          auth->credential_scope + "\n" + prev_signature + "\n" +
+                          empty_hash + "\n" + hex;
+  string signature = aws4_hmac_hex(auth->signing_key, string_to_sign);
+  if (signature != chunk_signature) {
+    dout(5) << "NOTICE: aws-chunked chunk signature mismatch: calculated=" << signature
+            << " chunk_signature=" << chunk_signature << dendl;
+    return -ERR_SIGNATURE_NO_MATCH;
+  }
+  prev_signature = signature;
+  return 0;
+}
+
+int RGWAWS4PayloadVerifier::append(const char *buf, size_t len, bufferlist& out)
+{
+  if (!streaming) {
+    hash.Update((const unsigned char *)buf, len);
+    out.append(buf, len);
+    return 0;
+  }
+
+  while (len > 0) {
+    switch (state) {
+    case STATE_CHUNK_HEADER:
+      {
+        const char *eol = (const char *)memchr(buf, '\n', len);
+        size_t n = (eol ? eol - buf + 1 : len);
+        chunk_header.append(buf, n);
+        buf += n;
+        len -= n;
+        if (chunk_header.size() > 4096) {
+          return -EINVAL;
+        }
+        if (!eol)
+          break;
+        if (chunk_header.size() < 2 || chunk_header[chunk_header.size() - 2] != '\r') {
+          return -EINVAL;
+        }
+        chunk_header.resize(chunk_header.size() - 2);
+        int ret = parse_chunk_header();
+        chunk_header.clear();
+        if (ret < 0) {
+          return ret;
+        }
+        state = STATE_CHUNK_DATA;
+      }
+      /* fall through, a chunk may be empty */
+    case STATE_CHUNK_DATA:
+      {
+        size_t n = min((uint64_t)len, chunk_left);
+        if (n > 0) {
+          hash.Update((const unsigned char *)buf, n);
+          out.append(buf, n);
+          buf += n;
+          len -= n;
+          chunk_left -= n;
+        }
+        if (chunk_left > 0)
+          break;
+        int ret = verify_chunk();
+        if (ret < 0) {
+          return ret;
+        }
+        crlf_pos = 0;
+        state = STATE_CHUNK_END;
+      }
+      break;
+    case STATE_CHUNK_END:
+      if (*buf != "\r\n"[crlf_pos]) {
+        return -EINVAL;
+      }
+      ++buf;
+      --len;
+      if (++crlf_pos == 2) {
+        state = (last_chunk ? STATE_DONE : STATE_CHUNK_HEADER);
+      }
+      break;
+    case STATE_DONE:
+      dout(10) << "NOTICE: data past the last aws-chunked chunk" << dendl;
+      return -EINVAL;
+    }
+  }
+  return 0;
+}
+
+int RGWAWS4PayloadVerifier::complete()
+{
+  if (streaming) {
+    if (state != STATE_DONE) {
+      dout(10) << "NOTICE: aws-chunked body ended before its last chunk" << dendl;
+      return -ERR_REQUEST_TIMEOUT;
+    }
+    return 0;
+  }
+
+  unsigned char digest[CEPH_CRYPTO_SHA256_DIGESTSIZE];
+  hash.Final(digest);
+  char hex[CEPH_CRYPTO_SHA256_DIGESTSIZE * 2 + 1];
+  buf_to_hex(digest, CEPH_CRYPTO_SHA256_DIGESTSIZE, hex);
+  if (strcasecmp(hex, auth->payload_hash.c_str()) != 0) {
+    dout(5) << "NOTICE: x-amz-content-sha256 mismatch: calculated=" << hex
+            << " supplied=" << auth->payload_hash << dendl;
+    return -ERR_AMZ_CONTENT_SHA256_MISMATCH;
+  }
+  return 0;
+}
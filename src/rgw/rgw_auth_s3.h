@@ -5,6 +5,7 @@
 #define CEPH_RGW_AUTH_S3_H
 
 
+#include "common/ceph_crypto.h"
 #include "rgw_common.h"
 
 void rgw_create_s3_canonical_header(const char *method, const char *content_md5, const char *content_type, const char *date,
@@ -13,6 +14,80 @@ void rgw_create_s3_canonical_header(const char *method, const char *content_md5,
 bool rgw_create_s3_canonical_header(req_info& info, utime_t *header_time, string& dest, bool qsr);
 int rgw_get_s3_header_digest(const string& auth_hdr, const string& key, string& dest);
 
+#define AWS4_HMAC_SHA256_STR "AWS4-HMAC-SHA256"
+#define AWS4_UNSIGNED_PAYLOAD_HASH "UNSIGNED-PAYLOAD"
+#define AWS4_STREAMING_PAYLOAD_HASH "STREAMING-AWS4-HMAC-SHA256-PAYLOAD"
+
+/* the parameters of a request signed with AWS signature version 4 */
+struct rgw_aws4_auth {
+  string access_key_id;
+  string date;             /* x-amz-date, e.g. 20150830T123600Z */
+  string credential_scope; /* e.g. 20150830/us-east-1/s3/aws4_request */
+  string signed_headers;
+  string signature;
+  string payload_hash;     /* x-amz-content-sha256 */
+  string signing_key;      /* set once the request is authenticated */
+
+  bool is_unsigned_payload() const {
+    return payload_hash == AWS4_UNSIGNED_PAYLOAD_HASH;
+  }
+  bool is_streaming() const {
+    return payload_hash == AWS4_STREAMING_PAYLOAD_HASH;
+  }
+};
+
+bool rgw_is_aws4_request(req_info& info, const char *http_auth);
+/* parses the Authorization header, or the query string of a presigned url */
+int rgw_parse_aws4_auth(req_info& info, const char *http_auth, rgw_aws4_auth *auth,
+                        utime_t *header_time, utime_t *expires);
+void rgw_get_aws4_signing_key(const string& secret, const string& credential_scope, string& dest);
+void rgw_get_aws4_canonical_request(req_info& info, rgw_aws4_auth *auth, bool qsr, string& dest);
+void rgw_get_aws4_string_to_sign(rgw_aws4_auth *auth, const string& canonical_req, string& dest);
+/* the signature of the request headers, auth->signing_key should be set */
+void rgw_get_aws4_signature(req_info& info, rgw_aws4_auth *auth, bool qsr, string& dest);
+
+/*
+ * Verifies the body of a request signed with signature version 4 as it
+ * is read, so that it never needs to be buffered.
+ *
+ * A body that is signed as a whole is checked against x-amz-content-sha256
+ * once it was read. An aws-chunked body is made of chunks framed as
+ *   hex(size);chunk-signature=<signature>\r\n<data>\r\n
+ * and ended by a chunk of size 0. The signature of each chunk covers its
+ * data and the signature of the previous chunk, the first one chains to
+ * the signature of the request headers. The chunks are checked as their
+ * data comes in and the framing is stripped off.
+ */
+class RGWAWS4PayloadVerifier {
+  rgw_aws4_auth *auth;
+  ceph::crypto::SHA256 hash;
+  bool streaming;
+
+  enum {
+    STATE_CHUNK_HEADER,
+    STATE_CHUNK_DATA,
+    STATE_CHUNK_END,
+    STATE_DONE,
+  } state;
+  string chunk_header;
+  string chunk_signature;
+  uint64_t chunk_left;
+  bool last_chunk;
+  int crlf_pos;
+  string prev_signature;
+
+  int parse_chunk_header();
+  int verify_chunk();
+
+public:
+  RGWAWS4PayloadVerifier(rgw_aws4_auth *_auth);
+
+  /* feeds raw body data, the payload it holds is appended to out */
+  int append(const char *buf, size_t len, bufferlist& out);
+  /* called once the whole body was read */
+  int complete();
+};
+
 
 
 #endif
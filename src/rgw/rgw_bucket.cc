@@ -777,12 +777,13 @@ int RGWBucket::check_object_index(RGWBucketAdminOpState& op_state,
   rgw_obj_key marker;
   bool is_truncated = true;
 
+  RGWBucketListShards list_shards;
   while (is_truncated) {
     map<string, RGWObjEnt> result;
 
     int r = store->cls_bucket_list(bucket, marker, prefix, 1000, true,
                                    result, &is_truncated, &marker,
-                                   bucket_object_check_filter);
+                                   bucket_object_check_filter, &list_shards);
     if (r == -ENOENT) {
       break;
     } else if (r < 0 && r != -ENOENT) {
@@ -1766,7 +1767,7 @@ public:
 
     objv_tracker = bci.info.objv_tracker;
 
-    ret = store->init_bucket_index(bci.info.bucket, bci.info.num_shards);
+    ret = store->init_bucket_index(bci.info.bucket, bci.info.num_shards, bci.info.index_gen);
     if (ret < 0)
       return ret;
 
@@ -9,47 +9,164 @@
 
 using namespace std;
 
-int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask, rgw_cache_entry_info *cache_info)
+static void inc_cache_counter(int cache_class, bool hit)
 {
-  RWLock::RLocker l(lock);
+  if (!perfcounter)
+    return;
+
+  perfcounter->inc(hit ? l_rgw_cache_hit : l_rgw_cache_miss);
+
+  switch (cache_class) {
+  case CACHE_CLASS_USER:
+    perfcounter->inc(hit ? l_rgw_cache_user_hit : l_rgw_cache_user_miss);
+    break;
+  case CACHE_CLASS_BUCKET:
+    perfcounter->inc(hit ? l_rgw_cache_bucket_hit : l_rgw_cache_bucket_miss);
+    break;
+  case CACHE_CLASS_ATTRS:
+    perfcounter->inc(hit ? l_rgw_cache_attrs_hit : l_rgw_cache_attrs_miss);
+    break;
+  default:
+    break;
+  }
+}
+
+ObjectCache::~ObjectCache()
+{
+  for (vector<Shard *>::iterator iter = shards.begin(); iter != shards.end(); ++iter) {
+    delete *iter;
+  }
+}
+
+void ObjectCache::set_ctx(CephContext *_cct)
+{
+  cct = _cct;
+
+  int num_shards = cct->_conf->rgw_cache_shards;
+  if (num_shards < 1)
+    num_shards = 1;
+
+  for (int i = 0; i < num_shards; i++) {
+    shards.push_back(new Shard);
+  }
+
+  max_entries = cct->_conf->rgw_cache_lru_size / num_shards;
+  if (!max_entries)
+    max_entries = 1;
+  lru_window = max_entries / 2;
+  max_bytes = cct->_conf->rgw_cache_max_bytes / num_shards;
+}
+
+ObjectCache::Shard *ObjectCache::get_shard(const string& name, unsigned *index)
+{
+  unsigned i = ceph_str_hash_linux(name.c_str(), name.size()) % shards.size();
+  if (index)
+    *index = i;
+  return shards[i];
+}
+
+bool ObjectCache::is_expired(ObjectCacheEntry& entry, utime_t& now)
+{
+  if (entry.expiration.is_zero())
+    return false;
+
+  if (now.is_zero())
+    now = ceph_clock_now(cct);
+
+  return (entry.expiration < now);
+}
+
+uint64_t ObjectCache::entry_size(const string& name, ObjectCacheEntry& entry)
+{
+  /* the name is kept both in the map and in the lru */
+  uint64_t size = sizeof(entry) + name.size() * 2 + entry.info.data.length();
+  for (map<string, bufferlist>::iterator iter = entry.info.xattrs.begin();
+       iter != entry.info.xattrs.end(); ++iter) {
+    size += iter->first.size() + iter->second.length();
+  }
+  return size;
+}
+
+void ObjectCache::invalidate_chained(ObjectCacheEntry& entry)
+{
+  for (list<pair<RGWChainedCache *, string> >::iterator iiter = entry.chained_entries.begin();
+       iiter != entry.chained_entries.end(); ++iiter) {
+    RGWChainedCache *chained_cache = iiter->first;
+    chained_cache->invalidate(iiter->second);
+  }
+  entry.chained_entries.clear();
+}
+
+/* called with the shard write lock held */
+void ObjectCache::remove_entry(Shard *shard, map<string, ObjectCacheEntry>::iterator& iter)
+{
+  ObjectCacheEntry& entry = iter->second;
+
+  invalidate_chained(entry);
+  remove_lru(shard, const_cast<string&>(iter->first), entry.lru_iter);
+
+  shard->size -= entry.size;
+  if (perfcounter) {
+    perfcounter->dec(l_rgw_cache_bytes, entry.size);
+    perfcounter->dec(l_rgw_cache_entries);
+  }
 
-  if (!enabled) {
+  shard->cache_map.erase(iter);
+}
+
+int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask, rgw_cache_entry_info *cache_info,
+                     int cache_class)
+{
+  if (!enabled.read()) {
     return -ENOENT;
   }
 
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end()) {
+  Shard *shard = get_shard(name);
+  RWLock::RLocker l(shard->lock);
+
+  map<string, ObjectCacheEntry>::iterator iter = shard->cache_map.find(name);
+  if (iter == shard->cache_map.end()) {
     ldout(cct, 10) << "cache get: name=" << name << " : miss" << dendl;
-    if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
+    inc_cache_counter(cache_class, false);
     return -ENOENT;
   }
 
   ObjectCacheEntry *entry = &iter->second;
+  utime_t now;
+  bool expired = is_expired(*entry, now);
 
-  if (lru_counter - entry->lru_promotion_ts > lru_window) {
-    ldout(cct, 20) << "cache get: touching lru, lru_counter=" << lru_counter << " promotion_ts=" << entry->lru_promotion_ts << dendl;
-    lock.unlock();
-    lock.get_write(); /* promote lock to writer */
+  if (expired || shard->lru_counter - entry->lru_promotion_ts > lru_window) {
+    ldout(cct, 20) << "cache get: touching lru, lru_counter=" << shard->lru_counter << " promotion_ts=" << entry->lru_promotion_ts << dendl;
+    shard->lock.unlock();
+    shard->lock.get_write(); /* promote lock to writer */
 
     /* need to redo this because entry might have dropped off the cache */
-    iter = cache_map.find(name);
-    if (iter == cache_map.end()) {
+    iter = shard->cache_map.find(name);
+    if (iter == shard->cache_map.end()) {
       ldout(cct, 10) << "lost race! cache get: name=" << name << " : miss" << dendl;
-      if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
+      inc_cache_counter(cache_class, false);
       return -ENOENT;
     }
 
     entry = &iter->second;
+    if (is_expired(*entry, now)) {
+      ldout(cct, 10) << "cache get: name=" << name << " : expired" << dendl;
+      remove_entry(shard, iter);
+      inc_cache_counter(cache_class, false);
+      return -ENOENT;
+    }
+
     /* check again, we might have lost a race here */
-    if (lru_counter - entry->lru_promotion_ts > lru_window) {
-      touch_lru(name, *entry, iter->second.lru_iter);
+    if (shard->lru_counter - entry->lru_promotion_ts > lru_window) {
+      touch_lru(shard, name, *entry, iter->second.lru_iter);
     }
   }
 
   ObjectCacheInfo& src = iter->second.info;
-  if ((src.flags & mask) != mask) {
+  /* a cached nonexistent object is a hit whatever was asked for */
+  if (src.status >= 0 && (src.flags & mask) != mask) {
     ldout(cct, 10) << "cache get: name=" << name << " : type miss (requested=" << mask << ", cached=" << src.flags << ")" << dendl;
-    if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
+    inc_cache_counter(cache_class, false);
     return -ENOENT;
   }
   ldout(cct, 10) << "cache get: name=" << name << " : hit" << dendl;
@@ -59,163 +176,193 @@ int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask, rgw_cac
     cache_info->cache_locator = name;
     cache_info->gen = entry->gen;
   }
-  if(perfcounter) perfcounter->inc(l_rgw_cache_hit);
+  inc_cache_counter(cache_class, true);
 
   return 0;
 }
 
 bool ObjectCache::chain_cache_entry(list<rgw_cache_entry_info *>& cache_info_entries, RGWChainedCache::Entry *chained_entry)
 {
-  RWLock::WLocker l(lock);
-
-  if (!enabled) {
+  if (!enabled.read()) {
     return false;
   }
 
   list<rgw_cache_entry_info *>::iterator citer;
 
+  /* lock the shards of all the entries, in order */
+  set<unsigned> shard_ids;
+  for (citer = cache_info_entries.begin(); citer != cache_info_entries.end(); ++citer) {
+    unsigned i;
+    get_shard((*citer)->cache_locator, &i);
+    shard_ids.insert(i);
+  }
+  for (set<unsigned>::iterator siter = shard_ids.begin(); siter != shard_ids.end(); ++siter) {
+    shards[*siter]->lock.get_write();
+  }
+
   list<ObjectCacheEntry *> cache_entry_list;
+  bool ret = true;
 
   /* first verify that all entries are still valid */
   for (citer = cache_info_entries.begin(); citer != cache_info_entries.end(); ++citer) {
     rgw_cache_entry_info *cache_info = *citer;
+    Shard *shard = get_shard(cache_info->cache_locator);
 
     ldout(cct, 10) << "chain_cache_entry: cache_locator=" << cache_info->cache_locator << dendl;
-    map<string, ObjectCacheEntry>::iterator iter = cache_map.find(cache_info->cache_locator);
-    if (iter == cache_map.end()) {
+    map<string, ObjectCacheEntry>::iterator iter = shard->cache_map.find(cache_info->cache_locator);
+    if (iter == shard->cache_map.end()) {
       ldout(cct, 20) << "chain_cache_entry: couldn't find cachce locator" << dendl;
-      return false;
+      ret = false;
+      break;
     }
 
     ObjectCacheEntry *entry = &iter->second;
 
     if (entry->gen != cache_info->gen) {
       ldout(cct, 20) << "chain_cache_entry: entry.gen (" << entry->gen << ") != cache_info.gen (" << cache_info->gen << ")" << dendl;
-      return false;
+      ret = false;
+      break;
     }
 
     cache_entry_list.push_back(entry);
   }
 
+  if (ret) {
+    chained_entry->cache->chain_cb(chained_entry->key, chained_entry->data);
 
-  chained_entry->cache->chain_cb(chained_entry->key, chained_entry->data);
+    list<ObjectCacheEntry *>::iterator liter;
 
-  list<ObjectCacheEntry *>::iterator liter;
+    for (liter = cache_entry_list.begin(); liter != cache_entry_list.end(); ++liter) {
+      ObjectCacheEntry *entry = *liter;
 
-  for (liter = cache_entry_list.begin(); liter != cache_entry_list.end(); ++liter) {
-    ObjectCacheEntry *entry = *liter;
+      entry->chained_entries.push_back(make_pair<RGWChainedCache *, string>(chained_entry->cache, chained_entry->key));
+    }
+  }
 
-    entry->chained_entries.push_back(make_pair<RGWChainedCache *, string>(chained_entry->cache, chained_entry->key));
+  for (set<unsigned>::iterator siter = shard_ids.begin(); siter != shard_ids.end(); ++siter) {
+    shards[*siter]->lock.unlock();
   }
 
-  return true;
+  return ret;
 }
 
 void ObjectCache::put(string& name, ObjectCacheInfo& info, rgw_cache_entry_info *cache_info)
 {
-  RWLock::WLocker l(lock);
+  if (!enabled.read()) {
+    return;
+  }
+
+  Shard *shard = get_shard(name);
+  RWLock::WLocker l(shard->lock);
 
-  if (!enabled) {
+  /* the cache might have been disabled (and cleared) in the meantime */
+  if (!enabled.read()) {
     return;
   }
 
   ldout(cct, 10) << "cache put: name=" << name << dendl;
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end()) {
+  map<string, ObjectCacheEntry>::iterator iter = shard->cache_map.find(name);
+  if (iter == shard->cache_map.end()) {
     ObjectCacheEntry entry;
-    entry.lru_iter = lru.end();
-    cache_map.insert(pair<string, ObjectCacheEntry>(name, entry));
-    iter = cache_map.find(name);
+    entry.lru_iter = shard->lru.end();
+    iter = shard->cache_map.insert(pair<string, ObjectCacheEntry>(name, entry)).first;
+    if (perfcounter)
+      perfcounter->inc(l_rgw_cache_entries);
   }
   ObjectCacheEntry& entry = iter->second;
   ObjectCacheInfo& target = entry.info;
 
-  for (list<pair<RGWChainedCache *, string> >::iterator iiter = entry.chained_entries.begin();
-       iiter != entry.chained_entries.end(); ++iiter) {
-    RGWChainedCache *chained_cache = iiter->first;
-    chained_cache->invalidate(iiter->second);
-  }
-
-  entry.chained_entries.clear();
+  invalidate_chained(entry);
   entry.gen++;
 
-  touch_lru(name, entry, entry.lru_iter);
-
   target.status = info.status;
 
+  int expiry = (info.status < 0 ? cct->_conf->rgw_cache_negative_expiry_interval :
+                                  cct->_conf->rgw_cache_expiry_interval);
+  if (expiry > 0) {
+    entry.expiration = ceph_clock_now(cct);
+    entry.expiration += expiry;
+  } else {
+    entry.expiration = utime_t();
+  }
+
   if (info.status < 0) {
     target.flags = 0;
     target.xattrs.clear();
     target.data.clear();
-    return;
-  }
-
-  if (cache_info) {
-    cache_info->cache_locator = name;
-    cache_info->gen = entry.gen;
-  }
+  } else {
+    if (cache_info) {
+      cache_info->cache_locator = name;
+      cache_info->gen = entry.gen;
+    }
 
-  target.flags |= info.flags;
+    target.flags |= info.flags;
+
+    if (info.flags & CACHE_FLAG_META)
+      target.meta = info.meta;
+    else if (!(info.flags & CACHE_FLAG_MODIFY_XATTRS))
+      target.flags &= ~CACHE_FLAG_META; // non-meta change should reset meta
+
+    if (info.flags & CACHE_FLAG_XATTRS) {
+      target.xattrs = info.xattrs;
+      map<string, bufferlist>::iterator iter;
+      for (iter = target.xattrs.begin(); iter != target.xattrs.end(); ++iter) {
+        ldout(cct, 10) << "updating xattr: name=" << iter->first << " bl.length()=" << iter->second.length() << dendl;
+      }
+    } else if (info.flags & CACHE_FLAG_MODIFY_XATTRS) {
+      map<string, bufferlist>::iterator iter;
+      for (iter = info.rm_xattrs.begin(); iter != info.rm_xattrs.end(); ++iter) {
+        ldout(cct, 10) << "removing xattr: name=" << iter->first << dendl;
+        target.xattrs.erase(iter->first);
+      }
+      for (iter = info.xattrs.begin(); iter != info.xattrs.end(); ++iter) {
+        ldout(cct, 10) << "appending xattr: name=" << iter->first << " bl.length()=" << iter->second.length() << dendl;
+        target.xattrs[iter->first] = iter->second;
+      }
+    }
 
-  if (info.flags & CACHE_FLAG_META)
-    target.meta = info.meta;
-  else if (!(info.flags & CACHE_FLAG_MODIFY_XATTRS))
-    target.flags &= ~CACHE_FLAG_META; // non-meta change should reset meta
+    if (info.flags & CACHE_FLAG_DATA)
+      target.data = info.data;
 
-  if (info.flags & CACHE_FLAG_XATTRS) {
-    target.xattrs = info.xattrs;
-    map<string, bufferlist>::iterator iter;
-    for (iter = target.xattrs.begin(); iter != target.xattrs.end(); ++iter) {
-      ldout(cct, 10) << "updating xattr: name=" << iter->first << " bl.length()=" << iter->second.length() << dendl;
-    }
-  } else if (info.flags & CACHE_FLAG_MODIFY_XATTRS) {
-    map<string, bufferlist>::iterator iter;
-    for (iter = info.rm_xattrs.begin(); iter != info.rm_xattrs.end(); ++iter) {
-      ldout(cct, 10) << "removing xattr: name=" << iter->first << dendl;
-      target.xattrs.erase(iter->first);
-    }
-    for (iter = info.xattrs.begin(); iter != info.xattrs.end(); ++iter) {
-      ldout(cct, 10) << "appending xattr: name=" << iter->first << " bl.length()=" << iter->second.length() << dendl;
-      target.xattrs[iter->first] = iter->second;
-    }
+    if (info.flags & CACHE_FLAG_OBJV)
+      target.version = info.version;
   }
 
-  if (info.flags & CACHE_FLAG_DATA)
-    target.data = info.data;
+  uint64_t size = entry_size(name, entry);
+  shard->size += size;
+  shard->size -= entry.size;
+  if (perfcounter) {
+    perfcounter->inc(l_rgw_cache_bytes, size);
+    perfcounter->dec(l_rgw_cache_bytes, entry.size);
+  }
+  entry.size = size;
 
-  if (info.flags & CACHE_FLAG_OBJV)
-    target.version = info.version;
+  /* last, as it may trim the cache to make room for the entry */
+  touch_lru(shard, name, entry, entry.lru_iter);
 }
 
 void ObjectCache::remove(string& name)
 {
-  RWLock::WLocker l(lock);
-
-  if (!enabled) {
+  if (!enabled.read()) {
     return;
   }
 
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end())
+  Shard *shard = get_shard(name);
+  RWLock::WLocker l(shard->lock);
+
+  map<string, ObjectCacheEntry>::iterator iter = shard->cache_map.find(name);
+  if (iter == shard->cache_map.end())
     return;
 
   ldout(cct, 10) << "removing " << name << " from cache" << dendl;
-  ObjectCacheEntry& entry = iter->second;
-
-  for (list<pair<RGWChainedCache *, string> >::iterator iiter = entry.chained_entries.begin();
-       iiter != entry.chained_entries.end(); ++iiter) {
-    RGWChainedCache *chained_cache = iiter->first;
-    chained_cache->invalidate(iiter->second);
-  }
-
-  remove_lru(name, iter->second.lru_iter);
-  cache_map.erase(iter);
+  remove_entry(shard, iter);
 }
 
-void ObjectCache::touch_lru(string& name, ObjectCacheEntry& entry, std::list<string>::iterator& lru_iter)
+void ObjectCache::touch_lru(Shard *shard, string& name, ObjectCacheEntry& entry, std::list<string>::iterator& lru_iter)
 {
-  while (lru_size > (size_t)cct->_conf->rgw_cache_lru_size) {
-    list<string>::iterator iter = lru.begin();
+  while (shard->lru_size > max_entries ||
+         (max_bytes && shard->size > max_bytes && shard->lru_size > 0)) {
+    list<string>::iterator iter = shard->lru.begin();
     if ((*iter).compare(name) == 0) {
       /*
        * if the entry we're touching happens to be at the lru end, don't remove it,
@@ -223,75 +370,83 @@ void ObjectCache::touch_lru(string& name, ObjectCacheEntry& entry, std::list<str
        */
       break;
     }
-    map<string, ObjectCacheEntry>::iterator map_iter = cache_map.find(*iter);
+    map<string, ObjectCacheEntry>::iterator map_iter = shard->cache_map.find(*iter);
     ldout(cct, 10) << "removing entry: name=" << *iter << " from cache LRU" << dendl;
-    if (map_iter != cache_map.end())
-      cache_map.erase(map_iter);
-    lru.pop_front();
-    lru_size--;
+    if (map_iter != shard->cache_map.end()) {
+      remove_entry(shard, map_iter);
+    } else {
+      shard->lru.pop_front();
+      shard->lru_size--;
+    }
   }
 
-  if (lru_iter == lru.end()) {
-    lru.push_back(name);
-    lru_size++;
+  if (lru_iter == shard->lru.end()) {
+    shard->lru.push_back(name);
+    shard->lru_size++;
     lru_iter--;
     ldout(cct, 10) << "adding " << name << " to cache LRU end" << dendl;
   } else {
     ldout(cct, 10) << "moving " << name << " to cache LRU end" << dendl;
-    lru.erase(lru_iter);
-    lru.push_back(name);
-    lru_iter = lru.end();
+    shard->lru.erase(lru_iter);
+    shard->lru.push_back(name);
+    lru_iter = shard->lru.end();
     --lru_iter;
   }
 
-  lru_counter++;
-  entry.lru_promotion_ts = lru_counter;
+  shard->lru_counter++;
+  entry.lru_promotion_ts = shard->lru_counter;
 }
 
-void ObjectCache::remove_lru(string& name, std::list<string>::iterator& lru_iter)
+void ObjectCache::remove_lru(Shard *shard, string& name, std::list<string>::iterator& lru_iter)
 {
-  if (lru_iter == lru.end())
+  if (lru_iter == shard->lru.end())
     return;
 
-  lru.erase(lru_iter);
-  lru_size--;
-  lru_iter = lru.end();
+  shard->lru.erase(lru_iter);
+  shard->lru_size--;
+  lru_iter = shard->lru.end();
 }
 
 void ObjectCache::set_enabled(bool status)
 {
-  RWLock::WLocker l(lock);
-
-  enabled = status;
+  enabled.set(status ? 1 : 0);
 
-  if (!enabled) {
+  if (!status) {
     do_invalidate_all();
   }
 }
 
 void ObjectCache::invalidate_all()
 {
-  RWLock::WLocker l(lock);
-
   do_invalidate_all();
 }
 
 void ObjectCache::do_invalidate_all()
 {
-  cache_map.clear();
-  lru.clear();
+  for (vector<Shard *>::iterator iter = shards.begin(); iter != shards.end(); ++iter) {
+    Shard *shard = *iter;
+    RWLock::WLocker l(shard->lock);
+
+    if (perfcounter) {
+      perfcounter->dec(l_rgw_cache_bytes, shard->size);
+      perfcounter->dec(l_rgw_cache_entries, shard->cache_map.size());
+    }
 
-  lru_size = 0;
-  lru_counter = 0;
-  lru_window = 0;
+    shard->cache_map.clear();
+    shard->lru.clear();
 
+    shard->lru_size = 0;
+    shard->lru_counter = 0;
+    shard->size = 0;
+  }
+
+  Mutex::Locker l(chained_lock);
   for (list<RGWChainedCache *>::iterator iter = chained_cache.begin(); iter != chained_cache.end(); ++iter) {
     (*iter)->invalidate_all();
   }
 }
 
 void ObjectCache::chain_cache(RGWChainedCache *cache) {
-  RWLock::WLocker l(lock);
+  Mutex::Locker l(chained_lock);
   chained_cache.push_back(cache);
 }
-
@@ -10,11 +10,24 @@
 #include "include/types.h"
 #include "include/utime.h"
 #include "include/assert.h"
+#include "include/atomic.h"
+#include "include/ceph_hash.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
 #include "common/RWLock.h"
 
 enum {
   UPDATE_OBJ,
   REMOVE_OBJ,
+  BATCH_OBJS, /* a list of encoded RGWCacheNotifyInfo */
+};
+
+/* kinds of lookups that hits and misses are accounted to */
+enum {
+  CACHE_CLASS_OTHER,
+  CACHE_CLASS_USER,
+  CACHE_CLASS_BUCKET,
+  CACHE_CLASS_ATTRS,
 };
 
 #define CACHE_FLAG_DATA           0x01
@@ -101,25 +114,29 @@ struct RGWCacheNotifyInfo {
   ObjectCacheInfo obj_info;
   off_t ofs;
   string ns;
+  list<bufferlist> batch;
 
   RGWCacheNotifyInfo() : op(0), ofs(0) {}
 
   void encode(bufferlist& obl) const {
-    ENCODE_START(2, 2, obl);
+    ENCODE_START(3, 2, obl);
     ::encode(op, obl);
     ::encode(obj, obl);
     ::encode(obj_info, obl);
     ::encode(ofs, obl);
     ::encode(ns, obl);
+    ::encode(batch, obl);
     ENCODE_FINISH(obl);
   }
   void decode(bufferlist::iterator& ibl) {
-    DECODE_START_LEGACY_COMPAT_LEN(2, 2, 2, ibl);
+    DECODE_START_LEGACY_COMPAT_LEN(3, 2, 2, ibl);
     ::decode(op, ibl);
     ::decode(obj, ibl);
     ::decode(obj_info, ibl);
     ::decode(ofs, ibl);
     ::decode(ns, ibl);
+    if (struct_v >= 3)
+      ::decode(batch, ibl);
     DECODE_FINISH(ibl);
   }
   void dump(Formatter *f) const;
@@ -132,37 +149,59 @@ struct ObjectCacheEntry {
   std::list<string>::iterator lru_iter;
   uint64_t lru_promotion_ts;
   uint64_t gen;
+  uint64_t size;        /* bytes accounted to the shard */
+  utime_t expiration;   /* zero if the entry doesn't expire */
   std::list<pair<RGWChainedCache *, string> > chained_entries;
 
-  ObjectCacheEntry() : lru_promotion_ts(0), gen(0) {}
+  ObjectCacheEntry() : lru_promotion_ts(0), gen(0), size(0) {}
 };
 
+/*
+ * The cache is split into shards, each with its own lock, lru and share of
+ * the entry and byte limits, so that lookups of different objects don't
+ * contend on a single lock.
+ */
 class ObjectCache {
-  std::map<string, ObjectCacheEntry> cache_map;
-  std::list<string> lru;
-  unsigned long lru_size;
-  unsigned long lru_counter;
+  struct Shard {
+    std::map<string, ObjectCacheEntry> cache_map;
+    std::list<string> lru;
+    unsigned long lru_size;
+    unsigned long lru_counter;
+    uint64_t size;
+    RWLock lock;
+
+    Shard() : lru_size(0), lru_counter(0), size(0), lock("ObjectCache::Shard") {}
+  };
+
+  vector<Shard *> shards;
   unsigned long lru_window;
-  RWLock lock;
+  unsigned long max_entries;   /* per shard */
+  uint64_t max_bytes;          /* per shard, 0 if unlimited */
   CephContext *cct;
 
+  Mutex chained_lock;
   list<RGWChainedCache *> chained_cache;
 
-  bool enabled;
+  atomic_t enabled;
 
-  void touch_lru(string& name, ObjectCacheEntry& entry, std::list<string>::iterator& lru_iter);
-  void remove_lru(string& name, std::list<string>::iterator& lru_iter);
+  Shard *get_shard(const string& name, unsigned *index = NULL);
+  bool is_expired(ObjectCacheEntry& entry, utime_t& now);
+  uint64_t entry_size(const string& name, ObjectCacheEntry& entry);
+  void invalidate_chained(ObjectCacheEntry& entry);
+  void remove_entry(Shard *shard, std::map<string, ObjectCacheEntry>::iterator& iter);
+  void touch_lru(Shard *shard, string& name, ObjectCacheEntry& entry, std::list<string>::iterator& lru_iter);
+  void remove_lru(Shard *shard, string& name, std::list<string>::iterator& lru_iter);
 
   void do_invalidate_all();
 public:
-  ObjectCache() : lru_size(0), lru_counter(0), lru_window(0), lock("ObjectCache"), cct(NULL), enabled(false) { }
-  int get(std::string& name, ObjectCacheInfo& bl, uint32_t mask, rgw_cache_entry_info *cache_info);
+  ObjectCache() : lru_window(0), max_entries(0), max_bytes(0), cct(NULL),
+                  chained_lock("ObjectCache::chained_lock") { }
+  ~ObjectCache();
+  int get(std::string& name, ObjectCacheInfo& bl, uint32_t mask, rgw_cache_entry_info *cache_info,
+          int cache_class = CACHE_CLASS_OTHER);
   void put(std::string& name, ObjectCacheInfo& bl, rgw_cache_entry_info *cache_info);
   void remove(std::string& name);
-  void set_ctx(CephContext *_cct) {
-    cct = _cct;
-    lru_window = cct->_conf->rgw_cache_lru_size / 2;
-  }
+  void set_ctx(CephContext *_cct);
   bool chain_cache_entry(list<rgw_cache_entry_info *>& cache_info_entries, RGWChainedCache::Entry *chained_entry);
 
   void set_enabled(bool status);
@@ -176,6 +215,33 @@ class RGWCache  : public T
 {
   ObjectCache cache;
 
+  /*
+   * Notifications that are sent while another one is in flight on the same
+   * control object are queued, and sent together once it completes.
+   */
+  struct NotifyWaiter {
+    string key;
+    bufferlist bl;
+    int r;
+    bool done;
+
+    NotifyWaiter(const string& _key, bufferlist& _bl) : key(_key), bl(_bl), r(0), done(false) {}
+  };
+
+  struct NotifyQueue {
+    Mutex lock;
+    Cond cond;
+    bool sending;
+    list<NotifyWaiter *> pending;
+
+    NotifyQueue() : lock("RGWCache::NotifyQueue"), sending(false) {}
+  };
+
+  vector<NotifyQueue *> notify_queues;
+
+  int distribute_batch(list<NotifyWaiter *>& batch);
+  void handle_notify_info(RGWCacheNotifyInfo& info);
+
   int list_objects_raw_init(rgw_bucket& bucket, RGWAccessHandle *handle) {
     return T::list_objects_raw_init(bucket, handle);
   }
@@ -197,9 +263,28 @@ class RGWCache  : public T
     return normal_name(obj.bucket, obj.get_object());
   }
 
+  int cache_class(rgw_bucket& bucket, bool stat) {
+    const string& pool = bucket.name;
+    if (pool == T::zone.user_uid_pool.name ||
+        pool == T::zone.user_keys_pool.name ||
+        pool == T::zone.user_email_pool.name ||
+        pool == T::zone.user_swift_pool.name) {
+      return CACHE_CLASS_USER;
+    }
+    if (pool == T::zone.domain_root.name) {
+      return CACHE_CLASS_BUCKET;
+    }
+    return (stat ? CACHE_CLASS_ATTRS : CACHE_CLASS_OTHER);
+  }
+
   int init_rados() {
     int ret;
     cache.set_ctx(T::cct);
+    /* one queue per control object, see RGWRados::pick_control_oid() */
+    int num_queues = MAX(T::cct->_conf->rgw_num_control_oids, 1);
+    for (int i = 0; i < num_queues; i++) {
+      notify_queues.push_back(new NotifyQueue);
+    }
     ret = T::init_rados();
     if (ret < 0)
       return ret;
@@ -222,6 +307,12 @@ class RGWCache  : public T
   }
 public:
   RGWCache() {}
+  ~RGWCache() {
+    for (typename vector<NotifyQueue *>::iterator iter = notify_queues.begin();
+         iter != notify_queues.end(); ++iter) {
+      delete *iter;
+    }
+  }
 
   void register_chained_cache(RGWChainedCache *cc) {
     cache.chain_cache(cc);
@@ -250,6 +341,11 @@ public:
 
   int delete_system_obj(rgw_obj& obj, RGWObjVersionTracker *objv_tracker);
 
+  void invalidate_system_obj(rgw_bucket& bucket, const string& oid) {
+    string name = normal_name(bucket, oid);
+    cache.remove(name);
+  }
+
   bool chain_cache_entry(list<rgw_cache_entry_info *>& cache_info_entries, RGWChainedCache::Entry *chained_entry) {
     return cache.chain_cache_entry(cache_info_entries, chained_entry);
   }
@@ -305,7 +401,7 @@ int RGWCache<T>::get_system_obj(RGWObjectCtx& obj_ctx, RGWRados::SystemObject::R
   if (objv_tracker)
     flags |= CACHE_FLAG_OBJV;
   
-  if (cache.get(name, info, flags, cache_info) == 0) {
+  if (cache.get(name, info, flags, cache_info, cache_class(bucket, false)) == 0) {
     if (info.status < 0)
       return info.status;
 
@@ -518,7 +614,7 @@ int RGWCache<T>::raw_obj_stat(rgw_obj& obj, uint64_t *psize, time_t *pmtime,
   uint32_t flags = CACHE_FLAG_META | CACHE_FLAG_XATTRS;
   if (objv_tracker)
     flags |= CACHE_FLAG_OBJV;
-  int r = cache.get(name, info, flags, NULL);
+  int r = cache.get(name, info, flags, NULL, cache_class(bucket, true));
   if (r == 0) {
     if (info.status < 0)
       return info.status;
@@ -571,8 +667,66 @@ int RGWCache<T>::distribute_cache(const string& normal_name, rgw_obj& obj, Objec
   info.obj = obj;
   bufferlist bl;
   ::encode(info, bl);
-  int ret = T::distribute(normal_name, bl);
-  return ret;
+
+  if (!T::cct->_conf->rgw_cache_notify_batch || notify_queues.empty()) {
+    return T::distribute(normal_name, bl);
+  }
+
+  /* same hash as RGWRados::pick_control_oid() */
+  uint32_t h = ceph_str_hash_linux(normal_name.c_str(), normal_name.size());
+  NotifyQueue *q = notify_queues[h % notify_queues.size()];
+
+  NotifyWaiter waiter(normal_name, bl);
+
+  Mutex::Locker l(q->lock);
+  q->pending.push_back(&waiter);
+  while (!waiter.done) {
+    if (q->sending) {
+      q->cond.Wait(q->lock);
+      continue;
+    }
+
+    /* send out everything that is queued, ours included */
+    q->sending = true;
+    list<NotifyWaiter *> batch;
+    batch.swap(q->pending);
+
+    q->lock.Unlock();
+    int r = distribute_batch(batch);
+    q->lock.Lock();
+
+    for (typename list<NotifyWaiter *>::iterator iter = batch.begin(); iter != batch.end(); ++iter) {
+      (*iter)->r = r;
+      (*iter)->done = true;
+    }
+    q->sending = false;
+    q->cond.Signal();
+  }
+
+  return waiter.r;
+}
+
+template <class T>
+int RGWCache<T>::distribute_batch(list<NotifyWaiter *>& batch)
+{
+  NotifyWaiter *first = batch.front();
+  if (batch.size() == 1) {
+    return T::distribute(first->key, first->bl);
+  }
+
+  RGWCacheNotifyInfo info;
+  info.op = BATCH_OBJS;
+  for (typename list<NotifyWaiter *>::iterator iter = batch.begin(); iter != batch.end(); ++iter) {
+    info.batch.push_back((*iter)->bl);
+  }
+
+  bufferlist bl;
+  ::encode(info, bl);
+
+  mydout(20) << "distributing " << batch.size() << " cache notifications at once" << dendl;
+
+  /* all the keys of a queue map to the same control object */
+  return T::distribute(first->key, bl);
 }
 
 template <class T>
@@ -594,11 +748,39 @@ int RGWCache<T>::watch_cb(uint64_t notify_id,
     return -EIO;
   }
 
+  if (info.op == BATCH_OBJS) {
+    for (list<bufferlist>::iterator iter = info.batch.begin(); iter != info.batch.end(); ++iter) {
+      RGWCacheNotifyInfo entry;
+      try {
+        bufferlist::iterator biter = iter->begin();
+        ::decode(entry, biter);
+      } catch (buffer::error& err) {
+        mydout(0) << "ERROR: buffer::error" << dendl;
+        return -EIO;
+      }
+      handle_notify_info(entry);
+    }
+    return 0;
+  }
+
+  if (info.op != UPDATE_OBJ && info.op != REMOVE_OBJ) {
+    mydout(0) << "WARNING: got unknown notification op: " << info.op << dendl;
+    return -EINVAL;
+  }
+
+  handle_notify_info(info);
+
+  return 0;
+}
+
+template <class T>
+void RGWCache<T>::handle_notify_info(RGWCacheNotifyInfo& info)
+{
   rgw_bucket bucket;
   string oid;
   normalize_bucket_and_obj(info.obj.bucket, info.obj.get_object(), bucket, oid);
   string name = normal_name(bucket, oid);
-  
+
   switch (info.op) {
   case UPDATE_OBJ:
     cache.put(name, info.obj_info, NULL);
@@ -608,10 +790,8 @@ int RGWCache<T>::watch_cb(uint64_t notify_id,
     break;
   default:
     mydout(0) << "WARNING: got unknown notification op: " << info.op << dendl;
-    return -EINVAL;
+    break;
   }
-
-  return 0;
 }
 
 #endif
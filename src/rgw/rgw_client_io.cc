@@ -66,6 +66,50 @@ int RGWClientIO::write(const char *buf, int len)
   return 0;
 }
 
+int RGWClientIO::write_data_bl(bufferlist& bl, off_t ofs, off_t len)
+{
+  int total = 0;
+
+  for (list<bufferptr>::const_iterator iter = bl.buffers().begin();
+       iter != bl.buffers().end() && len > 0; ++iter) {
+    off_t plen = iter->length();
+    if (ofs >= plen) {
+      ofs -= plen;
+      continue;
+    }
+
+    int n = MIN(plen - ofs, len);
+    int ret = write_data(iter->c_str() + ofs, n);
+    if (ret < 0)
+      return ret;
+
+    total += ret;
+    if (ret < n)
+      break;
+
+    ofs = 0;
+    len -= n;
+  }
+
+  return total;
+}
+
+int RGWClientIO::write(bufferlist& bl, off_t ofs, off_t len)
+{
+  int ret = write_data_bl(bl, ofs, len);
+  if (ret < 0)
+    return ret;
+
+  if (account)
+    bytes_sent += ret;
+
+  if (ret < len) {
+    /* sent less than tried to send, error out */
+    return -EIO;
+  }
+
+  return 0;
+}
 
 int RGWClientIO::read(char *buf, int max, int *actual)
 {
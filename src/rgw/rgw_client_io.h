@@ -23,6 +23,12 @@ protected:
 
   virtual int write_data(const char *buf, int len) = 0;
   virtual int read_data(char *buf, int max) = 0;
+  /*
+   * Write a range of a bufferlist. By default every buffer is written on its
+   * own so that the bufferlist doesn't need to be rebuilt into a contiguous
+   * buffer; frontends that can queue the buffers themselves override it.
+   */
+  virtual int write_data_bl(bufferlist& bl, off_t ofs, off_t len);
 
 public:
   virtual ~RGWClientIO() {}
@@ -31,6 +37,7 @@ public:
   void init(CephContext *cct);
   int print(const char *format, ...);
   int write(const char *buf, int len);
+  int write(bufferlist& bl, off_t ofs, off_t len);
   virtual void flush() = 0;
   int read(char *buf, int max, int *actual);
 
@@ -8,6 +8,7 @@
 
 #include "rgw_common.h"
 #include "rgw_acl.h"
+#include "rgw_auth_s3.h"
 #include "rgw_string.h"
 
 #include "common/ceph_crypto.h"
@@ -38,6 +39,8 @@ int rgw_perf_start(CephContext *cct)
   plb.add_u64_counter(l_rgw_get, "get", "Gets");
   plb.add_u64_counter(l_rgw_get_b, "get_b", "Size of gets");
   plb.add_time_avg(l_rgw_get_lat, "get_initial_lat", "Get latency");
+  plb.add_u64(l_rgw_get_inflight_b, "get_inflight_b", "Bytes of object data being read from rados");
+  plb.add_u64_avg(l_rgw_get_window, "get_window", "Read-ahead window of gets");
   plb.add_u64_counter(l_rgw_put, "put", "Puts");
   plb.add_u64_counter(l_rgw_put_b, "put_b", "Size of puts");
   plb.add_time_avg(l_rgw_put_lat, "put_initial_lat", "Put latency");
@@ -47,6 +50,20 @@ int rgw_perf_start(CephContext *cct)
 
   plb.add_u64_counter(l_rgw_cache_hit, "cache_hit", "Cache hits");
   plb.add_u64_counter(l_rgw_cache_miss, "cache_miss", "Cache miss");
+  plb.add_u64_counter(l_rgw_cache_user_hit, "cache_user_hit", "Cache hits on user info");
+  plb.add_u64_counter(l_rgw_cache_user_miss, "cache_user_miss", "Cache miss on user info");
+  plb.add_u64_counter(l_rgw_cache_bucket_hit, "cache_bucket_hit", "Cache hits on bucket info");
+  plb.add_u64_counter(l_rgw_cache_bucket_miss, "cache_bucket_miss", "Cache miss on bucket info");
+  plb.add_u64_counter(l_rgw_cache_attrs_hit, "cache_attrs_hit", "Cache hits on object attrs");
+  plb.add_u64_counter(l_rgw_cache_attrs_miss, "cache_attrs_miss", "Cache miss on object attrs");
+  plb.add_u64(l_rgw_cache_entries, "cache_entries", "Cache entries");
+  plb.add_u64(l_rgw_cache_bytes, "cache_bytes", "Cache size in bytes");
+
+  plb.add_u64_counter(l_rgw_gc_chains_removed, "gc_chains_removed", "Object chains removed by gc");
+  plb.add_u64_counter(l_rgw_gc_objs_removed, "gc_objs_removed", "Tail objects removed by gc");
+  plb.add_u64_avg(l_rgw_gc_aio_window, "gc_aio_window", "Removals gc keeps in flight per shard");
+
+  plb.add_u64_counter(l_rgw_lc_expired, "lc_expired", "Objects removed by lifecycle expiration");
 
   plb.add_u64_counter(l_rgw_keystone_token_cache_hit, "keystone_token_cache_hit", "Keystone token cache hits");
   plb.add_u64_counter(l_rgw_keystone_token_cache_miss, "keystone_token_cache_miss", "Keystone token cache miss");
@@ -173,6 +190,7 @@ req_state::req_state(CephContext *_cct, class RGWEnv *e) : cct(_cct), cio(NULL),
   length = NULL;
   copy_source = NULL;
   http_auth = NULL;
+  aws4_auth = NULL;
   local_source = false;
 
   obj_ctx = NULL;
@@ -182,6 +200,7 @@ req_state::~req_state() {
   delete formatter;
   delete bucket_acl;
   delete object_acl;
+  delete aws4_auth;
 }
 
 void req_state::gen_trans_id()
@@ -436,6 +455,15 @@ void calc_hmac_sha1(const char *key, int key_len,
   buf_to_hex((unsigned char *)dest, CEPH_CRYPTO_HMACSHA1_DIGESTSIZE, hex_str);
 }
 
+void calc_hmac_sha256(const char *key, int key_len,
+                      const char *msg, int msg_len, char *dest)
+/* destination should be CEPH_CRYPTO_HMACSHA256_DIGESTSIZE bytes long */
+{
+  HMACSHA256 hmac((const unsigned char *)key, key_len);
+  hmac.Update((const unsigned char *)msg, msg_len);
+  hmac.Final((unsigned char *)dest);
+}
+
 int gen_rand_base64(CephContext *cct, char *dest, int size) /* size should be the required string size + 1 */
 {
   char buf[size];
@@ -56,6 +56,7 @@ using ceph::crypto::MD5;
 
 #define RGW_ATTR_ACL		RGW_ATTR_PREFIX "acl"
 #define RGW_ATTR_CORS		RGW_ATTR_PREFIX "cors"
+#define RGW_ATTR_LC		RGW_ATTR_PREFIX "lc"
 #define RGW_ATTR_ETAG    	RGW_ATTR_PREFIX "etag"
 #define RGW_ATTR_BUCKETS	RGW_ATTR_PREFIX "buckets"
 #define RGW_ATTR_META_PREFIX	RGW_ATTR_PREFIX RGW_AMZ_META_PREFIX
@@ -148,6 +149,7 @@ using ceph::crypto::MD5;
 #define ERR_SIGNATURE_NO_MATCH   2027
 #define ERR_INVALID_ACCESS_KEY   2028
 #define ERR_MALFORMED_XML        2029
+#define ERR_AMZ_CONTENT_SHA256_MISMATCH 2030
 #define ERR_USER_SUSPENDED       2100
 #define ERR_INTERNAL_ERROR       2200
 
@@ -173,6 +175,8 @@ enum {
   l_rgw_get,
   l_rgw_get_b,
   l_rgw_get_lat,
+  l_rgw_get_inflight_b,
+  l_rgw_get_window,
 
   l_rgw_put,
   l_rgw_put_b,
@@ -183,6 +187,20 @@ enum {
 
   l_rgw_cache_hit,
   l_rgw_cache_miss,
+  l_rgw_cache_user_hit,
+  l_rgw_cache_user_miss,
+  l_rgw_cache_bucket_hit,
+  l_rgw_cache_bucket_miss,
+  l_rgw_cache_attrs_hit,
+  l_rgw_cache_attrs_miss,
+  l_rgw_cache_entries,
+  l_rgw_cache_bytes,
+
+  l_rgw_gc_chains_removed,
+  l_rgw_gc_objs_removed,
+  l_rgw_gc_aio_window,
+
+  l_rgw_lc_expired,
 
   l_rgw_keystone_token_cache_hit,
   l_rgw_keystone_token_cache_miss,
@@ -767,6 +785,11 @@ struct RGWBucketInfo
     MOD = 0
   };
 
+  enum BIReshardStatus {
+    RESHARD_NONE = 0,
+    RESHARD_IN_PROGRESS = 1,
+  };
+
   rgw_bucket bucket;
   string owner;
   uint32_t flags;
@@ -790,8 +813,17 @@ struct RGWBucketInfo
   // Represents the shard number for blind bucket.
   const static uint32_t NUM_SHARDS_BLIND_BUCKET;
 
+  // Generation of the bucket index objects, bumped every time the index is
+  // resharded (generation 0 uses the original object names).
+  uint32_t index_gen;
+
+  // While resharding, the index is being copied to new_num_shards shards
+  // of generation index_gen + 1.
+  uint8_t reshard_status;
+  uint32_t new_num_shards;
+
   void encode(bufferlist& bl) const {
-     ENCODE_START(11, 4, bl);
+     ENCODE_START(12, 4, bl);
      ::encode(bucket, bl);
      ::encode(owner, bl);
      ::encode(flags, bl);
@@ -803,6 +835,9 @@ struct RGWBucketInfo
      ::encode(quota, bl);
      ::encode(num_shards, bl);
      ::encode(bucket_index_shard_hash_type, bl);
+     ::encode(index_gen, bl);
+     ::encode(reshard_status, bl);
+     ::encode(new_num_shards, bl);
      ENCODE_FINISH(bl);
   }
   void decode(bufferlist::iterator& bl) {
@@ -829,6 +864,11 @@ struct RGWBucketInfo
        ::decode(num_shards, bl);
      if (struct_v >= 11)
        ::decode(bucket_index_shard_hash_type, bl);
+     if (struct_v >= 12) {
+       ::decode(index_gen, bl);
+       ::decode(reshard_status, bl);
+       ::decode(new_num_shards, bl);
+     }
      DECODE_FINISH(bl);
   }
   void dump(Formatter *f) const;
@@ -839,8 +879,10 @@ struct RGWBucketInfo
   bool versioned() { return (flags & BUCKET_VERSIONED) != 0; }
   int versioning_status() { return flags & (BUCKET_VERSIONED | BUCKET_VERSIONS_SUSPENDED); }
   bool versioning_enabled() { return versioning_status() == BUCKET_VERSIONED; }
+  bool resharding() const { return reshard_status == RESHARD_IN_PROGRESS; }
 
-  RGWBucketInfo() : flags(0), creation_time(0), has_instance_obj(false), num_shards(0), bucket_index_shard_hash_type(MOD) {}
+  RGWBucketInfo() : flags(0), creation_time(0), has_instance_obj(false), num_shards(0), bucket_index_shard_hash_type(MOD),
+                    index_gen(0), reshard_status(RESHARD_NONE), new_num_shards(0) {}
 };
 WRITE_CLASS_ENCODER(RGWBucketInfo)
 
@@ -902,6 +944,7 @@ struct RGWStorageStats
 };
 
 struct req_state;
+struct rgw_aws4_auth;
 
 class RGWEnv;
 
@@ -1048,6 +1091,7 @@ struct req_state {
    bool has_acl_header;
    const char *copy_source;
    const char *http_auth;
+   rgw_aws4_auth *aws4_auth; /* set for requests signed with signature v4 */
    bool local_source; /* source is local */
 
    int prot_flags;
@@ -1605,6 +1649,10 @@ extern void calc_hmac_sha1(const char *key, int key_len,
                           const char *msg, int msg_len, char *dest);
 /* destination should be CEPH_CRYPTO_HMACSHA1_DIGESTSIZE bytes long */
 
+extern void calc_hmac_sha256(const char *key, int key_len,
+                             const char *msg, int msg_len, char *dest);
+/* destination should be CEPH_CRYPTO_HMACSHA256_DIGESTSIZE bytes long */
+
 extern int rgw_parse_op_type_list(const string& str, uint32_t *perm);
 
 #endif
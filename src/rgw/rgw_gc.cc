@@ -9,6 +9,7 @@
 #include "auth/Crypto.h"
 
 #include <list>
+#include <deque>
 
 #define dout_subsys ceph_subsys_rgw
 
@@ -17,6 +18,16 @@ using namespace librados;
 
 static string gc_oid_prefix = "gc";
 static string gc_index_lock_name = "gc_process";
+static string gc_stats_attr = "rgw.gc_stats";
+
+void RGWGCShardStats::dump(Formatter *f) const
+{
+  f->dump_stream("last_run") << last_run;
+  f->dump_float("duration", (double)duration);
+  f->dump_unsigned("chains_removed", chains_removed);
+  f->dump_unsigned("objs_removed", objs_removed);
+  f->dump_unsigned("errors", errors);
+}
 
 
 #define HASH_PRIME 7877
@@ -107,6 +118,8 @@ int RGWGC::list(int *index, string& marker, uint32_t max, bool expired_only, std
     for (iter = entries.begin(); iter != entries.end(); ++iter) {
       result.push_back(*iter);
     }
+    if (!entries.empty())
+      cls_rgw_gc_list_marker(entries.back(), &marker);
 
     if (*index == cct->_conf->rgw_gc_max_objs - 1) {
       /* we cut short here, truncated will hold the correct value */
@@ -128,11 +141,199 @@ int RGWGC::list(int *index, string& marker, uint32_t max, bool expired_only, std
   return 0;
 }
 
+#define MAX_REMOVE_CHUNK 16
+
+/*
+ * Keeps a window of tail object removals of a single gc shard in flight.
+ * The window grows by one for every removal that completes within
+ * rgw_gc_aio_target_latency and is halved whenever one takes longer, so
+ * that gc backs off while the osds are busy serving clients. A chain's tag
+ * is only removed from the shard once all of its objects are gone.
+ */
+class RGWGCIOManager {
+  CephContext *cct;
+  RGWGC *gc;
+  int index;
+
+  struct IO {
+    CephContext *cct;
+    AioCompletion *c;
+    string tag;
+    string oid;
+    utime_t start;
+    utime_t end;
+
+    IO(CephContext *_cct, const string& _tag, const string& _oid) : cct(_cct), c(NULL), tag(_tag), oid(_oid) {}
+  };
+
+  struct ChainState {
+    int pending;
+    bool issued;
+    bool failed;
+
+    ChainState() : pending(0), issued(false), failed(false) {}
+  };
+
+  deque<IO *> ios;
+  map<string, ChainState> chains;
+  std::list<string> remove_tags;
+
+  unsigned window;
+  unsigned max_window;
+  utime_t target_latency;
+
+  static void io_complete(completion_t cb, void *arg) {
+    IO *io = static_cast<IO *>(arg);
+    io->end = ceph_clock_now(io->cct);
+  }
+
+  void update_window(const utime_t& latency) {
+    if (latency > target_latency) {
+      window = MAX(window / 2, 1);
+    } else if (window < max_window) {
+      window++;
+    }
+    if (perfcounter)
+      perfcounter->inc(l_rgw_gc_aio_window, window);
+  }
+
+  void chain_done(const string& tag) {
+    map<string, ChainState>::iterator iter = chains.find(tag);
+    if (iter == chains.end())
+      return;
+    ChainState& state = iter->second;
+    if (!state.issued || state.pending > 0)
+      return;
+    if (!state.failed) {
+      remove_tags.push_back(tag);
+      chains_removed++;
+      if (perfcounter)
+        perfcounter->inc(l_rgw_gc_chains_removed);
+      if (remove_tags.size() > MAX_REMOVE_CHUNK)
+        flush_remove_tags();
+    }
+    chains.erase(iter);
+  }
+
+  void handle_next_completion() {
+    IO *io = ios.front();
+    ios.pop_front();
+
+    io->c->wait_for_complete_and_cb();
+    int ret = io->c->get_return_value();
+    io->c->release();
+
+    update_window(io->end - io->start);
+
+    ChainState& state = chains[io->tag];
+    state.pending--;
+    if (ret == -ENOENT)
+      ret = 0;
+    if (ret < 0) {
+      state.failed = true;
+      errors++;
+      ldout(cct, 0) << "failed to remove " << io->oid << " ret=" << ret << dendl;
+    } else {
+      objs_removed++;
+      if (perfcounter)
+        perfcounter->inc(l_rgw_gc_objs_removed);
+    }
+
+    string tag = io->tag;
+    delete io;
+    chain_done(tag);
+  }
+
+public:
+  uint64_t chains_removed;
+  uint64_t objs_removed;
+  uint64_t errors;
+
+  RGWGCIOManager(CephContext *_cct, RGWGC *_gc, int _index) : cct(_cct), gc(_gc), index(_index),
+                                                             chains_removed(0), objs_removed(0), errors(0) {
+    max_window = MAX(cct->_conf->rgw_gc_max_aio, 1);
+    window = max_window;
+    target_latency.set_from_double(cct->_conf->rgw_gc_aio_target_latency);
+  }
+
+  ~RGWGCIOManager() {
+    drain();
+    flush_remove_tags();
+  }
+
+  void start_chain(const string& tag) {
+    chains[tag];
+  }
+
+  int schedule_io(IoCtx& ctx, const string& oid, const string& tag) {
+    while (ios.size() >= window)
+      handle_next_completion();
+
+    IO *io = new IO(cct, tag, oid);
+    io->c = librados::Rados::aio_create_completion(io, io_complete, NULL);
+
+    ObjectWriteOperation op;
+    cls_refcount_put(op, tag, true);
+
+    io->start = ceph_clock_now(cct);
+    int ret = ctx.aio_operate(oid, io->c, &op);
+    if (ret < 0) {
+      io->c->release();
+      delete io;
+      return ret;
+    }
+    chains[tag].pending++;
+    ios.push_back(io);
+    return 0;
+  }
+
+  void end_chain(const string& tag, bool failed) {
+    ChainState& state = chains[tag];
+    state.issued = true;
+    if (failed)
+      state.failed = true;
+    chain_done(tag);
+  }
+
+  void drain() {
+    while (!ios.empty())
+      handle_next_completion();
+  }
+
+  void flush_remove_tags() {
+    if (remove_tags.empty())
+      return;
+    gc->remove(index, remove_tags);
+    remove_tags.clear();
+  }
+};
+
+/*
+ * Keep the tail removals of all shard processors under
+ * rgw_gc_max_objs_per_sec, if set.
+ */
+void RGWGC::throttle_ops()
+{
+  double max_rate = cct->_conf->rgw_gc_max_objs_per_sec;
+  uint64_t ops = ops_issued.inc();
+  if (max_rate <= 0)
+    return;
+
+  utime_t due;
+  due.set_from_double((double)ops / max_rate);
+  due += process_start;
+  utime_t now = ceph_clock_now(cct);
+  if (now < due) {
+    utime_t delay = due - now;
+    delay.sleep();
+  }
+}
+
 int RGWGC::process(int index, int max_secs)
 {
   rados::cls::lock::Lock l(gc_index_lock_name);
-  utime_t end = ceph_clock_now(g_ceph_context);
-  std::list<string> remove_tags;
+  utime_t start = ceph_clock_now(g_ceph_context);
+  utime_t end = start;
 
   /* max_secs should be greater than zero. We don't want a zero max_secs
    * to be translated as no timeout, since we'd then need to break the
@@ -155,7 +356,8 @@ int RGWGC::process(int index, int max_secs)
 
   string marker;
   bool truncated;
-  IoCtx *ctx = new IoCtx;
+  map<string, IoCtx> ctxs;
+  RGWGCIOManager *io_manager = new RGWGCIOManager(cct, this, index);
   do {
     int max = 100;
     std::list<cls_rgw_gc_obj_info> entries;
@@ -167,10 +369,9 @@ int RGWGC::process(int index, int max_secs)
     if (ret < 0)
       goto done;
 
-    string last_pool;
     std::list<cls_rgw_gc_obj_info>::iterator iter;
     for (iter = entries.begin(); iter != entries.end(); ++iter) {
-      bool remove_tag;
+      bool failed = false;
       cls_rgw_gc_obj_info& info = *iter;
       std::list<cls_rgw_obj>::iterator liter;
       cls_rgw_obj_chain& chain = info.chain;
@@ -179,62 +380,87 @@ int RGWGC::process(int index, int max_secs)
       if (now >= end)
         goto done;
 
-      remove_tag = true;
+      io_manager->start_chain(info.tag);
       for (liter = chain.objs.begin(); liter != chain.objs.end(); ++liter) {
         cls_rgw_obj& obj = *liter;
 
-        if (obj.pool != last_pool) {
-          delete ctx;
-          ctx = new IoCtx;
-	  ret = store->get_rados_handle()->ioctx_create(obj.pool.c_str(), *ctx);
+        map<string, IoCtx>::iterator citer = ctxs.find(obj.pool);
+        if (citer == ctxs.end()) {
+          IoCtx ctx;
+	  ret = store->get_rados_handle()->ioctx_create(obj.pool.c_str(), ctx);
 	  if (ret < 0) {
 	    dout(0) << "ERROR: failed to create ioctx pool=" << obj.pool << dendl;
 	    continue;
 	  }
-          last_pool = obj.pool;
+          citer = ctxs.insert(make_pair(obj.pool, ctx)).first;
         }
+        IoCtx& ctx = citer->second;
 
-        ctx->locator_set_key(obj.loc);
+        ctx.locator_set_key(obj.loc);
         rgw_obj key_obj;
         key_obj.set_obj(obj.key.name);
         key_obj.set_instance(obj.key.instance);
 
-	dout(0) << "gc::process: removing " << obj.pool << ":" << key_obj.get_object() << dendl;
-	ObjectWriteOperation op;
-	cls_refcount_put(op, info.tag, true);
-        ret = ctx->operate(key_obj.get_object(), &op);
-	if (ret == -ENOENT)
-	  ret = 0;
+	dout(5) << "gc::process: removing " << obj.pool << ":" << key_obj.get_object() << dendl;
+        throttle_ops();
+        ret = io_manager->schedule_io(ctx, key_obj.get_object(), info.tag);
         if (ret < 0) {
-          remove_tag = false;
+          failed = true;
           dout(0) << "failed to remove " << obj.pool << ":" << key_obj.get_object() << "@" << obj.loc << dendl;
         }
 
-        if (going_down()) // leave early, even if tag isn't removed, it's ok
+        if (going_down()) { // leave early, even if tag isn't removed, it's ok
+          io_manager->end_chain(info.tag, true);
           goto done;
-      }
-      if (remove_tag) {
-        remove_tags.push_back(info.tag);
-#define MAX_REMOVE_CHUNK 16
-        if (remove_tags.size() > MAX_REMOVE_CHUNK) {
-          RGWGC::remove(index, remove_tags);
-          remove_tags.clear();
         }
       }
+      io_manager->end_chain(info.tag, failed);
     }
+    if (!entries.empty())
+      cls_rgw_gc_list_marker(entries.back(), &marker);
   } while (truncated);
 
 done:
-  if (!remove_tags.empty())
-    RGWGC::remove(index, remove_tags);
+  /* wait for the removals in flight before trimming the shard and
+   * releasing the lock */
+  io_manager->drain();
+  io_manager->flush_remove_tags();
+
+  RGWGCShardStats stats;
+  stats.last_run = start;
+  stats.duration = ceph_clock_now(g_ceph_context) - start;
+  stats.chains_removed = io_manager->chains_removed;
+  stats.objs_removed = io_manager->objs_removed;
+  stats.errors = io_manager->errors;
+  delete io_manager;
+
+  bufferlist bl;
+  ::encode(stats, bl);
+  ObjectWriteOperation op;
+  op.setxattr(gc_stats_attr.c_str(), bl);
+  store->gc_operate(obj_names[index], &op);
+
   l.unlock(&store->gc_pool_ctx, obj_names[index]);
-  delete ctx;
   return 0;
 }
 
+void *RGWGC::GCShardProcessor::entry()
+{
+  int num_shards = gc->max_objs;
+  while (!gc->going_down()) {
+    int i = gc->next_shard.inc() - 1;
+    if (i >= num_shards)
+      break;
+    int index = (i + start) % num_shards;
+    int r = gc->process(index, max_secs);
+    if (r < 0 && ret == 0)
+      ret = r;
+  }
+  return NULL;
+}
+
 int RGWGC::process()
 {
-  int max_objs = cct->_conf->rgw_gc_max_objs;
   int max_secs = cct->_conf->rgw_gc_processor_max_time;
 
   unsigned start;
@@ -242,11 +468,75 @@ int RGWGC::process()
   if (ret < 0)
     return ret;
 
-  for (int i = 0; i < max_objs; i++) {
-    int index = (i + start) % max_objs;
-    ret = process(index, max_secs);
+  int num_processors = cct->_conf->rgw_gc_max_concurrent_shards;
+  if (num_processors < 1)
+    num_processors = 1;
+  if (num_processors > max_objs)
+    num_processors = max_objs;
+
+  next_shard.set(0);
+  ops_issued.set(0);
+  process_start = ceph_clock_now(cct);
+
+  vector<GCShardProcessor *> processors;
+  for (int i = 0; i < num_processors; i++) {
+    GCShardProcessor *processor = new GCShardProcessor(this, start % max_objs, max_secs);
+    processor->create();
+    processors.push_back(processor);
+  }
+
+  for (vector<GCShardProcessor *>::iterator iter = processors.begin(); iter != processors.end(); ++iter) {
+    GCShardProcessor *processor = *iter;
+    processor->join();
+    if (processor->get_ret() < 0 && ret == 0)
+      ret = processor->get_ret();
+    delete processor;
+  }
+
+  return ret;
+}
+
+int RGWGC::get_shard_backlog(int index, RGWGCShardBacklog& backlog)
+{
+  utime_t now = ceph_clock_now(cct);
+  string marker;
+  bool truncated;
+
+  do {
+    std::list<cls_rgw_gc_obj_info> entries;
+    int ret = cls_rgw_gc_list(store->gc_pool_ctx, obj_names[index], marker, 1000, false, entries, &truncated);
+    if (ret == -ENOENT)
+      return 0;
     if (ret < 0)
       return ret;
+
+    std::list<cls_rgw_gc_obj_info>::iterator iter;
+    for (iter = entries.begin(); iter != entries.end(); ++iter) {
+      cls_rgw_gc_obj_info& info = *iter;
+      backlog.chains++;
+      backlog.objs += info.chain.objs.size();
+      if (info.time <= now)
+        backlog.expired_chains++;
+      if (backlog.oldest.is_zero() || info.time < backlog.oldest)
+        backlog.oldest = info.time;
+    }
+    if (!entries.empty())
+      cls_rgw_gc_list_marker(entries.back(), &marker);
+  } while (truncated);
+
+  bufferlist bl;
+  int ret = store->gc_pool_ctx.getxattr(obj_names[index], gc_stats_attr.c_str(), bl);
+  if (ret == -ENODATA || ret == -ENOENT)
+    return 0;
+  if (ret < 0)
+    return ret;
+
+  try {
+    bufferlist::iterator iter = bl.begin();
+    ::decode(backlog.stats, iter);
+  } catch (buffer::error& err) {
+    ldout(cct, 0) << "ERROR: failed to decode gc stats of " << obj_names[index] << dendl;
+    return -EIO;
   }
 
   return 0;
@@ -15,6 +15,53 @@
 #include "rgw_rados.h"
 #include "cls/rgw/cls_rgw_types.h"
 
+/*
+ * Result of the last processing pass over a gc shard, kept as an xattr of
+ * the shard object so that radosgw-admin can report how fast the backlog
+ * is drained no matter which gateway did the work.
+ */
+struct RGWGCShardStats {
+  utime_t last_run;
+  utime_t duration;
+  uint64_t chains_removed;
+  uint64_t objs_removed;
+  uint64_t errors;
+
+  RGWGCShardStats() : chains_removed(0), objs_removed(0), errors(0) {}
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(last_run, bl);
+    ::encode(duration, bl);
+    ::encode(chains_removed, bl);
+    ::encode(objs_removed, bl);
+    ::encode(errors, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::iterator& bl) {
+    DECODE_START(1, bl);
+    ::decode(last_run, bl);
+    ::decode(duration, bl);
+    ::decode(chains_removed, bl);
+    ::decode(objs_removed, bl);
+    ::decode(errors, bl);
+    DECODE_FINISH(bl);
+  }
+  void dump(Formatter *f) const;
+};
+WRITE_CLASS_ENCODER(RGWGCShardStats)
+
+/* backlog of a single gc shard, as reported by RGWGC::get_shard_backlog() */
+struct RGWGCShardBacklog {
+  uint64_t chains;
+  uint64_t expired_chains;
+  uint64_t objs;
+  utime_t oldest;
+  RGWGCShardStats stats;
+
+  RGWGCShardBacklog() : chains(0), expired_chains(0), objs(0) {}
+};
+
 class RGWGC {
   CephContext *cct;
   RGWRados *store;
@@ -22,7 +69,25 @@ class RGWGC {
   string *obj_names;
   atomic_t down_flag;
 
+  /* state shared by the shard processors of a single process() call */
+  atomic_t next_shard;
+  atomic_t ops_issued;
+  utime_t process_start;
+
   int tag_index(const string& tag);
+  void throttle_ops();
+
+  class GCShardProcessor : public Thread {
+    RGWGC *gc;
+    int start;
+    int max_secs;
+    int ret;
+
+  public:
+    GCShardProcessor(RGWGC *_gc, int _start, int _max_secs) : gc(_gc), start(_start), max_secs(_max_secs), ret(0) {}
+    void *entry();
+    int get_ret() { return ret; }
+  };
 
   class GCWorker : public Thread {
     CephContext *cct;
@@ -57,6 +122,9 @@ public:
   int process(int index, int process_max_secs);
   int process();
 
+  int get_num_shards() { return max_objs; }
+  int get_shard_backlog(int index, RGWGCShardBacklog& backlog);
+
   bool going_down();
   void start_processor();
   void stop_processor();
@@ -204,6 +204,7 @@ void RGWCacheNotifyInfo::dump(Formatter *f) const
   encode_json("obj_info", obj_info, f);
   encode_json("ofs", ofs, f);
   encode_json("ns", ns, f);
+  encode_json("batch_size", (int)batch.size(), f);
 }
 
 void RGWAccessKey::dump(Formatter *f) const
@@ -549,6 +550,9 @@ void RGWBucketInfo::dump(Formatter *f) const
   encode_json("quota", quota, f);
   encode_json("num_shards", num_shards, f);
   encode_json("bi_shard_hash_type", (uint32_t)bucket_index_shard_hash_type, f);
+  encode_json("index_gen", index_gen, f);
+  encode_json("reshard_status", (uint32_t)reshard_status, f);
+  encode_json("new_num_shards", new_num_shards, f);
 }
 
 void RGWBucketInfo::decode_json(JSONObj *obj) {
@@ -564,6 +568,11 @@ void RGWBucketInfo::decode_json(JSONObj *obj) {
   uint32_t hash_type;
   JSONDecoder::decode_json("bi_shard_hash_type", hash_type, obj);
   bucket_index_shard_hash_type = (uint8_t)hash_type;
+  JSONDecoder::decode_json("index_gen", index_gen, obj);
+  uint32_t status = RESHARD_NONE;
+  JSONDecoder::decode_json("reshard_status", status, obj);
+  reshard_status = (uint8_t)status;
+  JSONDecoder::decode_json("new_num_shards", new_num_shards, obj);
 }
 
 void RGWObjEnt::dump(Formatter *f) const
@@ -0,0 +1,528 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "common/ceph_json.h"
+#include "rgw_lc.h"
+#include "rgw_bucket.h"
+#include "include/rados/librados.hpp"
+#include "cls/rgw/cls_rgw_client.h"
+#include "cls/lock/cls_lock_client.h"
+#include "auth/Crypto.h"
+
+#include <list>
+
+#define dout_subsys ceph_subsys_rgw
+
+using namespace std;
+using namespace librados;
+
+static string lc_oid_prefix = "lc";
+static string lc_index_lock_name = "lc_process";
+
+#define HASH_PRIME 7877
+#define MAX_LC_RULES 1000
+#define LC_LIST_MAX 1000
+
+int RGWLifecycleConfiguration::add_rule(const LCRule& rule)
+{
+  if (rule.id.empty() || rule.id.size() > 255)
+    return -EINVAL;
+  if (rule.status != "Enabled" && rule.status != "Disabled")
+    return -EINVAL;
+  if (rule.expiration.days <= 0)
+    return -EINVAL;
+  if (rules.size() >= MAX_LC_RULES)
+    return -EINVAL;
+  if (rules.find(rule.id) != rules.end())
+    return -EINVAL;
+
+  rules[rule.id] = rule;
+  return 0;
+}
+
+bool RGWLifecycleConfiguration::has_enabled_rules() const
+{
+  map<string, LCRule>::const_iterator iter;
+  for (iter = rules.begin(); iter != rules.end(); ++iter) {
+    if (iter->second.is_enabled())
+      return true;
+  }
+  return false;
+}
+
+void LCExpiration::dump(Formatter *f) const
+{
+  f->dump_int("days", days);
+}
+
+void LCExpiration::decode_json(JSONObj *obj)
+{
+  JSONDecoder::decode_json("days", days, obj, true);
+}
+
+void LCRule::dump(Formatter *f) const
+{
+  f->dump_string("id", id);
+  f->dump_string("prefix", prefix);
+  f->dump_string("status", status);
+  encode_json("expiration", expiration, f);
+}
+
+void LCRule::decode_json(JSONObj *obj)
+{
+  JSONDecoder::decode_json("id", id, obj);
+  JSONDecoder::decode_json("prefix", prefix, obj);
+  JSONDecoder::decode_json("status", status, obj, true);
+  JSONDecoder::decode_json("expiration", expiration, obj, true);
+}
+
+void RGWLifecycleConfiguration::dump(Formatter *f) const
+{
+  f->open_array_section("rules");
+  for (map<string, LCRule>::const_iterator iter = rules.begin(); iter != rules.end(); ++iter) {
+    encode_json("rule", iter->second, f);
+  }
+  f->close_section();
+}
+
+void RGWLifecycleConfiguration::decode_json(JSONObj *obj)
+{
+  list<LCRule> l;
+  JSONDecoder::decode_json("rules", l, obj, true);
+  rules.clear();
+  for (list<LCRule>::iterator iter = l.begin(); iter != l.end(); ++iter) {
+    if (add_rule(*iter) < 0) {
+      throw JSONDecoder::err("invalid lifecycle rule " + iter->id);
+    }
+  }
+}
+
+void RGWLC::initialize(CephContext *_cct, RGWRados *_store) {
+  cct = _cct;
+  store = _store;
+
+  max_objs = cct->_conf->rgw_lc_max_objs;
+  if (max_objs > HASH_PRIME)
+    max_objs = HASH_PRIME;
+  if (max_objs < 1)
+    max_objs = 1;
+
+  obj_names = new string[max_objs];
+
+  for (int i = 0; i < max_objs; i++) {
+    obj_names[i] = lc_oid_prefix;
+    char buf[32];
+    snprintf(buf, 32, ".%d", i);
+    obj_names[i].append(buf);
+  }
+}
+
+void RGWLC::finalize()
+{
+  delete[] obj_names;
+  obj_names = NULL;
+}
+
+int RGWLC::bucket_index(const string& bucket_name)
+{
+  return ceph_str_hash_linux(bucket_name.c_str(), bucket_name.size()) % HASH_PRIME % max_objs;
+}
+
+int RGWLC::get_bucket_config(const string& bucket_name, RGWBucketInfo& bucket_info,
+                             map<string, bufferlist>& attrs, RGWLifecycleConfiguration *config)
+{
+  RGWObjectCtx obj_ctx(store);
+  int ret = store->get_bucket_info(obj_ctx, bucket_name, bucket_info, NULL, &attrs);
+  if (ret < 0)
+    return ret;
+
+  map<string, bufferlist>::iterator iter = attrs.find(RGW_ATTR_LC);
+  if (iter == attrs.end())
+    return -ENOENT;
+
+  try {
+    bufferlist::iterator biter = iter->second.begin();
+    ::decode(*config, biter);
+  } catch (buffer::error& err) {
+    ldout(cct, 0) << "ERROR: failed to decode lifecycle configuration of bucket " << bucket_name << dendl;
+    return -EIO;
+  }
+
+  return 0;
+}
+
+int RGWLC::set_bucket_config(RGWBucketInfo& bucket_info, RGWLifecycleConfiguration& config)
+{
+  map<string, bufferlist> attrs;
+  ::encode(config, attrs[RGW_ATTR_LC]);
+
+  int ret = rgw_bucket_set_attrs(store, bucket_info, attrs, NULL, &bucket_info.objv_tracker);
+  if (ret < 0)
+    return ret;
+
+  const string& bucket_name = bucket_info.bucket.name;
+  map<string, bufferlist> entry;
+  ::encode(bucket_info.bucket.bucket_id, entry[bucket_name]);
+  ObjectWriteOperation op;
+  op.omap_set(entry);
+  return store->gc_operate(obj_names[bucket_index(bucket_name)], &op);
+}
+
+int RGWLC::remove_bucket_config(RGWBucketInfo& bucket_info, map<string, bufferlist>& attrs)
+{
+  map<string, bufferlist>::iterator iter = attrs.find(RGW_ATTR_LC);
+  if (iter != attrs.end()) {
+    map<string, bufferlist> no_attrs, rmattrs;
+    rmattrs[RGW_ATTR_LC] = iter->second;
+    int ret = rgw_bucket_set_attrs(store, bucket_info, no_attrs, &rmattrs, &bucket_info.objv_tracker);
+    if (ret < 0)
+      return ret;
+  }
+
+  const string& bucket_name = bucket_info.bucket.name;
+  set<string> keys;
+  keys.insert(bucket_name);
+  ObjectWriteOperation op;
+  op.omap_rm_keys(keys);
+  int ret = store->gc_operate(obj_names[bucket_index(bucket_name)], &op);
+  if (ret == -ENOENT)
+    ret = 0;
+  return ret;
+}
+
+int RGWLC::list_buckets(int *index, string& marker, uint32_t max, list<string>& result, bool *truncated)
+{
+  result.clear();
+
+  for (; *index < max_objs && result.size() < max; (*index)++, marker.clear()) {
+    set<string> keys;
+    uint32_t left = max - result.size();
+    int ret = store->gc_pool_ctx.omap_get_keys(obj_names[*index], marker, left, &keys);
+    if (ret == -ENOENT)
+      continue;
+    if (ret < 0)
+      return ret;
+
+    for (set<string>::iterator iter = keys.begin(); iter != keys.end(); ++iter) {
+      result.push_back(*iter);
+    }
+
+    if (keys.size() == left) {
+      /* there might be more keys in this shard, continue from the last one */
+      marker = *keys.rbegin();
+      *truncated = true;
+      return 0;
+    }
+  }
+  *truncated = (*index < max_objs);
+
+  return 0;
+}
+
+bool RGWLC::is_expired(const LCRule& rule, const rgw_bucket_dir_entry& entry, const utime_t& now)
+{
+  if (!entry.exists || !entry.key.instance.empty())
+    return false;
+
+  /* skip entries of other namespaces, e.g., multipart uploads in progress */
+  string name = entry.key.name;
+  string instance;
+  string ns;
+  if (!rgw_obj::translate_raw_obj_to_obj_in_ns(name, instance, ns))
+    return false;
+
+  if (name.compare(0, rule.prefix.size(), rule.prefix) != 0)
+    return false;
+
+  int day = (cct->_conf->rgw_lc_debug_interval > 0 ? cct->_conf->rgw_lc_debug_interval : 24 * 3600);
+  utime_t expiration = entry.meta.mtime;
+  expiration += utime_t((uint64_t)rule.expiration.days * day, 0);
+
+  return (expiration <= now);
+}
+
+int RGWLC::process_shard(BucketJob *job, int shard_id, const string& oid)
+{
+  uint32_t max_batch = MAX(cct->_conf->rgw_lc_max_batch, 1);
+  map<string, LCRule>::iterator riter;
+
+  for (riter = job->config.rules.begin(); riter != job->config.rules.end(); ++riter) {
+    LCRule& rule = riter->second;
+    if (!rule.is_enabled())
+      continue;
+
+    /* index keys of names that start with an underscore are escaped */
+    string filter = rule.prefix;
+    if (!filter.empty() && filter[0] == '_')
+      filter = "_" + filter;
+
+    cls_rgw_obj_key marker;
+    list<rgw_bucket_dir_entry> expired;
+    bool truncated;
+    do {
+      if (going_down() || (!job->end.is_zero() && ceph_clock_now(cct) >= job->end))
+        return 0;
+
+      map<int, string> oids;
+      oids[shard_id] = oid;
+      map<int, struct rgw_cls_list_ret> results;
+      int ret = CLSRGWIssueBucketList(job->index_ctx, marker, filter, LC_LIST_MAX, false, oids, results, 1)();
+      if (ret == -ENOENT) /* the shard was removed by a reshard */
+        return 0;
+      if (ret < 0)
+        return ret;
+
+      struct rgw_cls_list_ret& result = results[shard_id];
+      truncated = result.is_truncated;
+
+      map<string, struct rgw_bucket_dir_entry>::iterator iter;
+      for (iter = result.dir.m.begin(); iter != result.dir.m.end(); ++iter) {
+        rgw_bucket_dir_entry& entry = iter->second;
+        marker = entry.key;
+        if (!is_expired(rule, entry, job->now))
+          continue;
+
+        expired.push_back(entry);
+        if (expired.size() < max_batch)
+          continue;
+
+        uint64_t num_deleted;
+        ret = store->bulk_delete_objs(job->bucket_info, shard_id, expired, &num_deleted);
+        if (ret < 0)
+          return ret;
+        job->expired.add(num_deleted);
+        if (perfcounter)
+          perfcounter->inc(l_rgw_lc_expired, num_deleted);
+        expired.clear();
+      }
+    } while (truncated);
+
+    if (!expired.empty()) {
+      uint64_t num_deleted;
+      int ret = store->bulk_delete_objs(job->bucket_info, shard_id, expired, &num_deleted);
+      if (ret < 0)
+        return ret;
+      job->expired.add(num_deleted);
+      if (perfcounter)
+        perfcounter->inc(l_rgw_lc_expired, num_deleted);
+    }
+  }
+
+  return 0;
+}
+
+void *RGWLC::ShardProcessor::entry()
+{
+  int num_shards = job->shards.size();
+  while (!lc->going_down()) {
+    int i = job->next_shard.inc() - 1;
+    if (i >= num_shards)
+      break;
+    pair<int, string>& shard = job->shards[i];
+    int r = lc->process_shard(job, shard.first, shard.second);
+    if (r < 0) {
+      ldout(lc->cct, 0) << "ERROR: failed to expire objects of bucket index shard " << shard.second << " r=" << r << dendl;
+      if (ret == 0)
+        ret = r;
+    }
+  }
+  return NULL;
+}
+
+int RGWLC::process_bucket(const string& bucket_name, const utime_t& end, uint64_t *num_expired)
+{
+  BucketJob job;
+  map<string, bufferlist> attrs;
+
+  *num_expired = 0;
+
+  int ret = get_bucket_config(bucket_name, job.bucket_info, attrs, &job.config);
+  if (ret == -ENOENT) {
+    /* the bucket or its configuration is gone, stop tracking it */
+    ldout(cct, 5) << "lifecycle configuration of bucket " << bucket_name << " not found, unregistering" << dendl;
+    set<string> keys;
+    keys.insert(bucket_name);
+    ObjectWriteOperation op;
+    op.omap_rm_keys(keys);
+    store->gc_operate(obj_names[bucket_index(bucket_name)], &op);
+    return 0;
+  }
+  if (ret < 0)
+    return ret;
+
+  if (job.bucket_info.versioned()) {
+    ldout(cct, 5) << "skipping lifecycle of versioned bucket " << bucket_name << dendl;
+    return 0;
+  }
+  if (!job.config.has_enabled_rules())
+    return 0;
+
+  map<int, string> oids;
+  ret = store->open_bucket_index(job.bucket_info.bucket, job.index_ctx, oids);
+  if (ret < 0)
+    return ret;
+
+  for (map<int, string>::iterator iter = oids.begin(); iter != oids.end(); ++iter) {
+    job.shards.push_back(*iter);
+  }
+  job.now = ceph_clock_now(cct);
+  job.end = end;
+
+  int num_processors = cct->_conf->rgw_lc_max_concurrent_shards;
+  if (num_processors > (int)job.shards.size())
+    num_processors = job.shards.size();
+  if (num_processors < 1)
+    num_processors = 1;
+
+  vector<ShardProcessor *> processors;
+  for (int i = 0; i < num_processors; i++) {
+    ShardProcessor *processor = new ShardProcessor(this, &job);
+    processor->create();
+    processors.push_back(processor);
+  }
+
+  for (vector<ShardProcessor *>::iterator iter = processors.begin(); iter != processors.end(); ++iter) {
+    ShardProcessor *processor = *iter;
+    processor->join();
+    if (processor->get_ret() < 0 && ret == 0)
+      ret = processor->get_ret();
+    delete processor;
+  }
+
+  *num_expired = job.expired.read();
+  ldout(cct, 2) << "lifecycle: expired " << *num_expired << " objects of bucket " << bucket_name << dendl;
+
+  return ret;
+}
+
+int RGWLC::process_bucket(const string& bucket_name, uint64_t *num_expired)
+{
+  return process_bucket(bucket_name, utime_t(), num_expired);
+}
+
+int RGWLC::process(int index, int max_secs)
+{
+  rados::cls::lock::Lock l(lc_index_lock_name);
+  utime_t end = ceph_clock_now(cct);
+
+  /* see RGWGC::process(), a zero max_secs would hold the lock forever */
+  if (max_secs <= 0)
+    return -EAGAIN;
+
+  end += max_secs;
+  utime_t time(max_secs, 0);
+  l.set_duration(time);
+
+  int ret = l.lock_exclusive(&store->gc_pool_ctx, obj_names[index]);
+  if (ret == -EBUSY) { /* already locked by another lc processor */
+    dout(0) << "RGWLC::process() failed to acquire lock on " << obj_names[index] << dendl;
+    return 0;
+  }
+  if (ret < 0)
+    return ret;
+
+  string marker;
+  bool truncated;
+  do {
+    set<string> keys;
+    ret = store->gc_pool_ctx.omap_get_keys(obj_names[index], marker, LC_LIST_MAX, &keys);
+    if (ret < 0)
+      break;
+    truncated = (keys.size() == LC_LIST_MAX);
+
+    for (set<string>::iterator iter = keys.begin(); iter != keys.end(); ++iter) {
+      if (going_down() || ceph_clock_now(cct) >= end)
+        goto done;
+
+      marker = *iter;
+      uint64_t num_expired;
+      int r = process_bucket(*iter, end, &num_expired);
+      if (r < 0) {
+        ldout(cct, 0) << "ERROR: failed to process lifecycle of bucket " << *iter << " r=" << r << dendl;
+      }
+    }
+  } while (truncated);
+
+done:
+  l.unlock(&store->gc_pool_ctx, obj_names[index]);
+  if (ret == -ENOENT)
+    ret = 0;
+  return ret;
+}
+
+int RGWLC::process()
+{
+  int max_secs = cct->_conf->rgw_lc_processor_max_time;
+
+  unsigned start;
+  int ret = get_random_bytes((char *)&start, sizeof(start));
+  if (ret < 0)
+    return ret;
+
+  for (int i = 0; i < max_objs && !going_down(); i++) {
+    int index = (i + start) % max_objs;
+    ret = process(index, max_secs);
+    if (ret < 0)
+      return ret;
+  }
+
+  return 0;
+}
+
+bool RGWLC::going_down()
+{
+  return (down_flag.read() != 0);
+}
+
+void RGWLC::start_processor()
+{
+  worker = new LCWorker(cct, this);
+  worker->create();
+}
+
+void RGWLC::stop_processor()
+{
+  down_flag.set(1);
+  if (worker) {
+    worker->stop();
+    worker->join();
+  }
+  delete worker;
+  worker = NULL;
+}
+
+void *RGWLC::LCWorker::entry() {
+  do {
+    utime_t start = ceph_clock_now(cct);
+    dout(2) << "lifecycle: start" << dendl;
+    int r = lc->process();
+    if (r < 0) {
+      dout(0) << "ERROR: lifecycle process() returned error r=" << r << dendl;
+    }
+    dout(2) << "lifecycle: stop" << dendl;
+
+    if (lc->going_down())
+      break;
+
+    utime_t end = ceph_clock_now(cct);
+    end -= start;
+    int secs = cct->_conf->rgw_lc_processor_period;
+
+    if (secs <= end.sec())
+      continue; // next round
+
+    secs -= end.sec();
+
+    lock.Lock();
+    cond.WaitInterval(cct, lock, utime_t(secs, 0));
+    lock.Unlock();
+  } while (!lc->going_down());
+
+  return NULL;
+}
+
+void RGWLC::LCWorker::stop()
+{
+  Mutex::Locker l(lock);
+  cond.Signal();
+}
@@ -0,0 +1,184 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_RGW_LC_H
+#define CEPH_RGW_LC_H
+
+#include <map>
+#include <string>
+
+#include "include/types.h"
+#include "include/atomic.h"
+#include "include/rados/librados.hpp"
+#include "common/Mutex.h"
+#include "common/Cond.h"
+#include "common/Thread.h"
+#include "common/Formatter.h"
+#include "rgw_common.h"
+#include "rgw_rados.h"
+
+class JSONObj;
+
+struct LCExpiration {
+  int days;
+
+  LCExpiration() : days(0) {}
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(days, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::iterator& bl) {
+    DECODE_START(1, bl);
+    ::decode(days, bl);
+    DECODE_FINISH(bl);
+  }
+  void dump(Formatter *f) const;
+  void decode_json(JSONObj *obj);
+};
+WRITE_CLASS_ENCODER(LCExpiration)
+
+struct LCRule {
+  string id;
+  string prefix;
+  string status;
+  LCExpiration expiration;
+
+  bool is_enabled() const { return status == "Enabled"; }
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(id, bl);
+    ::encode(prefix, bl);
+    ::encode(status, bl);
+    ::encode(expiration, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::iterator& bl) {
+    DECODE_START(1, bl);
+    ::decode(id, bl);
+    ::decode(prefix, bl);
+    ::decode(status, bl);
+    ::decode(expiration, bl);
+    DECODE_FINISH(bl);
+  }
+  void dump(Formatter *f) const;
+  void decode_json(JSONObj *obj);
+};
+WRITE_CLASS_ENCODER(LCRule)
+
+/*
+ * The lifecycle configuration of a bucket, kept in the RGW_ATTR_LC attr of
+ * the bucket instance. Only expiration of current objects is supported.
+ */
+struct RGWLifecycleConfiguration {
+  map<string, LCRule> rules;
+
+  /* returns -EINVAL if a rule is invalid or rule ids are duplicated */
+  int add_rule(const LCRule& rule);
+  bool has_enabled_rules() const;
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(rules, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::iterator& bl) {
+    DECODE_START(1, bl);
+    ::decode(rules, bl);
+    DECODE_FINISH(bl);
+  }
+  void dump(Formatter *f) const;
+  void decode_json(JSONObj *obj);
+};
+WRITE_CLASS_ENCODER(RGWLifecycleConfiguration)
+
+/*
+ * Applies the expiration rules of buckets in the background.
+ *
+ * Buckets that have a lifecycle configuration are registered in one of
+ * rgw_lc_max_objs lc shard objects. Every pass takes each lc shard in turn
+ * and, for every bucket registered in it, lists the bucket index shards in
+ * parallel and removes the expired objects in batches, with a single index
+ * operation per batch and index shard (see RGWRados::bulk_delete_objs()).
+ */
+class RGWLC {
+  CephContext *cct;
+  RGWRados *store;
+  int max_objs;
+  string *obj_names;
+  atomic_t down_flag;
+
+  struct BucketJob {
+    RGWBucketInfo bucket_info;
+    RGWLifecycleConfiguration config;
+    librados::IoCtx index_ctx;
+    vector<pair<int, string> > shards;
+    utime_t now;
+    utime_t end;
+    atomic_t next_shard;
+    atomic64_t expired;
+  };
+
+  /* processes the index shards of a bucket, picking them off the job */
+  class ShardProcessor : public Thread {
+    RGWLC *lc;
+    BucketJob *job;
+    int ret;
+
+  public:
+    ShardProcessor(RGWLC *_lc, BucketJob *_job) : lc(_lc), job(_job), ret(0) {}
+    void *entry();
+    int get_ret() { return ret; }
+  };
+
+  class LCWorker : public Thread {
+    CephContext *cct;
+    RGWLC *lc;
+    Mutex lock;
+    Cond cond;
+
+  public:
+    LCWorker(CephContext *_cct, RGWLC *_lc) : cct(_cct), lc(_lc), lock("LCWorker") {}
+    void *entry();
+    void stop();
+  };
+
+  LCWorker *worker;
+
+  int bucket_index(const string& bucket_name);
+  int process_shard(BucketJob *job, int shard_id, const string& oid);
+  int process_bucket(const string& bucket_name, const utime_t& end, uint64_t *num_expired);
+  int process(int index, int max_secs);
+
+public:
+  RGWLC() : cct(NULL), store(NULL), max_objs(0), obj_names(NULL), worker(NULL) {}
+  ~RGWLC() {
+    stop_processor();
+    finalize();
+  }
+
+  void initialize(CephContext *_cct, RGWRados *_store);
+  void finalize();
+
+  bool is_expired(const LCRule& rule, const rgw_bucket_dir_entry& entry, const utime_t& now);
+
+  int get_bucket_config(const string& bucket_name, RGWBucketInfo& bucket_info,
+                        map<string, bufferlist>& attrs, RGWLifecycleConfiguration *config);
+  int set_bucket_config(RGWBucketInfo& bucket_info, RGWLifecycleConfiguration& config);
+  int remove_bucket_config(RGWBucketInfo& bucket_info, map<string, bufferlist>& attrs);
+
+  void list_init(int *index) { *index = 0; }
+  int list_buckets(int *index, string& marker, uint32_t max, list<string>& result, bool *truncated);
+
+  /* apply the rules of a single bucket, returns the number of objects removed */
+  int process_bucket(const string& bucket_name, uint64_t *num_expired);
+  int process();
+
+  bool going_down();
+  void start_processor();
+  void stop_processor();
+};
+
+#endif
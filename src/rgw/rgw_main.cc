@@ -59,6 +59,7 @@
 #include "rgw_loadgen.h"
 #include "rgw_civetweb.h"
 #include "rgw_civetweb_log.h"
+#include "rgw_async_frontend.h"
 
 #include "civetweb/civetweb.h"
 
@@ -382,6 +383,7 @@ public:
   void checkpoint();
   void handle_request(RGWRequest *req);
   void gen_request(const string& method, const string& resource, int content_length, atomic_t *fail_flag);
+  void report(const char *phase, int num_ops, utime_t start);
 
   void set_access_key(RGWAccessKey& key) { access_key = key; }
 };
@@ -391,6 +393,14 @@ void RGWLoadGenProcess::checkpoint()
   m_tp.drain(&req_wq);
 }
 
+void RGWLoadGenProcess::report(const char *phase, int num_ops, utime_t start)
+{
+  utime_t elapsed = ceph_clock_now(g_ceph_context) - start;
+  double secs = (double)elapsed;
+  dout(0) << "loadgen: " << phase << ": " << num_ops << " ops in " << elapsed << " secs ("
+          << (secs > 0 ? num_ops / secs : 0) << " ops/sec)" << dendl;
+}
+
 void RGWLoadGenProcess::run()
 {
   m_tp.start(); /* start thread pool */
@@ -404,6 +414,11 @@ void RGWLoadGenProcess::run()
   int num_buckets;
   conf->get_val("num_buckets", 1, &num_buckets);
 
+  int obj_size;
+  conf->get_val("obj_size", 4096, &obj_size);
+
+  utime_t start;
+
   vector<string> buckets(num_buckets);
 
   atomic_t failed;
@@ -432,28 +447,34 @@ void RGWLoadGenProcess::run()
     objs[i] = buckets[i % num_buckets] + "/" + buf;
   }
 
+  start = ceph_clock_now(g_ceph_context);
   for (i = 0; i < num_objs; i++) {
-    gen_request("PUT", objs[i], 4096, &failed);
+    gen_request("PUT", objs[i], obj_size, &failed);
   }
 
   checkpoint();
+  report("put", num_objs, start);
 
   if (failed.read()) {
     derr << "ERROR: bucket creation failed" << dendl;
     goto done;
   }
 
+  start = ceph_clock_now(g_ceph_context);
   for (i = 0; i < num_objs; i++) {
-    gen_request("GET", objs[i], 4096, NULL);
+    gen_request("GET", objs[i], obj_size, NULL);
   }
 
   checkpoint();
+  report("get", num_objs, start);
 
+  start = ceph_clock_now(g_ceph_context);
   for (i = 0; i < num_objs; i++) {
     gen_request("DELETE", objs[i], 0, NULL);
   }
 
   checkpoint();
+  report("delete", num_objs, start);
 
   for (i = 0; i < num_buckets; i++) {
     gen_request("DELETE", buckets[i], 0, NULL);
@@ -478,6 +499,71 @@ void RGWLoadGenProcess::gen_request(const string& method, const string& resource
   req_wq.queue(req);
 }
 
+struct RGWAsyncRequest : public RGWRequest {
+  RGWAsyncConnection *conn;
+
+  RGWAsyncRequest(uint64_t req_id, RGWAsyncConnection *_conn) : RGWRequest(req_id), conn(_conn) {}
+};
+
+/*
+ * Request threads of the event driven frontend: the reactor threads read the
+ * requests and queue them once they are ready to be processed.
+ */
+class RGWAsyncProcess : public RGWProcess, public RGWAsyncServer::Dispatcher {
+  RGWAsyncServer::Config server_conf;
+  Mutex lock;
+  Cond cond;
+  bool stopping;
+public:
+  RGWAsyncProcess(CephContext *cct, RGWProcessEnv *pe, int num_threads, RGWFrontendConfig *_conf,
+                  const RGWAsyncServer::Config& _server_conf) :
+    RGWProcess(cct, pe, num_threads, _conf), server_conf(_server_conf),
+    lock("RGWAsyncProcess::lock"), stopping(false) {}
+  void run();
+  void stop();
+  void dispatch(RGWAsyncConnection *conn);
+  void handle_request(RGWRequest *req);
+};
+
+void RGWAsyncProcess::run()
+{
+  RGWAsyncServer server(g_ceph_context, this, server_conf);
+  int r = server.init();
+  if (r < 0) {
+    derr << "ERROR: failed to start async frontend on port " << server_conf.port << ": " << cpp_strerror(-r) << dendl;
+    return;
+  }
+
+  m_tp.start(); /* start thread pool */
+  server.start();
+
+  lock.Lock();
+  while (!stopping)
+    cond.Wait(lock);
+  lock.Unlock();
+
+  server.stop_accepting();
+  m_tp.drain(&req_wq);
+  m_tp.stop();
+  server.stop();
+}
+
+void RGWAsyncProcess::stop()
+{
+  Mutex::Locker l(lock);
+  stopping = true;
+  cond.Signal();
+}
+
+void RGWAsyncProcess::dispatch(RGWAsyncConnection *conn)
+{
+  RGWAsyncRequest *req = new RGWAsyncRequest(store->get_new_req_id(), conn);
+  dout(10) << "allocated request req=" << hex << req << dec << dendl;
+  /* the reactor must not block, the number of connections is bounded anyway */
+  req_throttle.take(1);
+  req_wq.queue(req);
+}
+
 static void signal_shutdown()
 {
   if (!disable_signal_fd.read()) {
@@ -708,6 +794,20 @@ void RGWLoadGenProcess::handle_request(RGWRequest *r)
   delete req;
 }
 
+void RGWAsyncProcess::handle_request(RGWRequest *r)
+{
+  RGWAsyncRequest *req = static_cast<RGWAsyncRequest *>(r);
+  RGWAsyncClientIO client_io(req->conn, server_conf.port);
+
+  int ret = process_request(store, rest, req, &client_io, olog);
+  if (ret < 0) {
+    /* we don't really care about return code */
+    dout(20) << "process_request() returned " << ret << dendl;
+  }
+
+  delete req;
+}
+
 
 static int civetweb_callback(struct mg_connection *conn) {
   struct mg_request_info *req_info = mg_get_request_info(conn);
@@ -945,6 +1045,39 @@ public:
   }
 };
 
+class RGWAsyncFrontend : public RGWProcessFrontend {
+public:
+  RGWAsyncFrontend(RGWProcessEnv& pe, RGWFrontendConfig *_conf) : RGWProcessFrontend(pe, _conf) {}
+
+  int init() {
+    RGWAsyncServer::Config server_conf;
+    int val;
+
+    conf->get_val("host", "", &server_conf.host);
+    conf->get_val("port", 80, &server_conf.port);
+    conf->get_val("reactor_threads", 1, &server_conf.num_reactors);
+    conf->get_val("max_connections", 10000, &server_conf.max_connections);
+    conf->get_val("buffer_size", 1 << 20, &val);
+    server_conf.buffer_size = val;
+    conf->get_val("idle_timeout", 60, &server_conf.idle_timeout);
+
+    if (server_conf.num_reactors < 1 || server_conf.max_connections < 1 ||
+        val < 4096 || server_conf.idle_timeout < 1) {
+      derr << "ERROR: invalid async frontend configuration" << dendl;
+      return -EINVAL;
+    }
+
+    int num_threads;
+    conf->get_val("num_threads", g_conf->rgw_thread_pool_size, &num_threads);
+    pprocess = new RGWAsyncProcess(g_ceph_context, &env, num_threads, conf, server_conf);
+    return 0;
+  }
+
+  void stop() {
+    static_cast<RGWAsyncProcess *>(pprocess)->stop();
+  }
+};
+
 class RGWMongooseFrontend : public RGWFrontend {
   RGWFrontendConfig *conf;
   struct mg_context *ctx;
@@ -1194,6 +1327,13 @@ int main(int argc, const char **argv)
       RGWProcessEnv env = { store, &rest, olog, port };
 
       fe = new RGWMongooseFrontend(env, config);
+    } else if (framework == "async") {
+      int port;
+      config->get_val("port", 80, &port);
+
+      RGWProcessEnv env = { store, &rest, olog, port };
+
+      fe = new RGWAsyncFrontend(env, config);
     } else if (framework == "loadgen") {
       int port;
       config->get_val("port", 80, &port);
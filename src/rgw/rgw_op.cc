@@ -1237,9 +1237,10 @@ void RGWListBucket::execute()
   list_op.params.marker = marker;
   list_op.params.end_marker = end_marker;
   list_op.params.list_versions = list_versions;
+  list_op.params.allow_unordered = allow_unordered;
 
   ret = list_op.list_objects(max, &objs, &common_prefixes, &is_truncated);
-  if (ret >= 0 && !delimiter.empty()) {
+  if (ret >= 0 && (!delimiter.empty() || allow_unordered)) {
     next_marker = list_op.get_next_marker();
   }
 }
@@ -3066,6 +3067,84 @@ static int list_multipart_parts(RGWRados *store, struct req_state *s,
   return 0;
 }
 
+/*
+ * Read the info of the parts a multipart upload is being completed with.
+ * For uploads whose part keys are sorted, the part keys are read in
+ * batches that are all fetched in parallel: batch i is made of the keys
+ * following the last part of batch i - 1, so it's enough to check that
+ * each batch holds exactly the parts that were requested (and that nothing
+ * follows the last one) to know that the upload is made of the requested
+ * parts only.
+ *
+ * Returns -EAGAIN if the uploaded parts don't match the requested ones; the
+ * caller should then go through the parts with list_multipart_parts(),
+ * which handles the unsorted keys written by older gateways and reports
+ * the exact error.
+ */
+static int read_complete_multipart_parts(RGWRados *store, struct req_state *s,
+                                         const string& upload_id, const string& meta_oid,
+                                         const map<int, string>& requested,
+                                         map<uint32_t, RGWUploadPartInfo>& parts)
+{
+  const size_t batch_size = 1000;
+
+  if (!is_v2_upload_id(upload_id) || requested.empty())
+    return -EAGAIN;
+
+  vector<int> nums;
+  for (map<int, string>::const_iterator iter = requested.begin(); iter != requested.end(); ++iter) {
+    if (iter->first <= 0)
+      return -EAGAIN;
+    nums.push_back(iter->first);
+  }
+
+  vector<pair<string, uint64_t> > ranges;
+  for (size_t i = 0; i < nums.size(); i += batch_size) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "part.%08d", (i == 0 ? 0 : nums[i - 1]));
+    uint64_t count = MIN(batch_size, nums.size() - i);
+    if (i + count == nums.size())
+      count++; /* make sure nothing follows the last part */
+    ranges.push_back(make_pair(string(buf), count));
+  }
+
+  rgw_obj obj;
+  obj.init_ns(s->bucket, meta_oid, mp_ns);
+  obj.set_in_extra_data(true);
+
+  vector<map<string, bufferlist> > results;
+  int ret = store->omap_get_vals_ranges(obj, ranges, s->cct->_conf->rgw_multipart_complete_max_aio, results);
+  if (ret < 0)
+    return ret;
+
+  parts.clear();
+
+  size_t n = 0;
+  for (vector<map<string, bufferlist> >::iterator riter = results.begin(); riter != results.end(); ++riter) {
+    for (map<string, bufferlist>::iterator iter = riter->begin(); iter != riter->end(); ++iter, ++n) {
+      if (n >= nums.size())
+        return -EAGAIN;
+
+      RGWUploadPartInfo info;
+      bufferlist::iterator bli = iter->second.begin();
+      try {
+        ::decode(info, bli);
+      } catch (buffer::error& err) {
+        ldout(s->cct, 0) << "ERROR: could not part info, caught buffer::error" << dendl;
+        return -EIO;
+      }
+      if ((int)info.num != nums[n])
+        return -EAGAIN;
+
+      parts[info.num] = info;
+    }
+  }
+  if (n != nums.size())
+    return -EAGAIN;
+
+  return 0;
+}
+
 int RGWCompleteMultipart::verify_permission()
 {
   if (!verify_bucket_permission(s, RGW_PERM_WRITE))
@@ -3143,6 +3222,7 @@ void RGWCompleteMultipart::execute()
   int max_parts = 1000;
   int marker = 0;
   bool truncated;
+  bool have_parts = false;
 
   uint64_t min_part_size = s->cct->_conf->rgw_multipart_min_part_size;
 
@@ -3162,8 +3242,25 @@ void RGWCompleteMultipart::execute()
     return;
   }
 
+  ret = read_complete_multipart_parts(store, s, upload_id, meta_oid, parts->parts, obj_parts);
+  if (ret == 0) {
+    have_parts = true;
+  } else if (ret == -EAGAIN) {
+    /* go through the uploaded parts in one pass, unsorted parts are read as a whole anyway */
+    max_parts = parts->parts.size() + 1;
+  } else {
+    if (ret == -ENOENT) {
+      ret = -ERR_NO_SUCH_UPLOAD;
+    }
+    return;
+  }
+
   do {
-    ret = list_multipart_parts(store, s, upload_id, meta_oid, max_parts, marker, obj_parts, &marker, &truncated);
+    if (have_parts) {
+      truncated = false;
+    } else {
+      ret = list_multipart_parts(store, s, upload_id, meta_oid, max_parts, marker, obj_parts, &marker, &truncated);
+    }
     if (ret == -ENOENT) {
       ret = -ERR_NO_SUCH_UPLOAD;
     }
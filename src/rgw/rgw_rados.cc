@@ -47,11 +47,11 @@ using namespace librados;
 #include "rgw_log.h"
 
 #include "rgw_gc.h"
+#include "rgw_reshard.h"
+#include "rgw_lc.h"
 
 #define dout_subsys ceph_subsys_rgw
 
-#define MAX_BUCKET_INDEX_SHARDS_PRIME 7877
-
 using namespace std;
 
 static RGWCache<RGWRados> cached_rados_provider;
@@ -1428,8 +1428,275 @@ int RGWRados::get_max_chunk_size(rgw_bucket& bucket, uint64_t *max_chunk_size)
   return 0;
 }
 
+/*
+ * Groups the completions of bucket index operations per index shard.
+ *
+ * At most one completion call is in flight for each shard. Completions that
+ * arrive while it is in flight are queued and sent together, with a single
+ * bucket_complete_ops call (and a single omap transaction) per batch, once
+ * the call in flight returns. As before, callers don't wait for completions.
+ *
+ * Completions that a shard refuses because the bucket index was resharded
+ * are sent again to the shards of the new index.
+ */
+class RGWIndexCompletionManager {
+  RGWRados *store;
+  CephContext *cct;
+  Mutex lock;
+  Cond cond;
+  atomic_t disabled;
+  int num_in_flight;
+
+  struct Batch {
+    list<rgw_cls_obj_complete_op> ops;
+    set<cls_rgw_obj_key> keys;
+
+    /* a batch can't hold the same key twice, and ops that remove other
+     * entries (multipart completions) are sent on their own */
+    bool can_add(const rgw_cls_obj_complete_op& op, size_t max) const {
+      if (ops.empty())
+        return true;
+      return ops.size() < max && keys.count(op.key) == 0 &&
+             op.remove_objs.empty() && ops.front().remove_objs.empty();
+    }
+    void add(const rgw_cls_obj_complete_op& op) {
+      ops.push_back(op);
+      keys.insert(op.key);
+    }
+  };
+
+  /* the pending batches of the shards that have a call in flight */
+  map<string, list<Batch> > shards;
+
+  struct Request {
+    RGWIndexCompletionManager *manager;
+    librados::IoCtx ioctx;
+    string oid;
+    string shard;
+    rgw_bucket bucket;
+    bool batched;
+    int retries;
+    list<rgw_cls_obj_complete_op> ops;
+  };
+
+  struct C_Resend : public Context {
+    RGWIndexCompletionManager *manager;
+    string oid;
+    rgw_bucket bucket;
+    int retries;
+    list<rgw_cls_obj_complete_op> ops;
+
+    C_Resend(RGWIndexCompletionManager *_manager, Request *req)
+      : manager(_manager), oid(req->oid), bucket(req->bucket), retries(req->retries + 1) {
+      ops.swap(req->ops);
+    }
+    void finish(int r) {
+      manager->resend(oid, bucket, ops, retries);
+    }
+  };
+
+  static void completion_cb(completion_t c, void *arg) {
+    Request *req = (Request *)arg;
+    req->manager->handle_completion(req, rados_aio_get_return_value(c));
+  }
+
+  /* lock should be held */
+  int send(librados::IoCtx& ioctx, const string& oid, const string& shard, rgw_bucket& bucket,
+           list<rgw_cls_obj_complete_op>& ops, bool batched, int retries = 0) {
+    Request *req = new Request;
+    req->manager = this;
+    req->ioctx = ioctx;
+    req->oid = oid;
+    req->shard = shard;
+    req->bucket = bucket;
+    req->batched = batched;
+    req->retries = retries;
+    req->ops.swap(ops);
+
+    ObjectWriteOperation o;
+    /* don't recreate an index shard that was removed by a reshard */
+    o.assert_exists();
+    if (req->ops.size() == 1) {
+      cls_rgw_bucket_complete_op(o, req->ops.front());
+    } else {
+      cls_rgw_bucket_complete_ops(o, req->ops);
+    }
+
+    AioCompletion *c = librados::Rados::aio_create_completion(req, completion_cb, NULL);
+    int r = req->ioctx.aio_operate(oid, c, &o);
+    c->release();
+    if (r < 0) {
+      delete req;
+      return r;
+    }
+    ++num_in_flight;
+    return 0;
+  }
+
+  /* lock should be held */
+  void send_singly(librados::IoCtx& ioctx, const string& oid, const string& shard, rgw_bucket& bucket,
+                   list<rgw_cls_obj_complete_op>& ops) {
+    for (list<rgw_cls_obj_complete_op>::iterator iter = ops.begin(); iter != ops.end(); ++iter) {
+      list<rgw_cls_obj_complete_op> single;
+      single.push_back(*iter);
+      int r = send(ioctx, oid, shard, bucket, single, false);
+      if (r < 0) {
+        ldout(cct, 0) << "ERROR: failed to send bucket index completion to " << oid << ": r=" << r << dendl;
+      }
+    }
+  }
+
+  void handle_completion(Request *req, int r) {
+    Mutex::Locker l(lock);
+
+    if (r == -EOPNOTSUPP && req->ops.size() > 1) {
+      if (!disabled.read()) {
+        ldout(cct, 0) << "WARNING: osds don't support bucket_complete_ops, completing bucket index operations one by one" << dendl;
+        disabled.set(1);
+      }
+      send_singly(req->ioctx, req->oid, req->shard, req->bucket, req->ops);
+    } else if ((r == -ERR_BUSY_RESHARDING || r == -ENOENT) &&
+               req->retries < RGW_INDEX_RESHARD_RETRIES) {
+      /* the shard may have been retired by a reshard (or removed after it),
+       * look up the new shards outside of the librados callback */
+      ++num_in_flight;
+      store->finisher->queue(new C_Resend(this, req));
+    } else if (r < 0 && req->ops.size() > 1) {
+      /* the osd dropped the whole batch, try each op on its own */
+      ldout(cct, 5) << "bucket index completion of " << req->ops.size() << " ops on " << req->oid << " returned r=" << r
+                    << ", completing them one by one" << dendl;
+      send_singly(req->ioctx, req->oid, req->shard, req->bucket, req->ops);
+    } else if (r < 0) {
+      ldout(cct, 5) << "bucket index completion on " << req->oid << " returned r=" << r << dendl;
+    }
+
+    if (req->batched) {
+      map<string, list<Batch> >::iterator iter = shards.find(req->shard);
+      assert(iter != shards.end());
+      list<Batch>& pending = iter->second;
+      bool sent = false;
+      while (!pending.empty() && !sent) {
+        list<rgw_cls_obj_complete_op> ops;
+        ops.swap(pending.front().ops);
+        pending.pop_front();
+        if (disabled.read()) {
+          send_singly(req->ioctx, req->oid, req->shard, req->bucket, ops);
+          continue;
+        }
+        size_t num = ops.size();
+        int ret = send(req->ioctx, req->oid, req->shard, req->bucket, ops, true);
+        if (ret < 0) {
+          ldout(cct, 0) << "ERROR: failed to send " << num << " bucket index completions to " << req->oid << ": r=" << ret << dendl;
+          continue;
+        }
+        sent = true;
+      }
+      if (!sent) {
+        shards.erase(iter);
+      }
+    }
+
+    if (--num_in_flight == 0) {
+      cond.Signal();
+    }
+    delete req;
+  }
+
+  /*
+   * Send completions that old_oid refused again, one by one, to the shards
+   * their keys map to now.
+   */
+  void resend(const string& old_oid, rgw_bucket& bucket, list<rgw_cls_obj_complete_op>& ops, int retries) {
+    store->invalidate_bucket_instance_info(bucket);
+
+    list<pair<string, rgw_cls_obj_complete_op> > resend_ops;
+    librados::IoCtx ioctx;
+    for (list<rgw_cls_obj_complete_op>::iterator iter = ops.begin(); iter != ops.end(); ++iter) {
+      string oid;
+      int shard_id;
+      int r = store->open_bucket_index_shard(bucket, ioctx, RGWRados::get_bucket_index_hash_source(iter->key.name),
+                                             &oid, &shard_id);
+      if (r < 0) {
+        ldout(cct, 0) << "ERROR: failed to find the bucket index shard of " << iter->key.name << ": r=" << r << dendl;
+        continue;
+      }
+      if (oid == old_oid) {
+        /* not resharded, the completion failed on its own */
+        ldout(cct, 5) << "bucket index completion of " << iter->key.name << " on " << oid << " failed" << dendl;
+        continue;
+      }
+      resend_ops.push_back(make_pair(oid, *iter));
+    }
+
+    Mutex::Locker l(lock);
+    list<pair<string, rgw_cls_obj_complete_op> >::iterator iter;
+    for (iter = resend_ops.begin(); iter != resend_ops.end(); ++iter) {
+      ldout(cct, 10) << "bucket index of " << bucket << " was resharded, completing " << iter->second.key.name
+                     << " on " << iter->first << dendl;
+      list<rgw_cls_obj_complete_op> single;
+      single.push_back(iter->second);
+      int r = send(ioctx, iter->first, string(), bucket, single, false, retries);
+      if (r < 0) {
+        ldout(cct, 0) << "ERROR: failed to send bucket index completion to " << iter->first << ": r=" << r << dendl;
+      }
+    }
+    if (--num_in_flight == 0) {
+      cond.Signal();
+    }
+  }
+
+public:
+  RGWIndexCompletionManager(RGWRados *_store) : store(_store), cct(_store->ctx()),
+                                                lock("RGWIndexCompletionManager"), num_in_flight(0) {}
+
+  int complete(librados::IoCtx& ioctx, const string& oid, rgw_bucket& bucket, const rgw_cls_obj_complete_op& op) {
+    Mutex::Locker l(lock);
+
+    list<rgw_cls_obj_complete_op> ops;
+    ops.push_back(op);
+
+    int max_batch = cct->_conf->rgw_bucket_index_complete_batch;
+    if (disabled.read() || max_batch <= 1) {
+      return send(ioctx, oid, string(), bucket, ops, false);
+    }
+
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lld:", (long long)ioctx.get_id());
+    string shard = buf + oid;
+
+    map<string, list<Batch> >::iterator iter = shards.find(shard);
+    if (iter == shards.end()) {
+      int r = send(ioctx, oid, shard, bucket, ops, true);
+      if (r < 0)
+        return r;
+      shards[shard];
+      return 0;
+    }
+
+    list<Batch>& pending = iter->second;
+    if (pending.empty() || !pending.back().can_add(op, max_batch)) {
+      pending.push_back(Batch());
+    }
+    pending.back().add(op);
+    return 0;
+  }
+
+  /* wait for all the completions that were sent or queued */
+  void drain() {
+    Mutex::Locker l(lock);
+    while (num_in_flight > 0) {
+      cond.Wait(lock);
+    }
+  }
+};
+
 void RGWRados::finalize()
 {
+  if (index_completion_manager) {
+    index_completion_manager->drain();
+    delete index_completion_manager;
+    index_completion_manager = NULL;
+  }
   if (finisher) {
     finisher->stop();
     delete finisher;
@@ -1444,6 +1711,16 @@ void RGWRados::finalize()
     delete gc;
     gc = NULL;
   }
+  if (reshard) {
+    reshard->stop_processor();
+    delete reshard;
+    reshard = NULL;
+  }
+  if (lc) {
+    lc->stop_processor();
+    delete lc;
+    lc = NULL;
+  }
   delete rest_master_conn;
 
   map<string, RGWRESTConn *>::iterator iter;
@@ -1615,6 +1892,19 @@ int RGWRados::init_complete()
   if (use_gc_thread)
     gc->start_processor();
 
+  if (use_gc_thread && cct->_conf->rgw_dynamic_resharding) {
+    reshard = new RGWReshard(cct, this);
+    reshard->start_processor();
+  }
+
+  lc = new RGWLC();
+  lc->initialize(cct, this);
+
+  index_completion_manager = new RGWIndexCompletionManager(this);
+
+  if (use_gc_thread && cct->_conf->rgw_enable_lc_threads)
+    lc->start_processor();
+
   quota_handler = RGWQuotaHandler::generate_handler(this, quota_threads);
 
   bucket_index_max_shards = (cct->_conf->rgw_override_bucket_index_max_shards ? cct->_conf->rgw_override_bucket_index_max_shards :
@@ -2398,6 +2688,20 @@ int rgw_policy_from_attrset(CephContext *cct, map<string, bufferlist>& attrset,
 int RGWRados::Bucket::List::list_objects(int max, vector<RGWObjEnt> *result,
                                          map<string, bool> *common_prefixes,
                                          bool *is_truncated)
+{
+  if (params.allow_unordered) {
+    /* common prefixes and end markers only make sense in a sorted listing */
+    if (!params.delim.empty() || !params.end_marker.empty()) {
+      return -EINVAL;
+    }
+    return list_objects_unordered(max, result, is_truncated);
+  }
+  return list_objects_ordered(max, result, common_prefixes, is_truncated);
+}
+
+int RGWRados::Bucket::List::list_objects_ordered(int max, vector<RGWObjEnt> *result,
+                                                 map<string, bool> *common_prefixes,
+                                                 bool *is_truncated)
 {
   RGWRados *store = target->get_store();
   CephContext *cct = store->ctx();
@@ -2458,6 +2762,9 @@ int RGWRados::Bucket::List::list_objects(int max, vector<RGWObjEnt> *result,
     }
   }
 
+  /* entries read ahead from the index shards for the next round */
+  RGWBucketListShards list_shards;
+
   while (truncated && count <= max) {
     if (skip_after_delim > cur_marker.name) {
       cur_marker.set(skip_after_delim);
@@ -2465,7 +2772,7 @@ int RGWRados::Bucket::List::list_objects(int max, vector<RGWObjEnt> *result,
     }
     std::map<string, RGWObjEnt> ent_map;
     int r = store->cls_bucket_list(bucket, cur_marker, cur_prefix, max + 1 - count, params.list_versions, ent_map,
-                            &truncated, &cur_marker);
+                            &truncated, &cur_marker, NULL, &list_shards);
     if (r < 0)
       return r;
 
@@ -2565,6 +2872,84 @@ done:
   return 0;
 }
 
+int RGWRados::Bucket::List::list_objects_unordered(int max, vector<RGWObjEnt> *result,
+                                                   bool *is_truncated)
+{
+  RGWRados *store = target->get_store();
+  CephContext *cct = store->ctx();
+  rgw_bucket& bucket = target->get_bucket();
+
+  int count = 0;
+  bool truncated = true;
+
+  if (store->bucket_is_system(bucket)) {
+    return -EINVAL;
+  }
+  result->clear();
+
+  rgw_obj marker_obj, prefix_obj;
+  marker_obj.set_instance(params.marker.instance);
+  marker_obj.set_ns(params.ns);
+  marker_obj.set_obj(params.marker.name);
+  rgw_obj_key cur_marker;
+  marker_obj.get_index_key(&cur_marker);
+
+  prefix_obj.set_ns(params.ns);
+  prefix_obj.set_obj(params.prefix);
+  string cur_prefix = prefix_obj.get_index_key_name();
+
+  while (truncated && count < max) {
+    vector<RGWObjEnt> ent_list;
+    int r = store->cls_bucket_list_unordered(bucket, cur_marker, cur_prefix, max - count, params.list_versions,
+                                             ent_list, &truncated, &cur_marker);
+    if (r < 0)
+      return r;
+
+    vector<RGWObjEnt>::iterator eiter;
+    for (eiter = ent_list.begin(); eiter != ent_list.end(); ++eiter) {
+      rgw_obj_key obj = eiter->key;
+      RGWObjEnt& entry = *eiter;
+      rgw_obj_key key = obj;
+      string instance;
+      string ns;
+
+      bool valid = rgw_obj::parse_raw_oid(obj.name, &obj.name, &instance, &ns);
+      if (!valid) {
+        ldout(cct, 0) << "ERROR: could not parse object name: " << obj.name << dendl;
+        continue;
+      }
+      if (!params.list_versions && !entry.is_visible()) {
+        continue;
+      }
+
+      /* the listing isn't sorted, skip whatever is in other namespaces */
+      if (params.enforce_ns && ns != params.ns) {
+        continue;
+      }
+
+      params.marker = obj;
+      next_marker = obj;
+
+      if (params.filter && !params.filter->filter(obj.name, key.name))
+        continue;
+
+      if (params.prefix.size() &&  (obj.name.compare(0, params.prefix.size(), params.prefix) != 0))
+        continue;
+
+      RGWObjEnt ent = entry;
+      ent.key = obj;
+      ent.ns = ns;
+      result->push_back(ent);
+      count++;
+    }
+  }
+
+  if (is_truncated)
+    *is_truncated = truncated;
+
+  return 0;
+}
+
 /**
  * create a rados pool, associated meta info
  * returns 0 on success, -ERR# otherwise.
@@ -2593,7 +2978,7 @@ int RGWRados::create_pool(rgw_bucket& bucket)
   return 0;
 }
 
-int RGWRados::init_bucket_index(rgw_bucket& bucket, int num_shards)
+int RGWRados::init_bucket_index(rgw_bucket& bucket, int num_shards, uint32_t index_gen)
 {
   librados::IoCtx index_ctx; // context for new bucket
 
@@ -2601,8 +2986,8 @@ int RGWRados::init_bucket_index(rgw_bucket& bucket, int num_shards)
   if (r < 0)
     return r;
 
-  string dir_oid =  dir_oid_prefix;
-  dir_oid.append(bucket.marker);
+  string dir_oid;
+  get_bucket_index_oid_base(bucket, index_gen, &dir_oid);
 
   map<int, string> bucket_objs;
   get_bucket_index_objects(dir_oid, num_shards, bucket_objs);
@@ -3296,6 +3681,31 @@ int RGWRados::BucketShard::init(rgw_bucket& _bucket, rgw_obj& obj)
   return 0;
 }
 
+bool RGWRados::BucketShard::retry_resharded(int r, rgw_obj& obj)
+{
+  /* a retired shard refuses changes, and a removed one fails assert_exists() */
+  if (r != -ERR_BUSY_RESHARDING && r != -ENOENT) {
+    return false;
+  }
+  if (store->bucket_is_system(bucket)) {
+    return false;
+  }
+
+  /* our copy of the bucket instance may predate the reshard */
+  store->invalidate_bucket_instance_info(bucket);
+
+  string old_obj = bucket_obj;
+  int ret = init(bucket, obj);
+  if (ret < 0) {
+    return false;
+  }
+  if (bucket_obj == old_obj) {
+    return false;
+  }
+  ldout(store->ctx(), 10) << "bucket index of " << bucket << " was resharded, retrying on " << bucket_obj << dendl;
+  return true;
+}
+
 
 /**
  * Write/overwrite an object to the bucket storage.
@@ -4487,13 +4897,23 @@ int RGWRados::open_bucket_index_base(rgw_bucket& bucket, librados::IoCtx& index_
     return -EIO;
   }
 
-  bucket_oid_base = dir_oid_prefix;
-  bucket_oid_base.append(bucket.marker);
+  get_bucket_index_oid_base(bucket, 0, &bucket_oid_base);
 
   return 0;
 
 }
 
+void RGWRados::get_bucket_index_oid_base(rgw_bucket& bucket, uint32_t index_gen, string *bucket_oid_base)
+{
+  *bucket_oid_base = dir_oid_prefix;
+  bucket_oid_base->append(bucket.marker);
+  if (index_gen > 0) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "#%u", index_gen);
+    bucket_oid_base->append(buf);
+  }
+}
+
 int RGWRados::open_bucket_index(rgw_bucket& bucket, librados::IoCtx& index_ctx,
     map<int, string>& bucket_objs, int shard_id, map<int, string> *bucket_instance_ids) {
   string bucket_oid_base;
@@ -4509,6 +4929,9 @@ int RGWRados::open_bucket_index(rgw_bucket& bucket, librados::IoCtx& index_ctx,
   if (ret < 0)
     return ret;
 
+  if (binfo.index_gen > 0) {
+    get_bucket_index_oid_base(bucket, binfo.index_gen, &bucket_oid_base);
+  }
   get_bucket_index_objects(bucket_oid_base, binfo.num_shards, bucket_objs, shard_id);
   if (bucket_instance_ids) {
     get_bucket_instance_ids(binfo, shard_id, bucket_instance_ids);
@@ -4548,6 +4971,10 @@ int RGWRados::open_bucket_index_shard(rgw_bucket& bucket, librados::IoCtx& index
   if (ret < 0)
     return ret;
 
+  if (binfo.index_gen > 0) {
+    get_bucket_index_oid_base(bucket, binfo.index_gen, &bucket_oid_base);
+  }
+
   ret = get_bucket_index_object(bucket_oid_base, obj_key, binfo.num_shards,
         (RGWBucketInfo::BIShardsHashType)binfo.bucket_index_shard_hash_type, bucket_obj, shard_id);
   if (ret < 0) {
@@ -4803,6 +5230,203 @@ int RGWRados::delete_obj(RGWObjectCtx& obj_ctx, RGWBucketInfo& bucket_info, rgw_
   return del_op.delete_obj();
 }
 
+struct bulk_delete_entry {
+  rgw_bucket_dir_entry *dirent;
+  rgw_obj obj;
+  string oid;
+  string loc;
+  map<string, bufferlist> attrs;
+  AioCompletion *c;
+  int ret;
+  uint64_t epoch;
+
+  bulk_delete_entry() : dirent(NULL), c(NULL), ret(0), epoch(0) {}
+};
+
+bool rgw_bulk_delete_index_op(const rgw_bucket_dir_entry& dirent, int ret, int64_t poolid,
+                              uint64_t epoch, rgw_cls_obj_complete_op *call)
+{
+  call->op = CLS_RGW_OP_DEL;
+  call->key = dirent.key;
+  if (ret == 0) {
+    call->ver.pool = poolid;
+    call->ver.epoch = epoch;
+    return true;
+  }
+  if (ret == -ENOENT) {
+    /* the head is already gone (or never made it), so the entry is stale.
+     * An epoch past the listed one keeps the removal from taking out the
+     * entry of an object that was written again since */
+    call->ver.pool = dirent.ver.pool;
+    call->ver.epoch = dirent.ver.epoch + 1;
+    return true;
+  }
+  /* -ECANCELED: the object was replaced and is kept */
+  return false;
+}
+
+static int bulk_delete_wait(bulk_delete_entry& e)
+{
+  if (!e.c)
+    return e.ret;
+  e.c->wait_for_complete();
+  e.ret = e.c->get_return_value();
+  e.epoch = e.c->get_version64();
+  e.c->release();
+  e.c = NULL;
+  return e.ret;
+}
+
+int RGWRados::bulk_delete_objs(RGWBucketInfo& bucket_info, int shard_id, list<rgw_bucket_dir_entry>& entries,
+                               uint64_t *num_deleted)
+{
+  rgw_bucket& bucket = bucket_info.bucket;
+  uint32_t max_aio = MAX(cct->_conf->rgw_lc_max_aio, 1);
+
+  *num_deleted = 0;
+  if (entries.empty())
+    return 0;
+
+  librados::IoCtx data_ctx;
+  int r = open_bucket_data_ctx(bucket, data_ctx);
+  if (r < 0)
+    return r;
+
+  librados::IoCtx index_ctx;
+  map<int, string> bucket_objs;
+  r = open_bucket_index(bucket, index_ctx, bucket_objs, shard_id);
+  if (r < 0)
+    return r;
+  map<int, string>::iterator oiter = bucket_objs.find(shard_id);
+  if (oiter == bucket_objs.end())
+    return -EINVAL;
+  string& index_oid = oiter->second;
+
+  vector<bulk_delete_entry> objs(entries.size());
+  vector<bulk_delete_entry>::iterator iter;
+  list<rgw_bucket_dir_entry>::iterator diter = entries.begin();
+  for (iter = objs.begin(); iter != objs.end(); ++iter, ++diter) {
+    bulk_delete_entry& e = *iter;
+    e.dirent = &(*diter);
+    e.obj.init(bucket, diter->key.name);
+    e.obj.set_instance(diter->key.instance);
+    rgw_bucket b;
+    get_obj_bucket_and_oid_loc(e.obj, b, e.oid, e.loc);
+  }
+
+  /* read the id tag and manifest of all the heads */
+  for (size_t i = 0; i < objs.size(); i++) {
+    if (i >= max_aio)
+      bulk_delete_wait(objs[i - max_aio]);
+    bulk_delete_entry& e = objs[i];
+    ObjectReadOperation op;
+    op.getxattrs(&e.attrs, NULL);
+    e.c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+    data_ctx.locator_set_key(e.loc);
+    e.ret = data_ctx.aio_operate(e.oid, e.c, &op, NULL);
+    if (e.ret < 0) {
+      e.c->release();
+      e.c = NULL;
+    }
+  }
+  for (iter = objs.begin(); iter != objs.end(); ++iter) {
+    bulk_delete_wait(*iter);
+  }
+
+  /* remove the heads, guarded against a racing overwrite */
+  for (size_t i = 0; i < objs.size(); i++) {
+    if (i >= max_aio)
+      bulk_delete_wait(objs[i - max_aio]);
+    bulk_delete_entry& e = objs[i];
+    if (e.ret < 0)
+      continue;
+    ObjectWriteOperation op;
+    bufferlist& tag = e.attrs[RGW_ATTR_ID_TAG];
+    if (tag.length())
+      op.cmpxattr(RGW_ATTR_ID_TAG, LIBRADOS_CMPXATTR_OP_EQ, tag);
+    remove_rgw_head_obj(op);
+    e.c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+    data_ctx.locator_set_key(e.loc);
+    e.ret = data_ctx.aio_operate(e.oid, e.c, &op);
+    if (e.ret < 0) {
+      e.c->release();
+      e.c = NULL;
+    }
+  }
+  for (iter = objs.begin(); iter != objs.end(); ++iter) {
+    bulk_delete_wait(*iter);
+  }
+
+  r = data_log->add_entry(bucket, (bucket_info.num_shards ? shard_id : -1));
+  if (r < 0) {
+    lderr(cct) << "ERROR: failed writing data log" << dendl;
+    return r;
+  }
+
+  list<rgw_cls_obj_complete_op> removed;
+  uint64_t removed_bytes = 0;
+  int64_t poolid = data_ctx.get_id();
+  for (iter = objs.begin(); iter != objs.end(); ++iter) {
+    bulk_delete_entry& e = *iter;
+    rgw_cls_obj_complete_op call;
+    if (!rgw_bulk_delete_index_op(*e.dirent, e.ret, poolid, e.epoch, &call)) {
+      if (e.ret != -ECANCELED) {
+        ldout(cct, 0) << "ERROR: failed to remove " << e.obj << " ret=" << e.ret << dendl;
+      }
+      continue;
+    }
+
+    /* whoever removed a missing head also took care of its tail */
+    bufferlist& manifest_bl = e.attrs[RGW_ATTR_MANIFEST];
+    if (e.ret == 0 && manifest_bl.length()) {
+      RGWObjManifest manifest;
+      try {
+        bufferlist::iterator miter = manifest_bl.begin();
+        ::decode(manifest, miter);
+        cls_rgw_obj_chain chain;
+        update_gc_chain(e.obj, manifest, &chain);
+        bufferlist& tag = e.attrs[RGW_ATTR_ID_TAG];
+        string tag_str(tag.c_str(), tag.length());
+        send_chain_to_gc(chain, tag_str, false);
+      } catch (buffer::error& err) {
+        ldout(cct, 0) << "ERROR: couldn't decode manifest of " << e.obj << ", tail objects were leaked" << dendl;
+      }
+    }
+
+    call.log_op = zone_public_config.log_data;
+    removed.push_back(call);
+    removed_bytes += e.dirent->meta.size;
+  }
+
+  if (removed.empty())
+    return 0;
+
+  ObjectWriteOperation index_op;
+  /* don't recreate an index shard that was removed by a reshard */
+  index_op.assert_exists();
+  cls_rgw_bucket_complete_ops(index_op, removed);
+  r = index_ctx.operate(index_oid, &index_op);
+  if (r < 0 && r != -ENOENT) {
+    /* osds that don't support bucket_complete_ops return -EOPNOTSUPP, fall
+     * back to removing the entries one at a time */
+    ldout(cct, 5) << "bulk index removal on " << index_oid << " returned r=" << r << ", retrying one by one" << dendl;
+    for (list<rgw_cls_obj_complete_op>::iterator riter = removed.begin(); riter != removed.end(); ++riter) {
+      ObjectWriteOperation op;
+      op.assert_exists();
+      cls_rgw_bucket_complete_op(op, *riter);
+      int ret = index_ctx.operate(index_oid, &op);
+      if (ret < 0 && ret != -ENOENT) {
+        ldout(cct, 0) << "ERROR: failed to remove index entry of " << riter->key.name << " ret=" << ret << dendl;
+      }
+    }
+  }
+
+  *num_deleted = removed.size();
+  quota_handler->update_stats(bucket_info.owner, bucket, -(int)removed.size(), 0, removed_bytes);
+
+  return 0;
+}
+
 int RGWRados::delete_system_obj(rgw_obj& obj, RGWObjVersionTracker *objv_tracker)
 {
   rgw_rados_ref ref;
@@ -5864,12 +6488,26 @@ struct get_obj_data : public RefCountedObject {
   Throttle throttle;
   list<bufferlist> read_list;
 
+  /* read-ahead window, see update_window() */
+  uint64_t window;
+  uint64_t min_window;
+  uint64_t max_window;
+  uint64_t epoch_read;
+  utime_t epoch_start;
+  double last_rate;
+
   get_obj_data(CephContext *_cct)
     : cct(_cct),
       rados(NULL), ctx(NULL),
       total_read(0), lock("get_obj_data"), data_lock("get_obj_data::data_lock"),
       client_cb(NULL),
-      throttle(cct, "get_obj_data", cct->_conf->rgw_get_obj_window_size, false) {}
+      throttle(cct, "get_obj_data", cct->_conf->rgw_get_obj_window_size, false),
+      window(cct->_conf->rgw_get_obj_window_size),
+      min_window(window),
+      max_window(MAX(window, (uint64_t)cct->_conf->rgw_get_obj_max_window_size)),
+      epoch_read(0), last_rate(0) {
+    epoch_start = ceph_clock_now(cct);
+  }
   virtual ~get_obj_data() { } 
   void set_cancelled(int r) {
     cancelled.set(1);
@@ -5965,6 +6603,41 @@ struct get_obj_data : public RefCountedObject {
     }
   }
 
+  /*
+   * Called before each read is issued. Once a full window worth of data was
+   * read, compare the throughput with the one seen during the previous
+   * window: keep doubling the window while it gets better, and halve it back
+   * if the throughput collapsed (e.g., the client or the OSDs slowed down).
+   * Returns the window to throttle the next read with.
+   */
+  uint64_t update_window() {
+    Mutex::Locker l(lock);
+    uint64_t bytes = total_read - epoch_read;
+    if (bytes < window)
+      return window;
+
+    utime_t now = ceph_clock_now(cct);
+    double elapsed = (double)(now - epoch_start);
+    if (elapsed <= 0)
+      return window;
+
+    double rate = bytes / elapsed;
+    uint64_t old_window = window;
+    if (rate > last_rate * 1.1) {
+      window = MIN(window * 2, max_window);
+    } else if (rate < last_rate / 2) {
+      window = MAX(window / 2, min_window);
+    }
+    if (window != old_window) {
+      ldout(cct, 20) << "get_obj_data: rate=" << (uint64_t)rate << " B/s, window " << old_window << " -> " << window << dendl;
+    }
+
+    last_rate = rate;
+    epoch_read = total_read;
+    epoch_start = now;
+    return window;
+  }
+
   int get_complete_ios(off_t ofs, list<bufferlist>& bl_list) {
     Mutex::Locker l(lock);
 
@@ -6040,6 +6713,8 @@ void RGWRados::get_obj_aio_completion_cb(completion_t c, void *arg)
 
   ldout(cct, 20) << "get_obj_aio_completion_cb: io completion ofs=" << ofs << " len=" << len << dendl;
   d->throttle.put(len);
+  if (perfcounter)
+    perfcounter->dec(l_rgw_get_inflight_b, len);
 
   r = rados_aio_get_return_value(c);
   if (r < 0) {
@@ -6145,8 +6820,16 @@ int RGWRados::get_obj_iterate_cb(RGWObjectCtx *ctx, RGWObjState *astate,
 
   get_obj_bucket_and_oid_loc(obj, bucket, oid, key);
 
-  d->throttle.get(len);
+  uint64_t window = d->update_window();
+  d->throttle.get(len, window);
+  if (perfcounter) {
+    perfcounter->inc(l_rgw_get_inflight_b, len);
+    perfcounter->inc(l_rgw_get_window, window);
+  }
   if (d->is_cancelled()) {
+    if (perfcounter)
+      perfcounter->dec(l_rgw_get_inflight_b, len);
+    d->throttle.put(len);
     return d->get_err_code();
   }
 
@@ -6175,6 +6858,8 @@ int RGWRados::get_obj_iterate_cb(RGWObjectCtx *ctx, RGWObjState *astate,
 
 done_err:
   ldout(cct, 20) << "cancelling io r=" << r << " obj_ofs=" << obj_ofs << dendl;
+  if (perfcounter)
+    perfcounter->dec(l_rgw_get_inflight_b, len);
   d->set_cancelled(r);
   d->cancel_io(obj_ofs);
 
@@ -6446,8 +7131,13 @@ int RGWRados::bucket_index_link_olh(RGWObjState& olh_state, rgw_obj& obj_instanc
   }
 
   cls_rgw_obj_key key(obj_instance.get_index_key_name(), obj_instance.get_instance());
-  ret = cls_rgw_bucket_link_olh(bs.index_ctx, bs.bucket_obj, key, olh_state.olh_tag, delete_marker, op_tag, meta, olh_epoch,
-                                zone_public_config.log_data);
+  for (int i = 0; ; ++i) {
+    ret = cls_rgw_bucket_link_olh(bs.index_ctx, bs.bucket_obj, key, olh_state.olh_tag, delete_marker, op_tag, meta, olh_epoch,
+                                  zone_public_config.log_data);
+    if (i >= RGW_INDEX_RESHARD_RETRIES || !bs.retry_resharded(ret, obj_instance)) {
+      break;
+    }
+  }
   if (ret < 0) {
     return ret;
   }
@@ -6478,7 +7168,12 @@ int RGWRados::bucket_index_unlink_instance(rgw_obj& obj_instance, const string&
   }
 
   cls_rgw_obj_key key(obj_instance.get_index_key_name(), obj_instance.get_instance());
-  ret = cls_rgw_bucket_unlink_instance(bs.index_ctx, bs.bucket_obj, key, op_tag, olh_epoch, zone_public_config.log_data);
+  for (int i = 0; ; ++i) {
+    ret = cls_rgw_bucket_unlink_instance(bs.index_ctx, bs.bucket_obj, key, op_tag, olh_epoch, zone_public_config.log_data);
+    if (i >= RGW_INDEX_RESHARD_RETRIES || !bs.retry_resharded(ret, obj_instance)) {
+      break;
+    }
+  }
   if (ret < 0) {
     return ret;
   }
@@ -6537,11 +7232,15 @@ int RGWRados::bucket_index_trim_olh_log(RGWObjState& state, rgw_obj& obj_instanc
 
   cls_rgw_obj_key key(obj_instance.get_index_key_name(), string());
 
-  ObjectWriteOperation op;
-
-  cls_rgw_trim_olh_log(op, key, ver, olh_tag);
-
-  ret = bs.index_ctx.operate(bs.bucket_obj, &op);
+  for (int i = 0; ; ++i) {
+    ObjectWriteOperation op;
+    op.assert_exists();
+    cls_rgw_trim_olh_log(op, key, ver, olh_tag);
+    ret = bs.index_ctx.operate(bs.bucket_obj, &op);
+    if (i >= RGW_INDEX_RESHARD_RETRIES || !bs.retry_resharded(ret, obj_instance)) {
+      break;
+    }
+  }
   if (ret < 0)
     return ret;
 
@@ -6568,7 +7267,12 @@ int RGWRados::bucket_index_clear_olh(RGWObjState& state, rgw_obj& obj_instance)
 
   cls_rgw_obj_key key(obj_instance.get_index_key_name(), string());
 
-  ret = cls_rgw_clear_olh(bs.index_ctx, bs.bucket_obj, key, olh_tag);
+  for (int i = 0; ; ++i) {
+    ret = cls_rgw_clear_olh(bs.index_ctx, bs.bucket_obj, key, olh_tag);
+    if (i >= RGW_INDEX_RESHARD_RETRIES || !bs.retry_resharded(ret, obj_instance)) {
+      break;
+    }
+  }
   if (ret < 0) {
     ldout(cct, 5) << "cls_rgw_clear_olh() returned ret=" << ret << dendl;
     return ret;
@@ -7225,6 +7929,17 @@ void RGWRados::get_bucket_meta_oid(rgw_bucket& bucket, string& oid)
   oid = RGW_BUCKET_INSTANCE_MD_PREFIX + entry;
 }
 
+void RGWRados::invalidate_bucket_instance_info(rgw_bucket& bucket)
+{
+  string oid;
+  if (bucket.oid.empty()) {
+    get_bucket_meta_oid(bucket, oid);
+  } else {
+    oid = bucket.oid;
+  }
+  invalidate_system_obj(zone.domain_root, oid);
+}
+
 void RGWRados::get_bucket_instance_obj(rgw_bucket& bucket, rgw_obj& obj)
 {
   if (!bucket.oid.empty()) {
@@ -7504,6 +8219,62 @@ int RGWRados::omap_get_all(rgw_obj& obj, bufferlist& header, std::map<string, bu
   return omap_get_vals(obj, header, start_after, (uint64_t)-1, m);
 }
 
+int RGWRados::omap_get_vals_ranges(rgw_obj& obj, const vector<pair<string, uint64_t> >& ranges,
+                                   uint32_t max_aio, vector<map<string, bufferlist> >& results)
+{
+  rgw_rados_ref ref;
+  rgw_bucket bucket;
+  int r = get_obj_ref(obj, &ref, &bucket);
+  if (r < 0) {
+    return r;
+  }
+
+  results.clear();
+  results.resize(ranges.size());
+  vector<int> rvals(ranges.size(), 0);
+
+  if (!max_aio)
+    max_aio = 1;
+
+  list<pair<size_t, librados::AioCompletion *> > pending;
+  size_t next = 0;
+  int ret = 0;
+
+  while (next < ranges.size() || !pending.empty()) {
+    while (ret == 0 && next < ranges.size() && pending.size() < max_aio) {
+      ObjectReadOperation op;
+      op.omap_get_vals(ranges[next].first, ranges[next].second, &results[next], &rvals[next]);
+
+      librados::AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+      r = ref.ioctx.aio_operate(ref.oid, c, &op, NULL);
+      if (r < 0) {
+        c->release();
+        ret = r;
+        break;
+      }
+      pending.push_back(make_pair(next, c));
+      ++next;
+    }
+
+    if (pending.empty())
+      break;
+
+    size_t i = pending.front().first;
+    librados::AioCompletion *c = pending.front().second;
+    pending.pop_front();
+
+    c->wait_for_complete();
+    r = c->get_return_value();
+    c->release();
+    if (r >= 0)
+      r = rvals[i];
+    if (r < 0 && ret == 0)
+      ret = r;
+  }
+
+  return ret;
+}
+
 int RGWRados::omap_set(rgw_obj& obj, std::string& key, bufferlist& bl)
 {
   rgw_rados_ref ref;
@@ -7925,6 +8696,16 @@ int RGWRados::process_gc()
   return gc->process();
 }
 
+int RGWRados::get_gc_num_shards()
+{
+  return gc->get_num_shards();
+}
+
+int RGWRados::get_gc_shard_backlog(int index, RGWGCShardBacklog& backlog)
+{
+  return gc->get_shard_backlog(index, backlog);
+}
+
 int RGWRados::cls_rgw_init_index(librados::IoCtx& index_ctx, librados::ObjectWriteOperation& op, string& oid)
 {
   bufferlist in;
@@ -7936,10 +8717,18 @@ int RGWRados::cls_rgw_init_index(librados::IoCtx& index_ctx, librados::ObjectWri
 int RGWRados::cls_obj_prepare_op(BucketShard& bs, RGWModifyOp op, string& tag,
                                  rgw_obj& obj, uint16_t bilog_flags)
 {
-  ObjectWriteOperation o;
   cls_rgw_obj_key key(obj.get_index_key_name(), obj.get_instance());
-  cls_rgw_bucket_prepare_op(o, op, tag, key, obj.get_loc(), zone_public_config.log_data, bilog_flags);
-  int r = bs.index_ctx.operate(bs.bucket_obj, &o);
+  int r;
+  for (int i = 0; ; ++i) {
+    ObjectWriteOperation o;
+    /* don't recreate an index shard that was removed by a reshard */
+    o.assert_exists();
+    cls_rgw_bucket_prepare_op(o, op, tag, key, obj.get_loc(), zone_public_config.log_data, bilog_flags);
+    r = bs.index_ctx.operate(bs.bucket_obj, &o);
+    if (i >= RGW_INDEX_RESHARD_RETRIES || !bs.retry_resharded(r, obj)) {
+      break;
+    }
+  }
   return r;
 }
 
@@ -7948,40 +8737,31 @@ int RGWRados::cls_obj_complete_op(BucketShard& bs, RGWModifyOp op, string& tag,
                                   RGWObjEnt& ent, RGWObjCategory category,
 				  list<rgw_obj_key> *remove_objs, uint16_t bilog_flags)
 {
-  list<cls_rgw_obj_key> *pro = NULL;
-  list<cls_rgw_obj_key> ro;
-
+  rgw_cls_obj_complete_op call;
+  call.op = op;
+  call.tag = tag;
+  call.key = cls_rgw_obj_key(ent.key.name, ent.key.instance);
+  call.ver.pool = pool;
+  call.ver.epoch = epoch;
+  call.meta.size = ent.size;
+  call.meta.accounted_size = ent.size;
+  call.meta.mtime = utime_t(ent.mtime, 0);
+  call.meta.etag = ent.etag;
+  call.meta.owner = ent.owner;
+  call.meta.owner_display_name = ent.owner_display_name;
+  call.meta.content_type = ent.content_type;
+  call.meta.category = category;
+  call.log_op = zone_public_config.log_data;
+  call.bilog_flags = bilog_flags;
   if (remove_objs) {
     for (list<rgw_obj_key>::iterator iter = remove_objs->begin(); iter != remove_objs->end(); ++iter) {
       cls_rgw_obj_key k;
       iter->transform(&k);
-      ro.push_back(k);
+      call.remove_objs.push_back(k);
     }
-    pro = &ro;
   }
 
-  ObjectWriteOperation o;
-  rgw_bucket_dir_entry_meta dir_meta;
-  dir_meta.size = ent.size;
-  dir_meta.accounted_size = ent.size;
-  dir_meta.mtime = utime_t(ent.mtime, 0);
-  dir_meta.etag = ent.etag;
-  dir_meta.owner = ent.owner;
-  dir_meta.owner_display_name = ent.owner_display_name;
-  dir_meta.content_type = ent.content_type;
-  dir_meta.category = category;
-
-  rgw_bucket_entry_ver ver;
-  ver.pool = pool;
-  ver.epoch = epoch;
-  cls_rgw_obj_key key(ent.key.name, ent.key.instance);
-  cls_rgw_bucket_complete_op(o, op, tag, ver, key, dir_meta, pro,
-                             zone_public_config.log_data, bilog_flags);
-
-  AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
-  int ret = bs.index_ctx.aio_operate(bs.bucket_obj, c, &o);
-  c->release();
-  return ret;
+  return index_completion_manager->complete(bs.index_ctx, bs.bucket_obj, bs.bucket, call);
 }
 
 int RGWRados::cls_obj_complete_add(BucketShard& bs, string& tag,
@@ -8021,121 +8801,346 @@ int RGWRados::cls_obj_set_bucket_tag_timeout(rgw_bucket& bucket, uint64_t timeou
   return CLSRGWIssueSetTagTimeout(index_ctx, bucket_objs, cct->_conf->rgw_bucket_index_max_aio, timeout)();
 }
 
-int RGWRados::cls_bucket_list(rgw_bucket& bucket, rgw_obj_key& start, const string& prefix,
-		              uint32_t num_entries, bool list_versions, map<string, RGWObjEnt>& m,
-			      bool *is_truncated, rgw_obj_key *last_entry,
-			      bool (*force_check_filter)(const string&  name))
+/* the largest read of a shard that returned nothing but invisible entries */
+#define BUCKET_LIST_SHARD_MAX_ENTRIES (1 << 30)
+
+int RGWRados::get_bucket_list_entry(librados::IoCtx& index_ctx, rgw_bucket& bucket,
+                                    rgw_bucket_dir_entry& dirent, bool force_check,
+                                    RGWObjEnt& e, bufferlist& suggested_updates)
 {
-  ldout(cct, 10) << "cls_bucket_list " << bucket << " start " << start.name << "[" << start.instance << "] num_entries " << num_entries << dendl;
+  // fill it in with initial values; we may correct later
+  e.key.set(dirent.key.name, dirent.key.instance);
+  e.size = dirent.meta.size;
+  e.mtime = dirent.meta.mtime;
+  e.etag = dirent.meta.etag;
+  e.owner = dirent.meta.owner;
+  e.owner_display_name = dirent.meta.owner_display_name;
+  e.content_type = dirent.meta.content_type;
+  e.tag = dirent.tag;
+  e.flags = dirent.flags;
+  e.versioned_epoch = dirent.versioned_epoch;
+
+  if ((!dirent.exists && !dirent.is_delete_marker()) || !dirent.pending_map.empty() || force_check) {
+    /* there are uncommitted ops. We need to check the current state,
+     * and if the tags are old we need to do cleanup as well. */
+    librados::IoCtx sub_ctx;
+    sub_ctx.dup(index_ctx);
+    return check_disk_state(sub_ctx, bucket, dirent, e, suggested_updates);
+  }
+  return 0;
+}
+
+void RGWRados::suggest_bucket_index_changes(librados::IoCtx& index_ctx, map<string, bufferlist>& updates)
+{
+  map<string, bufferlist>::iterator miter = updates.begin();
+  for (; miter != updates.end(); ++miter) {
+    if (miter->second.length()) {
+      ObjectWriteOperation o;
+      cls_rgw_suggest_changes(o, miter->second);
+      // we don't care if we lose suggested updates, send them off blindly
+      AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+      index_ctx.aio_operate(miter->first, c, &o);
+      c->release();
+    }
+  }
+}
+
+/*
+ * Set up list_shards for listing num_entries entries after start. If it
+ * holds the state of the listing that returned start as its last entry, the
+ * entries that were read ahead are kept.
+ */
+int RGWRados::init_bucket_list_shards(rgw_bucket& bucket, rgw_obj_key& start, const string& prefix,
+                                      uint32_t num_entries, bool list_versions,
+                                      RGWBucketListShards *list_shards)
+{
+  bool resume = (!list_shards->shards.empty() &&
+                 list_shards->bucket.name == bucket.name &&
+                 list_shards->bucket.bucket_id == bucket.bucket_id &&
+                 list_shards->prefix == prefix &&
+                 list_shards->list_versions == list_versions &&
+                 start.instance.empty() && start.name >= list_shards->position);
+  if (resume) {
+    if (start.name == list_shards->position) {
+      return 0;
+    }
+    /* the caller skipped ahead, drop the entries it is not interested in */
+    map<int, RGWBucketListShards::Shard>::iterator iter;
+    for (iter = list_shards->shards.begin(); iter != list_shards->shards.end(); ++iter) {
+      RGWBucketListShards::Shard& shard = iter->second;
+      shard.entries.erase(shard.entries.begin(), shard.entries.upper_bound(start.name));
+      if (shard.entries.empty() && shard.marker.name < start.name) {
+        shard.marker = cls_rgw_obj_key(start.name);
+      }
+    }
+    list_shards->position = start.name;
+    return 0;
+  }
+
+  list_shards->bucket = bucket;
+  list_shards->prefix = prefix;
+  list_shards->list_versions = list_versions;
+  list_shards->position = start.name;
+  list_shards->shards.clear();
 
-  librados::IoCtx index_ctx;
-  // key   - oid (for different shards if there is any)
-  // value - list result for the corresponding oid (shard), it is filled by the AIO callback
   map<int, string> oids;
-  map<int, struct rgw_cls_list_ret> list_results;
-  int r = open_bucket_index(bucket, index_ctx, oids);
+  int r = open_bucket_index(bucket, list_shards->index_ctx, oids);
   if (r < 0)
     return r;
 
-  cls_rgw_obj_key start_key(start.name, start.instance);
-  r = CLSRGWIssueBucketList(index_ctx, start_key, prefix, num_entries, list_versions,
-                            oids, list_results, cct->_conf->rgw_bucket_index_max_aio)();
+  /* keys are spread evenly across the shards, read a bit more than each
+   * shard's share of the page and read more of the shards that run out */
+  uint32_t shard_entries = num_entries * 3 / (2 * oids.size()) + 1;
+  if (shard_entries > num_entries) {
+    shard_entries = num_entries;
+  }
+
+  map<int, string>::iterator iter;
+  for (iter = oids.begin(); iter != oids.end(); ++iter) {
+    RGWBucketListShards::Shard& shard = list_shards->shards[iter->first];
+    shard.oid = iter->second;
+    shard.marker = cls_rgw_obj_key(start.name, start.instance);
+    shard.num_entries = shard_entries;
+  }
+  return 0;
+}
+
+/* read the next entries of the given shards in parallel */
+int RGWRados::read_bucket_list_shards(RGWBucketListShards *list_shards, map<int, string>& oids)
+{
+  map<int, struct rgw_cls_list_op> calls;
+  map<int, struct rgw_cls_list_ret> list_results;
+  map<int, string>::iterator iter;
+  for (iter = oids.begin(); iter != oids.end(); ++iter) {
+    RGWBucketListShards::Shard& shard = list_shards->shards[iter->first];
+    struct rgw_cls_list_op& call = calls[iter->first];
+    call.start_obj = shard.marker;
+    call.filter_prefix = list_shards->prefix;
+    call.num_entries = shard.num_entries;
+    call.list_versions = list_shards->list_versions;
+    list_results[iter->first] = rgw_cls_list_ret();
+  }
+
+  int r = CLSRGWIssueBucketListShards(list_shards->index_ctx, calls, oids, list_results,
+                                      cct->_conf->rgw_bucket_index_max_aio)();
   if (r < 0)
     return r;
 
-  // Create a list of iterators that are used to iterate each shard
-  vector<map<string, struct rgw_bucket_dir_entry>::iterator> vcurrents(list_results.size());
-  vector<map<string, struct rgw_bucket_dir_entry>::iterator> vends(list_results.size());
-  vector<string> vnames(list_results.size());
-  map<int, struct rgw_cls_list_ret>::iterator iter = list_results.begin();
-  *is_truncated = false;
-  for (; iter != list_results.end(); ++iter) {
-    vcurrents.push_back(iter->second.dir.m.begin());
-    vends.push_back(iter->second.dir.m.end());
-    vnames.push_back(oids[iter->first]);
-    *is_truncated = (*is_truncated || iter->second.is_truncated);
+  map<int, struct rgw_cls_list_ret>::iterator riter;
+  for (riter = list_results.begin(); riter != list_results.end(); ++riter) {
+    RGWBucketListShards::Shard& shard = list_shards->shards[riter->first];
+    map<string, struct rgw_bucket_dir_entry>& m = riter->second.dir.m;
+    shard.truncated = riter->second.is_truncated;
+    if (m.empty()) {
+      if (shard.truncated && shard.num_entries < BUCKET_LIST_SHARD_MAX_ENTRIES) {
+        /* everything we read was skipped, read further next time */
+        shard.num_entries *= 2;
+      }
+      continue;
+    }
+    shard.marker = cls_rgw_obj_key(m.rbegin()->first);
+    shard.entries.insert(m.begin(), m.end());
+  }
+  return 0;
+}
+
+int RGWRados::cls_bucket_list(rgw_bucket& bucket, rgw_obj_key& start, const string& prefix,
+		              uint32_t num_entries, bool list_versions, map<string, RGWObjEnt>& m,
+			      bool *is_truncated, rgw_obj_key *last_entry,
+			      bool (*force_check_filter)(const string&  name),
+                              RGWBucketListShards *list_shards)
+{
+  ldout(cct, 10) << "cls_bucket_list " << bucket << " start " << start.name << "[" << start.instance << "] num_entries " << num_entries << dendl;
+
+  RGWBucketListShards local_shards;
+  if (!list_shards) {
+    list_shards = &local_shards;
   }
 
-  // Create a map to track the next candidate entry from each shard, if the entry
-  // from a specified shard is selected/erased, the next entry from that shard will
-  // be inserted for next round selection
-  map<string, size_t> candidates;
-  for (size_t i = 0; i < vcurrents.size(); ++i) {
-    if (vcurrents[i] != vends[i]) {
-      candidates[vcurrents[i]->first] = i;
+  int r = init_bucket_list_shards(bucket, start, prefix, num_entries, list_versions, list_shards);
+  if (r < 0)
+    return r;
+
+  map<int, RGWBucketListShards::Shard>& shards = list_shards->shards;
+
+  // Track the next candidate entry from each shard, and the shards that ran
+  // out of entries and need to be read before the merge can go on
+  map<string, int> candidates;
+  set<int> dry;
+  map<int, RGWBucketListShards::Shard>::iterator iter;
+  for (iter = shards.begin(); iter != shards.end(); ++iter) {
+    if (!iter->second.entries.empty()) {
+      candidates[iter->second.entries.begin()->first] = iter->first;
+    } else if (iter->second.truncated) {
+      dry.insert(iter->first);
     }
   }
 
   map<string, bufferlist> updates;
   uint32_t count = 0;
-  while (count < num_entries && !candidates.empty()) {
+  while (count < num_entries) {
+    if (!dry.empty()) {
+      map<int, string> oids;
+      for (set<int>::iterator diter = dry.begin(); diter != dry.end(); ++diter) {
+        oids[*diter] = shards[*diter].oid;
+      }
+      /* read ahead from the shards that are about to run out too */
+      for (iter = shards.begin(); iter != shards.end(); ++iter) {
+        RGWBucketListShards::Shard& shard = iter->second;
+        if (shard.truncated && !shard.entries.empty() &&
+            shard.entries.size() < shard.num_entries / 4) {
+          oids[iter->first] = shard.oid;
+        }
+      }
+      r = read_bucket_list_shards(list_shards, oids);
+      if (r < 0)
+        return r;
+
+      dry.clear();
+      map<int, string>::iterator oiter;
+      for (oiter = oids.begin(); oiter != oids.end(); ++oiter) {
+        RGWBucketListShards::Shard& shard = shards[oiter->first];
+        if (!shard.entries.empty()) {
+          candidates[shard.entries.begin()->first] = oiter->first;
+        } else if (shard.truncated) {
+          dry.insert(oiter->first);
+        }
+      }
+      continue;
+    }
+
+    if (candidates.empty()) {
+      break;
+    }
+
     // Select the next one
     int pos = candidates.begin()->second;
-    const string& name = vcurrents[pos]->first;
-    struct rgw_bucket_dir_entry& dirent = vcurrents[pos]->second;
+    candidates.erase(candidates.begin());
+    RGWBucketListShards::Shard& shard = shards[pos];
+    map<string, struct rgw_bucket_dir_entry>::iterator eiter = shard.entries.begin();
+    const string name = eiter->first;
+    struct rgw_bucket_dir_entry& dirent = eiter->second;
 
-    // fill it in with initial values; we may correct later
     RGWObjEnt e;
-    e.key.set(dirent.key.name, dirent.key.instance);
-    e.size = dirent.meta.size;
-    e.mtime = dirent.meta.mtime;
-    e.etag = dirent.meta.etag;
-    e.owner = dirent.meta.owner;
-    e.owner_display_name = dirent.meta.owner_display_name;
-    e.content_type = dirent.meta.content_type;
-    e.tag = dirent.tag;
-    e.flags = dirent.flags;
-    e.versioned_epoch = dirent.versioned_epoch;
-
     bool force_check = force_check_filter && force_check_filter(dirent.key.name);
-    if ((!dirent.exists && !dirent.is_delete_marker()) || !dirent.pending_map.empty() || force_check) {
-      /* there are uncommitted ops. We need to check the current state,
-       * and if the tags are old we need to do cleanup as well. */
-      librados::IoCtx sub_ctx;
-      sub_ctx.dup(index_ctx);
-      r = check_disk_state(sub_ctx, bucket, dirent, e, updates[vnames[pos]]);
-      if (r < 0 && r != -ENOENT) {
-          return r;
-      }
+    r = get_bucket_list_entry(list_shards->index_ctx, bucket, dirent, force_check, e, updates[shard.oid]);
+    if (r < 0 && r != -ENOENT) {
+      return r;
     }
     if (r >= 0) {
       m[name] = e;
       ldout(cct, 10) << "RGWRados::cls_bucket_list: got " << e.key.name << "[" << e.key.instance << "]" << dendl;
       ++count;
     }
+    list_shards->position = name;
 
     // Refresh the candidates map
-    candidates.erase(candidates.begin());
-    ++vcurrents[pos];
-    if (vcurrents[pos] != vends[pos]) {
-      candidates[vcurrents[pos]->first] = pos;
+    shard.entries.erase(eiter);
+    if (!shard.entries.empty()) {
+      candidates[shard.entries.begin()->first] = pos;
+    } else if (shard.truncated) {
+      dry.insert(pos);
+      /* the shard ran out before the page was filled, read more of it */
+      shard.num_entries = min(shard.num_entries * 2, max(num_entries, shard.num_entries));
     }
   }
 
   // Suggest updates if there is any
-  map<string, bufferlist>::iterator miter = updates.begin();
-  for (; miter != updates.end(); ++miter) {
-    if (miter->second.length()) {
-      ObjectWriteOperation o;
-      cls_rgw_suggest_changes(o, miter->second);
-      // we don't care if we lose suggested updates, send them off blindly
-      AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
-      index_ctx.aio_operate(miter->first, c, &o);
-        c->release();
-    }
-  }
+  suggest_bucket_index_changes(list_shards->index_ctx, updates);
 
-  // Check if all the returned entries are consumed or not
-  for (size_t i = 0; i < vcurrents.size(); ++i) {
-    if (vcurrents[i] != vends[i])
+  // Check if all the entries are consumed or not
+  *is_truncated = false;
+  for (iter = shards.begin(); iter != shards.end(); ++iter) {
+    if (!iter->second.entries.empty() || iter->second.truncated)
       *is_truncated = true;
   }
   if (!m.empty())
-    *last_entry = m.rbegin()->first;
+    *last_entry = list_shards->position;
 
   return 0;
 }
 
+/*
+ * List the bucket index one shard after the other. The entries are only
+ * sorted within each shard, the listing continues in the shard start hashes
+ * to and then goes on with the following shards.
+ */
+int RGWRados::cls_bucket_list_unordered(rgw_bucket& bucket, rgw_obj_key& start, const string& prefix,
+                                        uint32_t num_entries, bool list_versions, vector<RGWObjEnt>& ent_list,
+                                        bool *is_truncated, rgw_obj_key *last_entry)
+{
+  ldout(cct, 10) << "cls_bucket_list_unordered " << bucket << " start " << start.name << "[" << start.instance << "] num_entries " << num_entries << dendl;
+
+  librados::IoCtx index_ctx;
+  map<int, string> oids;
+  int r = open_bucket_index(bucket, index_ctx, oids);
+  if (r < 0)
+    return r;
+
+  map<int, string>::iterator shard_iter = oids.begin();
+  if (!start.name.empty() && oids.size() > 1) {
+    string oid;
+    int shard_id;
+    r = open_bucket_index_shard(bucket, index_ctx, get_bucket_index_hash_source(start.name), &oid, &shard_id);
+    if (r < 0)
+      return r;
+    shard_iter = oids.find(shard_id);
+    if (shard_iter == oids.end()) {
+      ldout(cct, 0) << "ERROR: " << start.name << " maps to unknown bucket index shard " << shard_id << dendl;
+      return -EIO;
+    }
+  }
+
+  cls_rgw_obj_key marker(start.name, start.instance);
+  uint32_t read_entries = num_entries;
+  map<string, bufferlist> updates;
+  uint32_t count = 0;
+  while (count < num_entries && shard_iter != oids.end()) {
+    map<int, string> shard_oids;
+    shard_oids[shard_iter->first] = shard_iter->second;
+    map<int, struct rgw_cls_list_ret> list_results;
+    r = CLSRGWIssueBucketList(index_ctx, marker, prefix, read_entries, list_versions,
+                              shard_oids, list_results, 1)();
+    if (r < 0)
+      return r;
+
+    struct rgw_cls_list_ret& result = list_results[shard_iter->first];
+    map<string, struct rgw_bucket_dir_entry>::iterator eiter;
+    for (eiter = result.dir.m.begin(); eiter != result.dir.m.end(); ++eiter) {
+      struct rgw_bucket_dir_entry& dirent = eiter->second;
+      RGWObjEnt e;
+      r = get_bucket_list_entry(index_ctx, bucket, dirent, false, e, updates[shard_iter->second]);
+      if (r < 0 && r != -ENOENT) {
+        return r;
+      }
+      if (r >= 0) {
+        ent_list.push_back(e);
+        ++count;
+      }
+      marker = cls_rgw_obj_key(eiter->first);
+      last_entry->set(dirent.key.name, dirent.key.instance);
+    }
+
+    if (result.is_truncated) {
+      if (result.dir.m.empty() && read_entries < BUCKET_LIST_SHARD_MAX_ENTRIES) {
+        /* everything we read was skipped, read further */
+        read_entries *= 2;
+      } else {
+        read_entries = num_entries - count;
+      }
+    } else {
+      ++shard_iter;
+      marker = cls_rgw_obj_key();
+      read_entries = num_entries - count;
+    }
+  }
+
+  suggest_bucket_index_changes(index_ctx, updates);
+
+  *is_truncated = (shard_iter != oids.end());
+  return 0;
+}
+
 int RGWRados::cls_obj_usage_log_add(const string& oid, rgw_usage_log_info& info)
 {
   librados::IoCtx io_ctx;
@@ -8658,6 +9663,28 @@ int RGWRados::get_bucket_index_object(const string& bucket_oid_base, const strin
   return r;
 }
 
+string RGWRados::get_bucket_index_hash_source(const string& index_key_name)
+{
+  string name, instance, ns;
+  if (index_key_name.empty() ||
+      !rgw_obj::parse_raw_oid(index_key_name, &name, &instance, &ns)) {
+    return index_key_name;
+  }
+
+  if (ns == RGW_OBJ_NS_MULTIPART) {
+    /* <object>.<upload id>.meta */
+    size_t pos = name.rfind('.');
+    if (pos != string::npos && pos > 0) {
+      pos = name.rfind('.', pos - 1);
+    }
+    if (pos != string::npos) {
+      name = name.substr(0, pos);
+    }
+  }
+
+  return name;
+}
+
 void RGWStateLog::oid_str(int shard, string& oid) {
   oid = RGW_STATELOG_OBJ_PREFIX + module_name + ".";
   char buf[16];
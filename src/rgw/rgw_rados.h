@@ -21,6 +21,11 @@ class RGWWatcher;
 class SafeTimer;
 class ACLOwner;
 class RGWGC;
+struct RGWGCShardBacklog;
+class RGWReshard;
+class RGWLC;
+class RGWIndexCompletionManager;
+struct rgw_cls_obj_complete_op;
 
 /* flags for put_obj_meta() */
 #define PUT_OBJ_CREATE      0x01
@@ -32,6 +37,11 @@ class RGWGC;
 
 #define RGW_BUCKET_INSTANCE_MD_PREFIX ".bucket.meta."
 
+#define MAX_BUCKET_INDEX_SHARDS_PRIME 7877
+
+/* times an index operation follows its bucket to a resharded index */
+#define RGW_INDEX_RESHARD_RETRIES 10
+
 static inline void prepend_bucket_marker(rgw_bucket& bucket, const string& orig_oid, string& oid)
 {
   if (bucket.marker.empty() || orig_oid.empty()) {
@@ -57,6 +67,14 @@ static inline void get_obj_bucket_and_oid_loc(const rgw_obj& obj, rgw_bucket& bu
 
 int rgw_policy_from_attrset(CephContext *cct, map<string, bufferlist>& attrset, RGWAccessControlPolicy *policy);
 
+/*
+ * The index removal that follows a head removal of a bulk delete, given
+ * what the head removal returned and, on success, the version it left.
+ * Returns false if the index entry has to stay.
+ */
+bool rgw_bulk_delete_index_op(const rgw_bucket_dir_entry& dirent, int ret, int64_t poolid,
+                              uint64_t epoch, rgw_cls_obj_complete_op *call);
+
 struct RGWOLHInfo {
   rgw_obj target;
   bool removed;
@@ -1156,11 +1174,41 @@ struct RGWObjectCtx {
   void invalidate(rgw_obj& obj);
 };
 
+/*
+ * Entries read ahead from the shards of a bucket index by an ordered listing.
+ * It is kept across calls to RGWRados::cls_bucket_list() so that listing the
+ * next page carries on with the merge instead of reading every shard again.
+ */
+struct RGWBucketListShards {
+  struct Shard {
+    string oid;
+    map<string, rgw_bucket_dir_entry> entries; // read but not returned yet
+    cls_rgw_obj_key marker;                     // last index key read
+    bool truncated;
+    uint32_t num_entries;                       // entries to read next time
+
+    Shard() : truncated(true), num_entries(0) {}
+  };
+
+  rgw_bucket bucket;
+  string prefix;
+  bool list_versions;
+  string position; // last index key returned
+  librados::IoCtx index_ctx;
+  map<int, Shard> shards;
+
+  RGWBucketListShards() : list_versions(false) {}
+};
+
 class Finisher;
 
 class RGWRados
 {
   friend class RGWGC;
+  friend class RGWLC;
+  friend class RGWBucketReshard;
+  friend class RGWReshard;
+  friend class RGWIndexCompletionManager;
   friend class RGWStateLog;
   friend class RGWReplicaLogger;
 
@@ -1203,6 +1251,9 @@ class RGWRados
   };
 
   RGWGC *gc;
+  RGWReshard *reshard;
+  RGWLC *lc;
+  RGWIndexCompletionManager *index_completion_manager;
   bool use_gc_thread;
   bool quota_threads;
 
@@ -1257,7 +1308,7 @@ protected:
 
 public:
   RGWRados() : max_req_id(0), lock("rados_timer_lock"), watchers_lock("watchers_lock"), timer(NULL),
-               gc(NULL), use_gc_thread(false), quota_threads(false),
+               gc(NULL), reshard(NULL), lc(NULL), index_completion_manager(NULL), use_gc_thread(false), quota_threads(false),
                num_watchers(0), watchers(NULL),
                watch_initialized(false),
                bucket_id_lock("rados_bucket_id"),
@@ -1373,7 +1424,7 @@ public:
    * create a bucket with name bucket and the given list of attrs
    * returns 0 on success, -ERR# otherwise.
    */
-  virtual int init_bucket_index(rgw_bucket& bucket, int num_shards);
+  virtual int init_bucket_index(rgw_bucket& bucket, int num_shards, uint32_t index_gen = 0);
   int select_bucket_placement(RGWUserInfo& user_info, const string& region_name, const std::string& rule,
                               const std::string& bucket_name, rgw_bucket& bucket, string *pselected_rule);
   int select_legacy_bucket_placement(const string& bucket_name, rgw_bucket& bucket);
@@ -1455,6 +1506,13 @@ public:
 
     BucketShard(RGWRados *_store) : store(_store), shard_id(-1) {}
     int init(rgw_bucket& _bucket, rgw_obj& obj);
+
+    /*
+     * Called when an index operation on this shard failed with r. If the
+     * bucket index was resharded, point at the object's shard in the new
+     * index and return true, so that the caller retries the operation there.
+     */
+    bool retry_resharded(int r, rgw_obj& obj);
   };
 
   class Object {
@@ -1697,10 +1755,15 @@ public:
         bool enforce_ns;
         RGWAccessListFilter *filter;
         bool list_versions;
+        bool allow_unordered;
 
-        Params() : enforce_ns(true), filter(NULL), list_versions(false) {}
+        Params() : enforce_ns(true), filter(NULL), list_versions(false), allow_unordered(false) {}
       } params;
 
+    private:
+      int list_objects_ordered(int max, vector<RGWObjEnt> *result, map<string, bool> *common_prefixes, bool *is_truncated);
+      int list_objects_unordered(int max, vector<RGWObjEnt> *result, bool *is_truncated);
+
     public:
       List(RGWRados::Bucket *_target) : target(_target) {}
 
@@ -1854,9 +1917,22 @@ public:
   virtual int delete_obj(RGWObjectCtx& obj_ctx, RGWBucketInfo& bucket_owner, rgw_obj& src_obj,
                          int versioning_status, uint16_t bilog_flags = 0);
 
+  /*
+   * Delete a batch of objects of an unversioned bucket that are all indexed
+   * in the same bucket index shard. The heads are removed in parallel (their
+   * tails are handed to gc) and their index entries are then removed with a
+   * single operation on the index shard. An object is skipped if it was
+   * overwritten since its index entry was read.
+   */
+  int bulk_delete_objs(RGWBucketInfo& bucket_info, int shard_id, list<rgw_bucket_dir_entry>& entries,
+                       uint64_t *num_deleted);
+
   /* Delete a system object */
   virtual int delete_system_obj(rgw_obj& src_obj, RGWObjVersionTracker *objv_tracker = NULL);
 
+  /* Drop the cached copy of a system object, if it is cached */
+  virtual void invalidate_system_obj(rgw_bucket& bucket, const string& oid) {}
+
   /** Remove an object from the bucket index */
   int delete_obj_index(rgw_obj& obj);
 
@@ -1962,6 +2038,13 @@ public:
 
   int omap_get_vals(rgw_obj& obj, bufferlist& header, const std::string& marker, uint64_t count, std::map<string, bufferlist>& m);
   virtual int omap_get_all(rgw_obj& obj, bufferlist& header, std::map<string, bufferlist>& m);
+  /*
+   * Read several ranges of the omap of an object in parallel. A range is
+   * made of the (at most) count keys following a marker. Keeps up to max_aio
+   * reads in flight.
+   */
+  int omap_get_vals_ranges(rgw_obj& obj, const vector<pair<string, uint64_t> >& ranges,
+                           uint32_t max_aio, vector<map<string, bufferlist> >& results);
   virtual int omap_set(rgw_obj& obj, std::string& key, bufferlist& bl);
   virtual int omap_set(rgw_obj& obj, map<std::string, bufferlist>& m);
   virtual int omap_del(rgw_obj& obj, const std::string& key);
@@ -2002,6 +2085,7 @@ public:
   void get_bucket_instance_obj(rgw_bucket& bucket, rgw_obj& obj);
   void get_bucket_instance_entry(rgw_bucket& bucket, string& entry);
   void get_bucket_meta_oid(rgw_bucket& bucket, string& oid);
+  void invalidate_bucket_instance_info(rgw_bucket& bucket);
 
   int put_bucket_entrypoint_info(const string& bucket_name, RGWBucketEntryPoint& entry_point, bool exclusive, RGWObjVersionTracker& objv_tracker, time_t mtime,
                                  map<string, bufferlist> *pattrs);
@@ -2032,7 +2116,11 @@ public:
   int cls_bucket_list(rgw_bucket& bucket, rgw_obj_key& start, const string& prefix,
                       uint32_t num_entries, bool list_versions, map<string, RGWObjEnt>& m,
                       bool *is_truncated, rgw_obj_key *last_entry,
-                      bool (*force_check_filter)(const string&  name) = NULL);
+                      bool (*force_check_filter)(const string&  name) = NULL,
+                      RGWBucketListShards *list_shards = NULL);
+  int cls_bucket_list_unordered(rgw_bucket& bucket, rgw_obj_key& start, const string& prefix,
+                                uint32_t num_entries, bool list_versions, vector<RGWObjEnt>& ent_list,
+                                bool *is_truncated, rgw_obj_key *last_entry);
   int cls_bucket_head(rgw_bucket& bucket, map<string, struct rgw_bucket_dir_header>& headers, map<int, string> *bucket_instance_ids = NULL);
   int cls_bucket_head_async(rgw_bucket& bucket, RGWGetDirHeader_CB *ctx, int *num_aio);
   int list_bi_log_entries(rgw_bucket& bucket, int shard_id, string& marker, uint32_t max, std::list<rgw_bi_log_entry>& result, bool *truncated);
@@ -2071,6 +2159,9 @@ public:
 
   int list_gc_objs(int *index, string& marker, uint32_t max, bool expired_only, std::list<cls_rgw_gc_obj_info>& result, bool *truncated);
   int process_gc();
+  int get_gc_num_shards();
+  RGWLC *get_lc() { return lc; }
+  int get_gc_shard_backlog(int index, RGWGCShardBacklog& backlog);
   int defer_gc(void *ctx, rgw_obj& obj);
 
   int bucket_check_index(rgw_bucket& bucket,
@@ -2137,6 +2228,11 @@ public:
   void get_bucket_index_objects(const string& bucket_oid_base, uint32_t num_shards,
       map<int, string>& bucket_objs, int shard_id = -1);
 
+  /**
+   * Get the base name of the bucket index objects of the given index generation.
+   */
+  void get_bucket_index_oid_base(rgw_bucket& bucket, uint32_t index_gen, string *bucket_oid_base);
+
   /**
    * Get the bucket index object with the given base bucket index object and object key,
    * and the number of bucket index shards.
@@ -2152,6 +2248,13 @@ public:
   int get_bucket_index_object(const string& bucket_oid_base, const string& obj_key,
       uint32_t num_shards, RGWBucketInfo::BIShardsHashType hash_type, string *bucket_obj, int *shard);
 
+  /**
+   * Get the key an object is hashed by to find its bucket index shard, given
+   * the name of its bucket index entry. Multipart upload meta objects are
+   * hashed by the name of the object being uploaded.
+   */
+  static string get_bucket_index_hash_source(const string& index_key_name);
+
   /**
    * Check the actual on-disk state of the object specified
    * by list_state, and fill in the time and size of object.
@@ -2172,6 +2275,23 @@ public:
                        RGWObjEnt& object,
                        bufferlist& suggested_updates);
 
+  /**
+   * Fill in object from a bucket index entry, checking the state of the
+   * object on disk if the entry has pending operations.
+   *
+   * Returns 0 on success, -ENOENT if the object doesn't exist on disk,
+   * and -errno on other failures.
+   */
+  int get_bucket_list_entry(librados::IoCtx& index_ctx, rgw_bucket& bucket,
+                            rgw_bucket_dir_entry& dirent, bool force_check,
+                            RGWObjEnt& object, bufferlist& suggested_updates);
+  /* send off the updates suggested by check_disk_state(), keyed by index object */
+  void suggest_bucket_index_changes(librados::IoCtx& index_ctx, map<string, bufferlist>& updates);
+
+  int init_bucket_list_shards(rgw_bucket& bucket, rgw_obj_key& start, const string& prefix,
+                              uint32_t num_entries, bool list_versions, RGWBucketListShards *list_shards);
+  int read_bucket_list_shards(RGWBucketListShards *list_shards, map<int, string>& oids);
+
   bool bucket_is_system(rgw_bucket& bucket) {
     return (bucket.name[0] == '.');
   }
@@ -0,0 +1,743 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "rgw_reshard.h"
+#include "include/rados/librados.hpp"
+#include "cls/rgw/cls_rgw_client.h"
+#include "cls/lock/cls_lock_client.h"
+
+#include <list>
+#include <set>
+
+#define dout_subsys ceph_subsys_rgw
+
+using namespace std;
+using namespace librados;
+
+static string bucket_reshard_lock_name = "bucket_reshard";
+static string reshard_oid = "reshard";
+static string reshard_lock_name = "reshard_process";
+
+#define RESHARD_LIST_MAX 1000
+/* stop copying the log before the switch once a round copies this few keys */
+#define RESHARD_CATCH_UP_KEYS 100
+#define RESHARD_MAX_CATCH_UP_ROUNDS 10
+#define RESHARD_UPDATE_RETRIES 10
+
+enum ReshardStep {
+  RESHARD_STEP_START,
+  RESHARD_STEP_SWITCH,
+  RESHARD_STEP_CANCEL,
+};
+
+static int wait_for_completion(list<AioCompletion *>& pending)
+{
+  AioCompletion *c = pending.front();
+  pending.pop_front();
+  c->wait_for_safe();
+  int r = c->get_return_value();
+  c->release();
+  return r;
+}
+
+static int list_key_entries(IoCtx& index_ctx, const string& oid, const string& name,
+                            list<rgw_cls_bi_entry> *entries)
+{
+  string marker;
+  bool is_truncated = true;
+  while (is_truncated) {
+    list<rgw_cls_bi_entry> result;
+    int ret = cls_rgw_bi_list(index_ctx, oid, name, marker, RESHARD_LIST_MAX, &result, &is_truncated);
+    if (ret < 0) {
+      return ret;
+    }
+    if (result.empty()) {
+      break;
+    }
+    marker = result.back().idx;
+    entries->splice(entries->end(), result);
+  }
+  return 0;
+}
+
+RGWBucketReshard::RGWBucketReshard(RGWRados *_store, const RGWBucketInfo& _bucket_info,
+                                   const map<string, bufferlist>& _bucket_attrs)
+  : store(_store), cct(_store->ctx()), bucket_info(_bucket_info), bucket_attrs(_bucket_attrs),
+    new_num_shards(0), new_index_gen(0), reshard_lock(bucket_reshard_lock_name)
+{
+}
+
+int RGWBucketReshard::renew_lock()
+{
+  utime_t now = ceph_clock_now(cct);
+  if (now - lock_renewed < utime_t(cct->_conf->rgw_reshard_lock_duration / 2, 0)) {
+    return 0;
+  }
+
+  reshard_lock.set_renew(true);
+  int ret = reshard_lock.lock_exclusive(&index_ctx, lock_oid);
+  if (ret < 0) {
+    ldout(cct, 0) << "ERROR: failed to renew reshard lock on " << lock_oid << " ret=" << ret << dendl;
+    return ret;
+  }
+  lock_renewed = now;
+  return 0;
+}
+
+int RGWBucketReshard::update_bucket_info(int step)
+{
+  for (int i = 0; i < RESHARD_UPDATE_RETRIES; ++i) {
+    switch (step) {
+      case RESHARD_STEP_START:
+        bucket_info.reshard_status = RGWBucketInfo::RESHARD_IN_PROGRESS;
+        bucket_info.new_num_shards = new_num_shards;
+        break;
+      case RESHARD_STEP_SWITCH:
+        bucket_info.num_shards = new_num_shards;
+        bucket_info.index_gen = new_index_gen;
+        /* fall through */
+      case RESHARD_STEP_CANCEL:
+        bucket_info.reshard_status = RGWBucketInfo::RESHARD_NONE;
+        bucket_info.new_num_shards = 0;
+        break;
+    }
+
+    int ret = store->put_bucket_instance_info(bucket_info, false, 0, &bucket_attrs);
+    if (ret != -ECANCELED) {
+      return ret;
+    }
+
+    /* raced with another update of the bucket instance */
+    RGWObjectCtx obj_ctx(store);
+    bucket_attrs.clear();
+    ret = store->get_bucket_instance_info(obj_ctx, bucket_info.bucket, bucket_info, NULL, &bucket_attrs);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+  return -ECANCELED;
+}
+
+int RGWBucketReshard::get_new_shard(const string& key_name, string *oid, int *shard_id)
+{
+  return store->get_bucket_index_object(new_oid_base, RGWRados::get_bucket_index_hash_source(key_name), new_num_shards,
+                                        (RGWBucketInfo::BIShardsHashType)bucket_info.bucket_index_shard_hash_type,
+                                        oid, shard_id);
+}
+
+int RGWBucketReshard::write_entries(map<int, list<rgw_cls_bi_entry> >& entries)
+{
+  uint32_t max_aio = cct->_conf->rgw_bucket_index_max_aio;
+  list<AioCompletion *> pending;
+  int ret = 0;
+
+  map<int, list<rgw_cls_bi_entry> >::iterator iter;
+  for (iter = entries.begin(); iter != entries.end(); ++iter) {
+    ObjectWriteOperation op;
+    list<rgw_cls_bi_entry>::iterator eiter;
+    for (eiter = iter->second.begin(); eiter != iter->second.end(); ++eiter) {
+      cls_rgw_bi_put(op, *eiter);
+    }
+
+    AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+    int r = index_ctx.aio_operate(new_oids[iter->first], c, &op);
+    if (r < 0) {
+      c->release();
+      ret = r;
+      break;
+    }
+    pending.push_back(c);
+
+    while (pending.size() >= max_aio && ret >= 0) {
+      ret = wait_for_completion(pending);
+    }
+    if (ret < 0) {
+      break;
+    }
+  }
+
+  while (!pending.empty()) {
+    int r = wait_for_completion(pending);
+    if (r < 0 && ret >= 0) {
+      ret = r;
+    }
+  }
+  return ret;
+}
+
+int RGWBucketReshard::copy_entries(uint64_t *num_entries)
+{
+  *num_entries = 0;
+
+  map<int, string>::iterator iter;
+  for (iter = old_oids.begin(); iter != old_oids.end(); ++iter) {
+    string marker;
+    bool is_truncated = true;
+    while (is_truncated) {
+      list<rgw_cls_bi_entry> entries;
+      int ret = cls_rgw_bi_list(index_ctx, iter->second, string(), marker, RESHARD_LIST_MAX,
+                                &entries, &is_truncated);
+      if (ret < 0) {
+        ldout(cct, 0) << "ERROR: failed to list index entries of " << iter->second << " ret=" << ret << dendl;
+        return ret;
+      }
+
+      map<int, list<rgw_cls_bi_entry> > new_entries;
+      list<rgw_cls_bi_entry>::iterator eiter;
+      for (eiter = entries.begin(); eiter != entries.end(); ++eiter) {
+        rgw_cls_bi_entry& entry = *eiter;
+        marker = entry.idx;
+
+        cls_rgw_obj_key key;
+        ret = entry.get_key(&key);
+        if (ret < 0) {
+          ldout(cct, 0) << "ERROR: failed to decode index entry " << entry.idx << " of "
+                        << iter->second << " ret=" << ret << dendl;
+          return ret;
+        }
+
+        string oid;
+        int shard_id;
+        ret = get_new_shard(key.name, &oid, &shard_id);
+        if (ret < 0) {
+          return ret;
+        }
+        new_entries[shard_id].push_back(entry);
+      }
+
+      ret = write_entries(new_entries);
+      if (ret < 0) {
+        ldout(cct, 0) << "ERROR: failed to write index entries ret=" << ret << dendl;
+        return ret;
+      }
+      *num_entries += entries.size();
+
+      ret = renew_lock();
+      if (ret < 0) {
+        return ret;
+      }
+    }
+  }
+  return 0;
+}
+
+int RGWBucketReshard::get_log_markers(BucketIndexShardsManager *markers)
+{
+  map<int, rgw_cls_list_ret> headers;
+  map<int, string>::iterator iter;
+  for (iter = old_oids.begin(); iter != old_oids.end(); ++iter) {
+    headers[iter->first] = rgw_cls_list_ret();
+  }
+
+  int ret = CLSRGWIssueGetDirHeader(index_ctx, old_oids, headers, cct->_conf->rgw_bucket_index_max_aio)();
+  if (ret < 0) {
+    return ret;
+  }
+
+  map<int, rgw_cls_list_ret>::iterator hiter;
+  for (hiter = headers.begin(); hiter != headers.end(); ++hiter) {
+    markers->add(hiter->first, hiter->second.dir.header.max_marker);
+  }
+  return 0;
+}
+
+/*
+ * make the entries of an object in the new index match the ones in the old
+ * index
+ */
+int RGWBucketReshard::sync_key(const string& old_oid, const string& name, int *new_shard_id)
+{
+  list<rgw_cls_bi_entry> old_entries;
+  int ret = list_key_entries(index_ctx, old_oid, name, &old_entries);
+  if (ret < 0) {
+    return ret;
+  }
+
+  string new_oid;
+  int shard_id;
+  ret = get_new_shard(name, &new_oid, &shard_id);
+  if (ret < 0) {
+    return ret;
+  }
+  *new_shard_id = shard_id;
+
+  list<rgw_cls_bi_entry> new_entries;
+  ret = list_key_entries(index_ctx, new_oid, name, &new_entries);
+  if (ret < 0) {
+    return ret;
+  }
+
+  if (old_entries.empty() && new_entries.empty()) {
+    return 0;
+  }
+
+  set<string> stale_keys;
+  list<rgw_cls_bi_entry>::iterator iter;
+  for (iter = new_entries.begin(); iter != new_entries.end(); ++iter) {
+    stale_keys.insert(iter->idx);
+  }
+
+  ObjectWriteOperation op;
+  for (iter = old_entries.begin(); iter != old_entries.end(); ++iter) {
+    stale_keys.erase(iter->idx);
+    cls_rgw_bi_put(op, *iter);
+  }
+  if (!stale_keys.empty()) {
+    op.omap_rm_keys(stale_keys);
+  }
+
+  return index_ctx.operate(new_oid, &op);
+}
+
+/*
+ * copy the keys that were changed in the old index since the given log
+ * markers, and advance the markers. The entries are copied as they are,
+ * without updating the stats in the headers of the new shards; the ids of
+ * the new shards they went to are added to new_shards.
+ */
+int RGWBucketReshard::catch_up(BucketIndexShardsManager& markers, uint64_t *num_keys, set<int> *new_shards)
+{
+  *num_keys = 0;
+
+  map<int, string> oids = old_oids;
+  while (!oids.empty()) {
+    map<int, cls_rgw_bi_log_list_ret> logs;
+    int ret = CLSRGWIssueBILogList(index_ctx, markers, RESHARD_LIST_MAX, oids, logs,
+                                   cct->_conf->rgw_bucket_index_max_aio)();
+    if (ret < 0) {
+      ldout(cct, 0) << "ERROR: failed to list bucket index log ret=" << ret << dendl;
+      return ret;
+    }
+
+    map<int, cls_rgw_bi_log_list_ret>::iterator iter;
+    for (iter = logs.begin(); iter != logs.end(); ++iter) {
+      int shard_id = iter->first;
+      list<rgw_bi_log_entry>& entries = iter->second.entries;
+
+      set<string> names;
+      list<rgw_bi_log_entry>::iterator eiter;
+      for (eiter = entries.begin(); eiter != entries.end(); ++eiter) {
+        names.insert(eiter->object);
+        markers.add(shard_id, eiter->id);
+      }
+
+      set<string>::iterator niter;
+      for (niter = names.begin(); niter != names.end(); ++niter) {
+        int new_shard_id;
+        ret = sync_key(old_oids[shard_id], *niter, &new_shard_id);
+        if (ret < 0) {
+          ldout(cct, 0) << "ERROR: failed to copy index entries of " << *niter << " ret=" << ret << dendl;
+          return ret;
+        }
+        if (new_shards) {
+          new_shards->insert(new_shard_id);
+        }
+      }
+      *num_keys += names.size();
+
+      if (!iter->second.truncated) {
+        oids.erase(shard_id);
+      }
+    }
+
+    ret = renew_lock();
+    if (ret < 0) {
+      return ret;
+    }
+  }
+  return 0;
+}
+
+/*
+ * recalculate the stats in the headers of the given new shards from their
+ * entries
+ */
+int RGWBucketReshard::rebuild_stats(const set<int>& shards)
+{
+  map<int, string> oids;
+  for (set<int>::const_iterator iter = shards.begin(); iter != shards.end(); ++iter) {
+    oids[*iter] = new_oids[*iter];
+  }
+  if (oids.empty()) {
+    return 0;
+  }
+  return CLSRGWIssueBucketRebuild(index_ctx, oids, cct->_conf->rgw_bucket_index_max_aio)();
+}
+
+/*
+ * gateways that still have the old bucket instance cached may list the old
+ * shards for a little while
+ */
+void RGWBucketReshard::wait_grace()
+{
+  utime_t end = ceph_clock_now(cct);
+  end += utime_t(cct->_conf->rgw_reshard_old_index_grace, 0);
+  while (ceph_clock_now(cct) < end) {
+    sleep(1);
+    if (renew_lock() < 0) {
+      break;
+    }
+  }
+}
+
+void RGWBucketReshard::cancel()
+{
+  uint32_t max_aio = cct->_conf->rgw_bucket_index_max_aio;
+
+  int ret = CLSRGWIssueSetBucketResharding(index_ctx, old_oids, max_aio, CLS_RGW_RESHARD_NONE)();
+  if (ret < 0) {
+    ldout(cct, 0) << "ERROR: failed to clear the resharding flag of the bucket index ret=" << ret << dendl;
+  }
+
+  ret = update_bucket_info(RESHARD_STEP_CANCEL);
+  if (ret < 0) {
+    ldout(cct, 0) << "ERROR: failed to reset the reshard status of bucket " << bucket_info.bucket.name
+                  << " ret=" << ret << dendl;
+  }
+
+  map<int, string>::iterator iter;
+  for (iter = new_oids.begin(); iter != new_oids.end(); ++iter) {
+    index_ctx.remove(iter->second);
+  }
+
+  reshard_lock.unlock(&index_ctx, lock_oid);
+}
+
+int RGWBucketReshard::execute(uint32_t num_shards)
+{
+  const string& bucket_name = bucket_info.bucket.name;
+
+  if (store->need_to_log_data()) {
+    ldout(cct, 0) << "ERROR: bucket indexes cannot be resharded in a zone that logs data changes" << dendl;
+    return -ENOTSUP;
+  }
+  if (bucket_info.num_shards == RGWBucketInfo::NUM_SHARDS_BLIND_BUCKET) {
+    ldout(cct, 0) << "ERROR: bucket " << bucket_name << " has no index" << dendl;
+    return -EINVAL;
+  }
+  if (num_shards == 0 || num_shards > MAX_BUCKET_INDEX_SHARDS_PRIME) {
+    ldout(cct, 0) << "ERROR: invalid number of bucket index shards: " << num_shards << dendl;
+    return -EINVAL;
+  }
+
+  int ret = store->open_bucket_index(bucket_info.bucket, index_ctx, old_oids);
+  if (ret < 0) {
+    return ret;
+  }
+
+  /* the lock goes away with the old index, don't recreate it if a
+   * concurrent reshard already removed it */
+  lock_oid = old_oids.begin()->second;
+  reshard_lock.set_duration(utime_t(cct->_conf->rgw_reshard_lock_duration, 0));
+  ObjectWriteOperation lock_op;
+  lock_op.assert_exists();
+  reshard_lock.lock_exclusive(&lock_op);
+  ret = index_ctx.operate(lock_oid, &lock_op);
+  if (ret == -EBUSY || ret == -EEXIST) {
+    ldout(cct, 0) << "bucket " << bucket_name << " is already being resharded" << dendl;
+    return -EBUSY;
+  }
+  if (ret == -ENOENT) {
+    ldout(cct, 0) << "bucket " << bucket_name << " was resharded concurrently" << dendl;
+    return -EBUSY;
+  }
+  if (ret < 0) {
+    return ret;
+  }
+  lock_renewed = ceph_clock_now(cct);
+
+  /* reread the bucket instance now that no one else can reshard it */
+  RGWObjectCtx obj_ctx(store);
+  bucket_attrs.clear();
+  ret = store->get_bucket_instance_info(obj_ctx, bucket_info.bucket, bucket_info, NULL, &bucket_attrs);
+  if (ret < 0) {
+    reshard_lock.unlock(&index_ctx, lock_oid);
+    return ret;
+  }
+  if (bucket_info.resharding()) {
+    ldout(cct, 0) << "restarting interrupted reshard of bucket " << bucket_name << dendl;
+  }
+
+  uint32_t max_aio = cct->_conf->rgw_bucket_index_max_aio;
+  new_num_shards = num_shards;
+  new_index_gen = bucket_info.index_gen + 1;
+  store->get_bucket_index_oid_base(bucket_info.bucket, new_index_gen, &new_oid_base);
+  store->get_bucket_index_objects(new_oid_base, new_num_shards, new_oids);
+
+  ret = update_bucket_info(RESHARD_STEP_START);
+  if (ret < 0) {
+    ldout(cct, 0) << "ERROR: failed to update bucket instance of " << bucket_name << " ret=" << ret << dendl;
+    reshard_lock.unlock(&index_ctx, lock_oid);
+    return ret;
+  }
+
+  /* leftovers of an interrupted reshard */
+  map<int, string>::iterator iter;
+  for (iter = new_oids.begin(); iter != new_oids.end(); ++iter) {
+    index_ctx.remove(iter->second);
+  }
+
+  ret = CLSRGWIssueBucketIndexInit(index_ctx, new_oids, max_aio)();
+  if (ret < 0) {
+    ldout(cct, 0) << "ERROR: failed to create the new bucket index objects ret=" << ret << dendl;
+    cancel();
+    return ret;
+  }
+
+  ret = CLSRGWIssueSetBucketResharding(index_ctx, old_oids, max_aio, CLS_RGW_RESHARD_IN_PROGRESS)();
+  if (ret < 0) {
+    ldout(cct, 0) << "ERROR: failed to set the resharding flag of the bucket index ret=" << ret << dendl;
+    cancel();
+    return ret;
+  }
+
+  /* everything past these markers gets copied again */
+  BucketIndexShardsManager markers;
+  ret = get_log_markers(&markers);
+  if (ret < 0) {
+    cancel();
+    return ret;
+  }
+
+  uint64_t num_entries;
+  ret = copy_entries(&num_entries);
+  if (ret < 0) {
+    cancel();
+    return ret;
+  }
+  ldout(cct, 1) << "copied " << num_entries << " index entries of bucket " << bucket_name
+                << " to " << new_num_shards << " shards" << dendl;
+
+  uint64_t num_keys;
+  int round = 0;
+  do {
+    ret = catch_up(markers, &num_keys);
+    if (ret < 0) {
+      cancel();
+      return ret;
+    }
+    ldout(cct, 5) << "copied " << num_keys << " changed keys of bucket " << bucket_name << dendl;
+  } while (num_keys > RESHARD_CATCH_UP_KEYS && ++round < RESHARD_MAX_CATCH_UP_ROUNDS);
+
+  /* the new shards have no writers yet, recalculate their stats before
+   * switching to them */
+  ret = CLSRGWIssueBucketRebuild(index_ctx, new_oids, max_aio)();
+  if (ret < 0) {
+    ldout(cct, 0) << "ERROR: failed to rebuild the new bucket index stats ret=" << ret << dendl;
+    cancel();
+    return ret;
+  }
+
+  ret = update_bucket_info(RESHARD_STEP_SWITCH);
+  if (ret < 0) {
+    ldout(cct, 0) << "ERROR: failed to switch bucket " << bucket_name << " to the new index ret=" << ret << dendl;
+    cancel();
+    return ret;
+  }
+
+  /* gateways that haven't seen the switch yet, and requests that were in
+   * flight during it, may still send changes to the old index. Retire it:
+   * from now on it refuses them, and the gateways retry on the new index. */
+  ret = CLSRGWIssueSetBucketResharding(index_ctx, old_oids, max_aio, CLS_RGW_RESHARD_DONE)();
+  if (ret < 0) {
+    ldout(cct, 0) << "ERROR: failed to retire the old index of bucket " << bucket_name
+                  << ", keeping the old index objects ret=" << ret << dendl;
+    reshard_lock.unlock(&index_ctx, lock_oid);
+    return ret;
+  }
+
+  /* the changes that made it to the old index before that were all logged */
+  set<int> new_shards;
+  ret = catch_up(markers, &num_keys, &new_shards);
+  if (ret < 0) {
+    ldout(cct, 0) << "ERROR: failed to copy the last changes of bucket " << bucket_name
+                  << ", keeping the old index objects ret=" << ret << dendl;
+    reshard_lock.unlock(&index_ctx, lock_oid);
+    return ret;
+  }
+
+  ret = rebuild_stats(new_shards);
+  if (ret < 0) {
+    ldout(cct, 0) << "WARNING: failed to rebuild the stats of the new bucket index of " << bucket_name
+                  << " ret=" << ret << ", run bucket check --fix" << dendl;
+  }
+
+  wait_grace();
+
+  for (iter = old_oids.begin(); iter != old_oids.end(); ++iter) {
+    int r = index_ctx.remove(iter->second);
+    if (r < 0 && r != -ENOENT) {
+      ldout(cct, 0) << "WARNING: failed to remove old bucket index object " << iter->second << " r=" << r << dendl;
+    }
+  }
+
+  ldout(cct, 0) << "resharded bucket " << bucket_name << " index to " << new_num_shards << " shards" << dendl;
+  return 0;
+}
+
+uint32_t RGWReshard::get_target_shards(CephContext *cct, const RGWBucketInfo& bucket_info, uint64_t num_objs)
+{
+  if (bucket_info.num_shards == RGWBucketInfo::NUM_SHARDS_BLIND_BUCKET) {
+    return 0;
+  }
+
+  uint64_t max_objs_per_shard = cct->_conf->rgw_max_objs_per_shard;
+  uint64_t num_shards = (bucket_info.num_shards ? bucket_info.num_shards : 1);
+  if (max_objs_per_shard == 0 || num_objs <= num_shards * max_objs_per_shard) {
+    return 0;
+  }
+
+  /* leave room for the bucket to double before it needs another reshard */
+  uint64_t target = num_objs * 2 / max_objs_per_shard + 1;
+  if (target > MAX_BUCKET_INDEX_SHARDS_PRIME) {
+    target = MAX_BUCKET_INDEX_SHARDS_PRIME;
+  }
+  if (target <= num_shards) {
+    return 0;
+  }
+  return (uint32_t)target;
+}
+
+int RGWReshard::check_bucket(const string& bucket_name)
+{
+  RGWObjectCtx obj_ctx(store);
+  RGWBucketInfo bucket_info;
+  map<string, bufferlist> attrs;
+  int ret = store->get_bucket_info(obj_ctx, bucket_name, bucket_info, NULL, &attrs);
+  if (ret < 0) {
+    return ret;
+  }
+  if (store->bucket_is_system(bucket_info.bucket)) {
+    return 0;
+  }
+
+  string bucket_ver, master_ver;
+  map<RGWObjCategory, RGWStorageStats> stats;
+  ret = store->get_bucket_stats(bucket_info.bucket, &bucket_ver, &master_ver, stats, NULL);
+  if (ret < 0) {
+    return ret;
+  }
+
+  uint64_t num_objs = 0;
+  map<RGWObjCategory, RGWStorageStats>::iterator iter;
+  for (iter = stats.begin(); iter != stats.end(); ++iter) {
+    num_objs += iter->second.num_objects;
+  }
+
+  uint32_t num_shards = get_target_shards(cct, bucket_info, num_objs);
+  if (!num_shards) {
+    return 0;
+  }
+
+  ldout(cct, 0) << "resharding index of bucket " << bucket_name << " with " << num_objs
+                << " objects from " << bucket_info.num_shards << " to " << num_shards << " shards" << dendl;
+
+  RGWBucketReshard reshard(store, bucket_info, attrs);
+  ret = reshard.execute(num_shards);
+  if (ret == -EBUSY) {
+    return 0;
+  }
+  return ret;
+}
+
+int RGWReshard::process()
+{
+  rados::cls::lock::Lock l(reshard_lock_name);
+  utime_t time(cct->_conf->rgw_reshard_thread_interval, 0);
+  l.set_duration(time);
+
+  int ret = l.lock_exclusive(&store->gc_pool_ctx, reshard_oid);
+  if (ret == -EBUSY) { /* already locked by another reshard processor */
+    dout(0) << "RGWReshard::process() failed to acquire lock on " << reshard_oid << dendl;
+    return 0;
+  }
+  if (ret < 0)
+    return ret;
+
+  void *handle;
+  string section = "bucket";
+  ret = store->meta_mgr->list_keys_init(section, &handle);
+  if (ret < 0) {
+    l.unlock(&store->gc_pool_ctx, reshard_oid);
+    return ret;
+  }
+
+  bool truncated;
+  do {
+    list<string> keys;
+    ret = store->meta_mgr->list_keys_next(handle, RESHARD_LIST_MAX, keys, &truncated);
+    if (ret < 0) {
+      break;
+    }
+
+    list<string>::iterator iter;
+    for (iter = keys.begin(); iter != keys.end() && !going_down(); ++iter) {
+      int r = check_bucket(*iter);
+      if (r < 0) {
+        ldout(cct, 0) << "WARNING: failed to check index of bucket " << *iter << " r=" << r << dendl;
+      }
+    }
+  } while (truncated && !going_down());
+
+  store->meta_mgr->list_keys_complete(handle);
+  l.unlock(&store->gc_pool_ctx, reshard_oid);
+  return ret;
+}
+
+bool RGWReshard::going_down()
+{
+  return (down_flag.read() != 0);
+}
+
+void RGWReshard::start_processor()
+{
+  worker = new ReshardWorker(cct, this);
+  worker->create();
+}
+
+void RGWReshard::stop_processor()
+{
+  down_flag.set(1);
+  if (worker) {
+    worker->stop();
+    worker->join();
+  }
+  delete worker;
+  worker = NULL;
+}
+
+void *RGWReshard::ReshardWorker::entry() {
+  do {
+    utime_t start = ceph_clock_now(cct);
+    dout(2) << "bucket index reshard: start" << dendl;
+    int r = reshard->process();
+    if (r < 0) {
+      dout(0) << "ERROR: bucket index reshard process() returned error r=" << r << dendl;
+    }
+    dout(2) << "bucket index reshard: stop" << dendl;
+
+    if (reshard->going_down())
+      break;
+
+    utime_t end = ceph_clock_now(cct);
+    end -= start;
+    int secs = cct->_conf->rgw_reshard_thread_interval;
+
+    if (secs <= end.sec())
+      continue; // next round
+
+    secs -= end.sec();
+
+    lock.Lock();
+    cond.WaitInterval(cct, lock, utime_t(secs, 0));
+    lock.Unlock();
+  } while (!reshard->going_down());
+
+  return NULL;
+}
+
+void RGWReshard::ReshardWorker::stop()
+{
+  Mutex::Locker l(lock);
+  cond.Signal();
+}
@@ -0,0 +1,117 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_RGW_RESHARD_H
+#define CEPH_RGW_RESHARD_H
+
+
+#include "include/types.h"
+#include "include/atomic.h"
+#include "include/rados/librados.hpp"
+#include "common/Mutex.h"
+#include "common/Cond.h"
+#include "common/Thread.h"
+#include "cls/lock/cls_lock_client.h"
+#include "cls/rgw/cls_rgw_client.h"
+#include "rgw_common.h"
+#include "rgw_rados.h"
+
+/*
+ * Moves the index of a bucket to a different number of shards while the
+ * bucket keeps being written to.
+ *
+ * The old shards are flagged so that every change to them gets logged, the
+ * index entries are copied to the new shards, and the keys that were logged
+ * in the meantime are copied again. The bucket instance is then switched to
+ * the new shards (which belong to the next index generation) and the old
+ * shards are retired: from then on they refuse changes, and gateways that
+ * still send changes to them look up the bucket instance again and retry on
+ * the new shards. The keys that changed during the switch are copied one
+ * last time, and the old shards are removed after a grace period.
+ */
+class RGWBucketReshard {
+  RGWRados *store;
+  CephContext *cct;
+  RGWBucketInfo bucket_info;
+  map<string, bufferlist> bucket_attrs;
+
+  librados::IoCtx index_ctx;
+  map<int, string> old_oids;
+  map<int, string> new_oids;
+  string new_oid_base;
+  uint32_t new_num_shards;
+  uint32_t new_index_gen;
+
+  rados::cls::lock::Lock reshard_lock;
+  string lock_oid;
+  utime_t lock_renewed;
+
+  int renew_lock();
+  int update_bucket_info(int step);
+  int get_new_shard(const string& key_name, string *oid, int *shard_id);
+  int write_entries(map<int, list<rgw_cls_bi_entry> >& entries);
+  int copy_entries(uint64_t *num_entries);
+  int get_log_markers(BucketIndexShardsManager *markers);
+  int sync_key(const string& old_oid, const string& name, int *new_shard_id);
+  int catch_up(BucketIndexShardsManager& markers, uint64_t *num_keys, set<int> *new_shards = NULL);
+  int rebuild_stats(const set<int>& shards);
+  void wait_grace();
+  void cancel();
+
+public:
+  RGWBucketReshard(RGWRados *_store, const RGWBucketInfo& _bucket_info,
+                   const map<string, bufferlist>& _bucket_attrs);
+
+  /*
+   * Reshard the bucket index to num_shards shards.
+   * Returns -EBUSY if the bucket is already being resharded.
+   */
+  int execute(uint32_t num_shards);
+};
+
+/*
+ * Background thread that reshards the indexes of buckets that grew past
+ * rgw_max_objs_per_shard objects per shard.
+ */
+class RGWReshard {
+  CephContext *cct;
+  RGWRados *store;
+  atomic_t down_flag;
+
+  class ReshardWorker : public Thread {
+    CephContext *cct;
+    RGWReshard *reshard;
+    Mutex lock;
+    Cond cond;
+
+  public:
+    ReshardWorker(CephContext *_cct, RGWReshard *_reshard) : cct(_cct), reshard(_reshard), lock("ReshardWorker") {}
+    void *entry();
+    void stop();
+  };
+
+  ReshardWorker *worker;
+
+  int check_bucket(const string& bucket_name);
+
+public:
+  RGWReshard(CephContext *_cct, RGWRados *_store) : cct(_cct), store(_store), worker(NULL) {}
+  ~RGWReshard() {
+    stop_processor();
+  }
+
+  /*
+   * Get the number of shards the index of a bucket with num_objs objects
+   * should be resharded to, or 0 if it does not need to be resharded.
+   */
+  static uint32_t get_target_shards(CephContext *cct, const RGWBucketInfo& bucket_info, uint64_t num_objs);
+
+  int process();
+
+  bool going_down();
+  void start_processor();
+  void stop_processor();
+};
+
+
+#endif
@@ -15,6 +15,7 @@
 #include "rgw_rest_swift.h"
 #include "rgw_rest_s3.h"
 #include "rgw_swift_auth.h"
+#include "rgw_auth_s3.h"
 #include "rgw_cors_s3.h"
 #include "rgw_http_errors.h"
 
@@ -954,12 +955,30 @@ static int read_all_chunked_input(req_state *s, char **pdata, int *plen, int max
   return 0;
 }
 
+/* a signature v4 request signs its whole body through x-amz-content-sha256 */
+static int verify_aws4_payload(struct req_state *s, char *data, int len)
+{
+  RGWAWS4PayloadVerifier verifier(s->aws4_auth);
+  bufferlist bl;
+  int ret = verifier.append(data, len, bl);
+  if (ret < 0)
+    return ret;
+  return verifier.complete();
+}
+
 int rgw_rest_read_all_input(struct req_state *s, char **pdata, int *plen, int max_len)
 {
   size_t cl = 0;
   int len = 0;
   char *data = NULL;
 
+  bool verify_payload = (s->aws4_auth && !s->aws4_auth->is_unsigned_payload());
+  if (verify_payload && s->aws4_auth->is_streaming()) {
+    /* aws-chunked is only supported for object uploads */
+    ldout(s->cct, 5) << "NOTICE: aws-chunked payload on a request that reads its body at once" << dendl;
+    return -ERR_INVALID_REQUEST;
+  }
+
   if (s->length)
     cl = atoll(s->length);
   if (cl) {
@@ -986,6 +1005,14 @@ int rgw_rest_read_all_input(struct req_state *s, char **pdata, int *plen, int ma
       return ret;
   }
 
+  if (verify_payload) {
+    int ret = verify_aws4_payload(s, data, len);
+    if (ret < 0) {
+      free(data);
+      return ret;
+    }
+  }
+
   *plen = len;
   *pdata = data;
 
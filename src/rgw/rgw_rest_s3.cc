@@ -8,6 +8,7 @@
 #include "common/Formatter.h"
 #include "common/utf8.h"
 #include "common/ceph_json.h"
+#include "include/str_list.h"
 
 #include "rgw_rest.h"
 #include "rgw_rest_s3.h"
@@ -179,7 +180,7 @@ done:
 
 send_data:
   if (get_data && !ret) {
-    int r = s->cio->write(bl.c_str() + bl_ofs, bl_len);
+    int r = s->cio->write(bl, bl_ofs, bl_len);
     if (r < 0)
       return r;
   }
@@ -243,6 +244,10 @@ int RGWListBucket_ObjStore_S3::get_params()
     return ret;
   }
   delimiter = s->info.args.get("delimiter");
+  s->info.args.get_bool("allow-unordered", &allow_unordered, false);
+  if (allow_unordered && !delimiter.empty()) {
+    return -EINVAL;
+  }
   return 0;
 }
 
@@ -670,9 +675,80 @@ int RGWPutObj_ObjStore_S3::get_params()
   if_match = s->info.env->get("HTTP_IF_MATCH");
   if_nomatch = s->info.env->get("HTTP_IF_NONE_MATCH");
 
+  if (s->aws4_auth && !s->aws4_auth->is_unsigned_payload()) {
+    raw_len = s->content_length;
+    if (s->aws4_auth->is_streaming()) {
+      /* the content length covers the chunk framing too */
+      const char *decoded_len = s->info.env->get("HTTP_X_AMZ_DECODED_CONTENT_LENGTH");
+      if (!decoded_len)
+        return -ERR_LENGTH_REQUIRED;
+      string err;
+      s->content_length = strict_strtoll(decoded_len, 10, &err);
+      if (!err.empty() || s->content_length < 0)
+        return -EINVAL;
+
+      /* aws-chunked is the transfer encoding, it isn't part of the object */
+      map<string, string>::iterator iter = s->generic_attrs.find(RGW_ATTR_CONTENT_ENC);
+      if (iter != s->generic_attrs.end()) {
+        vector<string> encodings;
+        get_str_vec(iter->second, ", ", encodings);
+        encodings.erase(remove(encodings.begin(), encodings.end(), "aws-chunked"), encodings.end());
+        if (encodings.empty()) {
+          s->generic_attrs.erase(iter);
+        } else {
+          iter->second = str_join(encodings, ",");
+        }
+      }
+    }
+    aws4_verifier = new RGWAWS4PayloadVerifier(s->aws4_auth);
+  }
+
   return RGWPutObj_ObjStore::get_params();
 }
 
+RGWPutObj_ObjStore_S3::~RGWPutObj_ObjStore_S3()
+{
+  delete aws4_verifier;
+}
+
+int RGWPutObj_ObjStore_S3::get_data(bufferlist& bl)
+{
+  if (!aws4_verifier)
+    return RGWPutObj_ObjStore::get_data(bl);
+
+  /*
+   * the payload is verified as it is read, read the raw body until some
+   * payload comes out of it (an aws-chunked read may hold only framing)
+   */
+  uint64_t chunk_size = s->cct->_conf->rgw_max_chunk_size;
+  while (bl.length() == 0) {
+    uint64_t cl = min(raw_len - raw_ofs, chunk_size);
+    if (!cl) {
+      return aws4_verifier->complete();
+    }
+
+    bufferptr bp(cl);
+    int read_len; /* cio->read() expects int * */
+    int r = s->cio->read(bp.c_str(), cl, &read_len);
+    if (r < 0)
+      return r;
+    if (!read_len) {
+      return aws4_verifier->complete();
+    }
+    raw_ofs += read_len;
+
+    r = aws4_verifier->append(bp.c_str(), read_len, bl);
+    if (r < 0)
+      return r;
+  }
+
+  if ((uint64_t)ofs + bl.length() > s->cct->_conf->rgw_max_put_size) {
+    return -ERR_TOO_LARGE;
+  }
+
+  return bl.length();
+}
+
 static int get_success_retcode(int code)
 {
   switch (code) {
@@ -2276,6 +2352,115 @@ static void init_anon_user(struct req_state *s)
   s->perm_mask = RGW_PERM_FULL_CONTROL;
 }
 
+/*
+ * find the access key the request was signed with and set the permissions
+ * of the request from the (sub)user it belongs to
+ */
+static int get_request_key(struct req_state *s, const string& auth_id, RGWAccessKey **key)
+{
+  map<string, RGWAccessKey>::iterator iter = s->user.access_keys.find(auth_id);
+  if (iter == s->user.access_keys.end()) {
+    dout(0) << "ERROR: access key not encoded in user info" << dendl;
+    return -EPERM;
+  }
+  RGWAccessKey& k = iter->second;
+
+  if (!k.subuser.empty()) {
+    map<string, RGWSubUser>::iterator uiter = s->user.subusers.find(k.subuser);
+    if (uiter == s->user.subusers.end()) {
+      dout(0) << "NOTICE: could not find subuser: " << k.subuser << dendl;
+      return -EPERM;
+    }
+    RGWSubUser& subuser = uiter->second;
+    s->perm_mask = subuser.perm_mask;
+  } else
+    s->perm_mask = RGW_PERM_FULL_CONTROL;
+
+  *key = &k;
+  return 0;
+}
+
+static int init_system_request(RGWRados *store, struct req_state *s)
+{
+  if (!s->user.system)
+    return 0;
+
+  s->system_request = true;
+  dout(20) << "system request" << dendl;
+  s->info.args.set_system();
+  string effective_uid = s->info.args.get(RGW_SYS_PARAM_PREFIX "uid");
+  RGWUserInfo effective_user;
+  if (!effective_uid.empty()) {
+    int ret = rgw_get_user_info_by_uid(store, effective_uid, effective_user);
+    if (ret < 0) {
+      ldout(s->cct, 0) << "User lookup failed!" << dendl;
+      return -ENOENT;
+    }
+    s->user = effective_user;
+  }
+  return 0;
+}
+
+/*
+ * verify a request signed with signature version 4. Only the rados
+ * backend can do it, keystone's s3tokens api takes v2 signatures.
+ */
+int RGW_Auth_S3::authorize_v4(RGWRados *store, struct req_state *s)
+{
+  if (!store->ctx()->_conf->rgw_s3_auth_use_rados) {
+    dout(5) << "NOTICE: signature v4 requires rgw_s3_auth_use_rados" << dendl;
+    return -EPERM;
+  }
+
+  bool qsr = !(s->http_auth && *s->http_auth);
+  rgw_aws4_auth *auth = new rgw_aws4_auth;
+  s->aws4_auth = auth;
+
+  utime_t expires;
+  int ret = rgw_parse_aws4_auth(s->info, s->http_auth, auth, &s->header_time, &expires);
+  if (ret < 0) {
+    return ret;
+  }
+
+  utime_t now = ceph_clock_now(s->cct);
+  if (qsr) {
+    if (now >= expires)
+      return -EPERM;
+  } else {
+    time_t req_sec = s->header_time.sec();
+    if (req_sec < now.sec() - RGW_AUTH_GRACE_MINS * 60 ||
+        req_sec > now.sec() + RGW_AUTH_GRACE_MINS * 60) {
+      dout(0) << "NOTICE: request time skew too big now=" << now << " req_time=" << s->header_time << dendl;
+      return -ERR_REQUEST_TIME_SKEWED;
+    }
+  }
+
+  if (rgw_get_user_info_by_access_key(store, auth->access_key_id, s->user) < 0) {
+    dout(5) << "error reading user info, uid=" << auth->access_key_id << " can't authenticate" << dendl;
+    return -ERR_INVALID_ACCESS_KEY;
+  }
+
+  RGWAccessKey *k;
+  ret = get_request_key(s, auth->access_key_id, &k);
+  if (ret < 0) {
+    return ret;
+  }
+
+  rgw_get_aws4_signing_key(k->key, auth->credential_scope, auth->signing_key);
+
+  string signature;
+  rgw_get_aws4_signature(s->info, auth, qsr, signature);
+
+  dout(15) << "calculated signature=" << signature << dendl;
+  dout(15) << "auth_sign=" << auth->signature << dendl;
+
+  if (auth->signature != signature) {
+    return -ERR_SIGNATURE_NO_MATCH;
+  }
+
+  return init_system_request(store, s);
+}
+
 /*
  * verify that a signed request comes from the keyholder
  * by checking the signature against our locally-computed version
@@ -2301,6 +2486,16 @@ int RGW_Auth_S3::authorize(RGWRados *store, struct req_state *s)
     return 0;
   }
 
+  if (rgw_is_aws4_request(s->info, s->http_auth)) {
+    int ret = authorize_v4(store, s);
+    if (ret < 0)
+      return ret;
+
+    s->owner.set_id(s->user.user_id);
+    s->owner.set_name(s->user.display_name);
+    return 0;
+  }
+
   if (!s->http_auth || !(*s->http_auth)) {
     auth_id = s->info.args.get("AWSAccessKeyId");
     if (auth_id.size()) {
@@ -2399,26 +2594,14 @@ int RGW_Auth_S3::authorize(RGWRados *store, struct req_state *s)
       return -ERR_REQUEST_TIME_SKEWED;
     }
 
-    map<string, RGWAccessKey>::iterator iter = s->user.access_keys.find(auth_id);
-    if (iter == s->user.access_keys.end()) {
-      dout(0) << "ERROR: access key not encoded in user info" << dendl;
-      return -EPERM;
+    RGWAccessKey *k;
+    int ret = get_request_key(s, auth_id, &k);
+    if (ret < 0) {
+      return ret;
     }
-    RGWAccessKey& k = iter->second;
-
-    if (!k.subuser.empty()) {
-      map<string, RGWSubUser>::iterator uiter = s->user.subusers.find(k.subuser);
-      if (uiter == s->user.subusers.end()) {
-        dout(0) << "NOTICE: could not find subuser: " << k.subuser << dendl;
-        return -EPERM;
-      }
-      RGWSubUser& subuser = uiter->second;
-      s->perm_mask = subuser.perm_mask;
-    } else
-      s->perm_mask = RGW_PERM_FULL_CONTROL;
 
     string digest;
-    int ret = rgw_get_s3_header_digest(auth_hdr, k.key, digest);
+    ret = rgw_get_s3_header_digest(auth_hdr, k->key, digest);
     if (ret < 0) {
       return -EPERM;
     }
@@ -2431,20 +2614,9 @@ int RGW_Auth_S3::authorize(RGWRados *store, struct req_state *s)
       return -ERR_SIGNATURE_NO_MATCH;
     }
 
-    if (s->user.system) {
-      s->system_request = true;
-      dout(20) << "system request" << dendl;
-      s->info.args.set_system();
-      string effective_uid = s->info.args.get(RGW_SYS_PARAM_PREFIX "uid");
-      RGWUserInfo effective_user;
-      if (!effective_uid.empty()) {
-        ret = rgw_get_user_info_by_uid(store, effective_uid, effective_user);
-        if (ret < 0) {
-          ldout(s->cct, 0) << "User lookup failed!" << dendl;
-          return -ENOENT;
-        }
-        s->user = effective_user;
-      }
+    ret = init_system_request(store, s);
+    if (ret < 0) {
+      return ret;
     }
 
   } /* if keystone_result < 0 */
@@ -108,12 +108,19 @@ public:
   void send_response();
 };
 
+class RGWAWS4PayloadVerifier;
+
 class RGWPutObj_ObjStore_S3 : public RGWPutObj_ObjStore {
+  RGWAWS4PayloadVerifier *aws4_verifier;
+  uint64_t raw_len;
+  uint64_t raw_ofs;
+
 public:
-  RGWPutObj_ObjStore_S3() {}
-  ~RGWPutObj_ObjStore_S3() {}
+  RGWPutObj_ObjStore_S3() : aws4_verifier(NULL), raw_len(0), raw_ofs(0) {}
+  ~RGWPutObj_ObjStore_S3();
 
   int get_params();
+  int get_data(bufferlist& bl);
   void send_response();
 };
 
@@ -341,6 +348,7 @@ public:
 };
 
 class RGW_Auth_S3 {
+  static int authorize_v4(RGWRados *store, struct req_state *s);
 public:
   static int authorize(RGWRados *store, struct req_state *s);
 };
@@ -187,6 +187,7 @@ int RGWListBucket_ObjStore_SWIFT::get_params()
     return -ERR_PRECONDITION_FAILED;
 
   delimiter = s->info.args.get("delimiter");
+  s->info.args.get_bool("allow_unordered", &allow_unordered, false);
 
   string path_args;
   if (s->info.args.exists("path")) { // should handle empty path
@@ -209,6 +210,10 @@ int RGWListBucket_ObjStore_SWIFT::get_params()
       prefix.append(delimiter);
   }
 
+  if (allow_unordered && !delimiter.empty()) {
+    return -EINVAL;
+  }
+
   return 0;
 }
 
@@ -809,7 +814,7 @@ int RGWGetObj_ObjStore_SWIFT::send_response_data(bufferlist& bl, off_t bl_ofs, o
 
 send_data:
   if (get_data && !ret) {
-    int r = s->cio->write(bl.c_str() + bl_ofs, bl_len);
+    int r = s->cio->write(bl, bl_ofs, bl_len);
     if (r < 0)
       return r;
   }
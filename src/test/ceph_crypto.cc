@@ -107,6 +107,22 @@ TEST(HMACSHA1, Restart) {
   ASSERT_EQ(0, err);
 }
 
+TEST(HMACSHA256, Simple) {
+  ceph::crypto::HMACSHA256 h((const byte*)"sekrit", 6);
+  h.Update((const byte*)"f", 1);
+  h.Update((const byte*)"oo", 2);
+  unsigned char digest[CEPH_CRYPTO_HMACSHA256_DIGESTSIZE];
+  h.Final(digest);
+  int err;
+  unsigned char want_digest[CEPH_CRYPTO_HMACSHA256_DIGESTSIZE] = {
+    0xb0, 0x8a, 0x8f, 0x5d, 0x9e, 0x9e, 0x7f, 0x30, 0xc7, 0xa2, 0x44, 0xa3,
+    0x7b, 0xe8, 0xfb, 0x9b, 0xb9, 0x06, 0x68, 0x7c, 0xd5, 0xc8, 0x04, 0x5c,
+    0xf5, 0x5f, 0xf5, 0x1e, 0x82, 0x6d, 0x48, 0x24,
+  };
+  err = memcmp(digest, want_digest, CEPH_CRYPTO_HMACSHA256_DIGESTSIZE);
+  ASSERT_EQ(0, err);
+}
+
 class ForkDeathTest : public ::testing::Test {
  protected:
   virtual void SetUp() {
@@ -22,6 +22,7 @@
     bucket stats               returns bucket statistics
     bucket rm                  remove bucket
     bucket check               check bucket index
+    bucket reshard             reshard bucket index (requires --num-shards)
     object rm                  remove object
     object unlink              unlink object from bucket index
     quota set                  set quota params
@@ -51,6 +52,14 @@
     gc list                    dump expired garbage collection objects (specify
                                --include-all to list all entries, including unexpired)
     gc process                 manually process garbage
+    gc stats                   show garbage collection backlog and drain rate
+                               (of all shards, or of --shard-id)
+    lc list                    list buckets that have lifecycle rules
+    lc get                     get the lifecycle rules of a bucket
+    lc set                     set the lifecycle rules of a bucket (requires infile)
+    lc rm                      remove the lifecycle rules of a bucket
+    lc process                 manually apply lifecycle rules (of all buckets, or
+                               of --bucket)
     metadata get               get metadata info
     metadata put               put metadata info
     metadata rm                remove metadata info
@@ -101,6 +110,7 @@
      --fix                     besides checking bucket index, will also fix it
      --check-objects           bucket check: rebuilds bucket index according to
                                actual objects state
+     --num-shards=<num>        bucket reshard: number of index shards
      --format=<format>         specify output format for certain operations: xml,
                                json
      --purge-data              when specified, user removal will also purge all the
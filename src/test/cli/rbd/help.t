@@ -67,6 +67,9 @@
                    --io-threads <num>             ios in flight
                    --io-total <bytes>             total bytes to write
                    --io-pattern <seq|rand>        write pattern
+    bench-open <image-name>                     image open/close benchmark
+                   --io-threads <num>             opens in flight
+                   --open-total <num>             total number of opens
   
   <image-name>, <snap-name> are [pool/]name[@snap], or you may specify
   individual pieces of names with -p/--pool, --image, and/or --snap.
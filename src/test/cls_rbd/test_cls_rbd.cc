@@ -51,6 +51,7 @@ using ::librbd::cls_client::get_stripe_unit_count;
 using ::librbd::cls_client::set_stripe_unit_count;
 using ::librbd::cls_client::old_snapshot_add;
 using ::librbd::cls_client::get_mutable_metadata;
+using ::librbd::cls_client::get_image_info;
 using ::librbd::cls_client::object_map_load;
 using ::librbd::cls_client::object_map_save;
 using ::librbd::cls_client::object_map_resize;
@@ -937,6 +938,62 @@ TEST_F(TestClsRbd, get_mutable_metadata_features)
   ioctx.close();
 }
 
+TEST_F(TestClsRbd, get_image_info)
+{
+  librados::IoCtx ioctx;
+  ASSERT_EQ(0, _rados.ioctx_create(_pool_name.c_str(), ioctx));
+
+  string oid = get_temp_image_name();
+  std::map<rados::cls::lock::locker_id_t,
+           rados::cls::lock::locker_info_t> lockers;
+  bool exclusive_lock;
+  std::string lock_tag;
+  cls_rbd_image_info info;
+  ASSERT_EQ(-ENOENT, get_image_info(&ioctx, oid, false, &info, &lockers,
+                                    &exclusive_lock, &lock_tag));
+
+  ASSERT_EQ(0, create_image(&ioctx, oid, 10, 22,
+                            RBD_FEATURE_LAYERING | RBD_FEATURE_EXCLUSIVE_LOCK,
+                            oid));
+  ASSERT_EQ(0, set_parent(&ioctx, oid, parent_spec(1, "parent", 3), 10));
+  ASSERT_EQ(0, snapshot_add(&ioctx, oid, 1, "snap1"));
+  ASSERT_EQ(0, set_size(&ioctx, oid, 20));
+  ASSERT_EQ(0, snapshot_add(&ioctx, oid, 2, "snap2"));
+  ASSERT_EQ(0, set_protection_status(&ioctx, oid, 2,
+                                     RBD_PROTECTION_STATUS_PROTECTED));
+
+  ASSERT_EQ(0, get_image_info(&ioctx, oid, true, &info, &lockers,
+                              &exclusive_lock, &lock_tag));
+  ASSERT_EQ(22, info.order);
+  ASSERT_EQ(20U, info.size);
+  ASSERT_EQ(static_cast<uint64_t>(RBD_FEATURE_LAYERING |
+                                  RBD_FEATURE_EXCLUSIVE_LOCK), info.features);
+  ASSERT_EQ(0U, info.incompatible_features);
+  ASSERT_EQ(2U, info.snap_seq);
+  ASSERT_EQ(1, info.parent.pool);
+  ASSERT_EQ("parent", info.parent.id);
+  ASSERT_EQ(3U, info.parent.snapid.val);
+  ASSERT_EQ(10U, info.parent.overlap);
+  ASSERT_FALSE(exclusive_lock);
+
+  ASSERT_EQ(2U, info.snaps.size());
+  ASSERT_EQ(2U, info.snaps[0].id.val);
+  ASSERT_EQ("snap2", info.snaps[0].name);
+  ASSERT_EQ(20U, info.snaps[0].image_size);
+  ASSERT_EQ(RBD_PROTECTION_STATUS_PROTECTED, info.snaps[0].protection_status);
+  ASSERT_EQ(1U, info.snaps[1].id.val);
+  ASSERT_EQ("snap1", info.snaps[1].name);
+  ASSERT_EQ(10U, info.snaps[1].image_size);
+  ASSERT_EQ("parent", info.snaps[1].parent.id);
+
+  ASSERT_EQ(0, get_image_info(&ioctx, oid, false, &info, &lockers,
+                              &exclusive_lock, &lock_tag));
+  ASSERT_EQ(static_cast<uint64_t>(RBD_FEATURE_EXCLUSIVE_LOCK),
+            info.incompatible_features);
+
+  ioctx.close();
+}
+
 TEST_F(TestClsRbd, object_map_save)
 {
   librados::IoCtx ioctx;
@@ -12,6 +12,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 
 using namespace librados;
 
@@ -546,6 +547,347 @@ TEST(cls_rgw, gc_defer)
 
 /* must be last test! */
 
+TEST(cls_rgw, bi_list)
+{
+  string bucket_oid = str_int("bucket", 4);
+
+  OpMgr mgr;
+
+  ObjectWriteOperation *op = mgr.write_op();
+  cls_rgw_bucket_init(*op);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  uint64_t epoch = 1;
+  uint64_t obj_size = 1024;
+
+  /* every write is logged, the bilog entries must not show up in the listing */
+  for (int i = 0; i < NUM_OBJS; i++) {
+    string obj = str_int("obj", i);
+    string tag = str_int("tag", i);
+    string loc = str_int("loc", i);
+
+    index_prepare(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, obj, loc);
+
+    rgw_bucket_dir_entry_meta meta;
+    meta.category = 0;
+    meta.size = obj_size;
+    index_complete(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, epoch, obj, meta);
+  }
+
+  set<string> seen;
+  string marker;
+  bool is_truncated = true;
+  while (is_truncated) {
+    list<rgw_cls_bi_entry> entries;
+    ASSERT_EQ(0, cls_rgw_bi_list(ioctx, bucket_oid, string(), marker, 3, &entries, &is_truncated));
+    ASSERT_LE(entries.size(), 3u);
+    for (list<rgw_cls_bi_entry>::iterator iter = entries.begin(); iter != entries.end(); ++iter) {
+      ASSERT_EQ(PlainIdx, iter->type);
+      ASSERT_TRUE(seen.insert(iter->idx).second);
+      marker = iter->idx;
+    }
+  }
+
+  ASSERT_EQ((size_t)NUM_OBJS, seen.size());
+  for (int i = 0; i < NUM_OBJS; i++) {
+    ASSERT_EQ(1u, seen.count(str_int("obj", i)));
+  }
+}
+
+TEST(cls_rgw, bi_list_instances)
+{
+  string bucket_oid = str_int("bucket", 5);
+
+  OpMgr mgr;
+
+  ObjectWriteOperation *op = mgr.write_op();
+  cls_rgw_bucket_init(*op);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  string obj = "obj";
+  string loc = "loc";
+  uint64_t obj_size = 1024;
+
+#define NUM_INSTANCES 5
+  for (int i = 0; i < NUM_INSTANCES; i++) {
+    cls_rgw_obj_key key(obj, str_int("instance", i));
+    string tag = str_int("tag", i);
+
+    op = mgr.write_op();
+    cls_rgw_bucket_prepare_op(*op, CLS_RGW_OP_ADD, tag, key, loc, false, 0);
+    ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+    rgw_bucket_entry_ver ver;
+    ver.pool = ioctx.get_id();
+    ver.epoch = i + 1;
+    rgw_bucket_dir_entry_meta meta;
+    meta.category = 0;
+    meta.size = obj_size;
+    meta.accounted_size = obj_size;
+    op = mgr.write_op();
+    cls_rgw_bucket_complete_op(*op, CLS_RGW_OP_ADD, tag, ver, key, meta, NULL, false, 0);
+    ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+  }
+
+  /* page through the instances one at a time, resuming after the marker */
+  set<string> seen;
+  string marker;
+  bool is_truncated = true;
+  while (is_truncated) {
+    list<rgw_cls_bi_entry> entries;
+    ASSERT_EQ(0, cls_rgw_bi_list(ioctx, bucket_oid, obj, marker, 1, &entries, &is_truncated));
+    ASSERT_LE(entries.size(), 1u);
+    for (list<rgw_cls_bi_entry>::iterator iter = entries.begin(); iter != entries.end(); ++iter) {
+      ASSERT_EQ(InstanceIdx, iter->type);
+      ASSERT_TRUE(seen.insert(iter->idx).second);
+      marker = iter->idx;
+    }
+  }
+
+  ASSERT_EQ((size_t)NUM_INSTANCES, seen.size());
+}
+
+void get_reshard_status(librados::IoCtx& ioctx, string& oid, uint8_t *status)
+{
+  map<int, struct rgw_cls_list_ret> results;
+  map<int, string> oids;
+  oids[0] = oid;
+  ASSERT_EQ(0, CLSRGWIssueGetDirHeader(ioctx, oids, results, 8)());
+  *status = results[0].dir.header.reshard_status;
+}
+
+TEST(cls_rgw, bucket_set_resharding)
+{
+  string bucket_oid = str_int("bucket", 6);
+
+  OpMgr mgr;
+
+  ObjectWriteOperation *op = mgr.write_op();
+  cls_rgw_bucket_init(*op);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  map<int, string> oids;
+  oids[0] = bucket_oid;
+
+  uint8_t status;
+  get_reshard_status(ioctx, bucket_oid, &status);
+  ASSERT_EQ(CLS_RGW_RESHARD_NONE, status);
+
+  uint64_t epoch = 1;
+  uint64_t obj_size = 1024;
+  rgw_bucket_dir_entry_meta meta;
+  meta.category = 0;
+  meta.size = obj_size;
+
+  /* writes keep going while the shard is being copied */
+  ASSERT_EQ(0, CLSRGWIssueSetBucketResharding(ioctx, oids, 8, CLS_RGW_RESHARD_IN_PROGRESS)());
+  get_reshard_status(ioctx, bucket_oid, &status);
+  ASSERT_EQ(CLS_RGW_RESHARD_IN_PROGRESS, status);
+
+  string obj = "obj-0";
+  string tag = "tag-0";
+  string loc = "loc-0";
+  index_prepare(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, obj, loc);
+  index_complete(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, epoch, obj, meta);
+  test_stats(ioctx, bucket_oid, 0, 1, obj_size);
+
+  /* a canceled reshard goes back to normal */
+  ASSERT_EQ(0, CLSRGWIssueSetBucketResharding(ioctx, oids, 8, CLS_RGW_RESHARD_NONE)());
+  get_reshard_status(ioctx, bucket_oid, &status);
+  ASSERT_EQ(CLS_RGW_RESHARD_NONE, status);
+
+  /* a prepare that raced with the switch can't complete on the old shard */
+  obj = "obj-1";
+  tag = "tag-1";
+  loc = "loc-1";
+  index_prepare(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, obj, loc);
+
+  ASSERT_EQ(0, CLSRGWIssueSetBucketResharding(ioctx, oids, 8, CLS_RGW_RESHARD_DONE)());
+  get_reshard_status(ioctx, bucket_oid, &status);
+  ASSERT_EQ(CLS_RGW_RESHARD_DONE, status);
+
+  op = mgr.write_op();
+  cls_rgw_obj_key key(obj, string());
+  rgw_bucket_entry_ver ver;
+  ver.pool = ioctx.get_id();
+  ver.epoch = epoch;
+  meta.accounted_size = meta.size;
+  cls_rgw_bucket_complete_op(*op, CLS_RGW_OP_ADD, tag, ver, key, meta, NULL, true, 0);
+  ASSERT_EQ(-ERR_BUSY_RESHARDING, ioctx.operate(bucket_oid, op));
+
+  /* and new writes are refused too */
+  obj = "obj-2";
+  tag = "tag-2";
+  op = mgr.write_op();
+  cls_rgw_obj_key key2(obj, string());
+  cls_rgw_bucket_prepare_op(*op, CLS_RGW_OP_ADD, tag, key2, loc, true, 0);
+  ASSERT_EQ(-ERR_BUSY_RESHARDING, ioctx.operate(bucket_oid, op));
+
+  test_stats(ioctx, bucket_oid, 0, 1, obj_size);
+
+  /* the retired shard can still be listed */
+  list<rgw_cls_bi_entry> entries;
+  bool is_truncated;
+  ASSERT_EQ(0, cls_rgw_bi_list(ioctx, bucket_oid, string(), string(), 10, &entries, &is_truncated));
+  ASSERT_EQ(2u, entries.size());
+}
+
+void get_header(librados::IoCtx& ioctx, string& oid, struct rgw_bucket_dir_header *header)
+{
+  map<int, struct rgw_cls_list_ret> results;
+  map<int, string> oids;
+  oids[0] = oid;
+  ASSERT_EQ(0, CLSRGWIssueGetDirHeader(ioctx, oids, results, 8)());
+  *header = results[0].dir.header;
+}
+
+static rgw_cls_obj_complete_op complete_op(RGWModifyOp index_op, const string& obj, const string& tag,
+                                           int epoch, uint64_t size)
+{
+  rgw_cls_obj_complete_op op;
+  op.op = index_op;
+  op.key = cls_rgw_obj_key(obj, string());
+  op.tag = tag;
+  op.ver.pool = ioctx.get_id();
+  op.ver.epoch = epoch;
+  op.meta.category = 0;
+  op.meta.size = size;
+  op.meta.accounted_size = size;
+  op.log_op = true;
+  return op;
+}
+
+TEST(cls_rgw, index_complete_ops)
+{
+  string bucket_oid = str_int("bucket", 7);
+
+  OpMgr mgr;
+
+  ObjectWriteOperation *op = mgr.write_op();
+  cls_rgw_bucket_init(*op);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  uint64_t epoch = 1;
+  uint64_t obj_size = 1024;
+
+  /* the same key twice is refused as a whole */
+  list<rgw_cls_obj_complete_op> ops;
+  ops.push_back(complete_op(CLS_RGW_OP_ADD, "obj-0", "tag-0", epoch, obj_size));
+  ops.push_back(complete_op(CLS_RGW_OP_DEL, "obj-0", string(), epoch, 0));
+  op = mgr.write_op();
+  cls_rgw_bucket_complete_ops(*op, ops);
+  ASSERT_EQ(-EINVAL, ioctx.operate(bucket_oid, op));
+
+#define NUM_BATCH_OBJS 3
+  for (int i = 0; i < NUM_BATCH_OBJS; i++) {
+    string obj = str_int("obj", i);
+    string tag = str_int("tag", i);
+    string loc = str_int("loc", i);
+    index_prepare(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, obj, loc);
+  }
+  test_stats(ioctx, bucket_oid, 0, 0, 0);
+
+  struct rgw_bucket_dir_header header;
+  get_header(ioctx, bucket_oid, &header);
+  uint64_t ver = header.ver;
+
+  /* an op with no pending tag and the removal of a missing entry are
+   * skipped, the ops around them still go in */
+  ops.clear();
+  ops.push_back(complete_op(CLS_RGW_OP_ADD, "obj-0", "tag-0", epoch, obj_size));
+  ops.push_back(complete_op(CLS_RGW_OP_ADD, "obj-missing", "tag-missing", epoch, obj_size));
+  ops.push_back(complete_op(CLS_RGW_OP_ADD, "obj-1", "tag-1", epoch, obj_size));
+  ops.push_back(complete_op(CLS_RGW_OP_DEL, "obj-deleted", string(), epoch, 0));
+  ops.push_back(complete_op(CLS_RGW_OP_ADD, "obj-2", "tag-2", epoch, obj_size));
+  op = mgr.write_op();
+  cls_rgw_bucket_complete_ops(*op, ops);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  test_stats(ioctx, bucket_oid, 0, NUM_BATCH_OBJS, obj_size * NUM_BATCH_OBJS);
+
+  /* the index version moves once per applied op, as if they came one by one */
+  get_header(ioctx, bucket_oid, &header);
+  ASSERT_EQ(ver + NUM_BATCH_OBJS, header.ver);
+
+  list<rgw_cls_bi_entry> entries;
+  bool is_truncated;
+  ASSERT_EQ(0, cls_rgw_bi_list(ioctx, bucket_oid, string(), string(), 10, &entries, &is_truncated));
+  ASSERT_EQ((size_t)NUM_BATCH_OBJS, entries.size());
+
+  /* and each of them gets its own bilog entry */
+  map<int, string> oids;
+  oids[0] = bucket_oid;
+  BucketIndexShardsManager marker_mgr;
+  map<int, struct cls_rgw_bi_log_list_ret> logs;
+  ASSERT_EQ(0, CLSRGWIssueBILogList(ioctx, marker_mgr, 100, oids, logs, 8)());
+
+  map<string, uint64_t> completed;
+  set<uint64_t> index_vers;
+  list<rgw_bi_log_entry>::iterator iter;
+  for (iter = logs[0].entries.begin(); iter != logs[0].entries.end(); ++iter) {
+    if (iter->state != CLS_RGW_STATE_COMPLETE)
+      continue;
+    ASSERT_TRUE(completed.insert(make_pair(iter->object, iter->index_ver)).second) << iter->object;
+    ASSERT_TRUE(index_vers.insert(iter->index_ver).second);
+  }
+  ASSERT_EQ((size_t)NUM_BATCH_OBJS, completed.size());
+  for (int i = 0; i < NUM_BATCH_OBJS; i++) {
+    ASSERT_EQ(1u, completed.count(str_int("obj", i)));
+  }
+}
+
+TEST(cls_rgw, index_bulk_delete_stale)
+{
+  string bucket_oid = str_int("bucket", 8);
+
+  OpMgr mgr;
+
+  ObjectWriteOperation *op = mgr.write_op();
+  cls_rgw_bucket_init(*op);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  uint64_t epoch = 5;
+  uint64_t obj_size = 1024;
+
+  string tag_a = "tag-a", tag_b = "tag-b";
+  string obj_a = "obj-a", obj_b = "obj-b";
+  string loc;
+  index_prepare(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag_a, obj_a, loc);
+  index_prepare(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag_b, obj_b, loc);
+  list<rgw_cls_obj_complete_op> ops;
+  ops.push_back(complete_op(CLS_RGW_OP_ADD, obj_a, tag_a, epoch, obj_size));
+  ops.push_back(complete_op(CLS_RGW_OP_ADD, obj_b, tag_b, epoch, obj_size));
+  op = mgr.write_op();
+  cls_rgw_bucket_complete_ops(*op, ops);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  /* obj-b is written again after lifecycle listed it */
+  string tag_b2 = "tag-b2";
+  index_prepare(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag_b2, obj_b, loc);
+  ops.clear();
+  ops.push_back(complete_op(CLS_RGW_OP_ADD, obj_b, tag_b2, epoch + 3, obj_size));
+  op = mgr.write_op();
+  cls_rgw_bucket_complete_ops(*op, ops);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  /* both heads were found missing, the removals carry the listed epoch + 1 */
+  ops.clear();
+  ops.push_back(complete_op(CLS_RGW_OP_DEL, obj_a, string(), epoch + 1, 0));
+  ops.push_back(complete_op(CLS_RGW_OP_DEL, obj_b, string(), epoch + 1, 0));
+  op = mgr.write_op();
+  cls_rgw_bucket_complete_ops(*op, ops);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  /* the stale entry is gone, the rewritten one stays */
+  test_stats(ioctx, bucket_oid, 0, 1, obj_size);
+
+  list<rgw_cls_bi_entry> entries;
+  bool is_truncated;
+  ASSERT_EQ(0, cls_rgw_bi_list(ioctx, bucket_oid, string(), string(), 10, &entries, &is_truncated));
+  ASSERT_EQ(1u, entries.size());
+  ASSERT_EQ(obj_b, entries.front().idx);
+}
+
 TEST(cls_rgw, finalize)
 {
   /* remove pool */
@@ -263,6 +263,7 @@ TYPE(rgw_bucket_olh_log_entry)
 #include "cls/rgw/cls_rgw_ops.h"
 TYPE(rgw_cls_obj_prepare_op)
 TYPE(rgw_cls_obj_complete_op)
+TYPE(rgw_cls_obj_complete_ops)
 TYPE(rgw_cls_list_op)
 TYPE(rgw_cls_list_ret)
 TYPE(cls_rgw_gc_defer_entry_op)
@@ -274,6 +275,7 @@ TYPE(cls_rgw_gc_set_entry_op)
 TYPE(cls_rgw_obj)
 TYPE(cls_rgw_obj_chain)
 TYPE(rgw_cls_tag_timeout_op)
+TYPE(rgw_cls_set_resharding_op)
 TYPE(cls_rgw_bi_log_list_op)
 TYPE(cls_rgw_bi_log_trim_op)
 TYPE(cls_rgw_bi_log_list_ret)
@@ -319,6 +321,7 @@ TYPE(rgw_log_entry)
 #include "cls/rbd/cls_rbd.h"
 TYPE(cls_rbd_parent)
 TYPE(cls_rbd_snap)
+TYPE(cls_rbd_image_info)
 
 #endif
 
@@ -364,6 +367,8 @@ MESSAGE(MCacheExpire)
 MESSAGE(MClientCapRelease)
 #include "messages/MClientCaps.h"
 MESSAGE(MClientCaps)
+#include "messages/MClientCapsBatch.h"
+MESSAGE(MClientCapsBatch)
 #include "messages/MClientLease.h"
 MESSAGE(MClientLease)
 #include "messages/MClientReconnect.h"
@@ -21,6 +21,10 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <sys/xattr.h>
+#include <string.h>
+#include <set>
+#include <map>
+#include <string>
 
 TEST(LibCephFS, MulticlientSimple) {
   struct ceph_mount_info *ca, *cb;
@@ -95,3 +99,333 @@ TEST(LibCephFS, MulticlientHoleEOF) {
   ceph_shutdown(ca);
   ceph_shutdown(cb);
 }
+
+static void mount_async_dirops(struct ceph_mount_info **cmount, bool async_dirops)
+{
+  ASSERT_EQ(0, ceph_create(cmount, NULL));
+  ASSERT_EQ(0, ceph_conf_parse_env(*cmount, NULL));
+  ASSERT_EQ(0, ceph_conf_read_file(*cmount, NULL));
+  ASSERT_EQ(0, ceph_conf_set(*cmount, "client_async_dirops", async_dirops ? "true" : "false"));
+  ASSERT_EQ(0, ceph_mount(*cmount, NULL));
+}
+
+static int count_dentries(struct ceph_mount_info *cmount, const char *dir)
+{
+  struct ceph_dir_result *ls;
+  int r = ceph_opendir(cmount, dir, &ls);
+  if (r < 0)
+    return r;
+  int count = 0;
+  struct dirent *de;
+  while ((de = ceph_readdir(cmount, ls)) != NULL) {
+    if (strcmp(de->d_name, ".") && strcmp(de->d_name, ".."))
+      ++count;
+  }
+  ceph_closedir(cmount, ls);
+  return count;
+}
+
+/*
+ * More creates than the mds delegates inos for at once: the client falls
+ * back to synchronous creates when it runs out, and gets more inos from
+ * their replies.
+ */
+TEST(LibCephFS, AsyncDiropsDelegatedInos) {
+  struct ceph_mount_info *ca, *cb;
+  mount_async_dirops(&ca, true);
+  mount_async_dirops(&cb, false);
+
+  char dir[64];
+  snprintf(dir, sizeof(dir), "async_inos.%d", getpid());
+  ASSERT_EQ(0, ceph_mkdir(ca, dir, 0755));
+
+  const int num = 1500;
+  std::set<uint64_t> inos;
+  for (int i = 0; i < num; ++i) {
+    char name[128];
+    snprintf(name, sizeof(name), "%s/f%d", dir, i);
+    int fd = ceph_open(ca, name, O_CREAT|O_EXCL|O_WRONLY, 0644);
+    ASSERT_LE(0, fd);
+    if (i % 100 == 0)
+      ASSERT_EQ(3, ceph_write(ca, fd, "foo", 3, 0));
+    struct stat st;
+    ASSERT_EQ(0, ceph_fstat(ca, fd, &st));
+    ASSERT_TRUE(inos.insert(st.st_ino).second);
+    ASSERT_EQ(0, ceph_close(ca, fd));
+  }
+  ASSERT_EQ(0, ceph_sync_fs(ca));
+
+  // the other client sees the files the mds created, with the same inos
+  ASSERT_EQ(num, count_dentries(cb, dir));
+  for (int i = 0; i < num; i += 7) {
+    char name[128];
+    snprintf(name, sizeof(name), "%s/f%d", dir, i);
+    struct stat st;
+    ASSERT_EQ(0, ceph_stat(cb, name, &st));
+    ASSERT_EQ(1u, inos.count(st.st_ino));
+    ASSERT_EQ(i % 100 == 0 ? 3 : 0, st.st_size);
+  }
+
+  for (int i = 0; i < num; ++i) {
+    char name[128];
+    snprintf(name, sizeof(name), "%s/f%d", dir, i);
+    ASSERT_EQ(0, ceph_unlink(ca, name));
+  }
+  ASSERT_EQ(0, ceph_rmdir(ca, dir));
+
+  ceph_shutdown(ca);
+  ceph_shutdown(cb);
+}
+
+/*
+ * A second client using the dir takes Fx back: the first client's
+ * requests sent by then are applied before it, and the first client goes
+ * on synchronously.
+ */
+TEST(LibCephFS, AsyncDiropsConflict) {
+  struct ceph_mount_info *ca, *cb;
+  mount_async_dirops(&ca, true);
+  mount_async_dirops(&cb, true);
+
+  char dir[64];
+  snprintf(dir, sizeof(dir), "async_conflict.%d", getpid());
+  ASSERT_EQ(0, ceph_mkdir(ca, dir, 0755));
+
+  char name[128];
+  for (int i = 0; i < 50; ++i) {
+    snprintf(name, sizeof(name), "%s/a%d", dir, i);
+    int fd = ceph_open(ca, name, O_CREAT|O_EXCL|O_WRONLY, 0644);
+    ASSERT_LE(0, fd);
+    ASSERT_EQ(0, ceph_close(ca, fd));
+  }
+  snprintf(name, sizeof(name), "%s/a49", dir);
+  ASSERT_EQ(0, ceph_unlink(ca, name));
+
+  // the second client sees all of it
+  snprintf(name, sizeof(name), "%s/a10", dir);
+  ASSERT_EQ(-EEXIST, ceph_open(cb, name, O_CREAT|O_EXCL|O_WRONLY, 0644));
+  snprintf(name, sizeof(name), "%s/a49", dir);
+  struct stat st;
+  ASSERT_EQ(-ENOENT, ceph_stat(cb, name, &st));
+  snprintf(name, sizeof(name), "%s/a20", dir);
+  ASSERT_EQ(0, ceph_unlink(cb, name));
+  snprintf(name, sizeof(name), "%s/b0", dir);
+  int fd = ceph_open(cb, name, O_CREAT|O_EXCL|O_WRONLY, 0644);
+  ASSERT_LE(0, fd);
+  ASSERT_EQ(0, ceph_close(cb, fd));
+
+  // and the first sees its changes
+  snprintf(name, sizeof(name), "%s/a20", dir);
+  ASSERT_EQ(-ENOENT, ceph_stat(ca, name, &st));
+  snprintf(name, sizeof(name), "%s/b0", dir);
+  ASSERT_EQ(0, ceph_stat(ca, name, &st));
+  ASSERT_EQ(-EEXIST, ceph_open(ca, name, O_CREAT|O_EXCL|O_WRONLY, 0644));
+
+  // both go on creating and unlinking in the shared dir
+  for (int i = 0; i < 20; ++i) {
+    struct ceph_mount_info *c = (i % 2) ? ca : cb;
+    snprintf(name, sizeof(name), "%s/c%d", dir, i);
+    fd = ceph_open(c, name, O_CREAT|O_EXCL|O_WRONLY, 0644);
+    ASSERT_LE(0, fd);
+    ASSERT_EQ(0, ceph_close(c, fd));
+    if (i % 4 == 0)
+      ASSERT_EQ(0, ceph_unlink((i % 8) ? cb : ca, name));
+  }
+
+  // a0..a48 less a20, b0, and 15 of the c files
+  ASSERT_EQ(48 + 1 + 15, count_dentries(ca, dir));
+  ASSERT_EQ(48 + 1 + 15, count_dentries(cb, dir));
+
+  ceph_shutdown(ca);
+  ceph_shutdown(cb);
+}
+
+/*
+ * Unlinks of files the client doesn't know, or that are still being
+ * created, go to the mds synchronously.
+ */
+TEST(LibCephFS, AsyncDiropsUnlinkFallback) {
+  struct ceph_mount_info *ca, *cb;
+  mount_async_dirops(&ca, true);
+  mount_async_dirops(&cb, false);
+
+  char dir[64];
+  snprintf(dir, sizeof(dir), "async_unlink.%d", getpid());
+  ASSERT_EQ(0, ceph_mkdir(cb, dir, 0755));
+
+  char name[128];
+  for (int i = 0; i < 10; ++i) {
+    snprintf(name, sizeof(name), "%s/f%d", dir, i);
+    int fd = ceph_open(cb, name, O_CREAT|O_EXCL|O_WRONLY, 0644);
+    ASSERT_LE(0, fd);
+    ASSERT_EQ(0, ceph_close(cb, fd));
+  }
+  ceph_shutdown(cb);
+
+  // not in our cache
+  snprintf(name, sizeof(name), "%s/f0", dir);
+  ASSERT_EQ(0, ceph_unlink(ca, name));
+  ASSERT_EQ(-ENOENT, ceph_unlink(ca, name));
+
+  // cached
+  ASSERT_EQ(9, count_dentries(ca, dir));
+  for (int i = 1; i < 10; ++i) {
+    snprintf(name, sizeof(name), "%s/f%d", dir, i);
+    ASSERT_EQ(0, ceph_unlink(ca, name));
+  }
+
+  // just created
+  snprintf(name, sizeof(name), "%s/g", dir);
+  int fd = ceph_open(ca, name, O_CREAT|O_EXCL|O_WRONLY, 0644);
+  ASSERT_LE(0, fd);
+  ASSERT_EQ(0, ceph_unlink(ca, name));
+  ASSERT_EQ(0, ceph_close(ca, fd));
+
+  ASSERT_EQ(0, count_dentries(ca, dir));
+  ASSERT_EQ(0, ceph_rmdir(ca, dir));
+
+  ceph_shutdown(ca);
+}
+
+static void mount_readdir_prefetch(struct ceph_mount_info **cmount, const char *prefetch)
+{
+  ASSERT_EQ(0, ceph_create(cmount, NULL));
+  ASSERT_EQ(0, ceph_conf_parse_env(*cmount, NULL));
+  ASSERT_EQ(0, ceph_conf_read_file(*cmount, NULL));
+  ASSERT_EQ(0, ceph_conf_set(*cmount, "client_readdir_attr_prefetch", prefetch));
+  ASSERT_EQ(0, ceph_mount(*cmount, NULL));
+}
+
+/* the names in dir, each with its size; -1 if a name shows up twice */
+static int list_sizes(struct ceph_mount_info *cmount, const char *dir,
+		      std::map<std::string, int64_t> *sizes)
+{
+  struct ceph_dir_result *ls;
+  int r = ceph_opendir(cmount, dir, &ls);
+  if (r < 0)
+    return r;
+  sizes->clear();
+  struct dirent de;
+  struct stat st;
+  int stmask;
+  while ((r = ceph_readdirplus_r(cmount, ls, &de, &st, &stmask)) == 1) {
+    if (!strcmp(de.d_name, ".") || !strcmp(de.d_name, ".."))
+      continue;
+    if (!sizes->insert(std::make_pair(std::string(de.d_name), (int64_t)st.st_size)).second) {
+      r = -1;
+      break;
+    }
+  }
+  ceph_closedir(cmount, ls);
+  return r;
+}
+
+/*
+ * A rename by another client leaves the dir with as many files as
+ * before: the complete dir cache of the first client must still go.
+ */
+TEST(LibCephFS, ReaddirCacheRenamed) {
+  struct ceph_mount_info *ca, *cb;
+  mount_readdir_prefetch(&ca, "0");
+  mount_readdir_prefetch(&cb, "0");
+
+  char dir[64];
+  snprintf(dir, sizeof(dir), "readdir_renamed.%d", getpid());
+  ASSERT_EQ(0, ceph_mkdir(ca, dir, 0755));
+
+  char name[128], name2[128];
+  for (int i = 0; i < 10; ++i) {
+    snprintf(name, sizeof(name), "%s/f%d", dir, i);
+    int fd = ceph_open(ca, name, O_CREAT|O_EXCL|O_WRONLY, 0644);
+    ASSERT_LE(0, fd);
+    ASSERT_EQ(0, ceph_close(ca, fd));
+  }
+
+  // the second listing comes from the cache
+  std::map<std::string, int64_t> sizes;
+  ASSERT_EQ(0, list_sizes(ca, dir, &sizes));
+  ASSERT_EQ(10u, sizes.size());
+  ASSERT_EQ(0, list_sizes(ca, dir, &sizes));
+  ASSERT_EQ(10u, sizes.size());
+
+  snprintf(name, sizeof(name), "%s/f3", dir);
+  snprintf(name2, sizeof(name2), "%s/g3", dir);
+  ASSERT_EQ(0, ceph_rename(cb, name, name2));
+
+  ASSERT_EQ(0, list_sizes(ca, dir, &sizes));
+  ASSERT_EQ(10u, sizes.size());
+  ASSERT_EQ(0u, sizes.count("f3"));
+  ASSERT_EQ(1u, sizes.count("g3"));
+
+  // and listing it from the cache again sees the same
+  ASSERT_EQ(0, list_sizes(ca, dir, &sizes));
+  ASSERT_EQ(10u, sizes.size());
+  ASSERT_EQ(1u, sizes.count("g3"));
+
+  for (int i = 0; i < 10; ++i) {
+    snprintf(name, sizeof(name), "%s/%c%d", dir, i == 3 ? 'g' : 'f', i);
+    ASSERT_EQ(0, ceph_unlink(ca, name));
+  }
+  ASSERT_EQ(0, ceph_rmdir(ca, dir));
+
+  ceph_shutdown(ca);
+  ceph_shutdown(cb);
+}
+
+/*
+ * Another client writes to some of the files of a dir the first one has
+ * cached: the first reads the chunks whose attrs it lost from the mds and
+ * the rest from its cache, and the listing has every entry once, with
+ * current sizes.
+ */
+TEST(LibCephFS, ReaddirPrefetchChunks) {
+  struct ceph_mount_info *ca, *cb;
+  mount_readdir_prefetch(&ca, "4");
+  mount_readdir_prefetch(&cb, "0");
+
+  char dir[64];
+  snprintf(dir, sizeof(dir), "readdir_prefetch.%d", getpid());
+  ASSERT_EQ(0, ceph_mkdir(ca, dir, 0755));
+
+  const int num = 40;
+  char name[128];
+  for (int i = 0; i < num; ++i) {
+    snprintf(name, sizeof(name), "%s/f%d", dir, i);
+    int fd = ceph_open(ca, name, O_CREAT|O_EXCL|O_WRONLY, 0644);
+    ASSERT_LE(0, fd);
+    ASSERT_EQ(0, ceph_close(ca, fd));
+  }
+  std::map<std::string, int64_t> sizes;
+  ASSERT_EQ(0, list_sizes(ca, dir, &sizes));
+  ASSERT_EQ((size_t)num, sizes.size());
+
+  // runs of written and untouched files, longer than a chunk
+  for (int i = 0; i < num; ++i) {
+    if ((i / 10) % 2)
+      continue;
+    snprintf(name, sizeof(name), "%s/f%d", dir, i);
+    int fd = ceph_open(cb, name, O_WRONLY, 0644);
+    ASSERT_LE(0, fd);
+    ASSERT_EQ(i + 1, ceph_write(cb, fd, std::string(i + 1, 'a').c_str(), i + 1, 0));
+    ASSERT_EQ(0, ceph_close(cb, fd));
+  }
+
+  for (int pass = 0; pass < 2; ++pass) {
+    ASSERT_EQ(0, list_sizes(ca, dir, &sizes));
+    ASSERT_EQ((size_t)num, sizes.size());
+    for (int i = 0; i < num; ++i) {
+      snprintf(name, sizeof(name), "f%d", i);
+      ASSERT_EQ(1u, sizes.count(name)) << name;
+      ASSERT_EQ((int64_t)((i / 10) % 2 ? 0 : i + 1), sizes[name]) << name;
+    }
+  }
+
+  for (int i = 0; i < num; ++i) {
+    snprintf(name, sizeof(name), "%s/f%d", dir, i);
+    ASSERT_EQ(0, ceph_unlink(ca, name));
+  }
+  ASSERT_EQ(0, ceph_rmdir(ca, dir));
+
+  ceph_shutdown(ca);
+  ceph_shutdown(cb);
+}
@@ -0,0 +1,318 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Measure how quickly clones can be detached from their parent, either
+ * by flattening with different in-flight windows or by copy-on-read.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "include/rados/librados.hpp"
+#include "include/rbd/librbd.hpp"
+#include "include/stringify.h"
+#include "include/utime.h"
+#include "common/Clock.h"
+#include "common/ceph_argparse.h"
+#include "common/errno.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const char *PARENT_NAME = "bench_flatten_parent";
+const char *CLONE_NAME = "bench_flatten_clone";
+const char *SNAP_NAME = "snap";
+
+void usage(ostream &out)
+{
+  out << "usage: ceph_bench_librbd_flatten [options]\n"
+      << "  --pool <pool>           pool to create the images in (default rbd)\n"
+      << "  --size <MB>             size of the parent image (default 1024)\n"
+      << "  --order <bits>          object size of the images (default 22)\n"
+      << "  --windows <n>[,<n>...]  in-flight flatten windows to measure\n"
+      << "                          (default 1,4,16,64)\n"
+      << "  --no-copy-on-read       skip the copy-on-read pass\n";
+}
+
+double mb_per_sec(uint64_t bytes, utime_t elapsed)
+{
+  if ((double)elapsed == 0) {
+    return 0;
+  }
+  return (double)bytes / (1 << 20) / (double)elapsed;
+}
+
+int create_parent(librados::IoCtx &io_ctx, uint64_t size, int order)
+{
+  librbd::RBD rbd;
+  int r = rbd.create3(io_ctx, PARENT_NAME, size, RBD_FEATURE_LAYERING, &order,
+		      0, 0);
+  if (r < 0) {
+    cerr << "failed to create parent image: " << cpp_strerror(r) << std::endl;
+    return r;
+  }
+
+  librbd::Image image;
+  r = rbd.open(io_ctx, image, PARENT_NAME, NULL);
+  if (r < 0) {
+    cerr << "failed to open parent image: " << cpp_strerror(r) << std::endl;
+    return r;
+  }
+
+  uint64_t object_size = 1ULL << order;
+  bufferlist bl;
+  bl.append_zero(object_size);
+  for (uint64_t off = 0; off < size; off += object_size) {
+    // make every object unique so the OSDs cannot shortcut the copy
+    bl.copy_in(0, sizeof(off), reinterpret_cast<const char *>(&off));
+    ssize_t ret = image.write(off, std::min(object_size, size - off), bl);
+    if (ret < 0) {
+      cerr << "failed to write parent image: " << cpp_strerror(ret)
+	   << std::endl;
+      return ret;
+    }
+  }
+
+  r = image.snap_create(SNAP_NAME);
+  if (r == 0) {
+    r = image.snap_protect(SNAP_NAME);
+  }
+  if (r < 0) {
+    cerr << "failed to snapshot parent image: " << cpp_strerror(r)
+	 << std::endl;
+  }
+  return r;
+}
+
+void remove_parent(librados::IoCtx &io_ctx)
+{
+  librbd::RBD rbd;
+  {
+    librbd::Image image;
+    if (rbd.open(io_ctx, image, PARENT_NAME, NULL) == 0) {
+      image.snap_unprotect(SNAP_NAME);
+      image.snap_remove(SNAP_NAME);
+    }
+  }
+  rbd.remove(io_ctx, PARENT_NAME);
+}
+
+int create_clone(librados::IoCtx &io_ctx, int order)
+{
+  librbd::RBD rbd;
+  int r = rbd.clone(io_ctx, PARENT_NAME, SNAP_NAME, io_ctx, CLONE_NAME,
+		    RBD_FEATURE_LAYERING, &order);
+  if (r < 0) {
+    cerr << "failed to clone parent image: " << cpp_strerror(r) << std::endl;
+  }
+  return r;
+}
+
+int bench_flatten(librados::Rados &rados, librados::IoCtx &io_ctx,
+		  uint64_t size, int order, int window)
+{
+  int r = rados.conf_set("rbd_concurrent_flatten_ops",
+			 stringify(window).c_str());
+  if (r < 0) {
+    cerr << "failed to set rbd_concurrent_flatten_ops: " << cpp_strerror(r)
+	 << std::endl;
+    return r;
+  }
+
+  r = create_clone(io_ctx, order);
+  if (r < 0) {
+    return r;
+  }
+
+  librbd::RBD rbd;
+  {
+    librbd::Image image;
+    r = rbd.open(io_ctx, image, CLONE_NAME, NULL);
+    if (r < 0) {
+      cerr << "failed to open clone: " << cpp_strerror(r) << std::endl;
+      return r;
+    }
+
+    utime_t start = ceph_clock_now(NULL);
+    r = image.flatten();
+    utime_t elapsed = ceph_clock_now(NULL) - start;
+    if (r < 0) {
+      cerr << "failed to flatten clone: " << cpp_strerror(r) << std::endl;
+    } else {
+      cout << "flatten window " << window << ": " << elapsed << " sec, "
+	   << mb_per_sec(size, elapsed) << " MB/sec" << std::endl;
+    }
+  }
+
+  int rm_r = rbd.remove(io_ctx, CLONE_NAME);
+  return (r < 0 ? r : rm_r);
+}
+
+int read_image(librbd::Image &image, uint64_t size, int order,
+	       utime_t *elapsed)
+{
+  uint64_t object_size = 1ULL << order;
+  utime_t start = ceph_clock_now(NULL);
+  for (uint64_t off = 0; off < size; off += object_size) {
+    bufferlist bl;
+    ssize_t ret = image.read(off, std::min(object_size, size - off), bl);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+  *elapsed = ceph_clock_now(NULL) - start;
+  return 0;
+}
+
+int bench_copy_on_read(librados::Rados &rados, librados::IoCtx &io_ctx,
+		       uint64_t size, int order)
+{
+  int r = rados.conf_set("rbd_clone_copy_on_read", "true");
+  if (r < 0) {
+    cerr << "failed to set rbd_clone_copy_on_read: " << cpp_strerror(r)
+	 << std::endl;
+    return r;
+  }
+
+  r = create_clone(io_ctx, order);
+  if (r < 0) {
+    return r;
+  }
+
+  librbd::RBD rbd;
+  {
+    librbd::Image image;
+    r = rbd.open(io_ctx, image, CLONE_NAME, NULL);
+    if (r < 0) {
+      cerr << "failed to open clone: " << cpp_strerror(r) << std::endl;
+      return r;
+    }
+
+    // the first pass reads from the parent and copies up in the
+    // background, the second pass should only touch the clone
+    const char *passes[] = {"cold", "warm"};
+    for (size_t i = 0; r == 0 && i < sizeof(passes) / sizeof(passes[0]);
+	 ++i) {
+      utime_t elapsed;
+      r = read_image(image, size, order, &elapsed);
+      if (r < 0) {
+	cerr << "failed to read clone: " << cpp_strerror(r) << std::endl;
+	break;
+      }
+      cout << "copy-on-read " << passes[i] << " read: " << elapsed
+	   << " sec, " << mb_per_sec(size, elapsed) << " MB/sec" << std::endl;
+      if (i == 0) {
+	// wait for the background copyups to complete
+	r = image.flush();
+      }
+    }
+  }
+
+  int rm_r = rbd.remove(io_ctx, CLONE_NAME);
+  return (r < 0 ? r : rm_r);
+}
+
+} // anonymous namespace
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+
+  string pool_name = "rbd";
+  uint64_t size = 1024ULL << 20;
+  int order = 22;
+  vector<int> windows;
+  bool copy_on_read = true;
+  for (vector<const char*>::iterator i = args.begin(); i != args.end(); ) {
+    string val;
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_flag(args, i, "-h", "--help", (char*)NULL)) {
+      usage(cout);
+      return 0;
+    } else if (ceph_argparse_witharg(args, i, &val, "--pool", (char*)NULL)) {
+      pool_name = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--size", (char*)NULL)) {
+      size = strtoull(val.c_str(), NULL, 10) << 20;
+    } else if (ceph_argparse_witharg(args, i, &val, "--order", (char*)NULL)) {
+      order = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--windows",
+				     (char*)NULL)) {
+      stringstream ss(val);
+      string window;
+      while (getline(ss, window, ',')) {
+	windows.push_back(atoi(window.c_str()));
+      }
+    } else if (ceph_argparse_flag(args, i, "--no-copy-on-read",
+				  (char*)NULL)) {
+      copy_on_read = false;
+    } else {
+      ++i;
+    }
+  }
+
+  if (windows.empty()) {
+    windows.push_back(1);
+    windows.push_back(4);
+    windows.push_back(16);
+    windows.push_back(64);
+  }
+  if (size == 0 || order < 12 || order > 25) {
+    usage(cerr);
+    return EXIT_FAILURE;
+  }
+
+  librados::Rados rados;
+  int r = rados.init(NULL);
+  if (r == 0) {
+    r = rados.conf_read_file(NULL);
+  }
+  if (r == 0) {
+    r = rados.conf_parse_env(NULL);
+  }
+  if (r == 0) {
+    r = rados.conf_parse_argv(argc, argv);
+  }
+  if (r == 0) {
+    r = rados.connect();
+  }
+  if (r < 0) {
+    cerr << "failed to connect to cluster: " << cpp_strerror(r) << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  librados::IoCtx io_ctx;
+  r = rados.ioctx_create(pool_name.c_str(), io_ctx);
+  if (r < 0) {
+    cerr << "failed to open pool " << pool_name << ": " << cpp_strerror(r)
+	 << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  r = create_parent(io_ctx, size, order);
+  for (size_t i = 0; r == 0 && i < windows.size(); ++i) {
+    r = bench_flatten(rados, io_ctx, size, order, windows[i]);
+  }
+  if (r == 0 && copy_on_read) {
+    r = bench_copy_on_read(rados, io_ctx, size, order);
+  }
+
+  remove_parent(io_ctx);
+  return (r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -6,6 +6,8 @@
 #include "librbd/ImageWatcher.h"
 #include "librbd/internal.h"
 #include "librbd/ObjectMap.h"
+#include "librbd/WriteCoalescer.h"
+#include "common/Cond.h"
 #include <boost/scope_exit.hpp>
 #include <boost/assign/list_of.hpp>
 #include <utility>
@@ -628,3 +630,108 @@ TEST_F(TestInternal, ShrinkFlushesCache) {
   ASSERT_EQ(0, cond_ctx.wait());
   c->put();
 }
+
+namespace {
+
+// holds back the first write it sends, so that it stays in flight until
+// the test releases it
+class BlockingWriteCoalescer : public librbd::WriteCoalescer {
+public:
+  BlockingWriteCoalescer(librbd::ImageCtx &image_ctx, uint64_t max_bytes)
+    : librbd::WriteCoalescer(image_ctx, max_bytes), m_held(NULL),
+      m_blocking(true), m_sent(0) {
+  }
+
+  void release() {
+    assert(m_held != NULL);
+    PendingWrite *write = m_held;
+    m_held = NULL;
+    librbd::WriteCoalescer::send_write(write);
+  }
+
+  uint64_t get_sent() const {
+    return m_sent;
+  }
+
+protected:
+  virtual void send_write(PendingWrite *write) {
+    ++m_sent;
+    if (m_blocking) {
+      m_blocking = false;
+      m_held = write;
+      return;
+    }
+    librbd::WriteCoalescer::send_write(write);
+  }
+
+private:
+  PendingWrite *m_held;
+  bool m_blocking;
+  uint64_t m_sent;
+};
+
+} // anonymous namespace
+
+TEST_F(TestInternal, WriteCoalescer) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  if (ictx->image_watcher->is_lock_supported()) {
+    RWLock::WLocker owner_locker(ictx->owner_lock);
+    ASSERT_EQ(0, ictx->image_watcher->try_lock());
+  }
+
+  ::SnapContext snapc;
+  {
+    RWLock::RLocker snap_locker(ictx->snap_lock);
+    snapc = ictx->snapc;
+  }
+
+  BlockingWriteCoalescer coalescer(*ictx, 1 << 20);
+  std::string oid = ictx->get_object_name(0);
+  const size_t write_count = 32;
+  const size_t write_len = 512;
+
+  uint64_t merged = ictx->perfcounter->get(l_librbd_wr_coalesced);
+  uint64_t merged_bytes = ictx->perfcounter->get(l_librbd_wr_coalesced_bytes);
+
+  bufferlist expected_bl;
+  std::vector<C_SaferCond *> ctxs;
+  {
+    RWLock::RLocker owner_locker(ictx->owner_lock);
+    for (size_t i = 0; i < write_count; ++i) {
+      bufferlist bl;
+      bl.append(std::string(write_len, 'a' + (i % 26)));
+      expected_bl.append(bl);
+
+      C_SaferCond *ctx = new C_SaferCond();
+      ctxs.push_back(ctx);
+      coalescer.write(oid, 0, i * write_len, bl, snapc, 0, ctx);
+    }
+
+    // the first write is held in flight: the second was held back and
+    // the rest were merged into it (don't bail out before the release,
+    // the writes would never complete)
+    EXPECT_EQ(1U, coalescer.get_sent());
+    EXPECT_EQ(write_count - 2,
+              ictx->perfcounter->get(l_librbd_wr_coalesced) - merged);
+    EXPECT_EQ((write_count - 2) * write_len,
+              ictx->perfcounter->get(l_librbd_wr_coalesced_bytes) - merged_bytes);
+
+    // its completion sends the merged write
+    coalescer.release();
+  }
+
+  for (size_t i = 0; i < ctxs.size(); ++i) {
+    ASSERT_EQ(0, ctxs[i]->wait());
+    delete ctxs[i];
+  }
+  ASSERT_EQ(2U, coalescer.get_sent());
+
+  bufferptr read_ptr(expected_bl.length());
+  bufferlist read_bl;
+  read_bl.push_back(read_ptr);
+  ASSERT_EQ(static_cast<ssize_t>(expected_bl.length()),
+            librbd::read(ictx, 0, expected_bl.length(), read_bl.c_str(), 0));
+  ASSERT_TRUE(expected_bl.contents_equal(read_bl));
+}
@@ -0,0 +1,87 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "mds/MDBalancer.h"
+
+#include "test/unit.h"
+
+class MDSBalancer : public ::testing::Test {
+protected:
+  void SetUp() {
+    g_ceph_context->_conf->set_val("mds_bal_heat_samples", "5");
+    g_ceph_context->_conf->set_val("mds_bal_cost_horizon", "30");
+    g_ceph_context->_conf->set_val("mds_bal_export_item_cost", ".01");
+  }
+};
+
+TEST_F(MDSBalancer, ProjectLoadNew)
+{
+  // a dirfrag seen for the first time is taken at its load, not padded
+  // out with idle samples it never had
+  MDBalancer::heat_history_t h;
+  ASSERT_DOUBLE_EQ(40.0, MDBalancer::project_load(h, utime_t(10, 0), 40));
+  ASSERT_EQ(1u, h.samples.size());
+
+  // the same rebalance looking at it again doesn't add a sample
+  ASSERT_DOUBLE_EQ(40.0, MDBalancer::project_load(h, utime_t(10, 0), 40));
+  ASSERT_EQ(1u, h.samples.size());
+}
+
+TEST_F(MDSBalancer, ProjectLoadBurst)
+{
+  MDBalancer::heat_history_t h;
+  MDBalancer::project_load(h, utime_t(10, 0), 1);
+  MDBalancer::project_load(h, utime_t(20, 0), 1);
+  MDBalancer::project_load(h, utime_t(30, 0), 1);
+
+  // a burst doesn't count for more than the median
+  ASSERT_DOUBLE_EQ(1.0, MDBalancer::project_load(h, utime_t(40, 0), 500));
+
+  // and the projection never exceeds what it's doing now
+  ASSERT_DOUBLE_EQ(0.5, MDBalancer::project_load(h, utime_t(50, 0), 0.5));
+}
+
+TEST_F(MDSBalancer, ProjectLoadWindow)
+{
+  // only the last mds_bal_heat_samples rebalances count
+  MDBalancer::heat_history_t h;
+  for (int i = 1; i <= 5; ++i)
+    MDBalancer::project_load(h, utime_t(i * 10, 0), 1);
+  for (int i = 6; i <= 8; ++i)
+    MDBalancer::project_load(h, utime_t(i * 10, 0), 100);
+  ASSERT_EQ(5u, h.samples.size());
+  ASSERT_DOUBLE_EQ(100.0, MDBalancer::project_load(h, utime_t(90, 0), 100));
+}
+
+TEST_F(MDSBalancer, ExportCandidates)
+{
+  double cost, gain;
+
+  // a steadily hot subtree is worth moving with lots cached under it
+  MDBalancer::heat_history_t hot;
+  double load = 0;
+  for (int i = 1; i <= 5; ++i)
+    load = MDBalancer::project_load(hot, utime_t(i * 10, 0), 10);
+  ASSERT_TRUE(MDBalancer::export_pays_off(load, 10000, &cost, &gain));
+  ASSERT_DOUBLE_EQ(300.0, gain);
+  ASSERT_DOUBLE_EQ(100.0, cost);
+
+  // one that just had a burst isn't
+  MDBalancer::heat_history_t burst;
+  for (int i = 1; i <= 4; ++i)
+    MDBalancer::project_load(burst, utime_t(i * 10, 0), 0.1);
+  load = MDBalancer::project_load(burst, utime_t(50, 0), 10);
+  ASSERT_FALSE(MDBalancer::export_pays_off(load, 10000, &cost, &gain));
+
+  // unless there is little to migrate
+  ASSERT_TRUE(MDBalancer::export_pays_off(load, 100, &cost, &gain));
+}
@@ -0,0 +1,94 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <vector>
+
+#include "mds/CInode.h"
+#include "mds/CDentry.h"
+#include "mds/MDCache.h"
+
+#include "test/unit.h"
+
+using std::vector;
+
+/* a cache's worth of inodes with their primary dentries */
+class MDSCacheMemory : public ::testing::Test {
+protected:
+  static const int num = 100000;
+  vector<CInode*> inodes;
+  vector<CDentry*> dentries;
+
+  void SetUp() {
+    inodes.reserve(num);
+    dentries.reserve(num);
+    for (int i = 0; i < num; ++i) {
+      char name[32];
+      snprintf(name, sizeof(name), "file.%d", i);
+      CInode *in = new CInode(NULL);
+      in->inode.ino = inodeno_t(0x10000000000ull + i);
+      inodes.push_back(in);
+      dentries.push_back(new CDentry(name, i, 2, CEPH_NOSNAP));
+    }
+  }
+
+  void TearDown() {
+    for (unsigned i = 0; i < inodes.size(); ++i) {
+      delete dentries[i];
+      delete inodes[i];
+    }
+    g_ceph_context->_conf->set_val("mds_cache_size", "100000");
+    g_ceph_context->_conf->set_val("mds_cache_memory_limit", "0");
+  }
+};
+
+TEST_F(MDSCacheMemory, Used)
+{
+  const uint64_t per_inode = sizeof(CInode) + sizeof(CDentry);
+  ASSERT_EQ(per_inode * num, MDCache::cache_memory_used());
+
+  // and it goes down as they go away
+  for (int i = 0; i < num / 2; ++i) {
+    delete dentries.back();
+    dentries.pop_back();
+    delete inodes.back();
+    inodes.pop_back();
+  }
+  ASSERT_EQ(per_inode * (num - num / 2), MDCache::cache_memory_used());
+}
+
+TEST_F(MDSCacheMemory, InodeLimit)
+{
+  const uint64_t per_inode = sizeof(CInode) + sizeof(CDentry);
+  char buf[32];
+
+  // no memory limit: the inode count one
+  g_ceph_context->_conf->set_val("mds_cache_size", "50000");
+  ASSERT_EQ(50000, MDCache::get_cache_inode_limit());
+
+  // as many inodes as fit at what each costs now
+  snprintf(buf, sizeof(buf), "%llu", (unsigned long long)(per_inode * 1000));
+  g_ceph_context->_conf->set_val("mds_cache_memory_limit", buf);
+  ASSERT_EQ(1000, MDCache::get_cache_inode_limit());
+
+  // never above mds_cache_size
+  snprintf(buf, sizeof(buf), "%llu", (unsigned long long)(per_inode * 80000));
+  g_ceph_context->_conf->set_val("mds_cache_memory_limit", buf);
+  ASSERT_EQ(50000, MDCache::get_cache_inode_limit());
+
+  // unless that is unlimited
+  g_ceph_context->_conf->set_val("mds_cache_size", "0");
+  ASSERT_EQ(80000, MDCache::get_cache_inode_limit());
+
+  // and always at least one
+  g_ceph_context->_conf->set_val("mds_cache_memory_limit", "1");
+  ASSERT_EQ(1, MDCache::get_cache_inode_limit());
+}
@@ -0,0 +1,136 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "mds/Mutation.h"
+#include "mds/Locker.h"
+#include "mds/Capability.h"
+#include "mds/SessionMap.h"
+#include "messages/MClientCapsBatch.h"
+#include "include/ceph_features.h"
+#include "test/unit.h"
+
+/* encode a batch and decode it on the other side, as the messenger would */
+static MClientCapsBatch *round_trip(MClientCapsBatch *batch, utime_t recv)
+{
+  batch->encode_payload(CEPH_FEATURES_ALL);
+  bufferlist bl = batch->get_payload();
+  batch->put();
+
+  MClientCapsBatch *out = new MClientCapsBatch;
+  out->set_payload(bl);
+  out->set_recv_stamp(recv);
+  out->decode_payload();
+  return out;
+}
+
+TEST(CapsBatch, RoundTrip)
+{
+  MClientCapsBatch *batch = new MClientCapsBatch;
+  batch->stamp = utime_t(100, 0);
+  for (int i = 0; i < 3; ++i)
+    batch->caps.push_back(new MClientCaps(CEPH_CAP_OP_GRANT, inodeno_t(0x1000 + i),
+					  inodeno_t(1), 10 + i, 20 + i,
+					  CEPH_CAP_PIN | CEPH_CAP_FILE_SHARED,
+					  CEPH_CAP_FILE_RD, 0, i, 7));
+
+  MClientCapsBatch *out = round_trip(batch, utime_t(105, 0));
+  ASSERT_EQ(utime_t(100, 0), out->stamp);
+
+  list<MClientCaps*> ls;
+  out->claim_caps(ls);
+  ASSERT_TRUE(out->caps.empty());
+  out->put();
+
+  ASSERT_EQ(3u, ls.size());
+  int i = 0;
+  while (!ls.empty()) {
+    MClientCaps *m = ls.front();
+    ls.pop_front();
+    ASSERT_EQ(CEPH_CAP_OP_GRANT, m->get_op());
+    ASSERT_EQ(inodeno_t(0x1000 + i), m->get_ino());
+    ASSERT_EQ(10u + i, m->get_cap_id());
+    ASSERT_EQ((ceph_seq_t)(20 + i), m->get_seq());
+    ASSERT_EQ(CEPH_CAP_PIN | CEPH_CAP_FILE_SHARED, m->get_caps());
+    ASSERT_EQ(CEPH_CAP_FILE_RD, m->get_wanted());
+    ASSERT_EQ(i, (int)m->get_mseq());
+    ASSERT_EQ(7u, m->osd_epoch_barrier);
+    // a lease on it runs from the mds' stamp, which is the earlier
+    ASSERT_EQ(utime_t(100, 0), m->get_recv_stamp());
+    m->put();
+    ++i;
+  }
+}
+
+TEST(CapsBatch, LeaseFromReceipt)
+{
+  MClientCapsBatch *batch = new MClientCapsBatch;
+  batch->stamp = utime_t(100, 0);
+  batch->caps.push_back(new MClientCaps(CEPH_CAP_OP_GRANT, inodeno_t(0x1000),
+					inodeno_t(1), 1, 1, CEPH_CAP_PIN, 0, 0, 0, 0));
+
+  // our clock is behind the mds': take the lease from when we got it
+  MClientCapsBatch *out = round_trip(batch, utime_t(90, 0));
+  list<MClientCaps*> ls;
+  out->claim_caps(ls);
+  out->put();
+  ASSERT_EQ(1u, ls.size());
+  ASSERT_EQ(utime_t(90, 0), ls.front()->get_recv_stamp());
+  ls.front()->put();
+}
+
+static void set_lease_ttl(Session& s, const char *ttl)
+{
+  map<string, string> meta;
+  meta["cap_lease_ttl"] = ttl;
+  s.set_client_metadata(meta);
+}
+
+TEST(CapLease, Lapsed)
+{
+  Locker locker(NULL, NULL);
+  Session s;
+  Capability cap;
+  cap.set_last_issue_stamp(utime_t(100, 0));
+
+  // no lease, no session: always revoke
+  ASSERT_FALSE(locker.cap_lease_lapsed(&cap, NULL, utime_t(1000, 0)));
+  ASSERT_FALSE(locker.cap_lease_lapsed(&cap, &s, utime_t(1000, 0)));
+
+  // the client trusts it until 110 at the latest; we wait twice that
+  set_lease_ttl(s, "10");
+  ASSERT_FALSE(locker.cap_lease_lapsed(&cap, &s, utime_t(111, 0)));
+  ASSERT_FALSE(locker.cap_lease_lapsed(&cap, &s, utime_t(120, 0)));
+  ASSERT_TRUE(locker.cap_lease_lapsed(&cap, &s, utime_t(120, 1)));
+
+  // hearing from us again extends it
+  cap.set_last_issue_stamp(utime_t(115, 0));
+  ASSERT_FALSE(locker.cap_lease_lapsed(&cap, &s, utime_t(125, 0)));
+  ASSERT_TRUE(locker.cap_lease_lapsed(&cap, &s, utime_t(136, 0)));
+}
+
+TEST(CapLease, TooLongIsRefused)
+{
+  Locker locker(NULL, NULL);
+  Session s;
+  Capability cap;
+  cap.set_last_issue_stamp(utime_t(100, 0));
+
+  // longer than mds_cap_lease_max_ttl: the client isn't leasing at all
+  g_ceph_context->_conf->set_val("mds_cap_lease_max_ttl", "30");
+  set_lease_ttl(s, "60");
+  ASSERT_EQ(0, s.get_cap_lease_ttl());
+  ASSERT_FALSE(locker.cap_lease_lapsed(&cap, &s, utime_t(1000, 0)));
+
+  set_lease_ttl(s, "30");
+  ASSERT_EQ(30, s.get_cap_lease_ttl());
+  ASSERT_TRUE(locker.cap_lease_lapsed(&cap, &s, utime_t(1000, 0)));
+}
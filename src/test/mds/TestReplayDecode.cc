@@ -0,0 +1,163 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <list>
+#include <vector>
+
+#include "common/ceph_context.h"
+#include "common/Clock.h"
+#include "common/safe_io.h"
+#include "global/global_context.h"
+#include "mds/ReplayDecoder.h"
+#include "mds/LogEvent.h"
+#include "mds/events/EUpdate.h"
+#include "osdc/Journaler.h"
+
+#include "gtest/gtest.h"
+
+using std::cout;
+using std::list;
+using std::pair;
+using std::vector;
+
+typedef list<pair<uint64_t, bufferlist> > entry_list;
+
+/* a "<name> <value>" field of the dump header */
+static bool dump_field(const char *header, const char *name, unsigned long long *val)
+{
+  const char *p = strstr(header, name);
+  if (!p)
+    return false;
+  p += strlen(name);
+  return sscanf(p, " %llu", val) == 1;
+}
+
+/*
+ * Read the entries out of a `cephfs-journal-tool journal export` dump.
+ */
+static int load_dump(const char *fn, entry_list& entries)
+{
+  int fd = ::open(fn, O_RDONLY);
+  if (fd < 0)
+    return -errno;
+
+  char buf[200];
+  int r = safe_read(fd, buf, sizeof(buf) - 1);
+  if (r < 0) {
+    ::close(fd);
+    return r;
+  }
+  buf[r] = '\0';
+  unsigned long long start, write_pos, format;
+  if (!dump_field(buf, "start offset", &start) ||
+      !dump_field(buf, "write_pos", &write_pos) ||
+      !dump_field(buf, "format", &format) ||
+      write_pos < start) {
+    cout << fn << " doesn't look like a journal export" << std::endl;
+    ::close(fd);
+    return -EINVAL;
+  }
+
+  bufferlist data;
+  bufferptr bp(write_pos - start);
+  r = safe_pread_exact(fd, bp.c_str(), bp.length(), start);
+  ::close(fd);
+  if (r < 0)
+    return r;
+  data.append(bp);
+
+  JournalStream stream(format);
+  uint64_t pos = start;
+  uint64_t need;
+  while (stream.readable(data, &need)) {
+    bufferlist entry;
+    uint64_t start_ptr;
+    size_t len = stream.read(data, &entry, &start_ptr);
+    entries.push_back(make_pair(pos, entry));
+    pos += len;
+  }
+  return 0;
+}
+
+static void make_events(int num, entry_list& entries)
+{
+  uint64_t pos = 0;
+  for (int i = 0; i < num; ++i) {
+    EUpdate le(NULL, "bench");
+    for (int j = 0; j < 16; ++j)
+      le.metablob.add_client_req(metareqid_t(entity_name_t::CLIENT(i), j), 0);
+    bufferlist bl;
+    le.encode_with_header(bl);
+    entries.push_back(make_pair(pos, bl));
+    pos += bl.length();
+  }
+}
+
+/*
+ * Decode everything with the given number of threads, the way
+ * MDLog::_replay_thread does, noting what came out in what order.
+ */
+static double decode_all(int threads, const entry_list& entries,
+			 vector<pair<uint64_t,int> >& out)
+{
+  utime_t start = ceph_clock_now(g_ceph_context);
+  ReplayDecoder decoder(threads);
+  decoder.start();
+
+  entry_list::const_iterator p = entries.begin();
+  while (true) {
+    while (p != entries.end() && decoder.size() < 1024) {
+      bufferlist bl = p->second;
+      decoder.queue(p->first, p->first + bl.length(), bl);
+      ++p;
+    }
+    list<ReplayDecoder::Entry> ls;
+    if (!decoder.take(ls))
+      break;
+    for (list<ReplayDecoder::Entry>::iterator q = ls.begin(); q != ls.end(); ++q) {
+      out.push_back(make_pair(q->pos, q->le ? (int)q->le->get_type() : -1));
+      delete q->le;
+    }
+  }
+  return ceph_clock_now(g_ceph_context) - start;
+}
+
+TEST(MDSReplayDecode, InOrder)
+{
+  entry_list entries;
+  const char *fn = getenv("CEPH_TEST_MDS_JOURNAL");
+  if (fn) {
+    ASSERT_EQ(0, load_dump(fn, entries));
+    cout << "loaded " << entries.size() << " events from " << fn << std::endl;
+  } else {
+    make_events(20000, entries);
+  }
+
+  vector<pair<uint64_t,int> > serial;
+  double serial_time = decode_all(0, entries, serial);
+  ASSERT_EQ(entries.size(), serial.size());
+  cout << "0 threads: " << serial_time << "s, "
+       << (entries.size() / serial_time) << " events/s" << std::endl;
+
+  int threads[] = { 1, 2, 4, 8 };
+  for (unsigned i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+    vector<pair<uint64_t,int> > out;
+    double t = decode_all(threads[i], entries, out);
+    cout << threads[i] << " threads: " << t << "s, "
+	 << (entries.size() / t) << " events/s" << std::endl;
+    ASSERT_EQ(serial, out);
+  }
+}
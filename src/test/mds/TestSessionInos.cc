@@ -0,0 +1,77 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "mds/SessionMap.h"
+
+#include "gtest/gtest.h"
+
+/*
+ * A session's preallocated inos, part of which are delegated to the
+ * client for async creates.
+ */
+TEST(SessionInos, DelegatedAreNotAllocated)
+{
+  Session s;
+  s.info.prealloc_inos.insert(inodeno_t(0x1000), 100);
+
+  interval_set<inodeno_t> inos;
+  s.delegate_inos(10, inos);
+  ASSERT_EQ(10, (int)inos.size());
+  ASSERT_EQ(10, (int)s.delegated_inos.size());
+  ASSERT_EQ(inodeno_t(0x100a), s.next_ino());
+
+  // the mds' own allocations never hand out a delegated ino
+  for (int i = 0; i < 90; ++i) {
+    ASSERT_TRUE(s.can_take_ino(0));
+    inodeno_t ino = s.take_ino(0);
+    ASSERT_FALSE(inos.contains(ino));
+  }
+
+  // exhausted: what is left is the client's
+  ASSERT_EQ(inodeno_t(0), s.next_ino());
+  ASSERT_FALSE(s.can_take_ino(0));
+  ASSERT_FALSE(s.can_take_ino(inodeno_t(0x2000)));
+  ASSERT_EQ(10, (int)s.info.prealloc_inos.size());
+
+  // but the client can still use its own
+  ASSERT_TRUE(s.can_take_ino(inodeno_t(0x1005)));
+  ASSERT_EQ(inodeno_t(0x1005), s.take_ino(inodeno_t(0x1005)));
+  ASSERT_FALSE(s.delegated_inos.contains(inodeno_t(0x1005)));
+  ASSERT_FALSE(s.can_take_ino(inodeno_t(0x1005)));
+  ASSERT_EQ(9, (int)s.delegated_inos.size());
+  ASSERT_TRUE(s.info.used_inos.contains(inodeno_t(0x1005)));
+}
+
+TEST(SessionInos, DelegateWhatIsLeft)
+{
+  Session s;
+  s.info.prealloc_inos.insert(inodeno_t(0x1000), 10);
+  s.info.prealloc_inos.insert(inodeno_t(0x2000), 10);
+
+  interval_set<inodeno_t> inos;
+  s.delegate_inos(15, inos);
+  ASSERT_EQ(15, (int)inos.size());
+  ASSERT_TRUE(inos.contains(inodeno_t(0x1000), 10));
+  ASSERT_TRUE(inos.contains(inodeno_t(0x2000), 5));
+  ASSERT_EQ(inodeno_t(0x2005), s.next_ino());
+
+  // only the undelegated rest can go
+  interval_set<inodeno_t> more;
+  s.delegate_inos(15, more);
+  ASSERT_EQ(5, (int)more.size());
+  ASSERT_EQ(20, (int)s.delegated_inos.size());
+  ASSERT_EQ(inodeno_t(0), s.next_ino());
+
+  interval_set<inodeno_t> none;
+  s.delegate_inos(15, none);
+  ASSERT_TRUE(none.empty());
+}
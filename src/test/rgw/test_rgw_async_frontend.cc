@@ -0,0 +1,261 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "rgw/rgw_async_frontend.h"
+#include "test/unit.h"
+
+/* hands the requests the server dispatches to the test */
+class TestDispatcher : public RGWAsyncServer::Dispatcher {
+  Mutex lock;
+  Cond cond;
+  list<RGWAsyncConnection *> requests;
+
+public:
+  TestDispatcher() : lock("TestDispatcher::lock") {}
+
+  void dispatch(RGWAsyncConnection *conn) {
+    Mutex::Locker l(lock);
+    requests.push_back(conn);
+    cond.Signal();
+  }
+
+  /* the next request, or NULL if none comes within a few seconds */
+  RGWAsyncConnection *wait_request(int secs = 10) {
+    Mutex::Locker l(lock);
+    utime_t until = ceph_clock_now(g_ceph_context);
+    until += secs;
+    while (requests.empty() && ceph_clock_now(g_ceph_context) < until)
+      cond.WaitUntil(lock, until);
+    if (requests.empty())
+      return NULL;
+    RGWAsyncConnection *conn = requests.front();
+    requests.pop_front();
+    return conn;
+  }
+};
+
+class AsyncFrontend : public ::testing::Test {
+protected:
+  TestDispatcher dispatcher;
+  RGWAsyncServer *server;
+  int fd;
+
+  void SetUp() {
+    RGWAsyncServer::Config conf;
+    conf.host = "127.0.0.1";
+    conf.port = 0;
+    server = new RGWAsyncServer(g_ceph_context, &dispatcher, conf);
+    ASSERT_EQ(0, server->init());
+    server->start();
+
+    fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_LE(0, fd);
+    struct timeval tv = { 10, 0 };
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(server->get_port());
+    sa.sin_addr.s_addr = inet_addr("127.0.0.1");
+    ASSERT_EQ(0, ::connect(fd, (struct sockaddr *)&sa, sizeof(sa)));
+  }
+
+  void TearDown() {
+    if (fd >= 0)
+      ::close(fd);
+    server->stop();
+    delete server;
+  }
+
+  void send(const string& s) {
+    ASSERT_EQ((ssize_t)s.size(), ::send(fd, s.c_str(), s.size(), 0));
+  }
+
+  /* reads a response with a content length; returns its status line */
+  string read_response(string *body = NULL) {
+    string header;
+    char c;
+    while (header.size() < 4 || header.compare(header.size() - 4, 4, "\r\n\r\n") != 0) {
+      if (::recv(fd, &c, 1, 0) != 1)
+        return "";
+      header.push_back(c);
+    }
+    uint64_t len = 0;
+    size_t pos = header.find("Content-Length: ");
+    if (pos != string::npos)
+      len = strtoull(header.c_str() + pos + 16, NULL, 10);
+    string b;
+    while (b.size() < len) {
+      if (::recv(fd, &c, 1, 0) != 1)
+        return "";
+      b.push_back(c);
+    }
+    if (body)
+      *body = b;
+    return header.substr(0, header.find("\r\n"));
+  }
+
+  bool peer_closed() {
+    char c;
+    return ::recv(fd, &c, 1, 0) == 0;
+  }
+
+  /* reads the whole body and answers with the uri */
+  string handle_request(RGWAsyncConnection *conn) {
+    string body;
+    char buf[7];
+    int r;
+    while ((r = conn->read_body(buf, sizeof(buf))) > 0)
+      body.append(buf, r);
+    EXPECT_EQ(0, r);
+
+    char resp[256];
+    snprintf(resp, sizeof(resp), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n%s",
+             (int)conn->uri.size(), conn->uri.c_str());
+    conn->write(resp, strlen(resp));
+    conn->complete(false);
+    return body;
+  }
+};
+
+TEST_F(AsyncFrontend, ContentLength)
+{
+  send("PUT /bucket/obj?acl HTTP/1.1\r\n"
+       "Host: localhost\r\n"
+       "Content-Length: 11\r\n"
+       "Content-Length: 11\r\n"
+       "\r\n"
+       "hello world");
+
+  RGWAsyncConnection *conn = dispatcher.wait_request();
+  ASSERT_TRUE(conn != NULL);
+  ASSERT_EQ("PUT", conn->method);
+  ASSERT_EQ("/bucket/obj", conn->uri);
+  ASSERT_EQ("acl", conn->query_string);
+  ASSERT_FALSE(conn->chunked);
+  ASSERT_EQ(11u, conn->content_length);
+
+  RGWAsyncClientIO io(conn, server->get_port());
+  io.init_env(g_ceph_context);
+  ASSERT_STREQ("11", io.get_env().get("CONTENT_LENGTH"));
+  ASSERT_STREQ("/bucket/obj", io.get_env().get("SCRIPT_URI"));
+
+  ASSERT_EQ("hello world", handle_request(conn));
+  string body;
+  ASSERT_EQ("HTTP/1.1 200 OK", read_response(&body));
+  ASSERT_EQ("/bucket/obj", body);
+}
+
+TEST_F(AsyncFrontend, Chunked)
+{
+  /* split in awkward places */
+  send("PUT /obj HTTP/1.1\r\n"
+       "Host: localhost\r\n"
+       "Transfer-Encoding: chunked\r\n"
+       "\r\n"
+       "5\r\nhel");
+  send("lo\r");
+  send("\n6;name=value\r\n world\r\n1");
+  send("0\r\n, and then some.\r\n"
+       "0\r\n"
+       "Trailer: ignored\r\n"
+       "\r\n");
+
+  RGWAsyncConnection *conn = dispatcher.wait_request();
+  ASSERT_TRUE(conn != NULL);
+  ASSERT_TRUE(conn->chunked);
+  ASSERT_EQ(0u, conn->content_length);
+
+  RGWAsyncClientIO io(conn, server->get_port());
+  io.init_env(g_ceph_context);
+  ASSERT_TRUE(io.get_env().get("CONTENT_LENGTH") == NULL);
+  ASSERT_STREQ("chunked", io.get_env().get("HTTP_TRANSFER_ENCODING"));
+
+  ASSERT_EQ("hello world, and then some.", handle_request(conn));
+  ASSERT_EQ("HTTP/1.1 200 OK", read_response());
+}
+
+TEST_F(AsyncFrontend, Pipelined)
+{
+  send("GET /a HTTP/1.1\r\nHost: localhost\r\n\r\n"
+       "PUT /b HTTP/1.1\r\nHost: localhost\r\nContent-Length: 3\r\n\r\nabc"
+       "PUT /c HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: chunked\r\n\r\n"
+       "2\r\nde\r\n0\r\n\r\n"
+       "GET /d HTTP/1.1\r\nHost: localhost\r\n\r\n");
+
+  const char *uris[] = { "/a", "/b", "/c", "/d" };
+  const char *bodies[] = { "", "abc", "de", "" };
+  for (int i = 0; i < 4; ++i) {
+    RGWAsyncConnection *conn = dispatcher.wait_request();
+    ASSERT_TRUE(conn != NULL) << uris[i];
+    ASSERT_EQ(uris[i], conn->uri);
+    ASSERT_EQ(bodies[i], handle_request(conn));
+
+    string body;
+    ASSERT_EQ("HTTP/1.1 200 OK", read_response(&body));
+    ASSERT_EQ(uris[i], body);
+  }
+  ASSERT_TRUE(dispatcher.wait_request(1) == NULL);
+}
+
+TEST_F(AsyncFrontend, Malformed)
+{
+  const char *bad[] = {
+    /* both framings */
+    "PUT /obj HTTP/1.1\r\nContent-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n",
+    "PUT /obj HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 5\r\n\r\n",
+    /* lengths that disagree */
+    "PUT /obj HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 6\r\n\r\n",
+    "PUT /obj HTTP/1.1\r\nContent-Length: 5a\r\n\r\n",
+    "PUT /obj HTTP/1.1\r\nContent-Length: -5\r\n\r\n",
+    "PUT /obj HTTP/1.1\r\nContent-Length: 99999999999999999999999\r\n\r\n",
+    "PUT /obj HTTP/1.1\r\nContent-Length:\r\n\r\n",
+    /* the request line */
+    "GET\r\n\r\n",
+    "GET /obj\r\n\r\n",
+    "GET /obj HTTP/2.0\r\n\r\n",
+    " /obj HTTP/1.1\r\n\r\n",
+    /* header fields */
+    "GET /obj HTTP/1.1\r\nno colon\r\n\r\n",
+    "GET /obj HTTP/1.1\r\n: no name\r\n\r\n",
+    /* chunk sizes */
+    "PUT /obj HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+    "PUT /obj HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n\r\n",
+    "PUT /obj HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n11111111111111111\r\n",
+    "PUT /obj HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nabc\r\n",
+  };
+  for (unsigned i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+    if (i) {
+      TearDown();
+      SetUp();
+    }
+    send(bad[i]);
+    ASSERT_EQ("HTTP/1.1 400 Bad Request", read_response()) << bad[i];
+    ASSERT_TRUE(peer_closed()) << bad[i];
+  }
+  ASSERT_TRUE(dispatcher.wait_request(1) == NULL);
+}
+
+TEST_F(AsyncFrontend, NotImplemented)
+{
+  send("PUT /obj HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n");
+  ASSERT_EQ("HTTP/1.1 501 Not Implemented", read_response());
+  ASSERT_TRUE(peer_closed());
+}
@@ -0,0 +1,260 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ *
+ */
+
+#include "rgw/rgw_common.h"
+#include "rgw/rgw_auth_s3.h"
+#include "test/unit.h"
+
+#define AWS4_TEST_SECRET "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY"
+#define AWS4_EMPTY_HASH "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"
+
+/* the requests of the aws signature version 4 test suite */
+static void init_request(RGWEnv& env, const char *method, const char *uri)
+{
+  env.set("REQUEST_METHOD", method);
+  env.set("REQUEST_URI", uri);
+  env.set("HTTP_HOST", "example.amazonaws.com");
+  env.set("HTTP_X_AMZ_DATE", "20150830T123600Z");
+}
+
+static void init_auth(rgw_aws4_auth *auth)
+{
+  auth->date = "20150830T123600Z";
+  auth->credential_scope = "20150830/us-east-1/service/aws4_request";
+  auth->signed_headers = "host;x-amz-date";
+  auth->payload_hash = AWS4_EMPTY_HASH;
+  rgw_get_aws4_signing_key(AWS4_TEST_SECRET, auth->credential_scope, auth->signing_key);
+}
+
+TEST(AWS4, SigningKey)
+{
+  string key;
+  rgw_get_aws4_signing_key(AWS4_TEST_SECRET, "20120215/us-east-1/iam/aws4_request", key);
+  ASSERT_EQ(CEPH_CRYPTO_SHA256_DIGESTSIZE, (int)key.size());
+  char hex[CEPH_CRYPTO_SHA256_DIGESTSIZE * 2 + 1];
+  buf_to_hex((const unsigned char *)key.c_str(), key.size(), hex);
+  ASSERT_EQ(string("f4780e2d9f65fa895f9c67b32ce1baf0b0d8a43505a000a1a9e090d414db404d"), hex);
+}
+
+TEST(AWS4, GetVanilla)
+{
+  RGWEnv env;
+  init_request(env, "GET", "/");
+  req_info info(g_ceph_context, &env);
+  rgw_aws4_auth auth;
+  init_auth(&auth);
+
+  string canonical_req;
+  rgw_get_aws4_canonical_request(info, &auth, false, canonical_req);
+  ASSERT_EQ("GET\n"
+            "/\n"
+            "\n"
+            "host:example.amazonaws.com\n"
+            "x-amz-date:20150830T123600Z\n"
+            "\n"
+            "host;x-amz-date\n"
+            AWS4_EMPTY_HASH, canonical_req);
+
+  string string_to_sign;
+  rgw_get_aws4_string_to_sign(&auth, canonical_req, string_to_sign);
+  ASSERT_EQ("AWS4-HMAC-SHA256\n"
+            "20150830T123600Z\n"
+            "20150830/us-east-1/service/aws4_request\n"
+            "bb579772317eb040ac9ed261061d46c1f17a8133879d6129b6e1c25292927e63", string_to_sign);
+
+  string signature;
+  rgw_get_aws4_signature(info, &auth, false, signature);
+  ASSERT_EQ("5fa00fa31553b73ebf1942676e86291e8372ff2a2260956d9b8aae1d763fbf31", signature);
+}
+
+TEST(AWS4, GetVanillaQueryOrder)
+{
+  RGWEnv env;
+  init_request(env, "GET", "/?Param2=value2&Param1=value1");
+  req_info info(g_ceph_context, &env);
+  rgw_aws4_auth auth;
+  init_auth(&auth);
+
+  string canonical_req;
+  rgw_get_aws4_canonical_request(info, &auth, false, canonical_req);
+  ASSERT_EQ("GET\n"
+            "/\n"
+            "Param1=value1&Param2=value2\n"
+            "host:example.amazonaws.com\n"
+            "x-amz-date:20150830T123600Z\n"
+            "\n"
+            "host;x-amz-date\n"
+            AWS4_EMPTY_HASH, canonical_req);
+
+  string string_to_sign;
+  rgw_get_aws4_string_to_sign(&auth, canonical_req, string_to_sign);
+  ASSERT_EQ("AWS4-HMAC-SHA256\n"
+            "20150830T123600Z\n"
+            "20150830/us-east-1/service/aws4_request\n"
+            "816cd5b414d056048ba4f7c5386d6e0533120fb1fcfa93762cf0fc39e2cf19e0", string_to_sign);
+
+  string signature;
+  rgw_get_aws4_signature(info, &auth, false, signature);
+  ASSERT_EQ("b97d918cfa904a5beff61c982a1b6f458b799221646efd99d3219ec94cdf2500", signature);
+}
+
+TEST(AWS4, VirtualHostedUri)
+{
+  RGWEnv env;
+  init_request(env, "GET", "/obj?acl");
+  req_info info(g_ceph_context, &env);
+  /* what the virtual hosting rewrite leaves behind */
+  info.request_uri = "/bucket/obj";
+
+  rgw_aws4_auth auth;
+  init_auth(&auth);
+
+  string canonical_req;
+  rgw_get_aws4_canonical_request(info, &auth, false, canonical_req);
+  ASSERT_EQ(0u, canonical_req.find("GET\n/obj\nacl=\n"));
+}
+
+/*
+ * an aws-chunked upload of 65536 + 1024 bytes of 'a', signed with the
+ * secret above
+ */
+#define AWS4_CHUNKED_SEED "4f232c4386841ef735655705268965c44a0e4690baa4adea153f7db9fa80a0a9"
+#define AWS4_CHUNK1_SIG "61ed74d76ad0a0a3cd61199c82a3112c3c90ec6bf34d8b2c625093a11e569c2b"
+#define AWS4_CHUNK2_SIG "1bc5ec3a09ab65cbdd970c67f8744614b27f6f762e6f7b998405f4c8b577a685"
+#define AWS4_CHUNK3_SIG "7cd0adc4c8559a39c487847ea89a4137b7653d47264e872e48d980f945fc3927"
+
+static void init_chunked_auth(rgw_aws4_auth *auth)
+{
+  auth->date = "20130524T000000Z";
+  auth->credential_scope = "20130524/us-east-1/s3/aws4_request";
+  auth->signature = AWS4_CHUNKED_SEED;
+  auth->payload_hash = AWS4_STREAMING_PAYLOAD_HASH;
+  rgw_get_aws4_signing_key(AWS4_TEST_SECRET, auth->credential_scope, auth->signing_key);
+}
+
+static string chunked_body(const char *sig1 = AWS4_CHUNK1_SIG)
+{
+  string body;
+  body.append("10000;chunk-signature=");
+  body.append(sig1);
+  body.append("\r\n");
+  body.append(65536, 'a');
+  body.append("\r\n400;chunk-signature=" AWS4_CHUNK2_SIG "\r\n");
+  body.append(1024, 'a');
+  body.append("\r\n0;chunk-signature=" AWS4_CHUNK3_SIG "\r\n\r\n");
+  return body;
+}
+
+TEST(AWS4, ChunkedPayload)
+{
+  rgw_aws4_auth auth;
+  init_chunked_auth(&auth);
+  string body = chunked_body();
+
+  /* in one piece */
+  {
+    RGWAWS4PayloadVerifier verifier(&auth);
+    bufferlist out;
+    ASSERT_EQ(0, verifier.append(body.c_str(), body.size(), out));
+    ASSERT_EQ(0, verifier.complete());
+    ASSERT_EQ(65536u + 1024u, out.length());
+    ASSERT_EQ(string(65536 + 1024, 'a'), string(out.c_str(), out.length()));
+  }
+
+  /* split at every possible spot of the framing */
+  for (size_t split = 1; split < 200; ++split) {
+    RGWAWS4PayloadVerifier verifier(&auth);
+    bufferlist out;
+    size_t ofs = 0;
+    while (ofs < body.size()) {
+      size_t len = min(split, body.size() - ofs);
+      ASSERT_EQ(0, verifier.append(body.c_str() + ofs, len, out));
+      ofs += len;
+    }
+    ASSERT_EQ(0, verifier.complete());
+    ASSERT_EQ(65536u + 1024u, out.length());
+  }
+}
+
+TEST(AWS4, ChunkedBadSignature)
+{
+  rgw_aws4_auth auth;
+  init_chunked_auth(&auth);
+  string body = chunked_body(AWS4_CHUNK2_SIG);
+
+  RGWAWS4PayloadVerifier verifier(&auth);
+  bufferlist out;
+  ASSERT_EQ(-ERR_SIGNATURE_NO_MATCH, verifier.append(body.c_str(), body.size(), out));
+}
+
+TEST(AWS4, ChunkedBadSize)
+{
+  rgw_aws4_auth auth;
+  init_chunked_auth(&auth);
+  const char *bad[] = {
+    "zz;chunk-signature=" AWS4_CHUNK1_SIG "\r\n",
+    "-1;chunk-signature=" AWS4_CHUNK1_SIG "\r\n",
+    " 10;chunk-signature=" AWS4_CHUNK1_SIG "\r\n",
+    "100000000000000000;chunk-signature=" AWS4_CHUNK1_SIG "\r\n",
+    ";chunk-signature=" AWS4_CHUNK1_SIG "\r\n",
+    "10000\r\n",
+    "10000;chunk-signature=" AWS4_CHUNK1_SIG "\n",
+  };
+  for (unsigned i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+    RGWAWS4PayloadVerifier verifier(&auth);
+    bufferlist out;
+    ASSERT_EQ(-EINVAL, verifier.append(bad[i], strlen(bad[i]), out)) << bad[i];
+  }
+
+  /* a chunk with more data than its size */
+  string body = chunked_body();
+  body.insert(body.find("\r\n400;"), "a");
+  RGWAWS4PayloadVerifier verifier(&auth);
+  bufferlist out;
+  ASSERT_EQ(-EINVAL, verifier.append(body.c_str(), body.size(), out));
+}
+
+TEST(AWS4, ChunkedTruncated)
+{
+  rgw_aws4_auth auth;
+  init_chunked_auth(&auth);
+  string body = chunked_body();
+
+  /* cut in the first header, in the data, before and in the last chunk */
+  size_t cuts[] = { 10, 1000, body.find("\r\n0;") + 2, body.size() - 1 };
+  for (unsigned i = 0; i < sizeof(cuts) / sizeof(cuts[0]); ++i) {
+    RGWAWS4PayloadVerifier verifier(&auth);
+    bufferlist out;
+    ASSERT_EQ(0, verifier.append(body.c_str(), cuts[i], out));
+    ASSERT_EQ(-ERR_REQUEST_TIMEOUT, verifier.complete());
+  }
+
+  /* and data past the last chunk */
+  body.append("a");
+  RGWAWS4PayloadVerifier verifier(&auth);
+  bufferlist out;
+  ASSERT_EQ(-EINVAL, verifier.append(body.c_str(), body.size(), out));
+}
+
+TEST(AWS4, SignedPayload)
+{
+  rgw_aws4_auth auth;
+  init_auth(&auth);
+
+  RGWAWS4PayloadVerifier verifier(&auth);
+  bufferlist out;
+  ASSERT_EQ(0, verifier.complete());
+
+  RGWAWS4PayloadVerifier bad_verifier(&auth);
+  ASSERT_EQ(0, bad_verifier.append("a", 1, out));
+  ASSERT_EQ(-ERR_AMZ_CONTENT_SHA256_MISMATCH, bad_verifier.complete());
+}
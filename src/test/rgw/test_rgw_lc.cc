@@ -0,0 +1,110 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ *
+ */
+
+#include "cls/rgw/cls_rgw_ops.h"
+#include "rgw/rgw_lc.h"
+#include "test/unit.h"
+
+static void init_entry(rgw_bucket_dir_entry *entry, const string& name, time_t mtime)
+{
+  entry->key.name = name;
+  entry->exists = true;
+  entry->meta.mtime = utime_t(mtime, 0);
+  entry->ver.pool = 3;
+  entry->ver.epoch = 10;
+}
+
+TEST(LC, Expired)
+{
+  g_ceph_context->_conf->set_val("rgw_lc_debug_interval", "10");
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  RGWLC lc;
+  lc.initialize(g_ceph_context, NULL);
+
+  LCRule rule;
+  rule.prefix = "logs/";
+  rule.status = "Enabled";
+  rule.expiration.days = 2;
+
+  rgw_bucket_dir_entry entry;
+  init_entry(&entry, "logs/a", 1000);
+
+  /* two days of ten seconds each */
+  ASSERT_FALSE(lc.is_expired(rule, entry, utime_t(1019, 0)));
+  ASSERT_TRUE(lc.is_expired(rule, entry, utime_t(1020, 0)));
+
+  /* other prefixes, versioned instances and removed entries are kept */
+  rgw_bucket_dir_entry other;
+  init_entry(&other, "data/a", 1000);
+  ASSERT_FALSE(lc.is_expired(rule, other, utime_t(2000, 0)));
+
+  rgw_bucket_dir_entry instance;
+  init_entry(&instance, "logs/a", 1000);
+  instance.key.instance = "v1";
+  ASSERT_FALSE(lc.is_expired(rule, instance, utime_t(2000, 0)));
+
+  rgw_bucket_dir_entry removed;
+  init_entry(&removed, "logs/a", 1000);
+  removed.exists = false;
+  ASSERT_FALSE(lc.is_expired(rule, removed, utime_t(2000, 0)));
+
+  /* and so are the parts of a multipart upload in progress */
+  rgw_bucket bucket("b");
+  rgw_obj obj;
+  obj.init_ns(bucket, "logs/a.2~abc.1", "multipart");
+  rgw_bucket_dir_entry part;
+  init_entry(&part, obj.get_index_key_name(), 1000);
+  ASSERT_FALSE(lc.is_expired(rule, part, utime_t(2000, 0)));
+
+  g_ceph_context->_conf->set_val("rgw_lc_debug_interval", "-1");
+  g_ceph_context->_conf->apply_changes(NULL);
+}
+
+TEST(LC, BulkDeleteRemoved)
+{
+  rgw_bucket_dir_entry entry;
+  init_entry(&entry, "logs/a", 1000);
+
+  /* the head was removed, the index entry goes with the version of the removal */
+  rgw_cls_obj_complete_op call;
+  ASSERT_TRUE(rgw_bulk_delete_index_op(entry, 0, 4, 25, &call));
+  ASSERT_EQ(CLS_RGW_OP_DEL, call.op);
+  ASSERT_EQ("logs/a", call.key.name);
+  ASSERT_EQ(4, call.ver.pool);
+  ASSERT_EQ(25u, call.ver.epoch);
+}
+
+TEST(LC, BulkDeleteMissingHead)
+{
+  rgw_bucket_dir_entry entry;
+  init_entry(&entry, "logs/a", 1000);
+
+  /* the entry is stale, but mustn't take out a newer write of the object */
+  rgw_cls_obj_complete_op call;
+  ASSERT_TRUE(rgw_bulk_delete_index_op(entry, -ENOENT, 4, 0, &call));
+  ASSERT_EQ(CLS_RGW_OP_DEL, call.op);
+  ASSERT_EQ("logs/a", call.key.name);
+  ASSERT_EQ(3, call.ver.pool);
+  ASSERT_EQ(11u, call.ver.epoch);
+}
+
+TEST(LC, BulkDeleteOverwritten)
+{
+  rgw_bucket_dir_entry entry;
+  init_entry(&entry, "logs/a", 1000);
+
+  /* the id tag didn't match: the object was written again and stays */
+  rgw_cls_obj_complete_op call;
+  ASSERT_FALSE(rgw_bulk_delete_index_op(entry, -ECANCELED, 4, 0, &call));
+  ASSERT_FALSE(rgw_bulk_delete_index_op(entry, -EIO, 4, 0, &call));
+}
@@ -17,6 +17,9 @@
 #include <stdint.h>
 #include <boost/foreach.hpp>
 #include <cstdarg>
+#include <cstdio>
+#include <fstream>
+#include "rbd_replay/CompiledTrace.hpp"
 #include "rbd_replay/Deser.hpp"
 #include "rbd_replay/ImageNameMap.hpp"
 #include "rbd_replay/ios.hpp"
@@ -223,3 +226,86 @@ TEST(RBDReplay, batch_unreachable_from) {
   EXPECT_EQ(0U, unreachable.count(io8));
   EXPECT_EQ(0U, unreachable.count(io9));
 }
+
+static void write_ios(const std::string &path, const std::vector<IO::ptr> &ios) {
+  std::ofstream out(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  rbd_replay::Ser ser(out);
+  BOOST_FOREACH(const IO::ptr &io, ios) {
+    if (io->is_completion()) {
+      boost::dynamic_pointer_cast<CompletionIO>(io)->write_latency_to(ser);
+    } else {
+      io->write_to(ser);
+    }
+  }
+}
+
+TEST(RBDReplay, CompiledTrace) {
+  std::vector<IO::ptr> ios;
+  IO::ptr start1(new StartThreadIO(0, 1, 100));
+  ios.push_back(start1);
+  IO::ptr open(new OpenImageIO(2, 2, 100, start1, 7, "image", "snap", true));
+  ios.push_back(open);
+  IO::ptr open_completion(open->create_completion(4, 100));
+  ios.push_back(open_completion);
+  IO::ptr read(new AioReadIO(4, 10, 100, open, 7, 4096, 512));
+  read->dependencies().insert(open_completion);
+  ios.push_back(read);
+  IO::ptr start2(new StartThreadIO(6, 11, 200));
+  ios.push_back(start2);
+  IO::ptr read_completion(read->create_completion(110, 100));
+  ios.push_back(read_completion);
+  IO::ptr write(new AioWriteIO(8, 120, 200, start2, 7, 0, 1024));
+  write->dependencies().insert(read_completion);
+  ios.push_back(write);
+
+  const std::string replay_file("test_rbd_replay_compiled_trace");
+  const std::string compiled_file(replay_file + ".compiled");
+  write_ios(replay_file, ios);
+  {
+    std::ofstream out(compiled_file.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    ASSERT_EQ(0, CompiledTrace::compile(replay_file, out));
+  }
+
+  CompiledTrace trace;
+  ASSERT_EQ(0, trace.load(compiled_file));
+  ASSERT_EQ(2U, trace.num_streams());
+  ASSERT_EQ(5U, trace.num_actions());
+  ASSERT_TRUE(trace.has_latencies());
+
+  const CompiledTrace::action_d &a_open = trace.action(1);
+  EXPECT_EQ(IO_OPEN_IMAGE, a_open.type);
+  EXPECT_EQ(0U, a_open.stream);
+  EXPECT_EQ(7U, a_open.imagectx_id);
+  EXPECT_EQ(1, a_open.readonly);
+  EXPECT_STREQ("image", trace.string_at(a_open.name));
+  EXPECT_STREQ("snap", trace.string_at(a_open.snap_name));
+  EXPECT_EQ(2U, a_open.latency);
+
+  const CompiledTrace::action_d &a_read = trace.action(2);
+  EXPECT_EQ(IO_ASYNC_READ, a_read.type);
+  EXPECT_EQ(4U, a_read.id);
+  EXPECT_EQ(4096U, a_read.offset);
+  EXPECT_EQ(512U, a_read.length);
+  EXPECT_EQ(100U, a_read.latency);
+  ASSERT_EQ(1U, a_read.num_deps);
+  EXPECT_EQ(1U, trace.dep(a_read.first_dep).action);
+  EXPECT_EQ(1, trace.dep(a_read.first_dep).completion);
+  EXPECT_EQ(6U, trace.dep(a_read.first_dep).time_delta);
+
+  const CompiledTrace::action_d &a_write = trace.action(4);
+  EXPECT_EQ(IO_ASYNC_WRITE, a_write.type);
+  EXPECT_EQ(1U, a_write.stream);
+  EXPECT_EQ(1024U, a_write.length);
+  ASSERT_EQ(1U, a_write.num_deps);
+  EXPECT_EQ(2U, trace.dep(a_write.first_dep).action);
+  EXPECT_EQ(10U, trace.dep(a_write.first_dep).time_delta);
+
+  // an uncompiled replay file is compiled into memory
+  CompiledTrace in_memory;
+  ASSERT_EQ(0, in_memory.load(replay_file));
+  EXPECT_EQ(trace.num_actions(), in_memory.num_actions());
+  EXPECT_EQ(100U, in_memory.action(2).latency);
+
+  remove(replay_file.c_str());
+  remove(compiled_file.c_str());
+}